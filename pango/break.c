@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include "pango-break.h"
+#include "pango-break-private.h"
 #include "pango-script-private.h"
 #include "pango-emoji-private.h"
 #include "pango-attributes-private.h"
@@ -76,6 +77,133 @@ typedef enum
 #define BREAK_TYPE_SAFE(btype)            \
 	 ((btype) <= LAST_BREAK_TYPE ? (btype) : G_UNICODE_BREAK_UNKNOWN)
 
+/* default_break() looks at a number of Unicode properties for
+ * every character. Instead of asking GLib for each of them every
+ * time, we cache them in a two-level table, with the pages filled
+ * in from the GLib data the first time they are needed.
+ *
+ * This is only a lookup cache. The break rules below still run
+ * per character; they are not compiled into pair tables, and the
+ * cached values are exactly what GLib returns, so the PangoLogAttr
+ * output does not change. The UCD boundary tests cover this.
+ */
+#define CHAR_PROPS_PAGE_BITS 8
+#define CHAR_PROPS_PAGE_SIZE (1 << CHAR_PROPS_PAGE_BITS)
+#define CHAR_PROPS_N_PAGES   (0x110000 >> CHAR_PROPS_PAGE_BITS)
+
+enum {
+  CHAR_EXTENDED_PICTOGRAPHIC = 1 << 0,
+};
+
+typedef struct
+{
+  guint8 type;        /* GUnicodeType */
+  guint8 break_type;  /* GUnicodeBreakType */
+  guint8 flags;
+  guint16 script;     /* PangoScript */
+} CharProps;
+
+static CharProps *char_props_pages[CHAR_PROPS_N_PAGES];
+
+static const CharProps *
+get_char_props_page (guint page)
+{
+  CharProps *props;
+
+  props = g_atomic_pointer_get (&char_props_pages[page]);
+  if (G_UNLIKELY (props == NULL))
+    {
+      int i;
+
+      props = g_new (CharProps, CHAR_PROPS_PAGE_SIZE);
+      for (i = 0; i < CHAR_PROPS_PAGE_SIZE; i++)
+        {
+          gunichar wc = (page << CHAR_PROPS_PAGE_BITS) | i;
+
+          props[i].type = g_unichar_type (wc);
+          props[i].break_type = g_unichar_break_type (wc);
+          props[i].script = g_unichar_get_script (wc);
+          props[i].flags = 0;
+          if (_pango_Is_Emoji_Extended_Pictographic (wc))
+            props[i].flags |= CHAR_EXTENDED_PICTOGRAPHIC;
+        }
+
+      /* Another thread may have been faster */
+      if (!g_atomic_pointer_compare_and_exchange (&char_props_pages[page], NULL, props))
+        {
+          g_free (props);
+          props = g_atomic_pointer_get (&char_props_pages[page]);
+        }
+    }
+
+  return props;
+}
+
+/* Returns NULL for values that are not characters,
+ * which g_utf8_get_char() returns for invalid UTF-8.
+ */
+static inline const CharProps *
+get_char_props (gunichar wc)
+{
+  if (wc >= 0x110000)
+    return NULL;
+
+  return &get_char_props_page (wc >> CHAR_PROPS_PAGE_BITS)[wc & (CHAR_PROPS_PAGE_SIZE - 1)];
+}
+
+static inline gunichar
+get_char (const char *p)
+{
+  if ((guchar) *p < 0x80)
+    return (guchar) *p;
+
+  return g_utf8_get_char (p);
+}
+
+static inline GUnicodeType
+get_char_type (gunichar wc)
+{
+  const CharProps *props = get_char_props (wc);
+
+  if (props)
+    return (GUnicodeType) props->type;
+
+  return g_unichar_type (wc);
+}
+
+static inline GUnicodeBreakType
+get_break_type (gunichar wc)
+{
+  const CharProps *props = get_char_props (wc);
+
+  if (props)
+    return (GUnicodeBreakType) props->break_type;
+
+  return g_unichar_break_type (wc);
+}
+
+static inline PangoScript
+get_script (gunichar wc)
+{
+  const CharProps *props = get_char_props (wc);
+
+  if (props)
+    return (PangoScript) props->script;
+
+  return (PangoScript) g_unichar_get_script (wc);
+}
+
+static inline gboolean
+is_extended_pictographic (gunichar wc)
+{
+  const CharProps *props = get_char_props (wc);
+
+  if (props)
+    return (props->flags & CHAR_EXTENDED_PICTOGRAPHIC) != 0;
+
+  return _pango_Is_Emoji_Extended_Pictographic (wc);
+}
+
 
 /*
  * Hangul Conjoining Jamo handling.
@@ -167,7 +295,8 @@ default_break (const char    *text,
                int            length,
                PangoAnalysis *analysis G_GNUC_UNUSED,
                PangoLogAttr  *attrs,
-               int            attrs_len G_GNUC_UNUSED)
+               int            attrs_len G_GNUC_UNUSED,
+               gboolean       lines_only)
 {
   /* The rationale for all this is in section 5.15 of the Unicode 3.0 book,
    * the line breaking stuff is also in TR14 on unicode.org
@@ -303,6 +432,8 @@ default_break (const char    *text,
   prev_prev_break_type = G_UNICODE_BREAK_UNKNOWN;
   prev_wc = 0;
   prev_prev_wc = 0;
+  next_next_wc = 0;
+  next_next_break_type = G_UNICODE_BREAK_UNKNOWN;
   prev_script = PANGO_SCRIPT_COMMON;
   prev_jamo = NO_JAMO;
   prev_space_or_hyphen = FALSE;
@@ -317,9 +448,9 @@ default_break (const char    *text,
       almost_done = TRUE;
     }
   else
-    next_wc = g_utf8_get_char (next);
+    next_wc = get_char (next);
 
-  next_break_type = g_unichar_break_type (next_wc);
+  next_break_type = get_break_type (next_wc);
   FIX_BREAK_TYPE (next_break_type, next_wc);
   next_break_type = BREAK_TYPE_SAFE (next_break_type);
 
@@ -358,6 +489,8 @@ default_break (const char    *text,
 	}
       else
 	{
+	  gboolean have_next_break_type = FALSE;
+
 	  next = g_utf8_next_char (next);
 
 #ifdef ENABLE_UNICODE_ZERO_CODE_POINT_TEST_CASE
@@ -376,7 +509,15 @@ default_break (const char    *text,
 	    }
 	  else
 	    {
-	      next_wc = g_utf8_get_char (next);
+	      /* We decoded this character as next_next last time */
+	      if (next == next_next)
+	        {
+	          next_wc = next_next_wc;
+	          next_break_type = next_next_break_type;
+	          have_next_break_type = TRUE;
+	        }
+	      else
+	        next_wc = get_char (next);
 	      next_next = g_utf8_next_char (next);
 
 #ifdef ENABLE_UNICODE_ZERO_CODE_POINT_TEST_CASE
@@ -386,19 +527,22 @@ default_break (const char    *text,
 #endif
 	        next_next_wc = PARAGRAPH_SEPARATOR;
 	      else
-	        next_next_wc = g_utf8_get_char (next_next);
+	        next_next_wc = get_char (next_next);
 	    }
 
-	  next_break_type = g_unichar_break_type (next_wc);
-	  FIX_BREAK_TYPE (next_break_type, next_wc);
-	  next_break_type = BREAK_TYPE_SAFE (next_break_type);
+	  if (!have_next_break_type)
+	    {
+	      next_break_type = get_break_type (next_wc);
+	      FIX_BREAK_TYPE (next_break_type, next_wc);
+	      next_break_type = BREAK_TYPE_SAFE (next_break_type);
+	    }
 
-	  next_next_break_type = g_unichar_break_type (next_next_wc);
+	  next_next_break_type = get_break_type (next_next_wc);
 	  FIX_BREAK_TYPE (next_next_break_type, next_next_wc);
 	  next_next_break_type = BREAK_TYPE_SAFE (next_next_break_type);
 	}
 
-      type = g_unichar_type (wc);
+      type = get_char_type (wc);
       jamo = JAMO_TYPE (break_type);
 
       /* Determine wheter this forms a Hangul syllable with prev. */
@@ -435,7 +579,7 @@ default_break (const char    *text,
        */
       attrs[i].is_expandable_space = (0x0020 == wc || 0x00A0 == wc);
       is_Extended_Pictographic =
-	_pango_Is_Emoji_Extended_Pictographic (wc);
+	is_extended_pictographic (wc);
 
 
       /* ---- UAX#29 Grapheme Boundaries ---- */
@@ -557,7 +701,7 @@ default_break (const char    *text,
 	  {
 	    if (GB_type == GB_Extend)
 	      met_Extended_Pictographic = TRUE;
-	    else if (_pango_Is_Emoji_Extended_Pictographic (prev_wc) &&
+	    else if (is_extended_pictographic (prev_wc) &&
 		     GB_type == GB_ZWJ)
 	      met_Extended_Pictographic = TRUE;
 	    else if (prev_GB_type == GB_Extend && GB_type == GB_ZWJ)
@@ -647,7 +791,7 @@ default_break (const char    *text,
 	prev_GB_type = GB_type;
       }
 
-      script = (PangoScript)g_unichar_get_script (wc);
+      script = get_script (wc);
       /* ---- UAX#29 Word Boundaries ---- */
       {
 	is_word_boundary = FALSE;
@@ -889,238 +1033,239 @@ default_break (const char    *text,
       }
 
       /* ---- UAX#29 Sentence Boundaries ---- */
-      {
-	is_sentence_boundary = FALSE;
-	if (is_word_boundary ||
-	    wc == '\r' || wc == '\n') /* Rules SB3 and SB5 */
-	  {
-	    SentenceBreakType SB_type;
-
-	    /* Find the SentenceBreakType of wc */
-	    SB_type = SB_Other;
+      if (!lines_only)
+	{
+	  is_sentence_boundary = FALSE;
+	  if (is_word_boundary ||
+	      wc == '\r' || wc == '\n') /* Rules SB3 and SB5 */
+	    {
+	      SentenceBreakType SB_type;
+
+	      /* Find the SentenceBreakType of wc */
+	      SB_type = SB_Other;
+
+	      if (break_type == G_UNICODE_BREAK_NUMERIC)
+		SB_type = SB_Numeric; /* Numeric */
+
+	      if (SB_type == SB_Other)
+		switch ((int) type)
+		  {
+		  case G_UNICODE_CONTROL:
+		    if (wc == '\r' || wc == '\n')
+		      SB_type = SB_ParaSep;
+		    else if (wc == 0x0009 || wc == 0x000B || wc == 0x000C)
+		      SB_type = SB_Sp;
+		    else if (wc == 0x0085)
+		      SB_type = SB_ParaSep;
+		    break;
 
-	    if (break_type == G_UNICODE_BREAK_NUMERIC)
-	      SB_type = SB_Numeric; /* Numeric */
+		  case G_UNICODE_SPACE_SEPARATOR:
+		    if (wc == 0x0020 || wc == 0x00A0 || wc == 0x1680 ||
+			(wc >= 0x2000 && wc <= 0x200A) ||
+			wc == 0x202F || wc == 0x205F || wc == 0x3000)
+		      SB_type = SB_Sp;
+		    break;
 
-	    if (SB_type == SB_Other)
-	      switch ((int) type)
-		{
-		case G_UNICODE_CONTROL:
-		  if (wc == '\r' || wc == '\n')
+		  case G_UNICODE_LINE_SEPARATOR:
+		  case G_UNICODE_PARAGRAPH_SEPARATOR:
 		    SB_type = SB_ParaSep;
-		  else if (wc == 0x0009 || wc == 0x000B || wc == 0x000C)
-		    SB_type = SB_Sp;
-		  else if (wc == 0x0085)
-		    SB_type = SB_ParaSep;
-		  break;
+		    break;
 
-		case G_UNICODE_SPACE_SEPARATOR:
-		  if (wc == 0x0020 || wc == 0x00A0 || wc == 0x1680 ||
-		      (wc >= 0x2000 && wc <= 0x200A) ||
-		      wc == 0x202F || wc == 0x205F || wc == 0x3000)
-		    SB_type = SB_Sp;
-		  break;
+		  case G_UNICODE_FORMAT:
+		  case G_UNICODE_SPACING_MARK:
+		  case G_UNICODE_ENCLOSING_MARK:
+		  case G_UNICODE_NON_SPACING_MARK:
+		    SB_type = SB_ExtendFormat; /* Extend, Format */
+		    break;
 
-		case G_UNICODE_LINE_SEPARATOR:
-		case G_UNICODE_PARAGRAPH_SEPARATOR:
-		  SB_type = SB_ParaSep;
-		  break;
+		  case G_UNICODE_MODIFIER_LETTER:
+		    if (wc >= 0xFF9E && wc <= 0xFF9F)
+		      SB_type = SB_ExtendFormat; /* Other_Grapheme_Extend */
+		    break;
 
-		case G_UNICODE_FORMAT:
-		case G_UNICODE_SPACING_MARK:
-		case G_UNICODE_ENCLOSING_MARK:
-		case G_UNICODE_NON_SPACING_MARK:
-		  SB_type = SB_ExtendFormat; /* Extend, Format */
-		  break;
+		  case G_UNICODE_TITLECASE_LETTER:
+		    SB_type = SB_Upper;
+		    break;
 
-		case G_UNICODE_MODIFIER_LETTER:
-		  if (wc >= 0xFF9E && wc <= 0xFF9F)
-		    SB_type = SB_ExtendFormat; /* Other_Grapheme_Extend */
-		  break;
+		  case G_UNICODE_DASH_PUNCTUATION:
+		    if (wc == 0x002D ||
+			wc == 0x003B ||
+			wc == 0x037E ||
+			(wc >= 0x2013 && wc <= 0x2014) ||
+			wc == 0xFE14 ||
+			(wc >= 0xFE31 && wc <= 0xFE32) ||
+			wc == 0xFE54 ||
+			wc == 0xFE58 ||
+			wc == 0xFE63 ||
+			wc == 0xFF0D ||
+			wc == 0xFF1A ||
+			wc == 0xFF1B ||
+			wc == 0xFF64)
+		      SB_type = SB_SContinue;
+		    break;
 
-		case G_UNICODE_TITLECASE_LETTER:
-		  SB_type = SB_Upper;
-		  break;
+		  case G_UNICODE_OTHER_PUNCTUATION:
+		    if (wc == 0x05F3)
+		      SB_type = SB_OLetter;
+		    else if (wc == 0x002E || wc == 0x2024 ||
+			wc == 0xFE52 || wc == 0xFF0E)
+		      SB_type = SB_ATerm;
+
+		    if (wc == 0x002C ||
+			wc == 0x003A ||
+			wc == 0x055D ||
+			(wc >= 0x060C && wc <= 0x060D) ||
+			wc == 0x07F8 ||
+			wc == 0x1802 ||
+			wc == 0x1808 ||
+			wc == 0x3001 ||
+			(wc >= 0xFE10 && wc <= 0xFE11) ||
+			wc == 0xFE13 ||
+			(wc >= 0xFE50 && wc <= 0xFE51) ||
+			wc == 0xFE55 ||
+			wc == 0xFF0C ||
+			wc == 0xFF1A ||
+			wc == 0xFF64)
+		      SB_type = SB_SContinue;
+
+		    if (_pango_is_STerm(wc))
+		      SB_type = SB_STerm;
 
-		case G_UNICODE_DASH_PUNCTUATION:
-		  if (wc == 0x002D ||
-		      wc == 0x003B ||
-		      wc == 0x037E ||
-		      (wc >= 0x2013 && wc <= 0x2014) ||
-		      wc == 0xFE14 ||
-		      (wc >= 0xFE31 && wc <= 0xFE32) ||
-		      wc == 0xFE54 ||
-		      wc == 0xFE58 ||
-		      wc == 0xFE63 ||
-		      wc == 0xFF0D ||
-		      wc == 0xFF1A ||
-		      wc == 0xFF1B ||
-		      wc == 0xFF64)
-		    SB_type = SB_SContinue;
-		  break;
+		    break;
 
-		case G_UNICODE_OTHER_PUNCTUATION:
-		  if (wc == 0x05F3)
-		    SB_type = SB_OLetter;
-		  else if (wc == 0x002E || wc == 0x2024 ||
-		      wc == 0xFE52 || wc == 0xFF0E)
-		    SB_type = SB_ATerm;
-
-		  if (wc == 0x002C ||
-		      wc == 0x003A ||
-		      wc == 0x055D ||
-		      (wc >= 0x060C && wc <= 0x060D) ||
-		      wc == 0x07F8 ||
-		      wc == 0x1802 ||
-		      wc == 0x1808 ||
-		      wc == 0x3001 ||
-		      (wc >= 0xFE10 && wc <= 0xFE11) ||
-		      wc == 0xFE13 ||
-		      (wc >= 0xFE50 && wc <= 0xFE51) ||
-		      wc == 0xFE55 ||
-		      wc == 0xFF0C ||
-		      wc == 0xFF1A ||
-		      wc == 0xFF64)
-		    SB_type = SB_SContinue;
-
-		  if (_pango_is_STerm(wc))
-		    SB_type = SB_STerm;
+		  default:
+		    break;
+		  }
 
-		  break;
+	      if (SB_type == SB_Other)
+		{
+		  if (type == G_UNICODE_LOWERCASE_LETTER)
+		    SB_type = SB_Lower;
+		  else if (type == G_UNICODE_UPPERCASE_LETTER)
+		    SB_type = SB_Upper;
+		  else if (type == G_UNICODE_TITLECASE_LETTER ||
+			   type == G_UNICODE_MODIFIER_LETTER ||
+			   type == G_UNICODE_OTHER_LETTER)
+		    SB_type = SB_OLetter;
 
-                default:
-                  break;
+		  if (type == G_UNICODE_OPEN_PUNCTUATION ||
+		      type == G_UNICODE_CLOSE_PUNCTUATION ||
+		      break_type == G_UNICODE_BREAK_QUOTATION)
+		    SB_type = SB_Close;
 		}
 
-	    if (SB_type == SB_Other)
-	      {
-                if (type == G_UNICODE_LOWERCASE_LETTER)
-		  SB_type = SB_Lower;
-                else if (type == G_UNICODE_UPPERCASE_LETTER)
-		  SB_type = SB_Upper;
-                else if (type == G_UNICODE_TITLECASE_LETTER ||
-                         type == G_UNICODE_MODIFIER_LETTER ||
-                         type == G_UNICODE_OTHER_LETTER)
-		  SB_type = SB_OLetter;
-
-		if (type == G_UNICODE_OPEN_PUNCTUATION ||
-		    type == G_UNICODE_CLOSE_PUNCTUATION ||
-		    break_type == G_UNICODE_BREAK_QUOTATION)
-		  SB_type = SB_Close;
-	      }
-
-	    /* Sentence Boundary Rules */
+	      /* Sentence Boundary Rules */
 
-	    /* We apply Rules SB1 and SB2 at the end of the function */
+	      /* We apply Rules SB1 and SB2 at the end of the function */
 
 #define IS_OTHER_TERM(SB_type)						\
-	    /* not in (OLetter | Upper | Lower | ParaSep | SATerm) */	\
-	      !(SB_type == SB_OLetter ||				\
-		SB_type == SB_Upper || SB_type == SB_Lower ||		\
-		SB_type == SB_ParaSep ||				\
-		SB_type == SB_ATerm || SB_type == SB_STerm ||		\
-		SB_type == SB_ATerm_Close_Sp ||				\
-		SB_type == SB_STerm_Close_Sp)
-
-
-	    if (wc == '\n' && prev_wc == '\r')
-	      is_sentence_boundary = FALSE; /* Rule SB3 */
-	    else if (prev_SB_type == SB_ParaSep && prev_SB_i + 1 == i)
-	      {
-		/* The extra check for prev_SB_i is to correctly handle sequences like
-		 * ParaSep ÷ Extend × Extend
-		 * since we have not skipped ExtendFormat yet.
-		 */
+	      /* not in (OLetter | Upper | Lower | ParaSep | SATerm) */	\
+		!(SB_type == SB_OLetter ||				\
+		  SB_type == SB_Upper || SB_type == SB_Lower ||		\
+		  SB_type == SB_ParaSep ||				\
+		  SB_type == SB_ATerm || SB_type == SB_STerm ||		\
+		  SB_type == SB_ATerm_Close_Sp ||				\
+		  SB_type == SB_STerm_Close_Sp)
+
+
+	      if (wc == '\n' && prev_wc == '\r')
+		is_sentence_boundary = FALSE; /* Rule SB3 */
+	      else if (prev_SB_type == SB_ParaSep && prev_SB_i + 1 == i)
+		{
+		  /* The extra check for prev_SB_i is to correctly handle sequences like
+		   * ParaSep ÷ Extend × Extend
+		   * since we have not skipped ExtendFormat yet.
+		   */
 
-		is_sentence_boundary = TRUE; /* Rule SB4 */
-	      }
-	    else if (SB_type == SB_ExtendFormat)
-	      is_sentence_boundary = FALSE; /* Rule SB5? */
-	    else if (prev_SB_type == SB_ATerm && SB_type == SB_Numeric)
-	      is_sentence_boundary = FALSE; /* Rule SB6 */
-	    else if ((prev_prev_SB_type == SB_Upper ||
-		      prev_prev_SB_type == SB_Lower) &&
-		     prev_SB_type == SB_ATerm &&
-		     SB_type == SB_Upper)
-	      is_sentence_boundary = FALSE; /* Rule SB7 */
-	    else if (prev_SB_type == SB_ATerm && SB_type == SB_Close)
-		SB_type = SB_ATerm;
-	    else if (prev_SB_type == SB_STerm && SB_type == SB_Close)
-	      SB_type = SB_STerm;
-	    else if (prev_SB_type == SB_ATerm && SB_type == SB_Sp)
-	      SB_type = SB_ATerm_Close_Sp;
-	    else if (prev_SB_type == SB_STerm && SB_type == SB_Sp)
-	      SB_type = SB_STerm_Close_Sp;
-	    /* Rule SB8 */
-	    else if ((prev_SB_type == SB_ATerm ||
-		      prev_SB_type == SB_ATerm_Close_Sp) &&
-		     SB_type == SB_Lower)
-	      is_sentence_boundary = FALSE;
-	    else if ((prev_prev_SB_type == SB_ATerm ||
-		      prev_prev_SB_type == SB_ATerm_Close_Sp) &&
-		     IS_OTHER_TERM(prev_SB_type) &&
-		     SB_type == SB_Lower)
-              {
-	        attrs[prev_SB_i].is_sentence_boundary = FALSE;
-	        attrs[prev_SB_i].is_sentence_end = FALSE;
-                last_sentence_start = -1;
-                for (int j = prev_SB_i - 1; j >= 0; j--)
-                  {
-                    attrs[j].is_sentence_end = FALSE;
-                    if (attrs[j].is_sentence_boundary)
-                      {
-                        last_sentence_start = j;
-                        break;
-                      }
-                  }
-              }
-	    else if ((prev_SB_type == SB_ATerm ||
-		      prev_SB_type == SB_ATerm_Close_Sp ||
-		      prev_SB_type == SB_STerm ||
-		      prev_SB_type == SB_STerm_Close_Sp) &&
-		     (SB_type == SB_SContinue ||
-		      SB_type == SB_ATerm || SB_type == SB_STerm))
-	      is_sentence_boundary = FALSE; /* Rule SB8a */
-	    else if ((prev_SB_type == SB_ATerm ||
-		      prev_SB_type == SB_STerm) &&
-		     (SB_type == SB_Close || SB_type == SB_Sp ||
-		      SB_type == SB_ParaSep))
-	      is_sentence_boundary = FALSE; /* Rule SB9 */
-	    else if ((prev_SB_type == SB_ATerm ||
-		      prev_SB_type == SB_ATerm_Close_Sp ||
-		      prev_SB_type == SB_STerm ||
-		      prev_SB_type == SB_STerm_Close_Sp) &&
-		     (SB_type == SB_Sp || SB_type == SB_ParaSep))
-	      is_sentence_boundary = FALSE; /* Rule SB10 */
-	    else if ((prev_SB_type == SB_ATerm ||
-		      prev_SB_type == SB_ATerm_Close_Sp ||
-		      prev_SB_type == SB_STerm ||
-		      prev_SB_type == SB_STerm_Close_Sp) &&
-		     SB_type != SB_ParaSep)
-	      is_sentence_boundary = TRUE; /* Rule SB11 */
-	    else
-	      is_sentence_boundary = FALSE; /* Rule SB998 */
+		  is_sentence_boundary = TRUE; /* Rule SB4 */
+		}
+	      else if (SB_type == SB_ExtendFormat)
+		is_sentence_boundary = FALSE; /* Rule SB5? */
+	      else if (prev_SB_type == SB_ATerm && SB_type == SB_Numeric)
+		is_sentence_boundary = FALSE; /* Rule SB6 */
+	      else if ((prev_prev_SB_type == SB_Upper ||
+			prev_prev_SB_type == SB_Lower) &&
+		       prev_SB_type == SB_ATerm &&
+		       SB_type == SB_Upper)
+		is_sentence_boundary = FALSE; /* Rule SB7 */
+	      else if (prev_SB_type == SB_ATerm && SB_type == SB_Close)
+		  SB_type = SB_ATerm;
+	      else if (prev_SB_type == SB_STerm && SB_type == SB_Close)
+		SB_type = SB_STerm;
+	      else if (prev_SB_type == SB_ATerm && SB_type == SB_Sp)
+		SB_type = SB_ATerm_Close_Sp;
+	      else if (prev_SB_type == SB_STerm && SB_type == SB_Sp)
+		SB_type = SB_STerm_Close_Sp;
+	      /* Rule SB8 */
+	      else if ((prev_SB_type == SB_ATerm ||
+			prev_SB_type == SB_ATerm_Close_Sp) &&
+		       SB_type == SB_Lower)
+		is_sentence_boundary = FALSE;
+	      else if ((prev_prev_SB_type == SB_ATerm ||
+			prev_prev_SB_type == SB_ATerm_Close_Sp) &&
+		       IS_OTHER_TERM(prev_SB_type) &&
+		       SB_type == SB_Lower)
+		{
+		  attrs[prev_SB_i].is_sentence_boundary = FALSE;
+		  attrs[prev_SB_i].is_sentence_end = FALSE;
+		  last_sentence_start = -1;
+		  for (int j = prev_SB_i - 1; j >= 0; j--)
+		    {
+		      attrs[j].is_sentence_end = FALSE;
+		      if (attrs[j].is_sentence_boundary)
+			{
+			  last_sentence_start = j;
+			  break;
+			}
+		    }
+		}
+	      else if ((prev_SB_type == SB_ATerm ||
+			prev_SB_type == SB_ATerm_Close_Sp ||
+			prev_SB_type == SB_STerm ||
+			prev_SB_type == SB_STerm_Close_Sp) &&
+		       (SB_type == SB_SContinue ||
+			SB_type == SB_ATerm || SB_type == SB_STerm))
+		is_sentence_boundary = FALSE; /* Rule SB8a */
+	      else if ((prev_SB_type == SB_ATerm ||
+			prev_SB_type == SB_STerm) &&
+		       (SB_type == SB_Close || SB_type == SB_Sp ||
+			SB_type == SB_ParaSep))
+		is_sentence_boundary = FALSE; /* Rule SB9 */
+	      else if ((prev_SB_type == SB_ATerm ||
+			prev_SB_type == SB_ATerm_Close_Sp ||
+			prev_SB_type == SB_STerm ||
+			prev_SB_type == SB_STerm_Close_Sp) &&
+		       (SB_type == SB_Sp || SB_type == SB_ParaSep))
+		is_sentence_boundary = FALSE; /* Rule SB10 */
+	      else if ((prev_SB_type == SB_ATerm ||
+			prev_SB_type == SB_ATerm_Close_Sp ||
+			prev_SB_type == SB_STerm ||
+			prev_SB_type == SB_STerm_Close_Sp) &&
+		       SB_type != SB_ParaSep)
+		is_sentence_boundary = TRUE; /* Rule SB11 */
+	      else
+		is_sentence_boundary = FALSE; /* Rule SB998 */
 
-	    if (SB_type != SB_ExtendFormat &&
-		!((prev_prev_SB_type == SB_ATerm ||
-		   prev_prev_SB_type == SB_ATerm_Close_Sp) &&
-		  IS_OTHER_TERM(prev_SB_type) &&
-		  IS_OTHER_TERM(SB_type)))
-              {
-                prev_prev_SB_type = prev_SB_type;
-                prev_SB_type = SB_type;
-                prev_SB_i = i;
-              }
+	      if (SB_type != SB_ExtendFormat &&
+		  !((prev_prev_SB_type == SB_ATerm ||
+		     prev_prev_SB_type == SB_ATerm_Close_Sp) &&
+		    IS_OTHER_TERM(prev_SB_type) &&
+		    IS_OTHER_TERM(SB_type)))
+		{
+		  prev_prev_SB_type = prev_SB_type;
+		  prev_SB_type = SB_type;
+		  prev_SB_i = i;
+		}
 
 #undef IS_OTHER_TERM
 
-	  }
+	    }
 
-	if (i == 0 || done)
-	  is_sentence_boundary = TRUE; /* Rules SB1 and SB2 */
+	  if (i == 0 || done)
+	    is_sentence_boundary = TRUE; /* Rules SB1 and SB2 */
 
-	attrs[i].is_sentence_boundary = is_sentence_boundary;
-      }
+	  attrs[i].is_sentence_boundary = is_sentence_boundary;
+	}
 
       /* ---- Line breaking ---- */
 
@@ -1512,7 +1657,7 @@ default_break (const char    *text,
 	    break_op = BREAK_PROHIBITED;
 
 	  if (prev_break_type == G_UNICODE_BREAK_QUOTATION &&
-	      g_unichar_type(prev_wc) != G_UNICODE_FINAL_PUNCTUATION)
+	      get_char_type (prev_wc) != G_UNICODE_FINAL_PUNCTUATION)
 	    break_op = BREAK_PROHIBITED;
 
 	  /* handle related rules for Space as state machine here,
@@ -1627,8 +1772,8 @@ default_break (const char    *text,
 	    }
 	  else
 	    {
-	      if (_pango_Is_Emoji_Extended_Pictographic (wc) &&
-		  g_unichar_type (wc) == G_UNICODE_UNASSIGNED)
+	      if (is_extended_pictographic (wc) &&
+		  get_char_type (wc) == G_UNICODE_UNASSIGNED)
 		met_Ext_Pict_Unassigned = TRUE;
 	    }
 
@@ -1806,7 +1951,7 @@ default_break (const char    *text,
 	      break;
 	    }
 	}
-      else
+      else if (!lines_only) /* Word starts and ends are computed later */
 	{
 	  /* Check for a word start */
 	  switch ((int) type)
@@ -1836,38 +1981,45 @@ default_break (const char    *text,
 	}
 
       /* ---- Sentence breaks ---- */
-      {
+      if (!lines_only)
+	{
 
-	/* default to not a sentence start/end */
-	attrs[i].is_sentence_start = FALSE;
-	attrs[i].is_sentence_end = FALSE;
+	  /* default to not a sentence start/end */
+	  attrs[i].is_sentence_start = FALSE;
+	  attrs[i].is_sentence_end = FALSE;
 
-	/* maybe start sentence */
-	if (last_sentence_start == -1 && !is_sentence_boundary)
-	  last_sentence_start = i - 1;
+	  /* maybe start sentence */
+	  if (last_sentence_start == -1 && !is_sentence_boundary)
+	    last_sentence_start = i - 1;
 
-	/* remember last non space character position */
-	if (i > 0 && !attrs[i - 1].is_white)
-	  last_non_space = i;
+	  /* remember last non space character position */
+	  if (i > 0 && !attrs[i - 1].is_white)
+	    last_non_space = i;
 
-	/* meets sentence end, mark both sentence start and end */
-	if (last_sentence_start != -1 && is_sentence_boundary) {
-	  if (last_non_space >= last_sentence_start) {
-	    attrs[last_sentence_start].is_sentence_start = TRUE;
-	    attrs[last_non_space].is_sentence_end = TRUE;
+	  /* meets sentence end, mark both sentence start and end */
+	  if (last_sentence_start != -1 && is_sentence_boundary) {
+	    if (last_non_space >= last_sentence_start) {
+	      attrs[last_sentence_start].is_sentence_start = TRUE;
+	      attrs[last_non_space].is_sentence_end = TRUE;
+	    }
+
+	    last_sentence_start = -1;
+	    last_non_space = -1;
 	  }
 
-	  last_sentence_start = -1;
-	  last_non_space = -1;
+	  /* meets space character, move sentence start */
+	  if (last_sentence_start != -1 &&
+	      last_sentence_start == i - 1 &&
+	      attrs[i - 1].is_white) {
+	      last_sentence_start++;
+	    }
+	}
+      else
+	{
+	  attrs[i].is_sentence_boundary = FALSE;
+	  attrs[i].is_sentence_start = FALSE;
+	  attrs[i].is_sentence_end = FALSE;
 	}
-
-	/* meets space character, move sentence start */
-	if (last_sentence_start != -1 &&
-	    last_sentence_start == i - 1 &&
-	    attrs[i - 1].is_white) {
-	    last_sentence_start++;
-          }
-      }
 
       /* --- Hyphens --- */
 
@@ -2493,7 +2645,7 @@ pango_default_break (const char    *text,
 {
   PangoLogAttr before = *attrs;
 
-  default_break (text, length, analysis, attrs, attrs_len);
+  default_break (text, length, analysis, attrs, attrs_len, FALSE);
 
   attrs->is_line_break      |= before.is_line_break;
   attrs->is_mandatory_break |= before.is_mandatory_break;
@@ -2527,7 +2679,7 @@ pango_break (const char    *text,
   g_return_if_fail (analysis != NULL);
   g_return_if_fail (attrs != NULL);
 
-  default_break (text, length, analysis, attrs, attrs_len);
+  default_break (text, length, analysis, attrs, attrs_len, FALSE);
   tailor_break (text, length, analysis, -1, attrs, attrs_len);
 }
 
@@ -2697,6 +2849,29 @@ pango_get_log_attrs (const char    *text,
                attrs_len);
 }
 
+/* }}} */
+/* {{{ Private API */
+
+/* Like pango_default_break(), but only determines what is needed
+ * to break text into lines: line and character breaks, whitespace,
+ * cursor positions, word boundaries and hyphenation. Word starts
+ * and ends and all sentence information are left unset.
+ */
+void
+pango_default_break_lines (const char   *text,
+                           int           length,
+                           PangoLogAttr *attrs,
+                           int           attrs_len)
+{
+  PangoLogAttr before = *attrs;
+
+  default_break (text, length, NULL, attrs, attrs_len, TRUE);
+
+  attrs->is_line_break      |= before.is_line_break;
+  attrs->is_mandatory_break |= before.is_mandatory_break;
+  attrs->is_cursor_position |= before.is_cursor_position;
+}
+
 /* }}} */
 
 /* vim:set foldmethod=marker expandtab: */
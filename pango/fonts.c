@@ -52,10 +52,23 @@ struct _PangoFontDescription
   guint static_variations : 1;
   guint static_features : 1;
   guint size_is_absolute : 1;
+  guint interned : 1;
 
   int size;
 };
 
+/* Interned font descriptions are allocated with
+ * extra data after the font description
+ */
+typedef struct {
+  PangoFontDescription desc;
+
+  guint hash;
+  int ref_count; /* protected by intern_lock */
+} InternedFontDescription;
+
+static void pango_font_description_unref_interned (PangoFontDescription *desc);
+
 G_DEFINE_BOXED_TYPE (PangoFontDescription, pango_font_description,
                      pango_font_description_copy,
                      pango_font_description_free);
@@ -77,6 +90,7 @@ static const PangoFontDescription pfd_defaults = {
   0,                    /* static_variations */
   0,                    /* static_features */
   0,                    /* size_is_absolute */
+  0,                    /* interned */
 
   0,                    /* size */
 };
@@ -1091,6 +1105,7 @@ pango_font_description_copy (const PangoFontDescription *desc)
   result = g_slice_new (PangoFontDescription);
 
   *result = *desc;
+  result->interned = FALSE;
 
   if (result->family_name)
     {
@@ -1134,6 +1149,7 @@ pango_font_description_copy_static (const PangoFontDescription *desc)
   result = g_slice_new (PangoFontDescription);
 
   *result = *desc;
+  result->interned = FALSE;
   if (result->family_name)
     result->static_family = TRUE;
 
@@ -1169,6 +1185,13 @@ pango_font_description_equal (const PangoFontDescription *desc1,
   g_return_val_if_fail (desc1 != NULL, FALSE);
   g_return_val_if_fail (desc2 != NULL, FALSE);
 
+  if (desc1 == desc2)
+    return TRUE;
+
+  if (desc1->interned && desc2->interned &&
+      ((const InternedFontDescription *) desc1)->hash != ((const InternedFontDescription *) desc2)->hash)
+    return FALSE;
+
   return desc1->style == desc2->style &&
          desc1->variant == desc2->variant &&
          desc1->weight == desc2->weight &&
@@ -1219,6 +1242,9 @@ pango_font_description_hash (const PangoFontDescription *desc)
 
   g_return_val_if_fail (desc != NULL, 0);
 
+  if (desc->interned)
+    return ((const InternedFontDescription *) desc)->hash;
+
   if (desc->family_name)
     hash = case_insensitive_hash (desc->family_name);
   if (desc->variations)
@@ -1249,6 +1275,12 @@ pango_font_description_free (PangoFontDescription *desc)
   if (desc == NULL)
     return;
 
+  if (G_UNLIKELY (desc->interned))
+    {
+      pango_font_description_unref_interned (desc);
+      return;
+    }
+
   if (desc->family_name && !desc->static_family)
     g_free (desc->family_name);
 
@@ -1285,6 +1317,123 @@ pango_font_descriptions_free (PangoFontDescription **descs,
   g_free (descs);
 }
 
+/* Interned font descriptions are shared, immutable copies.
+ * Equal font descriptions with the same mask are interned to
+ * the same copy, so they can be compared by pointer, and their
+ * hash is computed only once. Families that only differ in case
+ * hash the same, but are interned separately, so that the family
+ * name of an interned font description is the one it was asked
+ * for with.
+ *
+ * They are refcounted, and removed from the table when the
+ * last reference is dropped.
+ */
+
+G_LOCK_DEFINE_STATIC (intern_lock);
+static GHashTable *interned_descs = NULL; /* protected by intern_lock */
+
+static gboolean
+interned_desc_equal (gconstpointer a,
+                     gconstpointer b)
+{
+  const PangoFontDescription *desc1 = a;
+  const PangoFontDescription *desc2 = b;
+
+  return desc1->mask == desc2->mask &&
+         g_strcmp0 (desc1->family_name, desc2->family_name) == 0 &&
+         pango_font_description_equal (desc1, desc2);
+}
+
+static guint
+interned_desc_hash (gconstpointer key)
+{
+  return pango_font_description_hash (key);
+}
+
+/*
+ * pango_font_description_intern:
+ * @desc: a `PangoFontDescription`
+ *
+ * Returns the interned copy of @desc.
+ *
+ * The result must not be modified. Free it with
+ * [method@Pango.FontDescription.free] when it is no
+ * longer needed.
+ *
+ * Returns: (transfer full): the interned font description
+ */
+PangoFontDescription *
+pango_font_description_intern (const PangoFontDescription *desc)
+{
+  InternedFontDescription *interned;
+  guint hash;
+
+  g_return_val_if_fail (desc != NULL, NULL);
+
+  hash = pango_font_description_hash (desc);
+
+  G_LOCK (intern_lock);
+
+  if (desc->interned)
+    {
+      interned = (InternedFontDescription *) desc;
+      interned->ref_count++;
+      goto out;
+    }
+
+  if (G_UNLIKELY (!interned_descs))
+    interned_descs = g_hash_table_new (interned_desc_hash, interned_desc_equal);
+
+  interned = g_hash_table_lookup (interned_descs, desc);
+  if (interned)
+    {
+      interned->ref_count++;
+      goto out;
+    }
+
+  interned = g_new (InternedFontDescription, 1);
+  interned->desc = *desc;
+  interned->desc.family_name = g_strdup (desc->family_name);
+  interned->desc.variations = g_strdup (desc->variations);
+  interned->desc.features = g_strdup (desc->features);
+  interned->desc.static_family = FALSE;
+  interned->desc.static_variations = FALSE;
+  interned->desc.static_features = FALSE;
+  interned->desc.interned = TRUE;
+  interned->hash = hash;
+  interned->ref_count = 1;
+
+  g_hash_table_add (interned_descs, interned);
+
+out:
+  G_UNLOCK (intern_lock);
+
+  return (PangoFontDescription *) interned;
+}
+
+static void
+pango_font_description_unref_interned (PangoFontDescription *desc)
+{
+  InternedFontDescription *interned = (InternedFontDescription *) desc;
+  gboolean last;
+
+  G_LOCK (intern_lock);
+
+  last = --interned->ref_count == 0;
+  if (last)
+    g_hash_table_remove (interned_descs, interned);
+
+  G_UNLOCK (intern_lock);
+
+  if (!last)
+    return;
+
+  g_free (desc->family_name);
+  g_free (desc->variations);
+  g_free (desc->features);
+  g_free (interned);
+}
+
 typedef struct
 {
   int value;
@@ -1550,73 +1699,56 @@ parse_features (const char  *word,
   return FALSE;
 }
 
-/**
- * pango_font_description_from_string:
- * @str: string representation of a font description.
- *
- * Creates a new font description from a string representation.
- *
- * The string must have the form
- *
- *     [FAMILY-LIST] [STYLE-OPTIONS] [SIZE] [VARIATIONS] [FEATURES]
- *
- * where FAMILY-LIST is a comma-separated list of families optionally
- * terminated by a comma, STYLE_OPTIONS is a whitespace-separated list
- * of words where each word describes one of style, variant, weight,
- * stretch, or gravity, and SIZE is a decimal number (size in points)
- * or optionally followed by the unit modifier "px" for absolute size.
- *
- * The following words are understood as styles:
- * "Normal", "Roman", "Oblique", "Italic".
- *
- * The following words are understood as variants:
- * "Small-Caps", "All-Small-Caps", "Petite-Caps", "All-Petite-Caps",
- * "Unicase", "Title-Caps".
- *
- * The following words are understood as weights:
- * "Thin", "Ultra-Light", "Extra-Light", "Light", "Semi-Light",
- * "Demi-Light", "Book", "Regular", "Medium", "Semi-Bold", "Demi-Bold",
- * "Bold", "Ultra-Bold", "Extra-Bold", "Heavy", "Black", "Ultra-Black",
- * "Extra-Black".
- *
- * The following words are understood as stretch values:
- * "Ultra-Condensed", "Extra-Condensed", "Condensed", "Semi-Condensed",
- * "Semi-Expanded", "Expanded", "Extra-Expanded", "Ultra-Expanded".
- *
- * The following words are understood as gravity values:
- * "Not-Rotated", "South", "Upside-Down", "North", "Rotated-Left",
- * "East", "Rotated-Right", "West".
- *
- * The following words are understood as color values:
- * "With-Color", "Without-Color".
- *
- * VARIATIONS is a comma-separated list of font variations
- * of the form @‍axis1=value,axis2=value,...
- *
- * FEATURES is a comma-separated list of font features of the form
- * \#‍feature1=value,feature2=value,...
- * The =value part can be ommitted if the value is 1.
- *
- * Any one of the options may be absent. If FAMILY-LIST is absent, then
- * the family_name field of the resulting font description will be
- * initialized to %NULL. If STYLE-OPTIONS is missing, then all style
- * options will be set to the default values. If SIZE is missing, the
- * size in the resulting font description will be set to 0.
- *
- * A typical example:
- *
- *     Cantarell Italic Light 15 @‍wght=200 #‍tnum=1
- *
- * Returns: (transfer full): a new `PangoFontDescription`.
+/* Copies the family list from @str to @last, trimming
+ * space from around the individual family names (bug #499624)
  */
-PangoFontDescription *
-pango_font_description_from_string (const char *str)
+static char *
+copy_family_list (const char *str,
+                  const char *last)
+{
+  char *result, *q;
+  const char *p;
+
+  result = q = g_new (char, last - str + 1);
+
+  for (p = str; ; )
+    {
+      const char *end, *start;
+
+      end = memchr (p, ',', last - p);
+      if (!end)
+        end = last;
+
+      start = p;
+      while (start < end && g_ascii_isspace (*start))
+        start++;
+
+      p = end;
+      while (p > start && g_ascii_isspace (*(p - 1)))
+        p--;
+
+      memcpy (q, start, p - start);
+      q += p - start;
+
+      if (end == last)
+        break;
+
+      *q++ = ',';
+      p = end + 1;
+    }
+
+  *q = '\0';
+
+  return result;
+}
+
+static PangoFontDescription *
+parse_font_description (const char *str,
+                        size_t      len)
 {
   PangoFontDescription *desc;
   const char *p, *last;
-  size_t len, wordlen;
-
-  g_return_val_if_fail (str != NULL, NULL);
+  size_t wordlen;
 
   desc = pango_font_description_new ();
 
@@ -1625,7 +1757,6 @@ pango_font_description_from_string (const char *str)
                PANGO_FONT_MASK_VARIANT |
                PANGO_FONT_MASK_WIDTH;
 
-  len = strlen (str);
   last = str + len;
   p = getword (str, last, &wordlen, "");
   /* Look for variations or features at the end of the string */
@@ -1705,26 +1836,182 @@ pango_font_description_from_string (const char *str)
 
   if (str != last)
     {
-      int i;
-      char **families;
+      desc->family_name = copy_family_list (str, last);
+      desc->mask |= PANGO_FONT_MASK_FAMILY;
+    }
+
+  return desc;
+}
+
+/* Applications tend to parse the same few font descriptions
+ * over and over, e.g. from markup or CSS, so we keep the most
+ * recently parsed ones around and hand out copies of them.
+ */
 
-      desc->family_name = g_strndup (str, last - str);
+#define PARSE_CACHE_SIZE 256
+#define PARSE_CACHE_MAX_LENGTH 256
 
-      /* Now sanitize it to trim space from around individual family names.
-       * bug #499624 */
+typedef struct {
+  char *str;
+  PangoFontDescription *desc;
+  GList link;
+} ParseCacheEntry;
 
-      families = g_strsplit (desc->family_name, ",", -1);
+G_LOCK_DEFINE_STATIC (parse_cache);
+static GHashTable *parse_cache = NULL; /* protected by parse_cache lock */
+static GQueue parse_cache_lru = G_QUEUE_INIT; /* protected by parse_cache lock */
 
-      for (i = 0; families[i]; i++)
-        g_strstrip (families[i]);
+static void
+parse_cache_entry_free (gpointer data)
+{
+  ParseCacheEntry *entry = data;
 
-      g_free (desc->family_name);
-      desc->family_name = g_strjoinv (",", families);
-      g_strfreev (families);
+  g_free (entry->str);
+  pango_font_description_free (entry->desc);
+  g_free (entry);
+}
 
-      desc->mask |= PANGO_FONT_MASK_FAMILY;
+static PangoFontDescription *
+parse_cache_lookup (const char *str)
+{
+  ParseCacheEntry *entry;
+  PangoFontDescription *desc = NULL;
+
+  G_LOCK (parse_cache);
+
+  if (parse_cache)
+    {
+      entry = g_hash_table_lookup (parse_cache, str);
+      if (entry)
+        {
+          g_queue_unlink (&parse_cache_lru, &entry->link);
+          g_queue_push_head_link (&parse_cache_lru, &entry->link);
+          desc = pango_font_description_copy (entry->desc);
+        }
     }
 
+  G_UNLOCK (parse_cache);
+
+  return desc;
+}
+
+static void
+parse_cache_insert (const char                 *str,
+                    const PangoFontDescription *desc)
+{
+  ParseCacheEntry *entry;
+
+  G_LOCK (parse_cache);
+
+  if (G_UNLIKELY (!parse_cache))
+    parse_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         NULL, parse_cache_entry_free);
+
+  /* Another thread may have parsed the same string meanwhile */
+  if (!g_hash_table_contains (parse_cache, str))
+    {
+      entry = g_new (ParseCacheEntry, 1);
+      entry->str = g_strdup (str);
+      entry->desc = pango_font_description_copy (desc);
+      entry->link.data = entry;
+      entry->link.prev = entry->link.next = NULL;
+
+      g_queue_push_head_link (&parse_cache_lru, &entry->link);
+      g_hash_table_insert (parse_cache, entry->str, entry);
+
+      if (parse_cache_lru.length > PARSE_CACHE_SIZE)
+        {
+          GList *link = g_queue_pop_tail_link (&parse_cache_lru);
+
+          entry = link->data;
+          g_hash_table_remove (parse_cache, entry->str);
+        }
+    }
+
+  G_UNLOCK (parse_cache);
+}
+
+/**
+ * pango_font_description_from_string:
+ * @str: string representation of a font description.
+ *
+ * Creates a new font description from a string representation.
+ *
+ * The string must have the form
+ *
+ *     [FAMILY-LIST] [STYLE-OPTIONS] [SIZE] [VARIATIONS] [FEATURES]
+ *
+ * where FAMILY-LIST is a comma-separated list of families optionally
+ * terminated by a comma, STYLE_OPTIONS is a whitespace-separated list
+ * of words where each word describes one of style, variant, weight,
+ * stretch, or gravity, and SIZE is a decimal number (size in points)
+ * or optionally followed by the unit modifier "px" for absolute size.
+ *
+ * The following words are understood as styles:
+ * "Normal", "Roman", "Oblique", "Italic".
+ *
+ * The following words are understood as variants:
+ * "Small-Caps", "All-Small-Caps", "Petite-Caps", "All-Petite-Caps",
+ * "Unicase", "Title-Caps".
+ *
+ * The following words are understood as weights:
+ * "Thin", "Ultra-Light", "Extra-Light", "Light", "Semi-Light",
+ * "Demi-Light", "Book", "Regular", "Medium", "Semi-Bold", "Demi-Bold",
+ * "Bold", "Ultra-Bold", "Extra-Bold", "Heavy", "Black", "Ultra-Black",
+ * "Extra-Black".
+ *
+ * The following words are understood as stretch values:
+ * "Ultra-Condensed", "Extra-Condensed", "Condensed", "Semi-Condensed",
+ * "Semi-Expanded", "Expanded", "Extra-Expanded", "Ultra-Expanded".
+ *
+ * The following words are understood as gravity values:
+ * "Not-Rotated", "South", "Upside-Down", "North", "Rotated-Left",
+ * "East", "Rotated-Right", "West".
+ *
+ * The following words are understood as color values:
+ * "With-Color", "Without-Color".
+ *
+ * VARIATIONS is a comma-separated list of font variations
+ * of the form @‍axis1=value,axis2=value,...
+ *
+ * FEATURES is a comma-separated list of font features of the form
+ * \#‍feature1=value,feature2=value,...
+ * The =value part can be ommitted if the value is 1.
+ *
+ * Any one of the options may be absent. If FAMILY-LIST is absent, then
+ * the family_name field of the resulting font description will be
+ * initialized to %NULL. If STYLE-OPTIONS is missing, then all style
+ * options will be set to the default values. If SIZE is missing, the
+ * size in the resulting font description will be set to 0.
+ *
+ * A typical example:
+ *
+ *     Cantarell Italic Light 15 @‍wght=200 #‍tnum=1
+ *
+ * Returns: (transfer full): a new `PangoFontDescription`.
+ */
+PangoFontDescription *
+pango_font_description_from_string (const char *str)
+{
+  PangoFontDescription *desc;
+  size_t len;
+
+  g_return_val_if_fail (str != NULL, NULL);
+
+  len = strlen (str);
+
+  if (len <= PARSE_CACHE_MAX_LENGTH)
+    {
+      desc = parse_cache_lookup (str);
+      if (desc)
+        return desc;
+    }
+
+  desc = parse_font_description (str, len);
+
+  if (len <= PARSE_CACHE_MAX_LENGTH)
+    parse_cache_insert (str, desc);
+
   return desc;
 }
 
@@ -2246,6 +2533,22 @@ pango_font_default_get_absolute_size (PangoFont *font)
   return size;
 }
 
+static void
+pango_font_default_get_glyph_extents_batch (PangoFont        *font,
+                                            const PangoGlyph *glyphs,
+                                            guint             n_glyphs,
+                                            PangoRectangle   *ink_rects,
+                                            PangoRectangle   *logical_rects)
+{
+  PangoFontClass *class = PANGO_FONT_GET_CLASS (font);
+  guint i;
+
+  for (i = 0; i < n_glyphs; i++)
+    class->get_glyph_extents (font, glyphs[i],
+                              ink_rects ? &ink_rects[i] : NULL,
+                              logical_rects ? &logical_rects[i] : NULL);
+}
+
 static void
 pango_font_class_init (PangoFontClass *class G_GNUC_UNUSED)
 {
@@ -2263,6 +2566,7 @@ pango_font_class_init (PangoFontClass *class G_GNUC_UNUSED)
   pclass->get_face = pango_font_default_get_face;
   pclass->get_matrix = pango_font_default_get_matrix;
   pclass->get_absolute_size = pango_font_default_get_absolute_size;
+  pclass->get_glyph_extents_batch = pango_font_default_get_glyph_extents_batch;
 }
 
 static void
@@ -2402,6 +2706,47 @@ pango_font_get_glyph_extents  (PangoFont      *font,
   PANGO_FONT_GET_CLASS (font)->get_glyph_extents (font, glyph, ink_rect, logical_rect);
 }
 
+/*< private >
+ * pango_font_get_glyph_extents_batch:
+ * @font: (nullable): a `PangoFont`
+ * @glyphs: (array length=n_glyphs): the glyph indices
+ * @n_glyphs: the number of glyphs
+ * @ink_rects: (out caller-allocates) (optional) (array length=n_glyphs):
+ *   array to store the ink extents of the glyphs in
+ * @logical_rects: (out caller-allocates) (optional) (array length=n_glyphs):
+ *   array to store the logical extents of the glyphs in
+ *
+ * Gets the extents of several glyphs at once.
+ *
+ * The results are the same as calling [method@Pango.Font.get_glyph_extents]
+ * for each glyph, but font implementations can do the work for all glyphs
+ * with a single lock and cache pass.
+ */
+void
+pango_font_get_glyph_extents_batch (PangoFont        *font,
+                                    const PangoGlyph *glyphs,
+                                    guint             n_glyphs,
+                                    PangoRectangle   *ink_rects,
+                                    PangoRectangle   *logical_rects)
+{
+  guint i;
+
+  if (n_glyphs == 0 || (!ink_rects && !logical_rects))
+    return;
+
+  if (G_UNLIKELY (!font))
+    {
+      for (i = 0; i < n_glyphs; i++)
+        pango_font_get_glyph_extents (NULL, glyphs[i],
+                                      ink_rects ? &ink_rects[i] : NULL,
+                                      logical_rects ? &logical_rects[i] : NULL);
+      return;
+    }
+
+  PANGO_FONT_GET_CLASS_PRIVATE (font)->get_glyph_extents_batch (font, glyphs, n_glyphs,
+                                                                ink_rects, logical_rects);
+}
+
 /**
  * pango_font_get_metrics:
  * @font: (nullable): a `PangoFont`
@@ -2518,17 +2863,28 @@ hb_font_t *
 pango_font_get_hb_font (PangoFont *font)
 {
   PangoFontPrivate *priv = pango_font_get_instance_private (font);
+  hb_font_t *hb_font;
 
   g_return_val_if_fail (PANGO_IS_FONT (font), NULL);
 
-  if (priv->hb_font)
-    return priv->hb_font;
+  hb_font = g_atomic_pointer_get (&priv->hb_font);
+  if (hb_font)
+    return hb_font;
 
-  priv->hb_font = PANGO_FONT_GET_CLASS (font)->create_hb_font (font);
+  hb_font = PANGO_FONT_GET_CLASS (font)->create_hb_font (font);
 
-  hb_font_make_immutable (priv->hb_font);
+  hb_font_make_immutable (hb_font);
+
+  /* Fonts can be shared between threads, so
+   * another thread may have beaten us to it
+   */
+  if (!g_atomic_pointer_compare_and_exchange (&priv->hb_font, NULL, hb_font))
+    {
+      hb_font_destroy (hb_font);
+      hb_font = g_atomic_pointer_get (&priv->hb_font);
+    }
 
-  return priv->hb_font;
+  return hb_font;
 }
 
 G_DEFINE_BOXED_TYPE (PangoFontMetrics, pango_font_metrics,
@@ -23,6 +23,7 @@
 #include <glib.h>
 #include "pango-glyph.h"
 #include "pango-font.h"
+#include "pango-font-private.h"
 #include "pango-impl-utils.h"
 
 #include <hb-ot.h>
@@ -142,6 +143,8 @@ pango_glyph_string_free (PangoGlyphString *string)
   g_slice_free (PangoGlyphString, string);
 }
 
+#define EXTENTS_CHUNK_SIZE 64
+
 /**
  * pango_glyph_string_extents_range:
  * @glyphs: a `PangoGlyphString`
@@ -168,6 +171,10 @@ pango_glyph_string_extents_range (PangoGlyphString *glyphs,
 				  PangoRectangle   *ink_rect,
 				  PangoRectangle   *logical_rect)
 {
+  PangoGlyph chunk_glyphs[EXTENTS_CHUNK_SIZE];
+  PangoRectangle chunk_ink[EXTENTS_CHUNK_SIZE];
+  PangoRectangle chunk_logical[EXTENTS_CHUNK_SIZE];
+  int chunk_start = start;
   int x_pos = 0;
   int i;
 
@@ -207,9 +214,26 @@ pango_glyph_string_extents_range (PangoGlyphString *glyphs,
 
       PangoGlyphGeometry *geometry = &glyphs->glyphs[i].geometry;
 
-      pango_font_get_glyph_extents (font, glyphs->glyphs[i].glyph,
-				    ink_rect ? &glyph_ink : NULL,
-				    logical_rect ? &glyph_logical : NULL);
+      /* Get the extents for the glyphs in chunks, so
+       * that the font can look them up in one go
+       */
+      if ((i - start) % EXTENTS_CHUNK_SIZE == 0)
+        {
+          int j, n = MIN (end - i, EXTENTS_CHUNK_SIZE);
+
+          for (j = 0; j < n; j++)
+            chunk_glyphs[j] = glyphs->glyphs[i + j].glyph;
+
+          pango_font_get_glyph_extents_batch (font, chunk_glyphs, n,
+                                              ink_rect ? chunk_ink : NULL,
+                                              logical_rect ? chunk_logical : NULL);
+          chunk_start = i;
+        }
+
+      if (ink_rect)
+        glyph_ink = chunk_ink[i - chunk_start];
+      if (logical_rect)
+        glyph_logical = chunk_logical[i - chunk_start];
 
       if (ink_rect && glyph_ink.width != 0 && glyph_ink.height != 0)
 	{
@@ -34,37 +34,61 @@
 #include "pango-attributes-private.h"
 #include "pango-item-private.h"
 #include "pango-utils-private.h"
+#include "pango-utils-internal.h"
 
 #include <hb-ot.h>
 
 /* {{{ Font cache */
 
 /*
- * We cache the results of character,fontset => font in a hash table
+ * We cache the results of character,fontset => font in a two-level
+ * table. The table is split into pages of 256 characters, which are
+ * allocated as needed. The pages for the BMP are looked up directly,
+ * the few pages outside of it that are used go in a hash table.
+ *
+ * To keep the pages small, they don't store fonts, but indices into
+ * an array of the fonts that have been found so far.
  */
 
-typedef struct {
-  GHashTable *hash;
-} FontCache;
+#define FONT_CACHE_PAGE_BITS 8
+#define FONT_CACHE_PAGE_SIZE (1 << FONT_CACHE_PAGE_BITS)
+#define FONT_CACHE_BMP_PAGES (0x10000 >> FONT_CACHE_PAGE_BITS)
 
 typedef struct {
-  PangoFont *font;
-  int position; /* position of the font in the fontset */
+  guint16 font;     /* 1 + index of the font in FontCache.fonts, or 0 if not cached */
+  guint16 position; /* position of the font in the fontset */
 } FontElement;
 
+typedef struct {
+  FontElement elements[FONT_CACHE_PAGE_SIZE];
+} FontCachePage;
+
+typedef struct {
+  GPtrArray *fonts;                         /* fonts that elements refer to, may contain NULL */
+  FontCachePage *bmp[FONT_CACHE_BMP_PAGES]; /* pages for the BMP */
+  GHashTable *pages;                        /* pages outside the BMP, by page number */
+} FontCache;
+
 static void
 font_cache_destroy (FontCache *cache)
 {
-  g_hash_table_destroy (cache->hash);
-  g_slice_free (FontCache, cache);
-}
+  guint i;
 
-static void
-font_element_destroy (FontElement *element)
-{
-  if (element->font)
-    g_object_unref (element->font);
-  g_slice_free (FontElement, element);
+  for (i = 0; i < cache->fonts->len; i++)
+    {
+      PangoFont *font = g_ptr_array_index (cache->fonts, i);
+      if (font)
+        g_object_unref (font);
+    }
+  g_ptr_array_unref (cache->fonts);
+
+  for (i = 0; i < FONT_CACHE_BMP_PAGES; i++)
+    g_free (cache->bmp[i]);
+
+  if (cache->pages)
+    g_hash_table_destroy (cache->pages);
+
+  g_free (cache);
 }
 
 static FontCache *
@@ -80,9 +104,8 @@ retry:
   cache = g_object_get_qdata (G_OBJECT (fontset), cache_quark);
   if (G_UNLIKELY (!cache))
     {
-      cache = g_slice_new (FontCache);
-      cache->hash = g_hash_table_new_full (g_direct_hash, NULL,
-                                           NULL, (GDestroyNotify)font_element_destroy);
+      cache = g_new0 (FontCache, 1);
+      cache->fonts = g_ptr_array_new ();
       if (!g_object_replace_qdata (G_OBJECT (fontset), cache_quark, NULL,
                                    cache, (GDestroyNotify)font_cache_destroy,
                                    NULL))
@@ -95,23 +118,38 @@ retry:
   return cache;
 }
 
-static gboolean
+static inline FontCachePage *
+font_cache_get_page (FontCache *cache,
+                     gunichar   wc)
+{
+  if (G_LIKELY (wc < 0x10000))
+    return cache->bmp[wc >> FONT_CACHE_PAGE_BITS];
+  else if (cache->pages)
+    return g_hash_table_lookup (cache->pages, GUINT_TO_POINTER (wc >> FONT_CACHE_PAGE_BITS));
+  else
+    return NULL;
+}
+
+static inline gboolean
 font_cache_get (FontCache   *cache,
                 gunichar     wc,
                 PangoFont  **font,
                 int         *position)
 {
+  FontCachePage *page;
   FontElement *element;
 
-  element = g_hash_table_lookup (cache->hash, GUINT_TO_POINTER (wc));
-  if (element)
-    {
-      *font = element->font;
-      *position = element->position;
-      return TRUE;
-    }
-  else
+  page = font_cache_get_page (cache, wc);
+  if (!page)
+    return FALSE;
+
+  element = &page->elements[wc & (FONT_CACHE_PAGE_SIZE - 1)];
+  if (element->font == 0)
     return FALSE;
+
+  *font = g_ptr_array_index (cache->fonts, element->font - 1);
+  *position = element->position;
+  return TRUE;
 }
 
 static void
@@ -120,11 +158,40 @@ font_cache_insert (FontCache *cache,
                    PangoFont *font,
                    int        position)
 {
-  FontElement *element = g_slice_new (FontElement);
-  element->font = font ? g_object_ref (font) : NULL;
-  element->position = position;
+  FontCachePage *page;
+  guint index;
+
+  /* Don't bother with fontsets that are too large for our elements */
+  if (position > G_MAXUINT16)
+    return;
+
+  if (!g_ptr_array_find (cache->fonts, font, &index))
+    {
+      if (cache->fonts->len >= G_MAXUINT16)
+        return;
+
+      index = cache->fonts->len;
+      g_ptr_array_add (cache->fonts, font ? g_object_ref (font) : NULL);
+    }
+
+  page = font_cache_get_page (cache, wc);
+  if (!page)
+    {
+      page = g_new0 (FontCachePage, 1);
+
+      if (wc < 0x10000)
+        cache->bmp[wc >> FONT_CACHE_PAGE_BITS] = page;
+      else
+        {
+          if (!cache->pages)
+            cache->pages = g_hash_table_new_full (g_direct_hash, NULL, NULL, g_free);
+
+          g_hash_table_insert (cache->pages, GUINT_TO_POINTER (wc >> FONT_CACHE_PAGE_BITS), page);
+        }
+    }
 
-  g_hash_table_insert (cache->hash, GUINT_TO_POINTER (wc), element);
+  page->elements[wc & (FONT_CACHE_PAGE_SIZE - 1)].font = index + 1;
+  page->elements[wc & (FONT_CACHE_PAGE_SIZE - 1)].position = position;
 }
 
 /* }}} */
@@ -289,6 +356,8 @@ struct _ItemizeState
   const char *run_start;
   const char *run_end;
 
+  gboolean ascii;
+
   GList *result;
   PangoItem *item;
 
@@ -456,12 +525,16 @@ itemize_state_init (ItemizeState               *state,
 {
   unsigned int n_chars;
 
-  n_chars = g_utf8_strlen (text + start_index, length);
-
   state->context = context;
   state->text = text;
   state->end = text + start_index + length;
 
+  state->ascii = _pango_utf8_is_ascii (text + start_index, length);
+  if (state->ascii)
+    n_chars = length;
+  else
+    n_chars = g_utf8_strlen (text + start_index, length);
+
   state->result = NULL;
   state->item = NULL;
 
@@ -528,14 +601,42 @@ itemize_state_init (ItemizeState               *state,
       state->enable_fallback = TRUE;
     }
 
-  /* Initialize the script iterator
-   */
-  _pango_script_iter_init (&state->script_iter, text + start_index, length);
-  pango_script_iter_get_range (&state->script_iter, NULL,
-                               &state->script_end, &state->script);
+  if (state->ascii)
+    {
+      /* ASCII text is a single run of Latin script (or Common,
+       * if it has no letters), does not contain emoji and has
+       * nothing that is upright in vertical text, so we can set
+       * up the iterators with their final values right away.
+       */
+      state->script_end = state->end;
+      if (_pango_ascii_has_letter (text + start_index, length))
+        state->script = PANGO_SCRIPT_LATIN;
+      else
+        state->script = PANGO_SCRIPT_COMMON;
+
+      state->width_iter.text_start = state->width_iter.start = text + start_index;
+      state->width_iter.text_end = state->width_iter.end = state->end;
+      state->width_iter.upright = FALSE;
+
+      state->emoji_iter.text_start = state->emoji_iter.start = text + start_index;
+      state->emoji_iter.text_end = state->emoji_iter.end = state->end;
+      state->emoji_iter.is_emoji = FALSE;
+      state->emoji_iter.has_vs = FALSE;
+      state->emoji_iter.types = state->emoji_iter.types_;
+      state->emoji_iter.n_chars = n_chars;
+      state->emoji_iter.cursor = n_chars;
+    }
+  else
+    {
+      /* Initialize the script iterator
+       */
+      _pango_script_iter_init (&state->script_iter, text + start_index, length);
+      pango_script_iter_get_range (&state->script_iter, NULL,
+                                   &state->script_end, &state->script);
 
-  width_iter_init (&state->width_iter, text + start_index, length);
-  _pango_emoji_iter_init (&state->emoji_iter, text + start_index, length, n_chars);
+      width_iter_init (&state->width_iter, text + start_index, length);
+      _pango_emoji_iter_init (&state->emoji_iter, text + start_index, length, n_chars);
+    }
 
   if (!PANGO_GRAVITY_IS_VERTICAL (state->context->resolved_gravity))
     state->width_iter.end = state->end;
@@ -981,6 +1082,83 @@ consider_as_space (gunichar wc)
          (wc >= 0xe0100u && wc <= 0xe01efu);
 }
 
+static int
+compare_unichar (gconstpointer a,
+                 gconstpointer b)
+{
+  gunichar wc1 = *(const gunichar *) a;
+  gunichar wc2 = *(const gunichar *) b;
+
+  return wc1 < wc2 ? -1 : (wc1 > wc2 ? 1 : 0);
+}
+
+/* Resolve the fonts for all the characters of the current
+ * run that are not in the font cache yet with a single walk
+ * over the fontset, instead of walking the fontset once for
+ * each of them in get_font(). This makes a big difference
+ * for text that has many different characters that need
+ * fallback fonts, like CJK or emoji.
+ */
+static void
+itemize_state_fill_font_cache (ItemizeState *state)
+{
+  GArray *chars = NULL;
+  PangoFont **fonts;
+  int *positions;
+  const char *p;
+  guint i, j;
+
+  if (!state->enable_fallback)
+    return;
+
+  for (p = state->run_start; p < state->run_end; p = g_utf8_next_char (p))
+    {
+      gunichar wc = g_utf8_get_char (p);
+      PangoFont *font;
+      int position;
+
+      if (consider_as_space (wc) ||
+          font_cache_get (state->cache, wc, &font, &position))
+        continue;
+
+      if (!chars)
+        chars = g_array_new (FALSE, FALSE, sizeof (gunichar));
+
+      g_array_append_val (chars, wc);
+    }
+
+  if (!chars)
+    return;
+
+  g_array_sort (chars, compare_unichar);
+  for (i = 1, j = 1; i < chars->len; i++)
+    {
+      if (g_array_index (chars, gunichar, i) != g_array_index (chars, gunichar, j - 1))
+        g_array_index (chars, gunichar, j++) = g_array_index (chars, gunichar, i);
+    }
+  g_array_set_size (chars, j);
+
+  /* A single character is just as fast with get_font() */
+  if (chars->len > 1)
+    {
+      positions = g_new (int, chars->len);
+      fonts = pango_fontset_get_fonts (state->current_fonts,
+                                       (const gunichar *) chars->data, chars->len,
+                                       positions);
+
+      for (i = 0; i < chars->len; i++)
+        font_cache_insert (state->cache,
+                           g_array_index (chars, gunichar, i),
+                           fonts[i] ? fonts[i] : get_base_font (state),
+                           positions[i]);
+
+      g_free (fonts);
+      g_free (positions);
+    }
+
+  g_array_unref (chars);
+}
+
 static void
 itemize_state_process_run (ItemizeState *state)
 {
@@ -997,6 +1175,8 @@ itemize_state_process_run (ItemizeState *state)
   /* We should never get an empty run */
   g_assert (state->run_end != state->run_start);
 
+  itemize_state_fill_font_cache (state);
+
   for (p = state->run_start;
        p < state->run_end;
        p = g_utf8_next_char (p))
@@ -1064,7 +1244,8 @@ itemize_state_finish (ItemizeState *state)
     g_free (state->embedding_levels);
   if (state->free_attr_iter)
     pango_attr_iterator_destroy (state->attr_iter);
-  _pango_script_iter_fini (&state->script_iter);
+  if (!state->ascii)
+    _pango_script_iter_fini (&state->script_iter);
   pango_font_description_free (state->font_desc);
   pango_font_description_free (state->emoji_font_desc);
   pango_font_description_free (state->text_emoji_font_desc);
@@ -36,6 +36,16 @@ struct _PangoAttrList
 {
   guint ref_count;
   GPtrArray *attributes;
+
+  /* A max-tree over the end indices of @attributes, used by
+   * pango_attr_list_change() to find overlapping attributes
+   * without walking the whole list. Only the first @tree_valid
+   * leaves are up to date, the leaves from @tree_used on are 0.
+   */
+  guint *end_tree;
+  guint tree_size;
+  guint tree_valid;
+  guint tree_used;
 };
 
 void     _pango_attr_list_init         (PangoAttrList     *list);
@@ -1878,6 +1878,10 @@ _pango_attr_list_init (PangoAttrList *list)
 {
   list->ref_count = 1;
   list->attributes = NULL;
+  list->end_tree = NULL;
+  list->tree_size = 0;
+  list->tree_valid = 0;
+  list->tree_used = 0;
 }
 
 /**
@@ -1927,6 +1931,8 @@ _pango_attr_list_destroy (PangoAttrList *list)
 {
   guint i, p;
 
+  g_clear_pointer (&list->end_tree, g_free);
+
   if (!list->attributes)
     return;
 
@@ -1993,6 +1999,148 @@ pango_attr_list_copy (PangoAttrList *list)
   return new;
 }
 
+/* The attributes in a list are kept sorted by start index,
+ * so we can bisect to find insertion points. Returns the index
+ * of the first attribute in [@lo, @hi) that starts after @index,
+ * or at @index if @inclusive is %TRUE, and @hi if there is none.
+ */
+static guint
+attr_list_bisect (PangoAttrList *list,
+                  guint          lo,
+                  guint          hi,
+                  guint          index,
+                  gboolean       inclusive)
+{
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      PangoAttribute *cur = g_ptr_array_index (list->attributes, mid);
+
+      if (cur->start_index > index ||
+          (inclusive && cur->start_index == index))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return lo;
+}
+
+/* Lists shorter than this are scanned linearly in
+ * pango_attr_list_change(), without building the end tree.
+ */
+#define ATTR_TREE_MIN_LENGTH 32
+
+/* Must be called whenever attributes at or after @index are
+ * added, removed, reordered or have their end index changed.
+ */
+static inline void
+attr_list_invalidate (PangoAttrList *list,
+                      guint          index)
+{
+  list->tree_valid = MIN (list->tree_valid, index);
+}
+
+static void
+attr_list_update_tree (PangoAttrList *list)
+{
+  guint len = list->attributes->len;
+  guint size, n, i, k;
+  guint *leaves;
+
+  if (len > list->tree_size)
+    {
+      size = MAX (list->tree_size, 2 * ATTR_TREE_MIN_LENGTH);
+      while (size < len)
+        size *= 2;
+
+      g_free (list->end_tree);
+      list->end_tree = g_new0 (guint, 2 * size);
+      list->tree_size = size;
+      list->tree_valid = 0;
+      list->tree_used = 0;
+    }
+
+  size = list->tree_size;
+  n = MAX (len, list->tree_used);
+  if (list->tree_valid == n)
+    return;
+
+  leaves = list->end_tree + size;
+  for (i = list->tree_valid; i < n; i++)
+    {
+      if (i < len)
+        leaves[i] = ((PangoAttribute *) g_ptr_array_index (list->attributes, i))->end_index;
+      else
+        leaves[i] = 0;
+    }
+
+  if (n - list->tree_valid > size / 8)
+    {
+      for (k = size - 1; k > 0; k--)
+        list->end_tree[k] = MAX (list->end_tree[2 * k], list->end_tree[2 * k + 1]);
+    }
+  else
+    {
+      /* Typically just the tail of the list changed */
+      for (i = list->tree_valid; i < n; i++)
+        for (k = (size + i) / 2; k > 0; k /= 2)
+          list->end_tree[k] = MAX (list->end_tree[2 * k], list->end_tree[2 * k + 1]);
+    }
+
+  list->tree_valid = len;
+  list->tree_used = len;
+}
+
+static guint
+attr_tree_find (const guint *tree,
+                guint        node,
+                guint        lo,
+                guint        hi,
+                guint        from,
+                guint        to,
+                guint        index)
+{
+  guint mid, found;
+
+  if (hi <= from || lo >= to || tree[node] < index)
+    return to;
+
+  if (hi - lo == 1)
+    return lo;
+
+  mid = lo + (hi - lo) / 2;
+  found = attr_tree_find (tree, 2 * node, lo, mid, from, to, index);
+  if (found < to)
+    return found;
+
+  return attr_tree_find (tree, 2 * node + 1, mid, hi, from, to, index);
+}
+
+/* Returns the index of the first attribute in [@from, @to) that
+ * ends at or after @index, or @to if there is none.
+ */
+static guint
+attr_list_find_overlap (PangoAttrList *list,
+                        gboolean       use_tree,
+                        guint          from,
+                        guint          to,
+                        guint          index)
+{
+  if (use_tree)
+    return attr_tree_find (list->end_tree, 1, 0, list->tree_size, from, to, index);
+
+  for (; from < to; from++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (list->attributes, from);
+
+      if (attr->end_index >= index)
+        return from;
+    }
+
+  return to;
+}
+
 static void
 pango_attr_list_insert_internal (PangoAttrList  *list,
                                  PangoAttribute *attr,
@@ -2021,19 +2169,12 @@ pango_attr_list_insert_internal (PangoAttrList  *list,
     }
   else
     {
-      guint i, p;
-
-      for (i = 0, p = list->attributes->len; i < p; i++)
-        {
-          PangoAttribute *cur = g_ptr_array_index (list->attributes, i);
+      guint i;
 
-          if (cur->start_index > start_index ||
-              (before && cur->start_index == start_index))
-            {
-              g_ptr_array_insert (list->attributes, i, attr);
-              break;
-            }
-        }
+      /* The last attribute goes after @attr, so there is no need to look at it */
+      i = attr_list_bisect (list, 0, list->attributes->len - 1, start_index, before);
+      g_ptr_array_insert (list->attributes, i, attr);
+      attr_list_invalidate (list, i);
     }
 }
 
@@ -2102,6 +2243,8 @@ pango_attr_list_change (PangoAttrList  *list,
   guint i, p;
   guint start_index = attr->start_index;
   guint end_index = attr->end_index;
+  guint after;
+  gboolean use_tree;
   gboolean inserted;
 
   g_return_if_fail (list != NULL);
@@ -2118,24 +2261,31 @@ pango_attr_list_change (PangoAttrList  *list,
       return;
     }
 
+  /* Only attributes before @after can overlap the start of
+   * the new one, and only those that don't end before it. The
+   * end tree lets us skip the others in large lists.
+   */
+  after = attr_list_bisect (list, 0, list->attributes->len, start_index, FALSE);
+
+  use_tree = list->attributes->len >= ATTR_TREE_MIN_LENGTH;
+  if (use_tree)
+    attr_list_update_tree (list);
+
+  /* Inserting attributes after @after below does not move the
+   * ones we are looking at, so the tree stays usable until we
+   * are done with them.
+   */
+  i = attr_list_find_overlap (list, use_tree, 0, after, start_index);
+  attr_list_invalidate (list, i);
+
   inserted = FALSE;
-  for (i = 0, p = list->attributes->len; i < p; i++)
+  for (; i < after; i = attr_list_find_overlap (list, use_tree, i + 1, after, start_index))
     {
       PangoAttribute *tmp_attr = g_ptr_array_index (list->attributes, i);
 
-      if (tmp_attr->start_index > start_index)
-        {
-          g_ptr_array_insert (list->attributes, i, attr);
-          inserted = TRUE;
-          break;
-        }
-
       if (tmp_attr->klass->type != attr->klass->type)
         continue;
 
-      if (tmp_attr->end_index < start_index)
-        continue; /* This attr does not overlap with the new one */
-
       g_assert (tmp_attr->start_index <= start_index);
       g_assert (tmp_attr->end_index >= start_index);
 
@@ -2270,57 +2420,64 @@ pango_attr_list_update (PangoAttrList *list,
                         int             remove,
                         int             add)
 {
-  guint i, p;
+  guint i, j, p;
 
   g_return_if_fail (pos >= 0);
   g_return_if_fail (remove >= 0);
   g_return_if_fail (add >= 0);
 
-  if (list->attributes)
-    for (i = 0, p = list->attributes->len; i < p; i++)
-      {
-        PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
+  if (!list->attributes)
+    return;
 
-        if (attr->start_index >= pos &&
-          attr->end_index < pos + remove)
-          {
-            pango_attribute_destroy (attr);
-            g_ptr_array_remove_index (list->attributes, i);
-            i--; /* Look at this index again */
-            p--;
-            continue;
-          }
+  /* Removed attributes are dropped by compacting the array
+   * as we go, instead of shifting the tail for each of them.
+   */
+  for (i = 0, j = 0, p = list->attributes->len; i < p; i++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
 
-        if (attr->start_index != PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING)
-          {
-            if (attr->start_index >= pos &&
-                attr->start_index < pos + remove)
-              {
-                attr->start_index = pos + add;
-              }
-            else if (attr->start_index >= pos + remove)
-              {
-                attr->start_index += add - remove;
-              }
-          }
+      if (attr->start_index >= pos &&
+        attr->end_index < pos + remove)
+        {
+          pango_attribute_destroy (attr);
+          continue;
+        }
 
-        if (attr->end_index != PANGO_ATTR_INDEX_TO_TEXT_END)
-          {
-            if (attr->end_index >= pos &&
-                attr->end_index < pos + remove)
-              {
-                attr->end_index = pos;
-              }
-            else if (attr->end_index >= pos + remove)
-              {
-                if (add > remove &&
-                    G_MAXUINT - attr->end_index < add - remove)
-                  attr->end_index = G_MAXUINT;
-                else
-                  attr->end_index += add - remove;
-              }
-          }
-      }
+      if (attr->start_index != PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING)
+        {
+          if (attr->start_index >= pos &&
+              attr->start_index < pos + remove)
+            {
+              attr->start_index = pos + add;
+            }
+          else if (attr->start_index >= pos + remove)
+            {
+              attr->start_index += add - remove;
+            }
+        }
+
+      if (attr->end_index != PANGO_ATTR_INDEX_TO_TEXT_END)
+        {
+          if (attr->end_index >= pos &&
+              attr->end_index < pos + remove)
+            {
+              attr->end_index = pos;
+            }
+          else if (attr->end_index >= pos + remove)
+            {
+              if (add > remove &&
+                  G_MAXUINT - attr->end_index < add - remove)
+                attr->end_index = G_MAXUINT;
+              else
+                attr->end_index += add - remove;
+            }
+        }
+
+      g_ptr_array_index (list->attributes, j++) = attr;
+    }
+
+  g_ptr_array_set_size (list->attributes, j);
+  attr_list_invalidate (list, 0);
 }
 
 /**
@@ -2398,6 +2555,8 @@ pango_attr_list_splice (PangoAttrList *list,
          }
       }
 
+  attr_list_invalidate (list, 0);
+
   if (!other->attributes || other->attributes->len == 0)
     return;
 
@@ -2573,6 +2732,7 @@ pango_attr_list_filter (PangoAttrList       *list,
       if ((*func) (tmp_attr, data))
         {
           g_ptr_array_remove_index (list->attributes, i);
+          attr_list_invalidate (list, i);
           i--; /* Need to look at this index again */
           p--;
 
@@ -3298,7 +3458,7 @@ pango_attr_iterator_range (PangoAttrIterator *iterator,
 gboolean
 pango_attr_iterator_next (PangoAttrIterator *iterator)
 {
-  int i;
+  guint i, j;
 
   g_return_val_if_fail (iterator != NULL, FALSE);
 
@@ -3311,15 +3471,22 @@ pango_attr_iterator_next (PangoAttrIterator *iterator)
 
   if (iterator->attribute_stack)
     {
-      for (i = iterator->attribute_stack->len - 1; i>= 0; i--)
+      /* Drop the attributes that end here in a single pass.
+       * The order of the others must be kept, so we can't
+       * use remove_index_fast.
+       */
+      for (i = 0, j = 0; i < iterator->attribute_stack->len; i++)
         {
-          const PangoAttribute *attr = g_ptr_array_index (iterator->attribute_stack, i);
+          PangoAttribute *attr = g_ptr_array_index (iterator->attribute_stack, i);
 
           if (attr->end_index == iterator->start_index)
-            g_ptr_array_remove_index (iterator->attribute_stack, i); /* Can't use index_fast :( */
-          else
-            iterator->end_index = MIN (iterator->end_index, attr->end_index);
+            continue;
+
+          iterator->end_index = MIN (iterator->end_index, attr->end_index);
+          g_ptr_array_index (iterator->attribute_stack, j++) = attr;
         }
+
+      g_ptr_array_set_size (iterator->attribute_stack, j);
     }
 
   while (1)
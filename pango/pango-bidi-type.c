@@ -30,6 +30,7 @@
 #include "pango-bidi-type.h"
 #include "pango-utils.h"
 #include "pango-utils-private.h"
+#include "pango-utils-internal.h"
 
 /**
  * pango_bidi_type_for_unichar:
@@ -164,6 +165,21 @@ pango_log2vis_fill_embedding_levels (const gchar    *text,
       break;
     }
 
+  /* ASCII has no RTL, Arabic or isolate types, and its only strong
+   * characters are the (LTR) letters. So it always ends up in the
+   * all-LTR case below, unless the base direction has an RTL taste,
+   * and we can skip the per-character type lookups.
+   */
+  if (fribidi_base_dir != FRIBIDI_PAR_RTL &&
+      _pango_utf8_is_ascii (text, length) &&
+      (fribidi_base_dir != FRIBIDI_PAR_WRTL ||
+       _pango_ascii_has_letter (text, length)))
+    {
+      memset (embedding_levels_list, 0, n_chars);
+      *pbase_dir = PANGO_DIRECTION_LTR;
+      return;
+    }
+
   if (n_chars < 64)
     {
       bidi_types = bidi_types_;
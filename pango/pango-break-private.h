@@ -0,0 +1,34 @@
+/* Pango
+ * pango-break-private.h: Breaking, private definitions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PANGO_BREAK_PRIVATE_H__
+#define __PANGO_BREAK_PRIVATE_H__
+
+#include <pango/pango-break.h>
+
+G_BEGIN_DECLS
+
+void    pango_default_break_lines       (const char    *text,
+                                         int            length,
+                                         PangoLogAttr  *attrs,
+                                         int            attrs_len);
+
+G_END_DECLS
+
+#endif /* __PANGO_BREAK_PRIVATE_H__ */
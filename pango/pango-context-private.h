@@ -23,6 +23,7 @@
 #define __PANGO_CONTEXT_PRIVATE_H__
 
 #include <pango/pango-context.h>
+#include "pango-shape-private.h"
 
 G_BEGIN_DECLS
 
@@ -48,6 +49,8 @@ struct _PangoContext
   PangoFontMetrics *metrics;
 
   gboolean round_glyph_positions;
+
+  PangoShapeCache *shape_cache;
 };
 
 G_END_DECLS
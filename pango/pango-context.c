@@ -105,6 +105,8 @@ pango_context_finalize (GObject *object)
   if (context->metrics)
     pango_font_metrics_unref (context->metrics);
 
+  g_clear_pointer (&context->shape_cache, pango_shape_cache_free);
+
   G_OBJECT_CLASS (pango_context_parent_class)->finalize (object);
 }
 
@@ -848,3 +850,97 @@ pango_context_get_round_glyph_positions (PangoContext *context)
 {
   return context->round_glyph_positions;
 }
+
+/**
+ * pango_context_set_shape_cache_size:
+ * @context: a `PangoContext`
+ * @size: the maximum number of entries in the cache, or 0
+ *
+ * Sets the size of the shape cache of @context.
+ *
+ * The shape cache keeps the results of shaping words with
+ * a given font, so that text that repeats a lot, such as
+ * the contents of tables, or log output, does not have to
+ * be shaped again every time it is laid out by `PangoLayout`.
+ * When the cache is full, the least recently used entries
+ * are dropped.
+ *
+ * The cache shapes words separately only for fonts that have
+ * no OpenType lookups involving the space glyph, and otherwise
+ * caches whole runs of text. This keeps kerning and ligatures
+ * across spaces intact in the fonts we know of, but it is a
+ * heuristic, so with unusual fonts the results can differ from
+ * shaping without the cache. The cache does not keep fonts alive.
+ *
+ * A size of 0 turns the cache off, which is the default.
+ *
+ * Since: 1.60
+ */
+void
+pango_context_set_shape_cache_size (PangoContext *context,
+                                    guint         size)
+{
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+
+  if (size == 0)
+    g_clear_pointer (&context->shape_cache, pango_shape_cache_free);
+  else if (context->shape_cache)
+    pango_shape_cache_set_size (context->shape_cache, size);
+  else
+    context->shape_cache = pango_shape_cache_new (size);
+}
+
+/**
+ * pango_context_get_shape_cache_size:
+ * @context: a `PangoContext`
+ *
+ * Returns the size of the shape cache of @context.
+ *
+ * See [method@Pango.Context.set_shape_cache_size].
+ *
+ * Returns: the maximum number of entries in the cache,
+ *   or 0 if the cache is turned off
+ *
+ * Since: 1.60
+ */
+guint
+pango_context_get_shape_cache_size (PangoContext *context)
+{
+  g_return_val_if_fail (PANGO_IS_CONTEXT (context), 0);
+
+  if (context->shape_cache)
+    return pango_shape_cache_get_size (context->shape_cache);
+
+  return 0;
+}
+
+/**
+ * pango_context_get_shape_cache_stats:
+ * @context: a `PangoContext`
+ * @hits: (out) (optional): return location for the number of hits
+ * @misses: (out) (optional): return location for the number of misses
+ *
+ * Returns how often shaping could use the results in the
+ * shape cache of @context, and how often it could not.
+ *
+ * The counts start at 0 when the cache is turned on.
+ *
+ * Since: 1.60
+ */
+void
+pango_context_get_shape_cache_stats (PangoContext *context,
+                                     guint        *hits,
+                                     guint        *misses)
+{
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+
+  if (context->shape_cache)
+    pango_shape_cache_get_stats (context->shape_cache, hits, misses);
+  else
+    {
+      if (hits)
+        *hits = 0;
+      if (misses)
+        *misses = 0;
+    }
+}
@@ -111,6 +111,16 @@ void                    pango_context_set_round_glyph_positions (PangoContext
 PANGO_AVAILABLE_IN_1_44
 gboolean                pango_context_get_round_glyph_positions (PangoContext                 *context);
 
+PANGO_AVAILABLE_IN_1_60
+void                    pango_context_set_shape_cache_size      (PangoContext                 *context,
+                                                                 guint                         size);
+PANGO_AVAILABLE_IN_1_60
+guint                   pango_context_get_shape_cache_size      (PangoContext                 *context);
+PANGO_AVAILABLE_IN_1_60
+void                    pango_context_get_shape_cache_stats     (PangoContext                 *context,
+                                                                 guint                        *hits,
+                                                                 guint                        *misses);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PangoContext, g_object_unref)
 
 G_END_DECLS
@@ -33,6 +33,9 @@ G_BEGIN_DECLS
 PANGO_AVAILABLE_IN_ALL
 PangoFontMetrics *pango_font_metrics_new (void);
 
+PANGO_AVAILABLE_IN_ALL
+PangoFontDescription *pango_font_description_intern (const PangoFontDescription *desc);
+
 typedef struct {
   PangoLanguage ** (* get_languages) (PangoFont *font);
 
@@ -49,6 +52,11 @@ typedef struct {
                                    PangoMatrix *matrix);
   int              (* get_absolute_size) (PangoFont *font);
   PangoVariant     (* get_variant) (PangoFont *font);
+  void             (* get_glyph_extents_batch) (PangoFont            *font,
+                                                const PangoGlyph     *glyphs,
+                                                guint                 n_glyphs,
+                                                PangoRectangle       *ink_rects,
+                                                PangoRectangle       *logical_rects);
 } PangoFontClassPrivate;
 
 gboolean pango_font_is_hinted         (PangoFont *font);
@@ -58,6 +66,13 @@ void     pango_font_get_scale_factors (PangoFont *font,
 void     pango_font_get_matrix        (PangoFont   *font,
                                        PangoMatrix *matrix);
 
+PANGO_AVAILABLE_IN_ALL
+void     pango_font_get_glyph_extents_batch (PangoFont        *font,
+                                             const PangoGlyph *glyphs,
+                                             guint             n_glyphs,
+                                             PangoRectangle   *ink_rects,
+                                             PangoRectangle   *logical_rects);
+
 static inline int pango_font_get_absolute_size (PangoFont *font)
 {
   GTypeClass *klass = (GTypeClass *) PANGO_FONT_GET_CLASS (font);
@@ -39,6 +39,13 @@ typedef struct {
                                const char    *filename,
                                GError       **error);
 
+  /* Start any work that @fontset will need later, without blocking */
+  void     (* prefetch_fontset) (PangoFontMap *fontmap,
+                                 PangoFontset *fontset);
+
+  /* Whether fonts and fontsets can be used from other threads */
+  gboolean threadsafe;
+
 } PangoFontMapClassPrivate;
 
 PANGO_DEPRECATED_IN_1_38
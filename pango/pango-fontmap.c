@@ -628,6 +628,288 @@ pango_font_map_add_font_file (PangoFontMap  *fontmap,
   return pclass->add_font_file (fontmap, filename, error);
 }
 
+static GPtrArray *
+pango_font_map_load_prefetch_fontsets (PangoFontMap                       *fontmap,
+                                       PangoContext                       *context,
+                                       const PangoFontDescription * const *descs,
+                                       PangoLanguage * const              *languages)
+{
+  PangoFontMapClassPrivate *pclass;
+  PangoLanguage *context_languages[2] = { NULL, NULL };
+  GPtrArray *fontsets;
+  int i, j;
+
+  pclass = g_type_class_get_private ((GTypeClass *) PANGO_FONT_MAP_GET_CLASS (fontmap),
+                                     PANGO_TYPE_FONT_MAP);
+
+  if (!languages)
+    {
+      context_languages[0] = pango_context_get_language (context);
+      languages = context_languages;
+    }
+
+  fontsets = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (i = 0; descs[i]; i++)
+    for (j = 0; languages[j]; j++)
+      {
+        PangoFontset *fontset;
+
+        fontset = pango_font_map_load_fontset (fontmap, context, descs[i], languages[j]);
+        if (!fontset)
+          continue;
+
+        if (pclass->prefetch_fontset)
+          pclass->prefetch_fontset (fontmap, fontset);
+
+        g_ptr_array_add (fontsets, fontset);
+      }
+
+  return fontsets;
+}
+
+static gboolean
+get_first_font (PangoFontset *fontset G_GNUC_UNUSED,
+                PangoFont    *font,
+                gpointer      data)
+{
+  PangoFont **first = data;
+
+  *first = g_object_ref (font);
+
+  return TRUE;
+}
+
+/* Does the work that the first use of the primary
+ * font of @fontset would do: wait for it to be loaded,
+ * and create its coverage and its hb_face_t
+ */
+static void
+pango_font_map_warm_fontset (PangoFontset *fontset)
+{
+  PangoFont *font = NULL;
+  PangoLanguage *language;
+  PangoCoverage *coverage;
+
+  pango_fontset_foreach (fontset, get_first_font, &font);
+  if (!font)
+    return;
+
+  language = PANGO_FONTSET_GET_CLASS (fontset)->get_language (fontset);
+
+  coverage = pango_font_get_coverage (font, language);
+  g_clear_object (&coverage);
+
+  pango_font_get_hb_font (font);
+
+  g_object_unref (font);
+}
+
+/**
+ * pango_font_map_prefetch:
+ * @fontmap: a `PangoFontMap`
+ * @context: a `PangoContext`
+ * @descs: (array zero-terminated=1): the font descriptions that
+ *   will be needed
+ * @languages: (nullable) (array zero-terminated=1): the languages
+ *   that will be needed, or %NULL to use the language of @context
+ *
+ * Loads the fonts that will be needed for the given font
+ * descriptions and languages ahead of time.
+ *
+ * The fontsets for every combination of @descs and @languages
+ * are loaded. The font map is told to start the work that it
+ * needs for the fallback fonts, and the primary font of each
+ * fontset is loaded, together with its coverage and font data.
+ *
+ * This function blocks until the primary fonts are ready.
+ * See [method@Pango.FontMap.prefetch_async] for a variant
+ * that does not block.
+ *
+ * Since: 1.60
+ */
+void
+pango_font_map_prefetch (PangoFontMap                       *fontmap,
+                         PangoContext                       *context,
+                         const PangoFontDescription * const *descs,
+                         PangoLanguage * const              *languages)
+{
+  GPtrArray *fontsets;
+  guint i;
+
+  g_return_if_fail (PANGO_IS_FONT_MAP (fontmap));
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+  g_return_if_fail (descs != NULL);
+
+  fontsets = pango_font_map_load_prefetch_fontsets (fontmap, context, descs, languages);
+
+  for (i = 0; i < fontsets->len; i++)
+    pango_font_map_warm_fontset (g_ptr_array_index (fontsets, i));
+
+  g_ptr_array_unref (fontsets);
+}
+
+typedef struct {
+  GPtrArray *fontsets;
+  guint next;
+} PrefetchData;
+
+static void
+prefetch_data_free (gpointer data)
+{
+  PrefetchData *pd = data;
+
+  g_ptr_array_unref (pd->fontsets);
+  g_free (pd);
+}
+
+/* Warms the fontsets in a thread, for font maps that can
+ * be used from other threads. Waiting for Fontconfig and
+ * loading coverage and font data don't block the main loop
+ * then.
+ */
+static void
+prefetch_thread (GTask        *task,
+                 gpointer      source_object G_GNUC_UNUSED,
+                 gpointer      task_data,
+                 GCancellable *cancellable G_GNUC_UNUSED)
+{
+  PrefetchData *pd = task_data;
+
+  for (; pd->next < pd->fontsets->len; pd->next++)
+    {
+      if (g_task_return_error_if_cancelled (task))
+        return;
+
+      pango_font_map_warm_fontset (g_ptr_array_index (pd->fontsets, pd->next));
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/* Warms one fontset per iteration of the main loop, for
+ * font maps whose fonts may only be used from the thread
+ * that owns the main context.
+ */
+static gboolean
+prefetch_idle (gpointer data)
+{
+  GTask *task = data;
+  PrefetchData *pd = g_task_get_task_data (task);
+
+  if (g_task_return_error_if_cancelled (task))
+    return G_SOURCE_REMOVE;
+
+  if (pd->next < pd->fontsets->len)
+    {
+      pango_font_map_warm_fontset (g_ptr_array_index (pd->fontsets, pd->next));
+      pd->next++;
+    }
+
+  if (pd->next < pd->fontsets->len)
+    return G_SOURCE_CONTINUE;
+
+  g_task_return_boolean (task, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * pango_font_map_prefetch_async:
+ * @fontmap: a `PangoFontMap`
+ * @context: a `PangoContext`
+ * @descs: (array zero-terminated=1): the font descriptions that
+ *   will be needed
+ * @languages: (nullable) (array zero-terminated=1): the languages
+ *   that will be needed, or %NULL to use the language of @context
+ * @cancellable: (nullable): a `GCancellable`
+ * @callback: (scope async): callback to call when the fonts are ready
+ * @user_data: data to pass to @callback
+ *
+ * Asynchronously loads the fonts that will be needed for
+ * the given font descriptions and languages.
+ *
+ * This is the asynchronous version of [method@Pango.FontMap.prefetch].
+ * The fontsets are loaded right away, and the font map starts its
+ * expensive work in the background where it can. The fonts are then
+ * prepared in a worker thread if the font map supports being used
+ * from several threads, and otherwise one fontset at a time from idle
+ * callbacks in the thread-default main context of the calling thread.
+ *
+ * Call [method@Pango.FontMap.prefetch_finish] from @callback
+ * to get the result.
+ *
+ * Since: 1.60
+ */
+void
+pango_font_map_prefetch_async (PangoFontMap                       *fontmap,
+                               PangoContext                       *context,
+                               const PangoFontDescription * const *descs,
+                               PangoLanguage * const              *languages,
+                               GCancellable                       *cancellable,
+                               GAsyncReadyCallback                 callback,
+                               gpointer                            user_data)
+{
+  PangoFontMapClassPrivate *pclass;
+  PrefetchData *pd;
+  GTask *task;
+
+  g_return_if_fail (PANGO_IS_FONT_MAP (fontmap));
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+  g_return_if_fail (descs != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (fontmap, cancellable, callback, user_data);
+  g_task_set_source_tag (task, pango_font_map_prefetch_async);
+
+  pd = g_new0 (PrefetchData, 1);
+  pd->fontsets = pango_font_map_load_prefetch_fontsets (fontmap, context, descs, languages);
+  g_task_set_task_data (task, pd, prefetch_data_free);
+
+  pclass = g_type_class_get_private ((GTypeClass *) PANGO_FONT_MAP_GET_CLASS (fontmap),
+                                     PANGO_TYPE_FONT_MAP);
+
+  if (pclass->threadsafe)
+    g_task_run_in_thread (task, prefetch_thread);
+  else
+    {
+      GSource *source;
+
+      source = g_idle_source_new ();
+      g_source_set_static_name (source, "[pango] prefetch fonts");
+      g_task_attach_source (task, source, prefetch_idle);
+      g_source_unref (source);
+    }
+
+  g_object_unref (task);
+}
+
+/**
+ * pango_font_map_prefetch_finish:
+ * @fontmap: a `PangoFontMap`
+ * @result: the `GAsyncResult` passed to the callback
+ * @error: return location for an error
+ *
+ * Finishes an operation that was started with
+ * [method@Pango.FontMap.prefetch_async].
+ *
+ * Returns: %TRUE if the fonts were loaded, %FALSE if
+ *   the operation was cancelled
+ *
+ * Since: 1.60
+ */
+gboolean
+pango_font_map_prefetch_finish (PangoFontMap  *fontmap,
+                                GAsyncResult  *result,
+                                GError       **error)
+{
+  g_return_val_if_fail (PANGO_IS_FONT_MAP (fontmap), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, fontmap), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == pango_font_map_prefetch_async, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 static GType
 pango_font_map_get_item_type (GListModel *list)
 {
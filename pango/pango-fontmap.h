@@ -22,6 +22,7 @@
 #ifndef __PANGO_FONTMAP_H__
 #define __PANGO_FONTMAP_H__
 
+#include <gio/gio.h>
 #include <pango/pango-types.h>
 #include <pango/pango-font.h>
 #include <pango/pango-fontset.h>
@@ -136,6 +137,26 @@ gboolean      pango_font_map_add_font_file (PangoFontMap                 *fontma
                                             const char                   *filename,
                                             GError                      **error);
 
+PANGO_AVAILABLE_IN_1_60
+void          pango_font_map_prefetch        (PangoFontMap                        *fontmap,
+                                              PangoContext                        *context,
+                                              const PangoFontDescription * const  *descs,
+                                              PangoLanguage * const               *languages);
+
+PANGO_AVAILABLE_IN_1_60
+void          pango_font_map_prefetch_async  (PangoFontMap                        *fontmap,
+                                              PangoContext                        *context,
+                                              const PangoFontDescription * const  *descs,
+                                              PangoLanguage * const               *languages,
+                                              GCancellable                        *cancellable,
+                                              GAsyncReadyCallback                  callback,
+                                              gpointer                             user_data);
+
+PANGO_AVAILABLE_IN_1_60
+gboolean      pango_font_map_prefetch_finish (PangoFontMap                        *fontmap,
+                                              GAsyncResult                        *result,
+                                              GError                             **error);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(PangoFontMap, g_object_unref)
 
 G_END_DECLS
@@ -107,6 +107,118 @@ pango_fontset_foreach (PangoFontset           *fontset,
   PANGO_FONTSET_GET_CLASS (fontset)->foreach (fontset, func, data);
 }
 
+typedef struct {
+  const gunichar *chars;
+  guint *pending;
+  guint n_pending;
+  PangoFont **fonts;
+  int *positions;
+  int position;
+} GetFontsInfo;
+
+static gboolean
+get_fonts_foreach (PangoFontset *fontset,
+                   PangoFont    *font,
+                   gpointer      data)
+{
+  GetFontsInfo *info = data;
+  guint i, j;
+
+  if (G_UNLIKELY (!font))
+    return FALSE;
+
+  /* Split the characters that are still pending into
+   * those that this font covers and the rest
+   */
+  for (i = 0, j = 0; i < info->n_pending; i++)
+    {
+      guint index = info->pending[i];
+
+      if (pango_font_has_char (font, info->chars[index]))
+        {
+          info->fonts[index] = font;
+          if (info->positions)
+            info->positions[index] = info->position;
+        }
+      else
+        info->pending[j++] = index;
+    }
+
+  info->n_pending = j;
+  info->position++;
+
+  return info->n_pending == 0;
+}
+
+/**
+ * pango_fontset_get_fonts:
+ * @fontset: a `PangoFontset`
+ * @chars: (array length=n_chars): Unicode characters
+ * @n_chars: the length of @chars
+ * @positions: (out caller-allocates) (array length=n_chars) (optional):
+ *   return location for the positions of the fonts in @fontset
+ *
+ * Finds the first font in @fontset that has a glyph for each
+ * of the characters in @chars.
+ *
+ * This gives the same fonts as checking each character against the
+ * fonts of @fontset with [method@Pango.Font.has_char], in the order
+ * of [method@Pango.Fontset.foreach], but it goes over the fonts only
+ * once for all the characters, and stops as soon as all of them are
+ * covered. This is much faster when many characters need fallback
+ * fonts.
+ *
+ * Characters that no font in @fontset has a glyph for get a %NULL
+ * font, and a position that is the number of fonts in @fontset.
+ *
+ * Returns: (array length=n_chars) (transfer container) (nullable):
+ *   the font for each character, owned by @fontset. Free the array
+ *   with g_free(). %NULL if @n_chars is 0
+ *
+ * Since: 1.60
+ */
+PangoFont **
+pango_fontset_get_fonts (PangoFontset   *fontset,
+                         const gunichar *chars,
+                         guint           n_chars,
+                         int            *positions)
+{
+  GetFontsInfo info;
+  PangoFont **fonts;
+  guint i;
+
+  g_return_val_if_fail (PANGO_IS_FONTSET (fontset), NULL);
+  g_return_val_if_fail (chars != NULL || n_chars == 0, NULL);
+
+  if (n_chars == 0)
+    return NULL;
+
+  fonts = g_new (PangoFont *, n_chars);
+
+  info.chars = chars;
+  info.pending = g_new (guint, n_chars);
+  info.n_pending = n_chars;
+  info.fonts = fonts;
+  info.positions = positions;
+  info.position = 0;
+
+  for (i = 0; i < n_chars; i++)
+    {
+      info.pending[i] = i;
+      fonts[i] = NULL;
+    }
+
+  pango_fontset_foreach (fontset, get_fonts_foreach, &info);
+
+  if (positions)
+    for (i = 0; i < info.n_pending; i++)
+      positions[info.pending[i]] = info.position;
+
+  g_free (info.pending);
+
+  return fonts;
+}
+
 static gboolean
 get_first_metrics_foreach (PangoFontset  *fontset,
                            PangoFont     *font,
@@ -127,6 +127,11 @@ PANGO_AVAILABLE_IN_1_4
 void                    pango_fontset_foreach           (PangoFontset                   *fontset,
                                                          PangoFontsetForeachFunc         func,
                                                          gpointer                        data);
+PANGO_AVAILABLE_IN_1_60
+PangoFont **           pango_fontset_get_fonts         (PangoFontset                   *fontset,
+                                                         const gunichar                 *chars,
+                                                         guint                           n_chars,
+                                                         int                            *positions);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PangoFontset, g_object_unref)
 
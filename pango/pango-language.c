@@ -121,6 +121,103 @@ lang_hash (gconstpointer key)
   return h;
 }
 
+/* Interned languages are kept in an open-addressing hash table
+ * that can be read without taking a lock, since looking up
+ * languages is very common, from many threads.
+ *
+ * Slots are only ever filled, never cleared or changed, and
+ * they are filled with fully initialized languages. When the
+ * table gets too full, a bigger copy is made and published
+ * in its place. The old tables are never freed, since readers
+ * may still be looking at them; they stay reachable from the new
+ * table, and take less space in total than the current table.
+ *
+ * Readers that don't find a language take the lock, and look
+ * again before adding it, so they can't miss a language that
+ * is being added concurrently.
+ */
+
+typedef struct _LangTable LangTable;
+
+struct _LangTable {
+  LangTable *prev;      /* The table that this one replaced */
+  guint mask;
+  guint n_entries;
+  char *entries[1];
+};
+
+#define LANG_TABLE_INITIAL_SIZE 64
+
+G_LOCK_DEFINE_STATIC (lang_from_string);
+static LangTable *lang_table = NULL; /* MT-safe, set atomically */
+
+static LangTable *
+lang_table_new (guint size)
+{
+  LangTable *table;
+
+  table = g_malloc0 (G_STRUCT_OFFSET (LangTable, entries) + size * sizeof (char *));
+  table->mask = size - 1;
+
+  return table;
+}
+
+static char *
+lang_table_lookup (LangTable  *table,
+                   const char *language,
+                   guint       hash)
+{
+  guint i;
+
+  for (i = hash & table->mask; ; i = (i + 1) & table->mask)
+    {
+      char *entry = g_atomic_pointer_get (&table->entries[i]);
+
+      if (!entry)
+        return NULL;
+
+      if (lang_equal (entry, language))
+        return entry;
+    }
+}
+
+/* Must be called with the lock held */
+static void
+lang_table_insert (LangTable *table,
+                   char      *language,
+                   guint      hash)
+{
+  guint i;
+
+  for (i = hash & table->mask; table->entries[i]; i = (i + 1) & table->mask)
+    ;
+
+  g_atomic_pointer_set (&table->entries[i], language);
+  table->n_entries++;
+}
+
+/* Must be called with the lock held */
+static LangTable *
+lang_table_grow (LangTable *table)
+{
+  LangTable *bigger;
+  guint i;
+
+  bigger = lang_table_new (2 * (table->mask + 1));
+  bigger->prev = table;
+
+  for (i = 0; i <= table->mask; i++)
+    {
+      if (table->entries[i])
+        lang_table_insert (bigger, table->entries[i], lang_hash (table->entries[i]));
+    }
+
+  return bigger;
+}
+
+static void pango_language_private_init_records (PangoLanguage        *language,
+                                                 PangoLanguagePrivate *priv);
+
 static PangoLanguage *
 pango_language_copy (PangoLanguage *language)
 {
@@ -329,23 +426,37 @@ pango_language_get_default (void)
 PangoLanguage *
 pango_language_from_string (const char *language)
 {
-  G_LOCK_DEFINE_STATIC (lang_from_string);
-  static GHashTable *hash = NULL; /* MT-safe */
   PangoLanguagePrivate *priv;
+  LangTable *table;
   char *result;
+  guint hash;
   int len;
   char *p;
 
   if (language == NULL)
     return NULL;
 
+  hash = lang_hash (language);
+
+  table = g_atomic_pointer_get (&lang_table);
+  if (G_LIKELY (table))
+    {
+      result = lang_table_lookup (table, language, hash);
+      if (result)
+        return (PangoLanguage *)result;
+    }
+
   G_LOCK (lang_from_string);
 
-  if (G_UNLIKELY (!hash))
-    hash = g_hash_table_new (lang_hash, lang_equal);
+  table = lang_table;
+  if (G_UNLIKELY (!table))
+    {
+      table = lang_table_new (LANG_TABLE_INITIAL_SIZE);
+      g_atomic_pointer_set (&lang_table, table);
+    }
   else
     {
-      result = g_hash_table_lookup (hash, language);
+      result = lang_table_lookup (table, language, hash);
       if (result)
         goto out;
     }
@@ -363,7 +474,16 @@ pango_language_from_string (const char *language)
   while ((*(p++) = canon_map[*(guchar *)language++]))
     ;
 
-  g_hash_table_insert (hash, result, result);
+  pango_language_private_init_records ((PangoLanguage *)result, priv);
+
+  /* Keep the table at most half full */
+  if (2 * (table->n_entries + 1) > table->mask + 1)
+    {
+      table = lang_table_grow (table);
+      g_atomic_pointer_set (&lang_table, table);
+    }
+
+  lang_table_insert (table, result, hash);
 
 out:
   G_UNLOCK (lang_from_string);
@@ -684,6 +804,23 @@ pango_language_get_scripts (PangoLanguage *language,
   return (const PangoScript *) script_for_lang->scripts;
 }
 
+/* Look up the records for the language when it is created,
+ * so that later lookups never need to search the tables
+ */
+static void
+pango_language_private_init_records (PangoLanguage        *language,
+                                     PangoLanguagePrivate *priv)
+{
+  priv->lang_info = find_best_lang_match (language,
+                                          lang_texts,
+                                          G_N_ELEMENTS (lang_texts),
+                                          sizeof (*lang_texts));
+  priv->script_for_lang = find_best_lang_match (language,
+                                                pango_script_for_lang,
+                                                G_N_ELEMENTS (pango_script_for_lang),
+                                                sizeof (*pango_script_for_lang));
+}
+
 /**
  * pango_language_includes_script:
  * @language: (nullable): a `PangoLanguage`
@@ -81,8 +81,13 @@ struct _PangoLayout
   /* Not copied during _copy() */
 
   PangoLogAttr *log_attrs;	/* Logical attributes for layout's text */
+  gboolean log_attrs_full;	/* Whether log_attrs has word and sentence information */
   GSList *lines;
   guint line_count;		/* Number of lines in @lines. 0 if lines is %NULL */
+
+  GHashTable *paragraphs;	/* Per-paragraph results of the last check_lines */
+  guint paragraph_generation;	/* Incremented for each check_lines */
+  gboolean relayout;		/* Whether check_lines ran before for the current text */
 };
 
 typedef struct _Extents Extents;
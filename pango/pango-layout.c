@@ -76,6 +76,7 @@
 #include "config.h"
 #include "pango-glyph.h"                /* For pango_shape() */
 #include "pango-break.h"
+#include "pango-break-private.h"
 #include "pango-item-private.h"
 #include "pango-engine.h"
 #include "pango-impl-utils.h"
@@ -88,6 +89,7 @@
 
 #include "pango-layout-private.h"
 #include "pango-attributes-private.h"
+#include "pango-context-private.h"
 #include "pango-font-private.h"
 
 
@@ -174,9 +176,11 @@ check_invalid (PangoLayoutIter *iter,
 
 static void check_context_changed  (PangoLayout *layout);
 static void layout_changed  (PangoLayout *layout);
+static void clear_paragraph_lines  (PangoLayout *layout);
 
 static void pango_layout_clear_lines (PangoLayout *layout);
 static void pango_layout_check_lines (PangoLayout *layout);
+static void pango_layout_ensure_full_log_attrs (PangoLayout *layout);
 
 static PangoAttrList *pango_layout_get_effective_attributes (PangoLayout *layout);
 
@@ -228,6 +232,10 @@ pango_layout_init (PangoLayout *layout)
   layout->lines = NULL;
   layout->line_count = 0;
 
+  layout->paragraphs = NULL;
+  layout->paragraph_generation = 0;
+  layout->relayout = FALSE;
+
   layout->tab_width = -1;
   layout->decimal = 0;
   layout->unknown_glyphs_count = -1;
@@ -255,6 +263,7 @@ pango_layout_finalize (GObject *object)
 
   pango_layout_clear_lines (layout);
   g_free (layout->log_attrs);
+  g_clear_pointer (&layout->paragraphs, g_hash_table_unref);
 
   if (layout->context)
     g_object_unref (layout->context);
@@ -375,6 +384,7 @@ pango_layout_set_width (PangoLayout *layout,
   if (width != layout->width)
     {
       layout->width = width;
+      clear_paragraph_lines (layout);
       layout_changed (layout);
     }
 }
@@ -437,6 +447,7 @@ pango_layout_set_height (PangoLayout *layout,
   if (height != layout->height)
     {
       layout->height = height;
+      clear_paragraph_lines (layout);
 
       /* Do not invalidate if the number of lines requested is
        * larger than the total number of lines in layout.
@@ -491,6 +502,7 @@ pango_layout_set_wrap (PangoLayout   *layout,
   if (layout->wrap != wrap)
     {
       layout->wrap = wrap;
+      clear_paragraph_lines (layout);
 
       if (layout->width != -1)
         layout_changed (layout);
@@ -566,6 +578,7 @@ pango_layout_set_indent (PangoLayout *layout,
   if (indent != layout->indent)
     {
       layout->indent = indent;
+      clear_paragraph_lines (layout);
       layout_changed (layout);
     }
 }
@@ -831,6 +844,7 @@ pango_layout_set_justify (PangoLayout *layout,
   if (justify != layout->justify)
     {
       layout->justify = justify;
+      clear_paragraph_lines (layout);
 
       if (layout->is_ellipsized ||
           layout->is_wrapped ||
@@ -879,6 +893,7 @@ pango_layout_set_justify_last_line (PangoLayout *layout,
   if (justify != layout->justify_last_line)
     {
       layout->justify_last_line = justify;
+      clear_paragraph_lines (layout);
 
       if (layout->justify)
         layout_changed (layout);
@@ -984,6 +999,7 @@ pango_layout_set_alignment (PangoLayout   *layout,
   if (alignment != layout->alignment)
     {
       layout->alignment = alignment;
+      clear_paragraph_lines (layout);
       layout_changed (layout);
     }
 }
@@ -1034,6 +1050,7 @@ pango_layout_set_tabs (PangoLayout   *layout,
   if (tabs != layout->tabs)
     {
       g_clear_pointer (&layout->tabs, pango_tab_array_free);
+      clear_paragraph_lines (layout);
 
       if (tabs)
         {
@@ -1094,6 +1111,7 @@ pango_layout_set_single_paragraph_mode (PangoLayout *layout,
   if (layout->single_paragraph != setting)
     {
       layout->single_paragraph = setting;
+      clear_paragraph_lines (layout);
       layout_changed (layout);
     }
 }
@@ -1149,6 +1167,7 @@ pango_layout_set_ellipsize (PangoLayout        *layout,
   if (ellipsize != layout->ellipsize)
     {
       layout->ellipsize = ellipsize;
+      clear_paragraph_lines (layout);
 
       if (layout->is_ellipsized || layout->is_wrapped)
         layout_changed (layout);
@@ -1204,6 +1223,37 @@ pango_layout_is_ellipsized (PangoLayout *layout)
   return layout->is_ellipsized;
 }
 
+/* Validates @text, and replaces invalid bytes with -1.
+ * Returns %FALSE if @text was not valid UTF-8.
+ */
+static gboolean
+sanitize_text (char *text)
+{
+  char *start, *end;
+
+  start = text;
+  for (;;) {
+    gboolean valid;
+
+    valid = g_utf8_validate (start, -1, (const char **)&end);
+
+    if (!*end)
+      break;
+
+    /* Replace invalid bytes with -1.  The -1 will be converted to
+     * ((gunichar) -1) by glib, and that in turn yields a glyph value of
+     * ((PangoGlyph) -1) by PANGO_GET_UNKNOWN_GLYPH(-1),
+     * and that's PANGO_GLYPH_INVALID_INPUT.
+     */
+    if (!valid)
+      *end++ = -1;
+
+    start = end;
+  }
+
+  return start == text;
+}
+
 /**
  * pango_layout_set_text:
  * @layout: a `PangoLayout`
@@ -1229,7 +1279,7 @@ pango_layout_set_text (PangoLayout *layout,
                        const char  *text,
                        int          length)
 {
-  char *old_text, *start, *end;
+  char *old_text;
 
   g_return_if_fail (layout != NULL);
   g_return_if_fail (length == 0 || text != NULL);
@@ -1254,33 +1304,119 @@ pango_layout_set_text (PangoLayout *layout,
       layout->text = g_malloc0 (1);
     }
 
-  /* validate it, and replace invalid bytes with -1 */
-  start = layout->text;
-  for (;;) {
-    gboolean valid;
+  if (!sanitize_text (layout->text))
+    /* TODO: Write out the beginning excerpt of text? */
+    g_warning ("Invalid UTF-8 string passed to pango_layout_set_text()");
 
-    valid = g_utf8_validate (start, -1, (const char **)&end);
+  layout->n_chars = pango_utf8_strlen (layout->text, -1);
+  layout->length = strlen (layout->text);
+  layout->relayout = FALSE;
 
-    if (!*end)
-      break;
+  g_clear_pointer (&layout->log_attrs, g_free);
+  layout_changed (layout);
 
-    /* Replace invalid bytes with -1.  The -1 will be converted to
-     * ((gunichar) -1) by glib, and that in turn yields a glyph value of
-     * ((PangoGlyph) -1) by PANGO_GET_UNKNOWN_GLYPH(-1),
-     * and that's PANGO_GLYPH_INVALID_INPUT.
-     */
-    if (!valid)
-      *end++ = -1;
+  g_free (old_text);
+}
 
-    start = end;
-  }
+/**
+ * pango_layout_replace_text:
+ * @layout: a `PangoLayout`
+ * @start_index: byte index of the first byte to replace
+ * @length: number of bytes to replace
+ * @text: the replacement text
+ * @text_length: length of @text in bytes, or -1 if @text
+ *   is nul-terminated
+ *
+ * Replaces a range of the text of the layout.
+ *
+ * The range from @start_index to @start_index + @length must
+ * lie within the text of @layout, and start and end at character
+ * boundaries. @text is validated the same way as for
+ * [method@Pango.Layout.set_text].
+ *
+ * The attribute list of the layout, if any, is replaced by a copy
+ * whose indices are updated for the change, as with
+ * [method@Pango.AttrList.update].
+ *
+ * Editing a layout this way is cheaper than calling
+ * [method@Pango.Layout.set_text] with the modified text for
+ * layouts that consist of many paragraphs, since only the
+ * paragraphs that are affected by the change will be laid out
+ * again. Note that the same is true for other changes of the text
+ * or attributes that leave most paragraphs intact; this function
+ * just saves the copying of the text.
+ *
+ * Since: 1.60
+ */
+void
+pango_layout_replace_text (PangoLayout *layout,
+                           int          start_index,
+                           int          length,
+                           const char  *text,
+                           int          text_length)
+{
+  char *old_text;
+  char *new_text;
+  char *insert;
+  int insert_length;
+  int new_length;
 
-  if (start != layout->text)
-    /* TODO: Write out the beginning excerpt of text? */
-    g_warning ("Invalid UTF-8 string passed to pango_layout_set_text()");
+  g_return_if_fail (PANGO_IS_LAYOUT (layout));
+  g_return_if_fail (text_length == 0 || text != NULL);
+  g_return_if_fail (start_index >= 0 && length >= 0);
+  g_return_if_fail (start_index + length <= layout->length);
 
-  layout->n_chars = pango_utf8_strlen (layout->text, -1);
-  layout->length = strlen (layout->text);
+  if (G_UNLIKELY (!layout->text))
+    pango_layout_set_text (layout, NULL, 0);
+
+  g_return_if_fail ((layout->text[start_index] & 0xc0) != 0x80);
+  g_return_if_fail ((layout->text[start_index + length] & 0xc0) != 0x80);
+
+  if (text_length < 0)
+    insert = g_strdup (text);
+  else if (text_length > 0)
+    insert = g_strndup (text, text_length);
+  else
+    insert = g_strdup ("");
+
+  if (!sanitize_text (insert))
+    g_warning ("Invalid UTF-8 string passed to pango_layout_replace_text()");
+
+  insert_length = strlen (insert);
+
+  if (length == 0 && insert_length == 0)
+    {
+      g_free (insert);
+      return;
+    }
+
+  old_text = layout->text;
+  new_length = layout->length - length + insert_length;
+  new_text = g_malloc (new_length + 1);
+
+  memcpy (new_text, old_text, start_index);
+  memcpy (new_text + start_index, insert, insert_length);
+  memcpy (new_text + start_index + insert_length,
+          old_text + start_index + length,
+          layout->length - (start_index + length));
+  new_text[new_length] = '\0';
+
+  layout->n_chars += pango_utf8_strlen (insert, insert_length)
+                   - pango_utf8_strlen (old_text + start_index, length);
+  layout->text = new_text;
+  layout->length = new_length;
+
+  g_free (insert);
+
+  if (layout->attrs)
+    {
+      PangoAttrList *attrs = pango_attr_list_copy (layout->attrs);
+
+      pango_attr_list_update (attrs, start_index, length, insert_length);
+      pango_attr_list_unref (layout->attrs);
+      layout->attrs = attrs;
+      layout->tab_width = -1;
+    }
 
   g_clear_pointer (&layout->log_attrs, g_free);
   layout_changed (layout);
@@ -1505,6 +1641,9 @@ pango_layout_context_changed (PangoLayout *layout)
 
   layout_changed (layout);
   layout->tab_width = -1;
+
+  if (layout->paragraphs)
+    g_hash_table_remove_all (layout->paragraphs);
 }
 
 /**
@@ -1558,6 +1697,7 @@ pango_layout_get_log_attrs (PangoLayout   *layout,
   g_return_if_fail (layout != NULL);
 
   pango_layout_check_lines (layout);
+  pango_layout_ensure_full_log_attrs (layout);
 
   if (attrs)
     {
@@ -1600,6 +1740,7 @@ pango_layout_get_log_attrs_readonly (PangoLayout *layout,
   g_return_val_if_fail (layout != NULL, NULL);
 
   pango_layout_check_lines (layout);
+  pango_layout_ensure_full_log_attrs (layout);
 
   if (n_attrs)
     *n_attrs = layout->n_chars + 1;
@@ -3600,6 +3741,18 @@ typedef enum
   BREAK_LINE_SEPARATOR
 } BreakResult;
 
+/* The result of shaping one of the items of a paragraph,
+ * kept in the paragraph cache so that we don't have to
+ * shape it again when only the line breaking changes.
+ */
+typedef struct
+{
+  int length;                   /* Length of the item */
+  PangoAnalysisFlags flags;     /* Flags of the item when it was shaped */
+  PangoGlyphString *glyphs;     /* Glyphs, or NULL if not shaped yet */
+  int *log_widths;              /* Logical widths, or NULL if not computed yet */
+} ShapedItem;
+
 struct _ParaBreakState
 {
   /* maintained per layout */
@@ -3619,6 +3772,8 @@ struct _ParaBreakState
   int num_log_widths;           /* Length of log_widths */
   int log_widths_offset;        /* Offset into log_widths to the point corresponding
                                  * to the remaining portion of the first item */
+  GHashTable *shaped_items;     /* Cached ShapedItems for the items of the paragraph, or NULL */
+  int para_start_index;         /* Start index (byte offset) of the paragraph in layout->text */
 
   int line_start_index;         /* Start index (byte offset) of line in layout->text */
   int line_start_offset;        /* Character offset of line in layout->text */
@@ -3698,6 +3853,31 @@ line_width (ParaBreakState  *state,
   return width;
 }
 
+/* Returns the cached shaping results for @item, if it is
+ * one of the items that the paragraph was itemized into.
+ * Parts of items that are split off during line breaking
+ * are not cached, since they depend on the width.
+ */
+static ShapedItem *
+lookup_shaped_item (ParaBreakState *state,
+                    PangoItem      *item)
+{
+  ShapedItem *shaped;
+
+  if (!state->shaped_items)
+    return NULL;
+
+  shaped = g_hash_table_lookup (state->shaped_items,
+                                GINT_TO_POINTER (item->offset - state->para_start_index));
+
+  if (!shaped ||
+      shaped->length != item->length ||
+      shaped->flags != item->analysis.flags)
+    return NULL;
+
+  return shaped;
+}
+
 static PangoGlyphString *
 shape_run (PangoLayoutLine *line,
            ParaBreakState  *state,
@@ -3705,9 +3885,15 @@ shape_run (PangoLayoutLine *line,
 {
   PangoLayout *layout = line->layout;
   PangoGlyphString *glyphs = pango_glyph_string_new ();
+  ShapedItem *shaped = NULL;
 
   if (layout->text[item->offset] == '\t')
     shape_tab (line, &state->last_tab, &state->properties, line_width (state, line), item, glyphs);
+  else if ((shaped = lookup_shaped_item (state, item)) && shaped->glyphs)
+    {
+      pango_glyph_string_free (glyphs);
+      glyphs = pango_glyph_string_copy (shaped->glyphs);
+    }
   else
     {
       PangoShapeFlags shape_flags = PANGO_SHAPE_NONE;
@@ -3720,11 +3906,12 @@ shape_run (PangoLayoutLine *line,
                             state->properties.shape_ink_rect, state->properties.shape_logical_rect,
                             glyphs);
       else
-        pango_shape_item (item,
-                          layout->text, layout->length,
-                          layout->log_attrs + state->start_offset,
-                          glyphs,
-                          shape_flags);
+        pango_shape_item_with_cache (layout->context->shape_cache,
+                                     item,
+                                     layout->text, layout->length,
+                                     layout->log_attrs + state->start_offset,
+                                     glyphs,
+                                     shape_flags);
 
       if (state->properties.letter_spacing)
         {
@@ -3746,32 +3933,35 @@ shape_run (PangoLayoutLine *line,
           glyphs->glyphs[glyphs->num_glyphs - 1].geometry.width += space_right;
         }
 
-      if (state->last_tab.glyphs != NULL)
-        {
-          int w;
+      if (shaped)
+        shaped->glyphs = pango_glyph_string_copy (glyphs);
+    }
 
-          g_assert (state->last_tab.glyphs->num_glyphs == 1);
+  if (layout->text[item->offset] != '\t' && state->last_tab.glyphs != NULL)
+    {
+      int w;
 
-          /* Update the width of the current tab to position this run properly */
+      g_assert (state->last_tab.glyphs->num_glyphs == 1);
 
-          w = state->last_tab.pos - state->last_tab.width;
+      /* Update the width of the current tab to position this run properly */
 
-          if (state->last_tab.align == PANGO_TAB_RIGHT)
-            w -= pango_glyph_string_get_width (glyphs);
-          else if (state->last_tab.align == PANGO_TAB_CENTER)
-            w -= pango_glyph_string_get_width (glyphs) / 2;
-          else if (state->last_tab.align == PANGO_TAB_DECIMAL)
-            {
-              int width;
-              gboolean found;
+      w = state->last_tab.pos - state->last_tab.width;
 
-              get_decimal_prefix_width (item, glyphs, layout->text, state->last_tab.decimal, &width, &found);
+      if (state->last_tab.align == PANGO_TAB_RIGHT)
+        w -= pango_glyph_string_get_width (glyphs);
+      else if (state->last_tab.align == PANGO_TAB_CENTER)
+        w -= pango_glyph_string_get_width (glyphs) / 2;
+      else if (state->last_tab.align == PANGO_TAB_DECIMAL)
+        {
+          int width;
+          gboolean found;
 
-              w -= width;
-            }
+          get_decimal_prefix_width (item, glyphs, layout->text, state->last_tab.decimal, &width, &found);
 
-          state->last_tab.glyphs->glyphs[0].geometry.width = MAX (w, 0);
+          w -= width;
         }
+
+      state->last_tab.glyphs->glyphs[0].geometry.width = MAX (w, 0);
     }
 
   return glyphs;
@@ -3935,6 +4125,7 @@ compute_log_widths (PangoLayout    *layout,
 {
   PangoItem *item = state->items->data;
   PangoGlyphItem glyph_item = { item, state->glyphs };
+  ShapedItem *shaped;
 
   if (item->num_chars > state->num_log_widths)
     {
@@ -3942,7 +4133,17 @@ compute_log_widths (PangoLayout    *layout,
       state->num_log_widths = item->num_chars;
     }
 
+  shaped = lookup_shaped_item (state, item);
+  if (shaped && shaped->log_widths)
+    {
+      memcpy (state->log_widths, shaped->log_widths, sizeof (int) * item->num_chars);
+      return;
+    }
+
   pango_glyph_item_get_logical_widths (&glyph_item, layout->text, state->log_widths);
+
+  if (shaped && shaped->glyphs)
+    shaped->log_widths = g_memdup2 (state->log_widths, sizeof (int) * item->num_chars);
 }
 
 /* If last_tab is set, we've added a tab and remaining_width has been updated to
@@ -4628,13 +4829,17 @@ get_items_log_attrs (const char    *text,
                      int            length,
                      GList         *items,
                      PangoAttrList *attrs,
+                     gboolean       full,
                      PangoLogAttr  *log_attrs,
                      int            log_attrs_len)
 {
   int offset = 0;
   GList *l;
 
-  pango_default_break (text + start, length, NULL, log_attrs, log_attrs_len);
+  if (full)
+    pango_default_break (text + start, length, NULL, log_attrs, log_attrs_len);
+  else
+    pango_default_break_lines (text + start, length, log_attrs, log_attrs_len);
 
   for (l = items; l; l = l->next)
     {
@@ -4801,23 +5006,684 @@ apply_attributes_to_runs (PangoLayout   *layout,
     }
 }
 
+/*******************
+ * Paragraph cache *
+ *******************/
+
+/* To avoid laying out all of the text again when only a few
+ * paragraphs of a long text change, we keep the results of
+ * itemizing, computing log attrs, shaping and line breaking
+ * for each paragraph in layout->paragraphs, and reuse them as
+ * long as the text of the paragraph, its base direction and
+ * the attributes that affect it are the same.
+ *
+ * The cached items and lines are computed at the position
+ * (start_index, start_offset) that the paragraph had at
+ * the time, and are shifted to the current position when
+ * they are reused.
+ *
+ * Changes to the context invalidate the entire cache,
+ * changes to line breaking parameters only the cached lines,
+ * so that e.g. changing the width only breaks the cached
+ * glyphs into lines again.
+ */
+
+typedef struct _ParagraphAttr ParagraphAttr;
+typedef struct _Paragraph Paragraph;
+typedef struct _ParagraphAttrs ParagraphAttrs;
+
+struct _ParagraphAttr
+{
+  PangoAttribute *attr;
+  int start;                    /* Relative to the paragraph, or -1 if it starts before it */
+  int end;                      /* Relative to the paragraph, or -1 if it ends after it */
+};
+
+struct _Paragraph
+{
+  /* key */
+  char *text;                   /* Text of the paragraph, including the delimiter */
+  int length;                   /* Length of text, in bytes */
+  PangoDirection base_dir;
+  GArray *attrs;                /* ParagraphAttrs that affect the paragraph */
+  guint hash;
+
+  /* value */
+  int start_index;              /* Byte index of the paragraph when the values were computed */
+  int start_offset;             /* Character offset of the paragraph when the values were computed */
+  int n_chars;                  /* Number of characters, including the delimiter */
+  PangoLogAttr *log_attrs;      /* n_chars + 1 log attrs */
+  guint log_attrs_full : 1;     /* Whether log_attrs has word and sentence information */
+  GList *items;                 /* Items, after post-processing */
+  GHashTable *shaped_items;     /* ShapedItems for items, by offset relative to the paragraph */
+  GSList *lines;                /* Lines, before attributes are applied to runs */
+  int tab_width;                /* Tab width used for lines, or -1 if there are no tabs */
+  guint has_lines     : 1;
+  guint is_wrapped    : 1;
+  guint is_ellipsized : 1;
+
+  guint generation;             /* Last check_lines that used this paragraph */
+};
+
+/* Used to collect the attributes that affect each paragraph in a
+ * single pass over the attribute list, since paragraphs are visited
+ * in order and the attribute list is sorted by start index.
+ */
+struct _ParagraphAttrs
+{
+  GPtrArray *attributes;        /* From the attribute list, may be NULL */
+  guint next;                   /* First attribute we haven't looked at */
+  GPtrArray *active;            /* Attributes that may extend into the current paragraph */
+  GArray *attrs;                /* ParagraphAttrs for the current paragraph */
+};
+
+static void
+paragraph_free (gpointer data)
+{
+  Paragraph *para = data;
+  guint i;
+
+  for (i = 0; i < para->attrs->len; i++)
+    pango_attribute_destroy (g_array_index (para->attrs, ParagraphAttr, i).attr);
+  g_array_unref (para->attrs);
+
+  g_free (para->text);
+  g_free (para->log_attrs);
+  g_list_free_full (para->items, (GDestroyNotify) pango_item_free);
+  if (para->shaped_items)
+    g_hash_table_unref (para->shaped_items);
+  g_slist_free_full (para->lines, (GDestroyNotify) pango_layout_line_unref);
+
+  g_free (para);
+}
+
+static guint
+paragraph_hash (gconstpointer data)
+{
+  const Paragraph *para = data;
+
+  return para->hash;
+}
+
+static gboolean
+paragraph_equal (gconstpointer a,
+                 gconstpointer b)
+{
+  const Paragraph *para1 = a;
+  const Paragraph *para2 = b;
+  guint i;
+
+  if (para1->hash != para2->hash ||
+      para1->length != para2->length ||
+      para1->base_dir != para2->base_dir ||
+      para1->attrs->len != para2->attrs->len)
+    return FALSE;
+
+  if (memcmp (para1->text, para2->text, para1->length) != 0)
+    return FALSE;
+
+  for (i = 0; i < para1->attrs->len; i++)
+    {
+      ParagraphAttr *attr1 = &g_array_index (para1->attrs, ParagraphAttr, i);
+      ParagraphAttr *attr2 = &g_array_index (para2->attrs, ParagraphAttr, i);
+
+      if (attr1->start != attr2->start ||
+          attr1->end != attr2->end ||
+          !pango_attribute_equal (attr1->attr, attr2->attr))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+paragraph_compute_hash (Paragraph *para)
+{
+  guint hash = 5381;
+  int i;
+
+  for (i = 0; i < para->length; i++)
+    hash = (hash << 5) + hash + (guchar) para->text[i];
+
+  hash = hash * 31 + para->base_dir;
+
+  for (i = 0; i < (int) para->attrs->len; i++)
+    {
+      ParagraphAttr *attr = &g_array_index (para->attrs, ParagraphAttr, i);
+
+      hash = hash * 31 + attr->attr->klass->type;
+      hash = hash * 31 + attr->start;
+      hash = hash * 31 + attr->end;
+    }
+
+  para->hash = hash;
+}
+
+static void
+paragraph_attrs_init (ParagraphAttrs *pattrs,
+                      PangoAttrList  *attrs)
+{
+  pattrs->attributes = attrs ? attrs->attributes : NULL;
+  pattrs->next = 0;
+  pattrs->active = g_ptr_array_new ();
+  pattrs->attrs = g_array_new (FALSE, FALSE, sizeof (ParagraphAttr));
+}
+
+static void
+paragraph_attrs_destroy (ParagraphAttrs *pattrs)
+{
+  g_ptr_array_unref (pattrs->active);
+  g_array_unref (pattrs->attrs);
+}
+
+/* Collects the attributes that affect itemization, breaking or
+ * shaping of the paragraph from @start to @end in pattrs->attrs.
+ *
+ * Note that attributes ending right at @start are included, since
+ * pango_item_apply_attrs() applies them to the first item.
+ *
+ * Returns %FALSE if the paragraph can't be cached, because
+ * baseline shifts are carried over from other paragraphs.
+ */
+static gboolean
+paragraph_attrs_collect (ParagraphAttrs *pattrs,
+                         int             start,
+                         int             end)
+{
+  gboolean cacheable = TRUE;
+  guint i, j;
+
+  for (i = 0, j = 0; i < pattrs->active->len; i++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (pattrs->active, i);
+
+      if (attr->end_index >= (guint) start)
+        g_ptr_array_index (pattrs->active, j++) = attr;
+    }
+  g_ptr_array_set_size (pattrs->active, j);
+
+  while (pattrs->attributes && pattrs->next < pattrs->attributes->len)
+    {
+      PangoAttribute *attr = g_ptr_array_index (pattrs->attributes, pattrs->next);
+
+      if (attr->start_index >= (guint) end)
+        break;
+
+      pattrs->next++;
+
+      if (attr->end_index >= (guint) start &&
+          (affects_itemization (attr, NULL) || affects_break_or_shape (attr, NULL)))
+        g_ptr_array_add (pattrs->active, attr);
+    }
+
+  g_array_set_size (pattrs->attrs, 0);
+
+  for (i = 0; i < pattrs->active->len; i++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (pattrs->active, i);
+      ParagraphAttr pattr;
+
+      pattr.attr = attr;
+      pattr.start = attr->start_index < (guint) start ? -1 : (int) (attr->start_index - start);
+      pattr.end = attr->end_index > (guint) end ? -1 : (int) (attr->end_index - start);
+
+      if (attr->klass->type == PANGO_ATTR_BASELINE_SHIFT &&
+          (pattr.start == -1 || pattr.end == -1))
+        cacheable = FALSE;
+
+      g_array_append_val (pattrs->attrs, pattr);
+    }
+
+  return cacheable;
+}
+
+/* Line breaking only needs part of the log attrs. The rest is
+ * computed when it is asked for, unless the attributes need word
+ * boundaries to be resolved for itemization or breaking.
+ */
+static gboolean
+paragraph_needs_full_log_attrs (GArray *attrs)
+{
+  guint i;
+
+  for (i = 0; i < attrs->len; i++)
+    {
+      PangoAttribute *attr = g_array_index (attrs, ParagraphAttr, i).attr;
+
+      switch ((int) attr->klass->type)
+        {
+        case PANGO_ATTR_WORD:
+        case PANGO_ATTR_SENTENCE:
+        case PANGO_ATTR_TEXT_TRANSFORM:
+          return TRUE;
+        default:
+          break;
+        }
+    }
+
+  return FALSE;
+}
+
+static Paragraph *
+lookup_paragraph (PangoLayout    *layout,
+                  const char     *text,
+                  int             length,
+                  PangoDirection  base_dir,
+                  GArray         *attrs)
+{
+  Paragraph key;
+
+  key.text = (char *) text;
+  key.length = length;
+  key.base_dir = base_dir;
+  key.attrs = attrs;
+  paragraph_compute_hash (&key);
+
+  return g_hash_table_lookup (layout->paragraphs, &key);
+}
+
+static Paragraph *
+add_paragraph (PangoLayout    *layout,
+               const char     *text,
+               int             length,
+               PangoDirection  base_dir,
+               GArray         *attrs,
+               int             start_offset,
+               int             n_chars)
+{
+  Paragraph *para;
+  guint i;
+
+  para = g_new0 (Paragraph, 1);
+
+  para->text = g_memdup2 (text, length);
+  para->length = length;
+  para->base_dir = base_dir;
+  para->attrs = g_array_sized_new (FALSE, FALSE, sizeof (ParagraphAttr), attrs->len);
+  for (i = 0; i < attrs->len; i++)
+    {
+      ParagraphAttr pattr = g_array_index (attrs, ParagraphAttr, i);
+
+      pattr.attr = pango_attribute_copy (pattr.attr);
+      g_array_append_val (para->attrs, pattr);
+    }
+  paragraph_compute_hash (para);
+
+  para->start_index = text - layout->text;
+  para->start_offset = start_offset;
+  para->n_chars = n_chars;
+  para->tab_width = -1;
+  para->generation = layout->paragraph_generation;
+
+  g_hash_table_add (layout->paragraphs, para);
+
+  return para;
+}
+
+static gboolean
+paragraph_is_stale (gpointer key,
+                    gpointer value,
+                    gpointer data)
+{
+  Paragraph *para = key;
+
+  return para->generation != GPOINTER_TO_UINT (data);
+}
+
+static void
+clear_paragraph_lines (PangoLayout *layout)
+{
+  GHashTableIter iter;
+  Paragraph *para;
+
+  if (!layout->paragraphs)
+    return;
+
+  g_hash_table_iter_init (&iter, layout->paragraphs);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &para, NULL))
+    {
+      g_slist_free_full (para->lines, (GDestroyNotify) pango_layout_line_unref);
+      para->lines = NULL;
+      para->has_lines = FALSE;
+    }
+}
+
+static inline guint
+shift_index (guint index,
+             int   delta)
+{
+  if (index == PANGO_ATTR_INDEX_TO_TEXT_END)
+    return index;
+  else if (delta < 0 && index < (guint) -delta)
+    return 0;
+  else if (delta > 0 && G_MAXUINT - index < (guint) delta)
+    return G_MAXUINT;
+  else
+    return index + delta;
+}
+
+/* Moves @item by @delta bytes and @char_delta characters,
+ * together with the attributes that it carries, since
+ * baseline shifts and font features are using their indices.
+ */
+static void
+shift_item (PangoItem *item,
+            int        delta,
+            int        char_delta)
+{
+  GSList *l;
+
+  item->offset += delta;
+  if (item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET)
+    ((PangoItemPrivate *)item)->char_offset += char_delta;
+
+  for (l = item->analysis.extra_attrs; l; l = l->next)
+    {
+      PangoAttribute *attr = l->data;
+
+      attr->start_index = shift_index (attr->start_index, delta);
+      attr->end_index = shift_index (attr->end_index, delta);
+    }
+}
+
+static GList *
+copy_items (GList *items,
+            int    delta,
+            int    char_delta)
+{
+  GList *copy = NULL;
+  GList *l;
+
+  for (l = items; l; l = l->next)
+    {
+      PangoItem *item = pango_item_copy (l->data);
+
+      shift_item (item, delta, char_delta);
+      copy = g_list_prepend (copy, item);
+    }
+
+  return g_list_reverse (copy);
+}
+
+static void
+shaped_item_free (gpointer data)
+{
+  ShapedItem *shaped = data;
+
+  if (shaped->glyphs)
+    pango_glyph_string_free (shaped->glyphs);
+  g_free (shaped->log_widths);
+  g_free (shaped);
+}
+
+static void
+paragraph_set_items (Paragraph *para,
+                     GList     *items)
+{
+  GList *l;
+
+  para->items = copy_items (items, 0, 0);
+  para->shaped_items = g_hash_table_new_full (NULL, NULL, NULL, shaped_item_free);
+
+  /* The glyphs and log widths are filled in when the items get shaped */
+  for (l = para->items; l; l = l->next)
+    {
+      PangoItem *item = l->data;
+      ShapedItem *shaped;
+
+      shaped = g_new0 (ShapedItem, 1);
+      shaped->length = item->length;
+      shaped->flags = item->analysis.flags;
+
+      g_hash_table_insert (para->shaped_items,
+                           GINT_TO_POINTER (item->offset - para->start_index),
+                           shaped);
+    }
+}
+
+static PangoLayoutLine *
+copy_line (PangoLayout     *layout,
+           PangoLayoutLine *line,
+           int              delta,
+           int              char_delta)
+{
+  PangoLayoutLine *copy;
+  GSList *l;
+
+  copy = pango_layout_line_new (layout);
+  copy->start_index = line->start_index + delta;
+  copy->length = line->length;
+  copy->is_paragraph_start = line->is_paragraph_start;
+  copy->resolved_dir = line->resolved_dir;
+
+  for (l = line->runs; l; l = l->next)
+    {
+      PangoLayoutRun *run = pango_glyph_item_copy (l->data);
+
+      shift_item (run->item, delta, char_delta);
+      copy->runs = g_slist_prepend (copy->runs, run);
+    }
+  copy->runs = g_slist_reverse (copy->runs);
+
+  return copy;
+}
+
+static gboolean
+can_cache_lines (PangoLayout *layout)
+{
+  /* If we ellipsize at a height, the lines of a
+   * paragraph depend on the paragraphs before it.
+   */
+  return layout->ellipsize == PANGO_ELLIPSIZE_NONE || layout->height < 0;
+}
+
+static gboolean
+can_reuse_lines (PangoLayout *layout,
+                 Paragraph   *para)
+{
+  if (!para->has_lines || !can_cache_lines (layout))
+    return FALSE;
+
+  if (para->tab_width != -1)
+    {
+      ensure_tab_width (layout);
+      if (para->tab_width != layout->tab_width)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Store the lines that were added to the layout
+ * for @para, which are the ones in front of @last.
+ */
+static void
+save_paragraph_lines (PangoLayout *layout,
+                      Paragraph   *para,
+                      GSList      *last,
+                      int          delta,
+                      int          char_delta)
+{
+  GSList *l;
+
+  g_slist_free_full (para->lines, (GDestroyNotify) pango_layout_line_unref);
+  para->lines = NULL;
+
+  for (l = layout->lines; l != last; l = l->next)
+    para->lines = g_slist_prepend (para->lines, copy_line (NULL, l->data, - delta, - char_delta));
+
+  if (memchr (para->text, '\t', para->length))
+    para->tab_width = layout->tab_width;
+  else
+    para->tab_width = -1;
+
+  para->has_lines = TRUE;
+  para->is_wrapped = layout->is_wrapped;
+  para->is_ellipsized = layout->is_ellipsized;
+}
+
+/* Walks the paragraphs of the layout, in the same way for
+ * pango_layout_check_lines() and pango_layout_ensure_full_log_attrs(),
+ * so that both find the same paragraphs in the cache.
+ */
+typedef struct _ParagraphIter ParagraphIter;
+
+struct _ParagraphIter
+{
+  PangoLayout *layout;
+  ParagraphAttrs pattrs;
+  PangoDirection prev_base_dir;
+  PangoDirection base_dir;
+
+  const char *start;            /* Start of the paragraph */
+  const char *end;              /* Start of the paragraph delimiter */
+  int delimiter_index;
+  int next_para_index;
+  int delim_len;
+  int start_offset;             /* Character offset of start */
+  int n_chars;                  /* Number of characters, including the delimiter, or -1 */
+  gboolean cacheable;           /* Whether the paragraph goes into the cache */
+  Paragraph *para;              /* The cached paragraph, or NULL */
+  gboolean last;
+};
+
+static void
+paragraph_iter_find (ParagraphIter *piter)
+{
+  PangoLayout *layout = piter->layout;
+  const char *start = piter->start;
+
+  if (layout->single_paragraph)
+    {
+      piter->delimiter_index = layout->length;
+      piter->next_para_index = layout->length;
+    }
+  else
+    {
+      pango_find_paragraph_boundary (start,
+                                     (layout->text + layout->length) - start,
+                                     &piter->delimiter_index,
+                                     &piter->next_para_index);
+    }
+
+  g_assert (piter->next_para_index >= piter->delimiter_index);
+
+  if (layout->auto_dir)
+    {
+      piter->base_dir = pango_find_base_dir (start, piter->delimiter_index);
+
+      /* Propagate the base direction for neutral paragraphs */
+      if (piter->base_dir == PANGO_DIRECTION_NEUTRAL)
+        piter->base_dir = piter->prev_base_dir;
+      else
+        piter->prev_base_dir = piter->base_dir;
+    }
+
+  piter->end = start + piter->delimiter_index;
+  piter->delim_len = piter->next_para_index - piter->delimiter_index;
+  piter->last = piter->end == (layout->text + layout->length);
+
+  g_assert (piter->end <= (layout->text + layout->length));
+  g_assert (start <= (layout->text + layout->length));
+  g_assert (piter->delim_len < 4); /* PS is 3 bytes */
+  g_assert (piter->delim_len >= 0);
+
+  piter->cacheable = paragraph_attrs_collect (&piter->pattrs,
+                                              start - layout->text,
+                                              start - layout->text + piter->next_para_index) &&
+                     layout->paragraphs != NULL;
+  if (piter->cacheable)
+    piter->para = lookup_paragraph (layout, start, piter->next_para_index,
+                                    piter->base_dir, piter->pattrs.attrs);
+  else
+    piter->para = NULL;
+
+  piter->n_chars = piter->para ? piter->para->n_chars : -1;
+}
+
+static void
+paragraph_iter_init (ParagraphIter *piter,
+                     PangoLayout   *layout,
+                     PangoAttrList *attrs)
+{
+  piter->layout = layout;
+  paragraph_attrs_init (&piter->pattrs, attrs);
+
+  piter->prev_base_dir = PANGO_DIRECTION_NEUTRAL;
+  piter->base_dir = PANGO_DIRECTION_NEUTRAL;
+
+  /* Find the first strong direction of the text */
+  if (layout->auto_dir)
+    {
+      piter->prev_base_dir = pango_find_base_dir (layout->text, layout->length);
+      if (piter->prev_base_dir == PANGO_DIRECTION_NEUTRAL)
+        piter->prev_base_dir = pango_context_get_base_dir (layout->context);
+    }
+  else
+    piter->base_dir = pango_context_get_base_dir (layout->context);
+
+  piter->start = layout->text;
+  piter->start_offset = 0;
+
+  paragraph_iter_find (piter);
+}
+
+static int
+paragraph_iter_get_n_chars (ParagraphIter *piter)
+{
+  if (piter->n_chars < 0)
+    piter->n_chars = pango_utf8_strlen (piter->start, piter->next_para_index);
+
+  return piter->n_chars;
+}
+
+static gboolean
+paragraph_iter_next (ParagraphIter *piter)
+{
+  if (piter->last)
+    return FALSE;
+
+  piter->start_offset += paragraph_iter_get_n_chars (piter);
+  piter->start = piter->end + piter->delim_len;
+
+  paragraph_iter_find (piter);
+
+  return TRUE;
+}
+
+static void
+paragraph_iter_destroy (ParagraphIter *piter)
+{
+  paragraph_attrs_destroy (&piter->pattrs);
+}
+
+static gboolean
+layout_has_several_paragraphs (PangoLayout *layout)
+{
+  int delimiter_index, next_para_index;
+
+  if (layout->single_paragraph)
+    return FALSE;
+
+  pango_find_paragraph_boundary (layout->text, layout->length,
+                                 &delimiter_index, &next_para_index);
+
+  return delimiter_index < layout->length;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
 static void
 pango_layout_check_lines (PangoLayout *layout)
 {
-  const char *start;
-  gboolean done = FALSE;
-  int start_offset;
   PangoAttrList *attrs;
   PangoAttrList *itemize_attrs;
   PangoAttrList *shape_attrs;
   PangoAttrIterator iter;
-  PangoDirection prev_base_dir = PANGO_DIRECTION_NEUTRAL;
-  PangoDirection base_dir = PANGO_DIRECTION_NEUTRAL;
   ParaBreakState state;
   gboolean need_log_attrs;
+  ParagraphIter piter;
 
   check_context_changed (layout);
 
@@ -4848,6 +5714,7 @@ pango_layout_check_lines (PangoLayout *layout)
   if (!layout->log_attrs)
     {
       layout->log_attrs = g_new0 (PangoLogAttr, layout->n_chars + 1);
+      layout->log_attrs_full = TRUE;
       need_log_attrs = TRUE;
     }
   else
@@ -4855,18 +5722,22 @@ pango_layout_check_lines (PangoLayout *layout)
       need_log_attrs = FALSE;
     }
 
-  start_offset = 0;
-  start = layout->text;
-
-  /* Find the first strong direction of the text */
-  if (layout->auto_dir)
+  /* The cache lets us avoid shaping again when some of the
+   * paragraphs or the width of the layout change. A layout with
+   * a single paragraph that is laid out only once, like most
+   * labels, would just hold on to a second copy of its items
+   * and lines, so we only start to cache for those when they
+   * get laid out again.
+   */
+  if (layout->relayout || layout_has_several_paragraphs (layout))
     {
-      prev_base_dir = pango_find_base_dir (layout->text, layout->length);
-      if (prev_base_dir == PANGO_DIRECTION_NEUTRAL)
-        prev_base_dir = pango_context_get_base_dir (layout->context);
+      if (!layout->paragraphs)
+        layout->paragraphs = g_hash_table_new_full (paragraph_hash, paragraph_equal, paragraph_free, NULL);
     }
   else
-    base_dir = pango_context_get_base_dir (layout->context);
+    g_clear_pointer (&layout->paragraphs, g_hash_table_unref);
+
+  layout->paragraph_generation++;
 
   /* these are only used if layout->height >= 0 */
   state.remaining_height = layout->height;
@@ -4884,83 +5755,31 @@ pango_layout_check_lines (PangoLayout *layout)
   state.baseline_shifts = NULL;
 
   DEBUG1 ("START layout");
+  paragraph_iter_init (&piter, layout, attrs);
   do
     {
-      int delim_len;
-      const char *end;
-      int delimiter_index, next_para_index;
-
-      if (layout->single_paragraph)
-        {
-          delimiter_index = layout->length;
-          next_para_index = layout->length;
-        }
-      else
-        {
-          pango_find_paragraph_boundary (start,
-                                         (layout->text + layout->length) - start,
-                                         &delimiter_index,
-                                         &next_para_index);
-        }
-
-      g_assert (next_para_index >= delimiter_index);
-
-      if (layout->auto_dir)
-        {
-          base_dir = pango_find_base_dir (start, delimiter_index);
-
-          /* Propagate the base direction for neutral paragraphs */
-          if (base_dir == PANGO_DIRECTION_NEUTRAL)
-            base_dir = prev_base_dir;
-          else
-            prev_base_dir = base_dir;
-        }
-
-      end = start + delimiter_index;
+      Paragraph *para = piter.para;
+      gboolean full_log_attrs;
+      int delta = 0;
+      int char_delta = 0;
 
-      delim_len = next_para_index - delimiter_index;
-
-      if (end == (layout->text + layout->length))
-        done = TRUE;
-
-      g_assert (end <= (layout->text + layout->length));
-      g_assert (start <= (layout->text + layout->length));
-      g_assert (delim_len < 4); /* PS is 3 bytes */
-      g_assert (delim_len >= 0);
+      /* Paragraphs that don't go into the cache have no items
+       * to complete their log attrs from later, so they get
+       * all of them right away.
+       */
+      full_log_attrs = !piter.cacheable ||
+                       paragraph_needs_full_log_attrs (piter.pattrs.attrs);
 
       state.attrs = itemize_attrs;
-      state.items = pango_itemize_with_font (layout->context,
-                                             base_dir,
-                                             layout->text,
-                                             start - layout->text,
-                                             end - start,
-                                             itemize_attrs,
-                                             itemize_attrs ? &iter : NULL,
-                                             NULL);
-
-      apply_attributes_to_items (state.items, shape_attrs);
-
-      if (need_log_attrs)
-        get_items_log_attrs (layout->text,
-                             start - layout->text,
-                             delimiter_index + delim_len,
-                             state.items,
-                             shape_attrs,
-                             layout->log_attrs + start_offset,
-                             layout->n_chars + 1 - start_offset);
-
-      state.items = pango_itemize_post_process_items (layout->context,
-                                                      layout->text,
-                                                      layout->log_attrs,
-                                                      state.items);
-
-      state.base_dir = base_dir;
+      state.base_dir = piter.base_dir;
       state.line_of_par = 1;
-      state.start_offset = start_offset;
-      state.line_start_offset = start_offset;
-      state.line_start_index = start - layout->text;
+      state.start_offset = piter.start_offset;
+      state.line_start_offset = piter.start_offset;
+      state.line_start_index = piter.start - layout->text;
+      state.para_start_index = piter.start - layout->text;
 
       state.glyphs = NULL;
+      state.shaped_items = NULL;
 
       /* for deterministic bug hunting's sake set everything! */
       state.line_width = -1;
@@ -4969,36 +5788,137 @@ pango_layout_check_lines (PangoLayout *layout)
 
       state.hyphen_width = -1;
 
-      if (state.items)
+      if (para)
         {
-          while (state.items)
-            process_line (layout, &state);
+          para->generation = layout->paragraph_generation;
+          delta = (piter.start - layout->text) - para->start_index;
+          char_delta = piter.start_offset - para->start_offset;
+
+          if (need_log_attrs)
+            {
+              memcpy (layout->log_attrs + piter.start_offset,
+                      para->log_attrs,
+                      sizeof (PangoLogAttr) * (para->n_chars + 1));
+              if (!para->log_attrs_full)
+                layout->log_attrs_full = FALSE;
+            }
         }
-      else
+
+      if (para && can_reuse_lines (layout, para))
         {
-          PangoLayoutLine *empty_line;
+          GSList *l;
 
-          empty_line = pango_layout_line_new (layout);
-          empty_line->start_index = state.line_start_index;
-          empty_line->is_paragraph_start = TRUE;
-          line_set_resolved_dir (empty_line, base_dir);
+          DEBUG1 ("reusing lines of paragraph at %d", state.line_start_index);
 
-          add_line (empty_line, &state);
+          for (l = para->lines; l; l = l->next)
+            add_line (copy_line (layout, l->data, delta, char_delta), &state);
+
+          layout->is_wrapped |= para->is_wrapped;
+          layout->is_ellipsized |= para->is_ellipsized;
         }
+      else
+        {
+          GSList *last_line = layout->lines;
+          gboolean is_wrapped = layout->is_wrapped;
+          gboolean is_ellipsized = layout->is_ellipsized;
 
-      if (layout->height >= 0 && state.remaining_height < state.line_height)
-        done = TRUE;
+          layout->is_wrapped = FALSE;
+          layout->is_ellipsized = FALSE;
 
-      if (!done)
-        start_offset += pango_utf8_strlen (start, (end - start) + delim_len);
+          if (para)
+            {
+              state.items = copy_items (para->items, delta, char_delta);
+            }
+          else
+            {
+              state.items = pango_itemize_with_font (layout->context,
+                                                     piter.base_dir,
+                                                     layout->text,
+                                                     piter.start - layout->text,
+                                                     piter.end - piter.start,
+                                                     itemize_attrs,
+                                                     itemize_attrs ? &iter : NULL,
+                                                     NULL);
+
+              apply_attributes_to_items (state.items, shape_attrs);
+
+              if (need_log_attrs)
+                {
+                  get_items_log_attrs (layout->text,
+                                       piter.start - layout->text,
+                                       piter.next_para_index,
+                                       state.items,
+                                       shape_attrs,
+                                       full_log_attrs,
+                                       layout->log_attrs + piter.start_offset,
+                                       layout->n_chars + 1 - piter.start_offset);
+                  if (!full_log_attrs)
+                    layout->log_attrs_full = FALSE;
+                }
+
+              state.items = pango_itemize_post_process_items (layout->context,
+                                                              layout->text,
+                                                              layout->log_attrs,
+                                                              state.items);
+
+              if (piter.cacheable)
+                {
+                  int n_chars = paragraph_iter_get_n_chars (&piter);
+
+                  para = add_paragraph (layout,
+                                        piter.start, piter.next_para_index,
+                                        piter.base_dir, piter.pattrs.attrs,
+                                        piter.start_offset, n_chars);
+                  para->log_attrs = g_memdup2 (layout->log_attrs + piter.start_offset,
+                                               sizeof (PangoLogAttr) * (n_chars + 1));
+                  para->log_attrs_full = full_log_attrs || layout->log_attrs_full;
+                  paragraph_set_items (para, state.items);
+                }
+            }
 
-      start = end + delim_len;
+          state.shaped_items = para ? para->shaped_items : NULL;
+
+          if (state.items)
+            {
+              while (state.items)
+                process_line (layout, &state);
+            }
+          else
+            {
+              PangoLayoutLine *empty_line;
+
+              empty_line = pango_layout_line_new (layout);
+              empty_line->start_index = state.line_start_index;
+              empty_line->is_paragraph_start = TRUE;
+              line_set_resolved_dir (empty_line, piter.base_dir);
+
+              add_line (empty_line, &state);
+            }
+
+          if (para && can_cache_lines (layout))
+            save_paragraph_lines (layout, para, last_line, delta, char_delta);
+
+          layout->is_wrapped |= is_wrapped;
+          layout->is_ellipsized |= is_ellipsized;
+        }
+
+      if (layout->height >= 0 && state.remaining_height < state.line_height)
+        break;
     }
-  while (!done);
+  while (paragraph_iter_next (&piter));
+
+  paragraph_iter_destroy (&piter);
 
   g_free (state.log_widths);
   g_list_free_full (state.baseline_shifts, g_free);
 
+  if (layout->paragraphs)
+    g_hash_table_foreach_remove (layout->paragraphs,
+                                 paragraph_is_stale,
+                                 GUINT_TO_POINTER (layout->paragraph_generation));
+
+  layout->relayout = TRUE;
+
   apply_attributes_to_runs (layout, attrs);
   layout->lines = g_slist_reverse (layout->lines);
 
@@ -5016,6 +5936,97 @@ pango_layout_check_lines (PangoLayout *layout)
   DEBUG1 ("DONE %d %d", w, h);
 }
 
+/* pango_layout_check_lines() only computes the log attrs needed
+ * for line breaking for the paragraphs that it keeps in the cache,
+ * unless the attributes require more. This fills in the word and
+ * sentence information when it is asked for, by running the break
+ * passes again over the cached items of those paragraphs.
+ *
+ * Paragraphs that have dropped out of the cache in the meantime,
+ * e.g. because a height limit kept pango_layout_check_lines()
+ * from getting to them, have to be itemized again.
+ */
+static void
+pango_layout_ensure_full_log_attrs (PangoLayout *layout)
+{
+  PangoAttrList *attrs;
+  PangoAttrList *itemize_attrs = NULL;
+  PangoAttrList *shape_attrs;
+  ParagraphIter piter;
+
+  if (layout->log_attrs_full)
+    return;
+
+  attrs = pango_layout_get_effective_attributes (layout);
+  shape_attrs = attrs ? pango_attr_list_filter (attrs, affects_break_or_shape, NULL) : NULL;
+
+  paragraph_iter_init (&piter, layout, attrs);
+  do
+    {
+      Paragraph *para = piter.para;
+      GList *items;
+
+      if (para && para->log_attrs_full)
+        {
+          memcpy (layout->log_attrs + piter.start_offset,
+                  para->log_attrs,
+                  sizeof (PangoLogAttr) * (para->n_chars + 1));
+          continue;
+        }
+
+      if (para)
+        {
+          items = copy_items (para->items,
+                              (piter.start - layout->text) - para->start_index,
+                              piter.start_offset - para->start_offset);
+        }
+      else
+        {
+          if (!itemize_attrs && attrs)
+            itemize_attrs = pango_attr_list_filter (attrs, affects_itemization, NULL);
+
+          items = pango_itemize_with_font (layout->context,
+                                           piter.base_dir,
+                                           layout->text,
+                                           piter.start - layout->text,
+                                           piter.end - piter.start,
+                                           itemize_attrs,
+                                           NULL,
+                                           NULL);
+
+          apply_attributes_to_items (items, shape_attrs);
+        }
+
+      get_items_log_attrs (layout->text,
+                           piter.start - layout->text,
+                           piter.next_para_index,
+                           items,
+                           shape_attrs,
+                           TRUE,
+                           layout->log_attrs + piter.start_offset,
+                           layout->n_chars + 1 - piter.start_offset);
+
+      g_list_free_full (items, (GDestroyNotify) pango_item_free);
+
+      if (para)
+        {
+          memcpy (para->log_attrs,
+                  layout->log_attrs + piter.start_offset,
+                  sizeof (PangoLogAttr) * (para->n_chars + 1));
+          para->log_attrs_full = TRUE;
+        }
+    }
+  while (paragraph_iter_next (&piter));
+
+  paragraph_iter_destroy (&piter);
+
+  pango_attr_list_unref (itemize_attrs);
+  pango_attr_list_unref (shape_attrs);
+  pango_attr_list_unref (attrs);
+
+  layout->log_attrs_full = TRUE;
+}
+
 #pragma GCC diagnostic pop
 
 /**
@@ -175,6 +175,12 @@ void           pango_layout_set_text       (PangoLayout    *layout,
 					    int             length);
 PANGO_AVAILABLE_IN_ALL
 const char    *pango_layout_get_text       (PangoLayout    *layout);
+PANGO_AVAILABLE_IN_1_60
+void           pango_layout_replace_text   (PangoLayout    *layout,
+                                            int             start_index,
+                                            int             length,
+                                            const char     *text,
+                                            int             text_length);
 
 PANGO_AVAILABLE_IN_1_30
 gint           pango_layout_get_character_count (PangoLayout *layout);
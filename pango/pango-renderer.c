@@ -65,6 +65,9 @@ struct _PangoRendererPrivate
   PangoOverline overline;
 
   PangoRenderComponent components;
+
+  /* Set while drawing with pango_renderer_draw_layout_region() */
+  const PangoRectangle *visible_rect;
 };
 
 static void pango_renderer_finalize                     (GObject          *gobject);
@@ -170,6 +173,66 @@ pango_renderer_draw_layout (PangoRenderer *renderer,
                             PangoLayout   *layout,
                             int            x,
                             int            y)
+{
+  pango_renderer_draw_layout_region (renderer, layout, x, y, NULL);
+}
+
+/* Antialiasing can touch pixels just outside of the ink
+ * rectangles, so we keep things that are this close to
+ * the visible area
+ */
+#define CULL_MARGIN PANGO_SCALE
+
+static gboolean
+rect_is_visible (const PangoRectangle *visible_rect,
+                 int                   x,
+                 int                   y,
+                 int                   width,
+                 int                   height)
+{
+  return x - CULL_MARGIN < visible_rect->x + visible_rect->width &&
+         x + width + CULL_MARGIN > visible_rect->x &&
+         y - CULL_MARGIN < visible_rect->y + visible_rect->height &&
+         y + height + CULL_MARGIN > visible_rect->y;
+}
+
+/**
+ * pango_renderer_draw_layout_region:
+ * @renderer: a `PangoRenderer`
+ * @layout: a `PangoLayout`
+ * @x: X position of left edge of baseline, in user space coordinates
+ *   in Pango units.
+ * @y: Y position of left edge of baseline, in user space coordinates
+ *   in Pango units.
+ * @visible_rect: (nullable): the area that needs to be drawn, in user
+ *   space coordinates in Pango units
+ *
+ * Draws the part of @layout that is inside @visible_rect with the
+ * specified `PangoRenderer`.
+ *
+ * This is like [method@Pango.Renderer.draw_layout], but lines whose
+ * ink and logical extents are entirely outside of @visible_rect are
+ * skipped, and so are the glyphs of runs whose logical extents,
+ * widened by the ink overhang of their line, are outside of it. The
+ * ink extents include decorations and shapes, so things that overhang
+ * their logical boxes are still drawn if they reach into @visible_rect.
+ * Things that are partially visible are drawn in full, so the caller
+ * still needs to clip the output to @visible_rect if it must not be
+ * touched outside of it.
+ *
+ * This is useful to draw a small window of a large layout, for
+ * example when scrolling through a long document.
+ *
+ * If @visible_rect is %NULL, the whole layout is drawn.
+ *
+ * Since: 1.60
+ */
+void
+pango_renderer_draw_layout_region (PangoRenderer        *renderer,
+                                   PangoLayout          *layout,
+                                   int                   x,
+                                   int                   y,
+                                   const PangoRectangle *visible_rect)
 {
   PangoLayoutIter iter;
 
@@ -188,17 +251,37 @@ pango_renderer_draw_layout (PangoRenderer *renderer,
 
   pango_renderer_activate (renderer);
 
+  renderer->priv->visible_rect = visible_rect;
+
   _pango_layout_get_iter (layout, &iter);
 
   do
     {
+      PangoRectangle   ink_rect;
       PangoRectangle   logical_rect;
       PangoLayoutLine *line;
       int              baseline;
 
       line = pango_layout_iter_get_line_readonly (&iter);
 
-      pango_layout_iter_get_line_extents (&iter, NULL, &logical_rect);
+      if (visible_rect)
+        {
+          pango_layout_iter_get_line_extents (&iter, &ink_rect, &logical_rect);
+
+          /* Backgrounds fill the logical rectangle, everything
+           * else is covered by the ink rectangle
+           */
+          if (!rect_is_visible (visible_rect,
+                                x + ink_rect.x, y + ink_rect.y,
+                                ink_rect.width, ink_rect.height) &&
+              !rect_is_visible (visible_rect,
+                                x + logical_rect.x, y + logical_rect.y,
+                                logical_rect.width, logical_rect.height))
+            continue;
+        }
+      else
+        pango_layout_iter_get_line_extents (&iter, NULL, &logical_rect);
+
       baseline = pango_layout_iter_get_baseline (&iter);
 
       pango_renderer_draw_layout_line (renderer,
@@ -210,6 +293,8 @@ pango_renderer_draw_layout (PangoRenderer *renderer,
 
   _pango_layout_iter_destroy (&iter);
 
+  renderer->priv->visible_rect = NULL;
+
   pango_renderer_deactivate (renderer);
 }
 
@@ -553,6 +638,32 @@ draw_shaped_glyphs (PangoRenderer    *renderer,
 }
 
 
+/* Returns whether a run that starts at @x and is @width wide
+ * reaches into the visible rectangle. We go by the logical width
+ * of the run, which we have anyway, and allow for as much ink
+ * overhang as the line has. @line_ink and @line_logical are the
+ * extents of the line that has its baseline at @y.
+ */
+static gboolean
+run_is_visible (PangoRenderer        *renderer,
+                const PangoRectangle *line_ink,
+                const PangoRectangle *line_logical,
+                int                   x,
+                int                   width,
+                int                   y)
+{
+  int left, right, top, bottom;
+
+  left = MAX (0, line_logical->x - line_ink->x);
+  right = MAX (0, (line_ink->x + line_ink->width) - (line_logical->x + line_logical->width));
+  top = MIN (line_ink->y, line_logical->y);
+  bottom = MAX (line_ink->y + line_ink->height, line_logical->y + line_logical->height);
+
+  return rect_is_visible (renderer->priv->visible_rect,
+                          x - left, y + top,
+                          width + left + right, bottom - top);
+}
+
 /**
  * pango_renderer_draw_layout_line:
  * @renderer: a `PangoRenderer`
@@ -582,6 +693,7 @@ pango_renderer_draw_layout_line (PangoRenderer   *renderer,
   GSList *l;
   gboolean got_overall = FALSE;
   PangoRectangle overall_rect;
+  PangoRectangle line_ink = { 0, };
   const char *text;
 
   g_return_if_fail (PANGO_IS_RENDERER_FAST (renderer));
@@ -607,6 +719,12 @@ pango_renderer_draw_layout_line (PangoRenderer   *renderer,
 
   text = G_LIKELY (line->layout) ? pango_layout_get_text (line->layout) : NULL;
 
+  if (G_UNLIKELY (renderer->priv->visible_rect))
+    {
+      pango_layout_line_get_extents (line, &line_ink, &overall_rect);
+      got_overall = TRUE;
+    }
+
   for (l = line->runs; l; l = l->next)
     {
       PangoFontMetrics *metrics;
@@ -684,7 +802,11 @@ pango_renderer_draw_layout_line (PangoRenderer   *renderer,
                                          overall_rect.height);
         }
 
-      if (shape_attr)
+      if (G_UNLIKELY (renderer->priv->visible_rect) &&
+          !run_is_visible (renderer, &line_ink, &overall_rect,
+                           x + x_off, glyph_string_width, y))
+        ; /* Only the glyphs are skipped, decorations span runs */
+      else if (shape_attr)
         {
           draw_shaped_glyphs (renderer, run->glyphs, shape_attr, x + x_off, y - y_off);
         }
@@ -208,6 +208,12 @@ void pango_renderer_draw_layout          (PangoRenderer    *renderer,
                                           PangoLayout      *layout,
                                           int               x,
                                           int               y);
+PANGO_AVAILABLE_IN_1_60
+void pango_renderer_draw_layout_region   (PangoRenderer        *renderer,
+                                          PangoLayout          *layout,
+                                          int                   x,
+                                          int                   y,
+                                          const PangoRectangle *visible_rect);
 PANGO_AVAILABLE_IN_1_8
 void pango_renderer_draw_layout_line     (PangoRenderer    *renderer,
                                           PangoLayoutLine  *line,
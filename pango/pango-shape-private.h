@@ -0,0 +1,49 @@
+/* Pango
+ * pango-shape-private.h: Shaping, private definitions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PANGO_SHAPE_PRIVATE_H__
+#define __PANGO_SHAPE_PRIVATE_H__
+
+#include <pango/pango-glyph.h>
+#include <pango/pango-item.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PangoShapeCache PangoShapeCache;
+
+PangoShapeCache *       pango_shape_cache_new           (guint             size);
+void                    pango_shape_cache_free          (PangoShapeCache  *cache);
+void                    pango_shape_cache_set_size      (PangoShapeCache  *cache,
+                                                         guint             size);
+guint                   pango_shape_cache_get_size      (PangoShapeCache  *cache);
+void                    pango_shape_cache_get_stats     (PangoShapeCache  *cache,
+                                                         guint            *hits,
+                                                         guint            *misses);
+
+void                    pango_shape_item_with_cache     (PangoShapeCache  *cache,
+                                                         PangoItem        *item,
+                                                         const char       *paragraph_text,
+                                                         int               paragraph_length,
+                                                         PangoLogAttr     *log_attrs,
+                                                         PangoGlyphString *glyphs,
+                                                         PangoShapeFlags   flags);
+
+G_END_DECLS
+
+#endif /* __PANGO_SHAPE_PRIVATE_H__ */
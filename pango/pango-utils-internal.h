@@ -43,6 +43,11 @@ gboolean pango_parse_flags              (GType       type,
 
 char    *_pango_trim_string             (const char *str);
 
+gboolean _pango_utf8_is_ascii           (const char *text,
+                                         int         length);
+gboolean _pango_ascii_has_letter        (const char *text,
+                                         int         length);
+
 gboolean pango_parse_width (const char *str,
                             PangoWidth *width,
                             gboolean    warn);
@@ -1253,3 +1253,76 @@ pango_find_paragraph_boundary (const char *text,
   if (start && next_paragraph_start)
     *next_paragraph_start = start - text;
 }
+
+/*
+ * _pango_utf8_is_ascii:
+ * @text: UTF-8 text
+ * @length: length of @text in bytes
+ *
+ * Checks whether @text consists only of ASCII characters,
+ * excluding NUL. The layout pipeline uses this to take shortcuts
+ * for text that has trivial bidi, script and emoji properties.
+ *
+ * The bulk of the text is checked a machine word at a time.
+ *
+ * Returns: %TRUE if @text is pure ASCII
+ */
+gboolean
+_pango_utf8_is_ascii (const char *text,
+                      int         length)
+{
+  const guchar *p = (const guchar *) text;
+  const guchar *end = p + length;
+  const gsize ones = (gsize) G_GUINT64_CONSTANT (0x0101010101010101);
+  const gsize high_bits = (gsize) G_GUINT64_CONSTANT (0x8080808080808080);
+
+  while (p < end && ((gsize) p & (sizeof (gsize) - 1)) != 0)
+    {
+      if (*p == 0 || *p >= 0x80)
+        return FALSE;
+      p++;
+    }
+
+  while ((gsize) (end - p) >= sizeof (gsize))
+    {
+      gsize word;
+
+      memcpy (&word, p, sizeof (gsize));
+
+      /* A byte has its high bit set, or is zero */
+      if ((word & high_bits) != 0 ||
+          ((word - ones) & ~word & high_bits) != 0)
+        return FALSE;
+
+      p += sizeof (gsize);
+    }
+
+  while (p < end)
+    {
+      if (*p == 0 || *p >= 0x80)
+        return FALSE;
+      p++;
+    }
+
+  return TRUE;
+}
+
+/*
+ * _pango_ascii_has_letter:
+ * @text: ASCII text
+ * @length: length of @text in bytes
+ *
+ * Returns: %TRUE if @text contains an ASCII letter
+ */
+gboolean
+_pango_ascii_has_letter (const char *text,
+                         int         length)
+{
+  int i;
+
+  for (i = 0; i < length; i++)
+    if (g_ascii_isalpha (text[i]))
+      return TRUE;
+
+  return FALSE;
+}
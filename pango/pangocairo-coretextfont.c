@@ -78,6 +78,20 @@ pango_cairo_core_text_font_get_glyph_extents (PangoFont      *font,
 					       logical_rect);
 }
 
+static void
+pango_cairo_core_text_font_get_glyph_extents_batch (PangoFont        *font,
+                                                    const PangoGlyph *glyphs,
+                                                    guint             n_glyphs,
+                                                    PangoRectangle   *ink_rects,
+                                                    PangoRectangle   *logical_rects)
+{
+  PangoCairoCoreTextFont *cfont = (PangoCairoCoreTextFont *) font;
+
+  _pango_cairo_font_private_get_glyph_extents_batch (&cfont->cf_priv,
+                                                     glyphs, n_glyphs,
+                                                     ink_rects, logical_rects);
+}
+
 static cairo_font_face_t *
 pango_cairo_core_text_font_create_font_face (PangoCairoFont *font)
 {
@@ -147,12 +161,16 @@ pango_cairo_core_text_font_class_init (PangoCairoCoreTextFontClass *class)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   PangoFontClass *font_class = PANGO_FONT_CLASS (class);
+  PangoFontClassPrivate *pclass;
 
   object_class->finalize = pango_cairo_core_text_font_finalize;
   /* font_class->describe defined by parent class PangoCoreTextFont. */
   font_class->get_glyph_extents = pango_cairo_core_text_font_get_glyph_extents;
   font_class->get_metrics = _pango_cairo_font_get_metrics;
   font_class->describe_absolute = pango_cairo_core_text_font_describe_absolute;
+
+  pclass = g_type_class_get_private ((GTypeClass *) class, PANGO_TYPE_FONT);
+  pclass->get_glyph_extents_batch = pango_cairo_core_text_font_get_glyph_extents_batch;
 }
 
 static void
@@ -28,6 +28,7 @@
 #pragma GCC diagnostic pop
 
 #include "pangofc-fontmap-private.h"
+#include "pango-font-private.h"
 #include "pangocairo-private.h"
 #include "pangocairo-fc-private.h"
 #include "pangofc-private.h"
@@ -133,6 +134,20 @@ pango_cairo_fc_font_get_glyph_extents (PangoFont      *font,
 					       logical_rect);
 }
 
+static void
+pango_cairo_fc_font_get_glyph_extents_batch (PangoFont        *font,
+                                             const PangoGlyph *glyphs,
+                                             guint             n_glyphs,
+                                             PangoRectangle   *ink_rects,
+                                             PangoRectangle   *logical_rects)
+{
+  PangoCairoFcFont *cfont = (PangoCairoFcFont *) font;
+
+  _pango_cairo_font_private_get_glyph_extents_batch (&cfont->cf_priv,
+                                                     glyphs, n_glyphs,
+                                                     ink_rects, logical_rects);
+}
+
 static FT_Face
 pango_cairo_fc_font_lock_face (PangoFcFont *font)
 {
@@ -163,6 +178,7 @@ pango_cairo_fc_font_class_init (PangoCairoFcFontClass *class)
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   PangoFontClass *font_class = PANGO_FONT_CLASS (class);
   PangoFcFontClass *fc_font_class = PANGO_FC_FONT_CLASS (class);
+  PangoFontClassPrivate *pclass;
 
   object_class->finalize = pango_cairo_fc_font_finalize;
 
@@ -171,6 +187,9 @@ pango_cairo_fc_font_class_init (PangoCairoFcFontClass *class)
 
   fc_font_class->lock_face = pango_cairo_fc_font_lock_face;
   fc_font_class->unlock_face = pango_cairo_fc_font_unlock_face;
+
+  pclass = g_type_class_get_private ((GTypeClass *) class, PANGO_TYPE_FONT);
+  pclass->get_glyph_extents_batch = pango_cairo_fc_font_get_glyph_extents_batch;
 }
 
 static void
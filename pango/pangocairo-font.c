@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include <math.h>
+#include <string.h>
 #include "pangocairo.h"
 #include "pangocairo-private.h"
 #include "pango-font-private.h"
@@ -36,9 +37,172 @@
 typedef PangoCairoFontIface PangoCairoFontInterface;
 G_DEFINE_INTERFACE (PangoCairoFont, pango_cairo_font, PANGO_TYPE_FONT)
 
+/* The glyph extents cache is set-associative: a glyph can be
+ * in any of the GLYPH_CACHE_WAYS slots of the set that the low
+ * bits of its id select. Within a set, slots are kept in most
+ * recently used order, so the least recently used glyph is the
+ * one that gets replaced.
+ *
+ * The glyph ids of a set are kept together, apart from the
+ * extents, so that a lookup reads a single 16-byte group of
+ * ids, and the extents of only the glyph that it finds.
+ *
+ * The cache starts out with 256 slots, which is plenty for
+ * scripts with few glyphs. Whenever it has seen as many misses
+ * as it has slots, it checks how many of them replaced another
+ * glyph, and doubles its size if that was more than an eighth.
+ * Fonts with big working sets, like CJK, Indic or emoji fonts,
+ * thus get a bigger cache, up to GLYPH_CACHE_MAX_SETS sets.
+ */
+
+#define GLYPH_CACHE_WAYS 4
+#define GLYPH_CACHE_MIN_SETS 64 /* must be a power of two */
+#define GLYPH_CACHE_MAX_SETS 4096
+
+/* PANGO_GLYPH_EMPTY is never looked up in the cache */
+#define GLYPH_CACHE_INVALID PANGO_GLYPH_EMPTY
+
+typedef struct
+{
+  int            width;
+  PangoRectangle ink_rect;
+} PangoCairoFontGlyphExtentsCacheEntry;
+
+struct _PangoCairoFontGlyphExtentsCache
+{
+  guint n_sets;
+
+  PangoGlyph *glyphs;                            /* n_sets * GLYPH_CACHE_WAYS */
+  PangoCairoFontGlyphExtentsCacheEntry *entries; /* n_sets * GLYPH_CACHE_WAYS */
+
+  guint window_misses;
+  guint window_evictions;
+
+  guint64 hits;
+  guint64 misses;
+};
+
+static PangoCairoFontGlyphExtentsCache *
+glyph_extents_cache_new (guint n_sets)
+{
+  PangoCairoFontGlyphExtentsCache *cache;
+  guint i;
+
+  cache = g_new0 (PangoCairoFontGlyphExtentsCache, 1);
+  cache->n_sets = n_sets;
+  cache->glyphs = g_new (PangoGlyph, n_sets * GLYPH_CACHE_WAYS);
+  cache->entries = g_new (PangoCairoFontGlyphExtentsCacheEntry, n_sets * GLYPH_CACHE_WAYS);
+
+  for (i = 0; i < n_sets * GLYPH_CACHE_WAYS; i++)
+    cache->glyphs[i] = GLYPH_CACHE_INVALID;
+
+  return cache;
+}
+
+static void
+glyph_extents_cache_free (PangoCairoFontGlyphExtentsCache *cache)
+{
+  g_free (cache->glyphs);
+  g_free (cache->entries);
+  g_free (cache);
+}
+
+static PangoCairoFontGlyphExtentsCacheEntry *
+glyph_extents_cache_lookup (PangoCairoFontGlyphExtentsCache *cache,
+                            PangoGlyph                       glyph)
+{
+  guint set = (glyph & (cache->n_sets - 1)) * GLYPH_CACHE_WAYS;
+  PangoGlyph *glyphs = cache->glyphs + set;
+  PangoCairoFontGlyphExtentsCacheEntry *entries = cache->entries + set;
+  guint i;
+
+  for (i = 0; i < GLYPH_CACHE_WAYS; i++)
+    {
+      if (glyphs[i] == glyph)
+        {
+          if (i > 0)
+            {
+              PangoCairoFontGlyphExtentsCacheEntry entry = entries[i];
+
+              /* Move to the front of the set */
+              memmove (glyphs + 1, glyphs, i * sizeof (PangoGlyph));
+              memmove (entries + 1, entries, i * sizeof (PangoCairoFontGlyphExtentsCacheEntry));
+              glyphs[0] = glyph;
+              entries[0] = entry;
+            }
+
+          return &entries[0];
+        }
+    }
+
+  return NULL;
+}
+
+/* Makes room for @glyph at the front of its set, dropping
+ * the least recently used glyph of the set if it is full,
+ * and returns the entry for the caller to fill in
+ */
+static PangoCairoFontGlyphExtentsCacheEntry *
+glyph_extents_cache_insert (PangoCairoFontGlyphExtentsCache *cache,
+                            PangoGlyph                       glyph)
+{
+  guint set = (glyph & (cache->n_sets - 1)) * GLYPH_CACHE_WAYS;
+  PangoGlyph *glyphs = cache->glyphs + set;
+  PangoCairoFontGlyphExtentsCacheEntry *entries = cache->entries + set;
+
+  if (glyphs[GLYPH_CACHE_WAYS - 1] != GLYPH_CACHE_INVALID)
+    cache->window_evictions++;
+
+  memmove (glyphs + 1, glyphs, (GLYPH_CACHE_WAYS - 1) * sizeof (PangoGlyph));
+  memmove (entries + 1, entries, (GLYPH_CACHE_WAYS - 1) * sizeof (PangoCairoFontGlyphExtentsCacheEntry));
+  glyphs[0] = glyph;
+
+  return &entries[0];
+}
+
+static void
+glyph_extents_cache_maybe_grow (PangoCairoFontGlyphExtentsCache *cache)
+{
+  PangoCairoFontGlyphExtentsCache *bigger;
+  guint n_entries = cache->n_sets * GLYPH_CACHE_WAYS;
+  guint i;
+  int j;
+
+  if (++cache->window_misses < n_entries)
+    return;
+
+  if (cache->window_evictions > n_entries / 8 &&
+      cache->n_sets < GLYPH_CACHE_MAX_SETS)
+    {
+      bigger = glyph_extents_cache_new (2 * cache->n_sets);
+
+      /* Reinsert least recently used first, to keep the order */
+      for (i = 0; i < cache->n_sets; i++)
+        for (j = GLYPH_CACHE_WAYS - 1; j >= 0; j--)
+          {
+            PangoGlyph glyph = cache->glyphs[i * GLYPH_CACHE_WAYS + j];
+
+            if (glyph != GLYPH_CACHE_INVALID)
+              *glyph_extents_cache_insert (bigger, glyph) = cache->entries[i * GLYPH_CACHE_WAYS + j];
+          }
+
+      g_free (cache->glyphs);
+      g_free (cache->entries);
+      cache->n_sets = bigger->n_sets;
+      cache->glyphs = g_steal_pointer (&bigger->glyphs);
+      cache->entries = g_steal_pointer (&bigger->entries);
+      g_free (bigger);
+    }
+
+  cache->window_misses = 0;
+  cache->window_evictions = 0;
+}
+
 static PangoCairoFontHexBoxInfo *
 _pango_cairo_font_private_get_hex_box_info (PangoCairoFontPrivate *cf_priv);
 static void
+_pango_cairo_font_hex_box_info_destroy (PangoCairoFontHexBoxInfo *hbi);
+static void
 _pango_cairo_font_private_get_glyph_extents_missing (PangoCairoFontPrivate *cf_priv,
 						     PangoGlyph             glyph,
 						     PangoRectangle        *ink_rect,
@@ -105,6 +269,8 @@ pango_cairo_hex_box_encode_glyph (PangoCairoFontPrivate *cf_priv,
   if (!(glyph & PANGO_GLYPH_UNKNOWN_FLAG))
     return glyph;
 
+  g_mutex_lock (&cf_priv->mutex);
+
   if (!cf_priv->hex_box_glyphs)
     {
       cf_priv->hex_box_glyph_base = 1;
@@ -113,17 +279,20 @@ pango_cairo_hex_box_encode_glyph (PangoCairoFontPrivate *cf_priv,
     }
 
   value = g_hash_table_lookup (cf_priv->hex_box_glyphs, GUINT_TO_POINTER (glyph));
-  if (value)
-    return GPOINTER_TO_UINT (value);
+  if (!value &&
+      cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len <= 0xFFFF)
+    {
+      value = GUINT_TO_POINTER (cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len);
+      g_hash_table_insert (cf_priv->hex_box_glyphs,
+                           GUINT_TO_POINTER (glyph),
+                           value);
+      g_array_append_val (cf_priv->hex_box_pango_glyphs, glyph);
+    }
 
-  if (cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len > 0xFFFF)
-    return glyph;
+  g_mutex_unlock (&cf_priv->mutex);
 
-  value = GUINT_TO_POINTER (cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len);
-  g_hash_table_insert (cf_priv->hex_box_glyphs,
-                       GUINT_TO_POINTER (glyph),
-                       value);
-  g_array_append_val (cf_priv->hex_box_pango_glyphs, glyph);
+  if (!value)
+    return glyph;
 
   return GPOINTER_TO_UINT (value);
 }
@@ -132,14 +301,20 @@ static PangoGlyph
 pango_cairo_hex_box_decode_glyph (PangoCairoFontPrivate *cf_priv,
                                   unsigned long          glyph)
 {
+  PangoGlyph result = glyph;
+
+  g_mutex_lock (&cf_priv->mutex);
+
   if (cf_priv->hex_box_pango_glyphs &&
       glyph >= cf_priv->hex_box_glyph_base &&
       glyph < cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len)
-    return g_array_index (cf_priv->hex_box_pango_glyphs,
-                          PangoGlyph,
-                          glyph - cf_priv->hex_box_glyph_base);
+    result = g_array_index (cf_priv->hex_box_pango_glyphs,
+                            PangoGlyph,
+                            glyph - cf_priv->hex_box_glyph_base);
 
-  return glyph;
+  g_mutex_unlock (&cf_priv->mutex);
+
+  return result;
 }
 
 static void
@@ -464,34 +639,29 @@ cairo_scaled_font_t *
 _pango_cairo_font_private_get_scaled_font (PangoCairoFontPrivate *cf_priv)
 {
   cairo_font_face_t *font_face;
+  cairo_scaled_font_t *scaled_font = NULL;
 
-  if (G_LIKELY (cf_priv->scaled_font))
+  /* Only one thread gets to create it, and we only
+   * try once, even if that fails
+   */
+  if (G_LIKELY (!g_once_init_enter (&cf_priv->scaled_font_initialized)))
     return cf_priv->scaled_font;
 
-  /* need to create it */
-
-  if (G_UNLIKELY (cf_priv->data == NULL))
-    {
-      /* we have tried to create and failed before */
-      return NULL;
-    }
-
   font_face = (* PANGO_CAIRO_FONT_GET_IFACE (cf_priv->cfont)->create_font_face) (cf_priv->cfont);
   if (G_UNLIKELY (font_face == NULL))
     goto done;
 
-  cf_priv->scaled_font = cairo_scaled_font_create (font_face,
-						   &cf_priv->data->font_matrix,
-						   &cf_priv->data->ctm,
-						   cf_priv->data->options);
+  scaled_font = cairo_scaled_font_create (font_face,
+                                          &cf_priv->data->font_matrix,
+                                          &cf_priv->data->ctm,
+                                          cf_priv->data->options);
 
   cairo_font_face_destroy (font_face);
 
 done:
 
-  if (G_UNLIKELY (cf_priv->scaled_font == NULL || cairo_scaled_font_status (cf_priv->scaled_font) != CAIRO_STATUS_SUCCESS))
+  if (G_UNLIKELY (scaled_font == NULL || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
     {
-      cairo_scaled_font_t *scaled_font = cf_priv->scaled_font;
       PangoFont *font = PANGO_FONT (cf_priv->cfont);
       static GQuark warned_quark = 0; /* MT-safe */
       if (!warned_quark)
@@ -529,10 +699,13 @@ done:
 	}
     }
 
-  _pango_cairo_font_private_scaled_font_data_destroy (cf_priv->data);
-  cf_priv->data = NULL;
+  /* We keep cf_priv->data around, since other threads
+   * may be looking at it in get_font_options()
+   */
+  g_atomic_pointer_set (&cf_priv->scaled_font, scaled_font);
+  g_once_init_leave (&cf_priv->scaled_font_initialized, 1);
 
-  return cf_priv->scaled_font;
+  return scaled_font;
 }
 
 cairo_scaled_font_t *
@@ -544,12 +717,14 @@ _pango_cairo_font_get_hex_box_scaled_font (PangoCairoFont *cfont)
   cairo_font_options_t *font_options;
   cairo_matrix_t ctm, font_matrix;
   PangoCairoHexBoxFontUserData *user_data;
+  cairo_scaled_font_t *hex_box_scaled_font;
 
   if (G_UNLIKELY (!cf_priv))
     return NULL;
 
-  if (cf_priv->hex_box_scaled_font)
-    return cf_priv->hex_box_scaled_font;
+  hex_box_scaled_font = g_atomic_pointer_get (&cf_priv->hex_box_scaled_font);
+  if (hex_box_scaled_font)
+    return hex_box_scaled_font;
 
   native_scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
   if (G_UNLIKELY (!native_scaled_font || cairo_scaled_font_status (native_scaled_font) != CAIRO_STATUS_SUCCESS))
@@ -581,25 +756,30 @@ _pango_cairo_font_get_hex_box_scaled_font (PangoCairoFont *cfont)
   font_options = cairo_font_options_create ();
   cairo_scaled_font_get_font_options (native_scaled_font, font_options);
 
-  cf_priv->hex_box_scaled_font = cairo_scaled_font_create (font_face,
-                                                           &font_matrix,
-                                                           &ctm,
-                                                           font_options);
+  hex_box_scaled_font = cairo_scaled_font_create (font_face,
+                                                  &font_matrix,
+                                                  &ctm,
+                                                  font_options);
 
   cairo_font_options_destroy (font_options);
   cairo_font_face_destroy (font_face);
 
-  if (G_UNLIKELY (!cf_priv->hex_box_scaled_font ||
-                  cairo_scaled_font_status (cf_priv->hex_box_scaled_font) != CAIRO_STATUS_SUCCESS))
+  if (G_UNLIKELY (!hex_box_scaled_font ||
+                  cairo_scaled_font_status (hex_box_scaled_font) != CAIRO_STATUS_SUCCESS))
     {
-      cairo_scaled_font_t *scaled_font = cf_priv->hex_box_scaled_font;
+      if (hex_box_scaled_font)
+        cairo_scaled_font_destroy (hex_box_scaled_font);
+      return NULL;
+    }
 
-      cf_priv->hex_box_scaled_font = NULL;
-      if (scaled_font)
-        cairo_scaled_font_destroy (scaled_font);
+  /* Another thread may have created one meanwhile */
+  if (!g_atomic_pointer_compare_and_exchange (&cf_priv->hex_box_scaled_font, NULL, hex_box_scaled_font))
+    {
+      cairo_scaled_font_destroy (hex_box_scaled_font);
+      hex_box_scaled_font = g_atomic_pointer_get (&cf_priv->hex_box_scaled_font);
     }
 
-  return cf_priv->hex_box_scaled_font;
+  return hex_box_scaled_font;
 }
 
 unsigned long
@@ -640,6 +820,61 @@ pango_cairo_font_get_scaled_font (PangoCairoFont *cfont)
   return _pango_cairo_font_private_get_scaled_font (cf_priv);
 }
 
+/**
+ * pango_cairo_font_get_glyph_extents_cache_stats:
+ * @font: (nullable): a `PangoFont` from a `PangoCairoFontMap`
+ * @hits: (out) (optional): return location for the number of lookups
+ *   that were found in the cache
+ * @misses: (out) (optional): return location for the number of lookups
+ *   that had to compute the glyph extents
+ * @n_entries: (out) (optional): return location for the current size
+ *   of the cache
+ *
+ * Gets statistics about the cache that @font keeps for the
+ * extents of its glyphs.
+ *
+ * The cache grows with the number of distinct glyphs that
+ * are used with the font.
+ *
+ * Since: 1.60
+ */
+void
+pango_cairo_font_get_glyph_extents_cache_stats (PangoCairoFont *cfont,
+                                                guint64        *hits,
+                                                guint64        *misses,
+                                                guint          *n_entries)
+{
+  PangoCairoFontPrivate *cf_priv;
+  PangoCairoFontGlyphExtentsCache *cache;
+
+  if (hits)
+    *hits = 0;
+  if (misses)
+    *misses = 0;
+  if (n_entries)
+    *n_entries = 0;
+
+  if (G_UNLIKELY (!cfont))
+    return;
+
+  cf_priv = PANGO_CAIRO_FONT_PRIVATE (cfont);
+
+  g_mutex_lock (&cf_priv->mutex);
+
+  cache = cf_priv->glyph_extents_cache;
+  if (cache)
+    {
+      if (hits)
+        *hits = cache->hits;
+      if (misses)
+        *misses = cache->misses;
+      if (n_entries)
+        *n_entries = cache->n_sets * GLYPH_CACHE_WAYS;
+    }
+
+  g_mutex_unlock (&cf_priv->mutex);
+}
+
 void
 pango_cairo_font_get_font_options (PangoCairoFont       *cfont,
                                    cairo_font_options_t *options)
@@ -709,126 +944,171 @@ typedef struct _PangoCairoFontMetricsInfo
   PangoFontMetrics *metrics;
 } PangoCairoFontMetricsInfo;
 
+static void
+free_metrics_info (PangoCairoFontMetricsInfo *info)
+{
+  pango_font_metrics_unref (info->metrics);
+  g_slice_free (PangoCairoFontMetricsInfo, info);
+}
+
+/* Must be called with cf_priv->mutex held */
+static PangoCairoFontMetricsInfo *
+find_metrics_info (PangoCairoFontPrivate *cf_priv,
+                   const char            *sample_str)
+{
+  GSList *tmp_list;
+
+  for (tmp_list = cf_priv->metrics_by_lang; tmp_list; tmp_list = tmp_list->next)
+    {
+      PangoCairoFontMetricsInfo *info = tmp_list->data;
+
+      if (info->sample_str == sample_str)    /* We _don't_ need strcmp */
+        return info;
+    }
+
+  return NULL;
+}
+
 PangoFontMetrics *
 _pango_cairo_font_get_metrics (PangoFont     *font,
 			       PangoLanguage *language)
 {
   PangoCairoFont *cfont = (PangoCairoFont *) font;
   PangoCairoFontPrivate *cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
-  PangoCairoFontMetricsInfo *info = NULL; /* Quiet gcc */
-  GSList *tmp_list;
-  static int in_get_metrics;
+  PangoCairoFontMetricsInfo *info, *other;
+  PangoFontMetrics *metrics;
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  cairo_font_options_t *font_options;
+  PangoLayout *layout;
+  PangoRectangle extents;
+  PangoFontDescription *desc;
+  cairo_scaled_font_t *scaled_font;
+  glong sample_str_width;
+  gboolean recursing;
+  int height, shift;
+  /* Per thread, since fonts can be shared between threads */
+  static GPrivate in_get_metrics;
 
   const char *sample_str = pango_language_get_sample_string (language);
 
-  tmp_list = cf_priv->metrics_by_lang;
-  while (tmp_list)
-    {
-      info = tmp_list->data;
+  g_mutex_lock (&cf_priv->mutex);
+  info = find_metrics_info (cf_priv, sample_str);
+  metrics = info ? pango_font_metrics_ref (info->metrics) : NULL;
+  g_mutex_unlock (&cf_priv->mutex);
 
-      if (info->sample_str == sample_str)    /* We _don't_ need strcmp */
-	break;
+  if (metrics)
+    return metrics;
 
-      tmp_list = tmp_list->next;
-    }
+  /* We compute the metrics without holding the lock, since we
+   * call into PangoLayout below, and add them afterwards, unless
+   * another thread was faster.
+   */
 
-  if (!tmp_list)
-    {
-      PangoFontMap *fontmap;
-      PangoContext *context;
-      cairo_font_options_t *font_options;
-      PangoLayout *layout;
-      PangoRectangle extents;
-      PangoFontDescription *desc;
-      cairo_scaled_font_t *scaled_font;
-      glong sample_str_width;
+  /* XXX this is racy.  need a ref'ing getter... */
+  fontmap = pango_font_get_font_map (font);
+  if (!fontmap)
+    return pango_font_metrics_new ();
+  fontmap = g_object_ref (fontmap);
 
-      int height, shift;
+  info = g_slice_new0 (PangoCairoFontMetricsInfo);
 
-      /* XXX this is racy.  need a ref'ing getter... */
-      fontmap = pango_font_get_font_map (font);
-      if (!fontmap)
-        return pango_font_metrics_new ();
-      fontmap = g_object_ref (fontmap);
+  info->sample_str = sample_str;
 
-      info = g_slice_new0 (PangoCairoFontMetricsInfo);
+  scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
 
-      cf_priv->metrics_by_lang = g_slist_prepend (cf_priv->metrics_by_lang, info);
+  context = pango_font_map_create_context (fontmap);
+  pango_context_set_language (context, language);
 
-      info->sample_str = sample_str;
+  font_options = cairo_font_options_create ();
+  cairo_scaled_font_get_font_options (scaled_font, font_options);
+  pango_cairo_context_set_font_options (context, font_options);
+  cairo_font_options_destroy (font_options);
 
-      scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
+  info->metrics = (* PANGO_CAIRO_FONT_GET_IFACE (font)->create_base_metrics_for_context) (cfont, context);
 
-      context = pango_font_map_create_context (fontmap);
-      pango_context_set_language (context, language);
+  /* Ugly. We need to prevent recursion when we call into
+   * PangoLayout to determine approximate char width.
+   */
+  recursing = g_private_get (&in_get_metrics) != NULL;
+  if (!recursing)
+    {
+      g_private_set (&in_get_metrics, GINT_TO_POINTER (1));
 
-      font_options = cairo_font_options_create ();
-      cairo_scaled_font_get_font_options (scaled_font, font_options);
-      pango_cairo_context_set_font_options (context, font_options);
-      cairo_font_options_destroy (font_options);
+      /* Update approximate_*_width now */
+      layout = pango_layout_new (context);
+      desc = pango_font_describe_with_absolute_size (font);
+      pango_layout_set_font_description (layout, desc);
+      pango_font_description_free (desc);
 
-      info->metrics = (* PANGO_CAIRO_FONT_GET_IFACE (font)->create_base_metrics_for_context) (cfont, context);
+      pango_layout_set_text (layout, sample_str, -1);
+      pango_layout_get_extents (layout, NULL, &extents);
 
-      /* Ugly. We need to prevent recursion when we call into
-       * PangoLayout to determine approximate char width.
-       */
-      if (!in_get_metrics)
-        {
-          in_get_metrics = 1;
+      sample_str_width = pango_utf8_strwidth (sample_str);
+      g_assert (sample_str_width > 0);
+      info->metrics->approximate_char_width = extents.width / sample_str_width;
 
-          /* Update approximate_*_width now */
-          layout = pango_layout_new (context);
-          desc = pango_font_describe_with_absolute_size (font);
-          pango_layout_set_font_description (layout, desc);
-          pango_font_description_free (desc);
+      pango_layout_set_text (layout, "0123456789", -1);
+      info->metrics->approximate_digit_width = max_glyph_width (layout);
 
-          pango_layout_set_text (layout, sample_str, -1);
-          pango_layout_get_extents (layout, NULL, &extents);
+      g_object_unref (layout);
+      g_private_set (&in_get_metrics, NULL);
+    }
 
-          sample_str_width = pango_utf8_strwidth (sample_str);
-          g_assert (sample_str_width > 0);
-          info->metrics->approximate_char_width = extents.width / sample_str_width;
+  /* We may actually reuse ascent/descent we got from cairo here.  that's
+   * in cf_priv->font_extents.
+   */
+  height = info->metrics->ascent + info->metrics->descent;
+  switch (cf_priv->gravity)
+    {
+      default:
+      case PANGO_GRAVITY_AUTO:
+      case PANGO_GRAVITY_SOUTH:
+	break;
+      case PANGO_GRAVITY_NORTH:
+	info->metrics->ascent = info->metrics->descent;
+	break;
+      case PANGO_GRAVITY_EAST:
+      case PANGO_GRAVITY_WEST:
+	{
+	  int ascent = height / 2;
+	  if (cf_priv->is_hinted)
+	    ascent = PANGO_UNITS_ROUND (ascent);
+	  info->metrics->ascent = ascent;
+	}
+    }
+  shift = (height - info->metrics->ascent) - info->metrics->descent;
+  info->metrics->descent += shift;
+  info->metrics->underline_position -= shift;
+  info->metrics->strikethrough_position -= shift;
+  info->metrics->ascent = height - info->metrics->descent;
 
-          pango_layout_set_text (layout, "0123456789", -1);
-          info->metrics->approximate_digit_width = max_glyph_width (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
 
-          g_object_unref (layout);
-          in_get_metrics = 0;
-        }
+  /* Metrics computed while recursing lack the approximate
+   * widths, so we don't keep them
+   */
+  if (recursing)
+    {
+      metrics = pango_font_metrics_ref (info->metrics);
+      free_metrics_info (info);
+      return metrics;
+    }
 
-      /* We may actually reuse ascent/descent we got from cairo here.  that's
-       * in cf_priv->font_extents.
-       */
-      height = info->metrics->ascent + info->metrics->descent;
-      switch (cf_priv->gravity)
-	{
-	  default:
-	  case PANGO_GRAVITY_AUTO:
-	  case PANGO_GRAVITY_SOUTH:
-	    break;
-	  case PANGO_GRAVITY_NORTH:
-	    info->metrics->ascent = info->metrics->descent;
-	    break;
-	  case PANGO_GRAVITY_EAST:
-	  case PANGO_GRAVITY_WEST:
-	    {
-	      int ascent = height / 2;
-	      if (cf_priv->is_hinted)
-	        ascent = PANGO_UNITS_ROUND (ascent);
-	      info->metrics->ascent = ascent;
-	    }
-	}
-      shift = (height - info->metrics->ascent) - info->metrics->descent;
-      info->metrics->descent += shift;
-      info->metrics->underline_position -= shift;
-      info->metrics->strikethrough_position -= shift;
-      info->metrics->ascent = height - info->metrics->descent;
-
-      g_object_unref (context);
-      g_object_unref (fontmap);
+  g_mutex_lock (&cf_priv->mutex);
+  other = find_metrics_info (cf_priv, sample_str);
+  if (other)
+    {
+      free_metrics_info (info);
+      info = other;
     }
+  else
+    cf_priv->metrics_by_lang = g_slist_prepend (cf_priv->metrics_by_lang, info);
+  metrics = pango_font_metrics_ref (info->metrics);
+  g_mutex_unlock (&cf_priv->mutex);
 
-  return pango_font_metrics_ref (info->metrics);
+  return metrics;
 }
 
 static PangoCairoFontHexBoxInfo *
@@ -860,8 +1140,9 @@ _pango_cairo_font_private_get_hex_box_info (PangoCairoFontPrivate *cf_priv)
   if (!cf_priv)
     return NULL;
 
-  if (cf_priv->hbi)
-    return cf_priv->hbi;
+  hbi = g_atomic_pointer_get (&cf_priv->hbi);
+  if (hbi)
+    return hbi;
 
   scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
   if (G_UNLIKELY (scaled_font == NULL || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
@@ -1028,7 +1309,13 @@ _pango_cairo_font_private_get_hex_box_info (PangoCairoFontPrivate *cf_priv)
        hbi->box_descent = HINT_Y (hbi->box_descent);
     }
 
-  cf_priv->hbi = hbi;
+  /* Another thread may have computed it meanwhile */
+  if (!g_atomic_pointer_compare_and_exchange (&cf_priv->hbi, NULL, hbi))
+    {
+      _pango_cairo_font_hex_box_info_destroy (hbi);
+      hbi = g_atomic_pointer_get (&cf_priv->hbi);
+    }
+
   return hbi;
 }
 
@@ -1088,9 +1375,11 @@ _pango_cairo_font_private_initialize (PangoCairoFontPrivate      *cf_priv,
   cf_priv->data->options = cairo_font_options_copy (font_options);
   cf_priv->is_hinted = cairo_font_options_get_hint_metrics (font_options) != CAIRO_HINT_METRICS_OFF;
 
+  cf_priv->scaled_font_initialized = 0;
   cf_priv->scaled_font = NULL;
   cf_priv->hex_box_scaled_font = NULL;
   cf_priv->hbi = NULL;
+  g_mutex_init (&cf_priv->mutex);
   cf_priv->hex_box_glyphs = NULL;
   cf_priv->hex_box_pango_glyphs = NULL;
   cf_priv->hex_box_glyph_base = 0;
@@ -1098,17 +1387,11 @@ _pango_cairo_font_private_initialize (PangoCairoFontPrivate      *cf_priv,
   cf_priv->metrics_by_lang = NULL;
 }
 
-static void
-free_metrics_info (PangoCairoFontMetricsInfo *info)
-{
-  pango_font_metrics_unref (info->metrics);
-  g_slice_free (PangoCairoFontMetricsInfo, info);
-}
-
 void
 _pango_cairo_font_private_finalize (PangoCairoFontPrivate *cf_priv)
 {
   _pango_cairo_font_private_scaled_font_data_destroy (cf_priv->data);
+  cf_priv->data = NULL;
 
   if (cf_priv->scaled_font)
     cairo_scaled_font_destroy (cf_priv->scaled_font);
@@ -1131,12 +1414,14 @@ _pango_cairo_font_private_finalize (PangoCairoFontPrivate *cf_priv)
   cf_priv->hex_box_glyph_base = 0;
 
   if (cf_priv->glyph_extents_cache)
-    g_free (cf_priv->glyph_extents_cache);
+    glyph_extents_cache_free (cf_priv->glyph_extents_cache);
   cf_priv->glyph_extents_cache = NULL;
 
   g_slist_foreach (cf_priv->metrics_by_lang, (GFunc)free_metrics_info, NULL);
   g_slist_free (cf_priv->metrics_by_lang);
   cf_priv->metrics_by_lang = NULL;
+
+  g_mutex_clear (&cf_priv->mutex);
 }
 
 gboolean
@@ -1149,8 +1434,10 @@ void
 pango_cairo_font_private_get_font_options (PangoCairoFontPrivate *cf_priv,
                                            cairo_font_options_t  *options)
 {
-  if (cf_priv->scaled_font)
-    cairo_scaled_font_get_font_options (cf_priv->scaled_font, options);
+  cairo_scaled_font_t *scaled_font = g_atomic_pointer_get (&cf_priv->scaled_font);
+
+  if (scaled_font)
+    cairo_scaled_font_get_font_options (scaled_font, options);
   else if (cf_priv->data)
     cairo_font_options_merge (options, cf_priv->data->options);
 }
@@ -1233,20 +1520,6 @@ _pango_cairo_font_private_get_glyph_extents_missing (PangoCairoFontPrivate *cf_p
     }
 }
 
-#define GLYPH_CACHE_NUM_ENTRIES 256 /* should be power of two */
-#define GLYPH_CACHE_MASK (GLYPH_CACHE_NUM_ENTRIES - 1)
-/* An entry in the fixed-size cache for the glyph->extents mapping.
- * The cache is indexed by the lower N bits of the glyph (see
- * GLYPH_CACHE_NUM_ENTRIES).  For scripts with few glyphs,
- * this should provide pretty much instant lookups.
- */
-struct _PangoCairoFontGlyphExtentsCacheEntry
-{
-  PangoGlyph     glyph;
-  int            width;
-  PangoRectangle ink_rect;
-};
-
 static gboolean
 _pango_cairo_font_private_glyph_extents_cache_init (PangoCairoFontPrivate *cf_priv)
 {
@@ -1299,11 +1572,7 @@ _pango_cairo_font_private_glyph_extents_cache_init (PangoCairoFontPrivate *cf_pr
     }
 
   if (!cf_priv->glyph_extents_cache)
-    {
-      cf_priv->glyph_extents_cache = g_new0 (PangoCairoFontGlyphExtentsCacheEntry, GLYPH_CACHE_NUM_ENTRIES);
-      /* Make sure all cache entries are invalid initially */
-      cf_priv->glyph_extents_cache[0].glyph = 1; /* glyph 1 cannot happen in bucket 0 */
-    }
+    cf_priv->glyph_extents_cache = glyph_extents_cache_new (GLYPH_CACHE_MIN_SETS);
 
   return TRUE;
 }
@@ -1326,7 +1595,6 @@ compute_glyph_extents (PangoCairoFontPrivate  *cf_priv,
   cairo_scaled_font_glyph_extents (_pango_cairo_font_private_get_scaled_font (cf_priv),
 				   &cairo_glyph, 1, &extents);
 
-  entry->glyph = glyph;
   if (PANGO_GRAVITY_IS_VERTICAL (cf_priv->gravity))
     entry->width = pango_units_from_double (extents.y_advance);
   else
@@ -1341,20 +1609,60 @@ static PangoCairoFontGlyphExtentsCacheEntry *
 _pango_cairo_font_private_get_glyph_extents_cache_entry (PangoCairoFontPrivate  *cf_priv,
 							 PangoGlyph              glyph)
 {
+  PangoCairoFontGlyphExtentsCache *cache = cf_priv->glyph_extents_cache;
   PangoCairoFontGlyphExtentsCacheEntry *entry;
-  guint idx;
 
-  idx = glyph & GLYPH_CACHE_MASK;
-  entry = cf_priv->glyph_extents_cache + idx;
-
-  if (entry->glyph != glyph)
+  entry = glyph_extents_cache_lookup (cache, glyph);
+  if (G_LIKELY (entry))
     {
-      compute_glyph_extents (cf_priv, glyph, entry);
+      cache->hits++;
+      return entry;
     }
 
+  cache->misses++;
+
+  glyph_extents_cache_maybe_grow (cache);
+
+  entry = glyph_extents_cache_insert (cache, glyph);
+  compute_glyph_extents (cf_priv, glyph, entry);
+
   return entry;
 }
 
+static void
+glyph_extents_from_cache_entry (PangoCairoFontPrivate                *cf_priv,
+				PangoCairoFontGlyphExtentsCacheEntry *entry,
+				PangoRectangle                       *ink_rect,
+				PangoRectangle                       *logical_rect)
+{
+  if (ink_rect)
+    *ink_rect = entry->ink_rect;
+  if (logical_rect)
+    {
+      *logical_rect = cf_priv->font_extents;
+      switch (cf_priv->gravity)
+        {
+        case PANGO_GRAVITY_SOUTH:
+          logical_rect->width = entry->width;
+          break;
+        case PANGO_GRAVITY_EAST:
+          logical_rect->width = cf_priv->font_extents.height;
+          logical_rect->x = - logical_rect->width;
+          break;
+        case PANGO_GRAVITY_NORTH:
+          logical_rect->width = entry->width;
+          break;
+        case PANGO_GRAVITY_WEST:
+          logical_rect->width = - cf_priv->font_extents.height;
+          logical_rect->x = - logical_rect->width;
+          break;
+        case PANGO_GRAVITY_AUTO:
+        default:
+          g_assert_not_reached ();
+        }
+    }
+}
+
 void
 _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
 					     PangoGlyph             glyph,
@@ -1363,10 +1671,19 @@ _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
 {
   PangoCairoFontGlyphExtentsCacheEntry *entry;
 
-  if (!cf_priv ||
-      (cf_priv->glyph_extents_cache == NULL &&
-       !_pango_cairo_font_private_glyph_extents_cache_init (cf_priv)))
+  if (!cf_priv)
+    {
+      /* Get generic unknown-glyph extents. */
+      pango_font_get_glyph_extents (NULL, glyph, ink_rect, logical_rect);
+      return;
+    }
+
+  g_mutex_lock (&cf_priv->mutex);
+
+  if (cf_priv->glyph_extents_cache == NULL &&
+      !_pango_cairo_font_private_glyph_extents_cache_init (cf_priv))
     {
+      g_mutex_unlock (&cf_priv->mutex);
       /* Get generic unknown-glyph extents. */
       pango_font_get_glyph_extents (NULL, glyph, ink_rect, logical_rect);
       return;
@@ -1378,40 +1695,91 @@ _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
 	ink_rect->x = ink_rect->y = ink_rect->width = ink_rect->height = 0;
       if (logical_rect)
 	*logical_rect = cf_priv->font_extents;
+      g_mutex_unlock (&cf_priv->mutex);
       return;
     }
   else if (glyph & PANGO_GLYPH_UNKNOWN_FLAG)
     {
+      /* This loads another font for the hex box, so we
+       * don't want to hold the lock
+       */
+      g_mutex_unlock (&cf_priv->mutex);
       _pango_cairo_font_private_get_glyph_extents_missing (cf_priv, glyph, ink_rect, logical_rect);
       return;
     }
 
   entry = _pango_cairo_font_private_get_glyph_extents_cache_entry (cf_priv, glyph);
+  glyph_extents_from_cache_entry (cf_priv, entry, ink_rect, logical_rect);
 
-  if (ink_rect)
-    *ink_rect = entry->ink_rect;
-  if (logical_rect)
+  g_mutex_unlock (&cf_priv->mutex);
+}
+
+/* Like _pango_cairo_font_private_get_glyph_extents(), but takes
+ * the lock only once for all the glyphs. Unknown glyphs are done
+ * afterwards, since their extents come from another font.
+ */
+void
+_pango_cairo_font_private_get_glyph_extents_batch (PangoCairoFontPrivate *cf_priv,
+						   const PangoGlyph      *glyphs,
+						   guint                  n_glyphs,
+						   PangoRectangle        *ink_rects,
+						   PangoRectangle        *logical_rects)
+{
+  gboolean have_unknown = FALSE;
+  guint i;
+
+  if (!cf_priv)
     {
-      *logical_rect = cf_priv->font_extents;
-      switch (cf_priv->gravity)
+      for (i = 0; i < n_glyphs; i++)
+        pango_font_get_glyph_extents (NULL, glyphs[i],
+                                      ink_rects ? &ink_rects[i] : NULL,
+                                      logical_rects ? &logical_rects[i] : NULL);
+      return;
+    }
+
+  g_mutex_lock (&cf_priv->mutex);
+
+  if (cf_priv->glyph_extents_cache == NULL &&
+      !_pango_cairo_font_private_glyph_extents_cache_init (cf_priv))
+    {
+      g_mutex_unlock (&cf_priv->mutex);
+      _pango_cairo_font_private_get_glyph_extents_batch (NULL, glyphs, n_glyphs,
+                                                         ink_rects, logical_rects);
+      return;
+    }
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      PangoRectangle *ink_rect = ink_rects ? &ink_rects[i] : NULL;
+      PangoRectangle *logical_rect = logical_rects ? &logical_rects[i] : NULL;
+      PangoCairoFontGlyphExtentsCacheEntry *entry;
+
+      if (glyphs[i] == PANGO_GLYPH_EMPTY)
         {
-        case PANGO_GRAVITY_SOUTH:
-          logical_rect->width = entry->width;
-          break;
-        case PANGO_GRAVITY_EAST:
-          logical_rect->width = cf_priv->font_extents.height;
-          logical_rect->x = - logical_rect->width;
-          break;
-        case PANGO_GRAVITY_NORTH:
-          logical_rect->width = entry->width;
-          break;
-        case PANGO_GRAVITY_WEST:
-          logical_rect->width = - cf_priv->font_extents.height;
-          logical_rect->x = - logical_rect->width;
-          break;
-        case PANGO_GRAVITY_AUTO:
-        default:
-          g_assert_not_reached ();
+          if (ink_rect)
+            ink_rect->x = ink_rect->y = ink_rect->width = ink_rect->height = 0;
+          if (logical_rect)
+            *logical_rect = cf_priv->font_extents;
+        }
+      else if (glyphs[i] & PANGO_GLYPH_UNKNOWN_FLAG)
+        have_unknown = TRUE;
+      else
+        {
+          entry = _pango_cairo_font_private_get_glyph_extents_cache_entry (cf_priv, glyphs[i]);
+          glyph_extents_from_cache_entry (cf_priv, entry, ink_rect, logical_rect);
+        }
+    }
+
+  g_mutex_unlock (&cf_priv->mutex);
+
+  if (G_UNLIKELY (have_unknown))
+    {
+      for (i = 0; i < n_glyphs; i++)
+        {
+          if (glyphs[i] & PANGO_GLYPH_UNKNOWN_FLAG)
+            _pango_cairo_font_private_get_glyph_extents_missing (cf_priv, glyphs[i],
+                                                                 ink_rects ? &ink_rects[i] : NULL,
+                                                                 logical_rects ? &logical_rects[i] : NULL);
         }
     }
 }
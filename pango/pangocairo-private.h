@@ -50,7 +50,7 @@ typedef struct _PangoCairoFontIface                  PangoCairoFontIface;
 typedef struct _PangoCairoFontPrivate                PangoCairoFontPrivate;
 typedef struct _PangoCairoFontHexBoxInfo             PangoCairoFontHexBoxInfo;
 typedef struct _PangoCairoFontPrivateScaledFontData  PangoCairoFontPrivateScaledFontData;
-typedef struct _PangoCairoFontGlyphExtentsCacheEntry PangoCairoFontGlyphExtentsCacheEntry;
+typedef struct _PangoCairoFontGlyphExtentsCache      PangoCairoFontGlyphExtentsCache;
 
 struct _PangoCairoFontHexBoxInfo
 {
@@ -78,9 +78,17 @@ struct _PangoCairoFontPrivate
 
   PangoCairoFontPrivateScaledFontData *data;
 
+  /* Fonts can be shared between threads. The scaled fonts and
+   * hex box info are created once and never change after that,
+   * the caches below are protected by mutex.
+   */
+  gsize scaled_font_initialized;
   cairo_scaled_font_t *scaled_font;
   cairo_scaled_font_t *hex_box_scaled_font;
   PangoCairoFontHexBoxInfo *hbi;
+
+  GMutex mutex;
+
   GHashTable *hex_box_glyphs;
   GArray *hex_box_pango_glyphs;
   unsigned int hex_box_glyph_base;
@@ -89,7 +97,7 @@ struct _PangoCairoFontPrivate
   PangoGravity gravity;
 
   PangoRectangle font_extents;
-  PangoCairoFontGlyphExtentsCacheEntry *glyph_extents_cache;
+  PangoCairoFontGlyphExtentsCache *glyph_extents_cache;
 
   GSList *metrics_by_lang;
 };
@@ -130,6 +138,11 @@ void _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv
 						  PangoGlyph             glyph,
 						  PangoRectangle        *ink_rect,
 						  PangoRectangle        *logical_rect);
+void _pango_cairo_font_private_get_glyph_extents_batch (PangoCairoFontPrivate *cf_priv,
+							const PangoGlyph      *glyphs,
+							guint                  n_glyphs,
+							PangoRectangle        *ink_rects,
+							PangoRectangle        *logical_rects);
 
 #define PANGO_TYPE_CAIRO_RENDERER            (pango_cairo_renderer_get_type())
 #define PANGO_CAIRO_RENDERER(object)         (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_TYPE_CAIRO_RENDERER, PangoCairoRenderer))
@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include <math.h>
+#include <string.h>
 
 #include "pango-font-private.h"
 #include "pangocairo-private.h"
@@ -46,6 +47,17 @@ struct _PangoCairoRenderer
   /* house-keeping options */
   gboolean is_cached_renderer;
   gboolean cr_had_current_point;
+
+  /* Glyphs of consecutive runs that share the scaled font and
+   * the source, which are drawn with a single cairo_show_glyphs()
+   * call when something else needs to be drawn, or at the end
+   */
+  cairo_glyph_t *glyphs;
+  int n_glyphs;
+  int glyphs_size;
+  cairo_scaled_font_t *glyphs_font;
+  gboolean glyphs_have_color;
+  double glyphs_color[4];
 };
 
 struct _PangoCairoRendererClass
@@ -55,43 +67,120 @@ struct _PangoCairoRendererClass
 
 G_DEFINE_TYPE (PangoCairoRenderer, pango_cairo_renderer, PANGO_TYPE_RENDERER)
 
-static void
-set_color (PangoCairoRenderer *crenderer,
-	   PangoRenderPart     part)
+/* Returns FALSE if the current source should be used */
+static gboolean
+get_color (PangoCairoRenderer *crenderer,
+           PangoRenderPart     part,
+           double              rgba[4])
 {
   PangoColor *color = pango_renderer_get_color ((PangoRenderer *) (crenderer), part);
   guint16 a = pango_renderer_get_alpha ((PangoRenderer *) (crenderer), part);
-  gdouble red, green, blue, alpha;
 
   if (!a && !color)
-    return;
+    return FALSE;
 
   if (color)
     {
-      red = color->red / 65535.;
-      green = color->green / 65535.;
-      blue = color->blue / 65535.;
-      alpha = 1.;
+      rgba[0] = color->red / 65535.;
+      rgba[1] = color->green / 65535.;
+      rgba[2] = color->blue / 65535.;
+      rgba[3] = 1.;
     }
   else
     {
       cairo_pattern_t *pattern = cairo_get_source (crenderer->cr);
 
       if (pattern && cairo_pattern_get_type (pattern) == CAIRO_PATTERN_TYPE_SOLID)
-        cairo_pattern_get_rgba (pattern, &red, &green, &blue, &alpha);
+        cairo_pattern_get_rgba (pattern, &rgba[0], &rgba[1], &rgba[2], &rgba[3]);
       else
         {
-          red = 0.;
-          green = 0.;
-          blue = 0.;
-          alpha = 1.;
+          rgba[0] = 0.;
+          rgba[1] = 0.;
+          rgba[2] = 0.;
+          rgba[3] = 1.;
         }
     }
 
   if (a)
-    alpha = a / 65535.;
+    rgba[3] = a / 65535.;
+
+  return TRUE;
+}
+
+static void
+set_color (PangoCairoRenderer *crenderer,
+	   PangoRenderPart     part)
+{
+  double rgba[4];
 
-  cairo_set_source_rgba (crenderer->cr, red, green, blue, alpha);
+  if (get_color (crenderer, part, rgba))
+    cairo_set_source_rgba (crenderer->cr, rgba[0], rgba[1], rgba[2], rgba[3]);
+}
+
+/* Draws the glyphs that have been collected by
+ * pango_cairo_renderer_add_glyphs()
+ */
+static void
+pango_cairo_renderer_flush_glyphs (PangoCairoRenderer *crenderer)
+{
+  if (!crenderer->glyphs_font)
+    return;
+
+  if (crenderer->n_glyphs > 0)
+    {
+      cairo_save (crenderer->cr);
+
+      if (crenderer->glyphs_have_color)
+        cairo_set_source_rgba (crenderer->cr,
+                               crenderer->glyphs_color[0],
+                               crenderer->glyphs_color[1],
+                               crenderer->glyphs_color[2],
+                               crenderer->glyphs_color[3]);
+      cairo_set_scaled_font (crenderer->cr, crenderer->glyphs_font);
+      cairo_show_glyphs (crenderer->cr, crenderer->glyphs, crenderer->n_glyphs);
+
+      cairo_restore (crenderer->cr);
+    }
+
+  cairo_scaled_font_destroy (crenderer->glyphs_font);
+  crenderer->glyphs_font = NULL;
+  crenderer->n_glyphs = 0;
+}
+
+/* Returns space for @n_glyphs more glyphs that will be drawn
+ * with @scaled_font and the foreground color, flushing the
+ * collected glyphs first if they use a different font or color.
+ * The caller must add the number of glyphs it actually used
+ * to crenderer->n_glyphs.
+ */
+static cairo_glyph_t *
+pango_cairo_renderer_add_glyphs (PangoCairoRenderer  *crenderer,
+                                 cairo_scaled_font_t *scaled_font,
+                                 int                  n_glyphs)
+{
+  double rgba[4] = { 0., 0., 0., 0. };
+  gboolean have_color;
+
+  have_color = get_color (crenderer, PANGO_RENDER_PART_FOREGROUND, rgba);
+
+  if (crenderer->glyphs_font != scaled_font ||
+      crenderer->glyphs_have_color != have_color ||
+      (have_color && memcmp (crenderer->glyphs_color, rgba, sizeof (rgba)) != 0))
+    {
+      pango_cairo_renderer_flush_glyphs (crenderer);
+
+      crenderer->glyphs_font = cairo_scaled_font_reference (scaled_font);
+      crenderer->glyphs_have_color = have_color;
+      memcpy (crenderer->glyphs_color, rgba, sizeof (rgba));
+    }
+
+  if (crenderer->n_glyphs + n_glyphs > crenderer->glyphs_size)
+    {
+      crenderer->glyphs_size = MAX (2 * crenderer->glyphs_size, crenderer->n_glyphs + n_glyphs);
+      crenderer->glyphs = g_renew (cairo_glyph_t, crenderer->glyphs, crenderer->glyphs_size);
+    }
+
+  return crenderer->glyphs + crenderer->n_glyphs;
 }
 
 /* note: modifies crenderer->cr without doing cairo_save/restore() */
@@ -512,13 +601,47 @@ pango_cairo_renderer_show_text_glyphs_range (PangoRenderer        *renderer,
   double base_y = crenderer->y_offset + (double)y / PANGO_SCALE;
   PangoRenderComponent components = pango_renderer_get_components (renderer);
 
+  for (i = 0; i < glyph_start; i++)
+    x_position += glyphs->glyphs[i].geometry.width;
+
+  /* Plain glyphs are collected across runs, and drawn together */
+  if (!crenderer->do_path && !clusters && !use_hex_box_scaled_font &&
+      !pango_cairo_glyph_range_has_unknown_glyphs (glyphs, glyph_start, glyph_end))
+    {
+      cairo_scaled_font_t *scaled_font = pango_cairo_font_get_scaled_font ((PangoCairoFont *) font);
+
+      if (G_LIKELY (scaled_font && cairo_scaled_font_status (scaled_font) == CAIRO_STATUS_SUCCESS))
+        {
+          cairo_glyphs = pango_cairo_renderer_add_glyphs (crenderer, scaled_font,
+                                                          glyph_end - glyph_start);
+
+          count = 0;
+          for (i = glyph_start; i < glyph_end; i++)
+            {
+              PangoGlyphInfo *gi = &glyphs->glyphs[i];
+
+              if ((components & (gi->attr.is_color ? PANGO_RENDER_COMPONENT_COLOR_GLYPH : PANGO_RENDER_COMPONENT_PLAIN_GLYPH)) != 0 &&
+                  gi->glyph != PANGO_GLYPH_EMPTY)
+                {
+                  cairo_glyphs[count].index = gi->glyph;
+                  cairo_glyphs[count].x = base_x + (double)(x_position + gi->geometry.x_offset) / PANGO_SCALE;
+                  cairo_glyphs[count].y = base_y + (double)(gi->geometry.y_offset) / PANGO_SCALE;
+                  count++;
+                }
+              x_position += gi->geometry.width;
+            }
+
+          crenderer->n_glyphs += count;
+          return;
+        }
+    }
+
+  pango_cairo_renderer_flush_glyphs (crenderer);
+
   cairo_save (crenderer->cr);
   if (!crenderer->do_path)
     set_color (crenderer, PANGO_RENDER_PART_FOREGROUND);
 
-  for (i = 0; i < glyph_start; i++)
-    x_position += glyphs->glyphs[i].geometry.width;
-
   if (use_hex_box_scaled_font)
     cairo_set_scaled_font (crenderer->cr,
                            _pango_cairo_font_get_hex_box_scaled_font ((PangoCairoFont *) font));
@@ -821,6 +944,8 @@ pango_cairo_renderer_draw_rectangle (PangoRenderer     *renderer,
 {
   PangoCairoRenderer *crenderer = (PangoCairoRenderer *) (renderer);
 
+  pango_cairo_renderer_flush_glyphs (crenderer);
+
   if (!crenderer->do_path)
     {
       cairo_save (crenderer->cr);
@@ -857,6 +982,8 @@ pango_cairo_renderer_draw_trapezoid (PangoRenderer     *renderer,
 
   cr = crenderer->cr;
 
+  pango_cairo_renderer_flush_glyphs (crenderer);
+
   cairo_save (cr);
 
   if (!crenderer->do_path)
@@ -963,6 +1090,8 @@ pango_cairo_renderer_draw_error_underline (PangoRenderer *renderer,
   PangoCairoRenderer *crenderer = (PangoCairoRenderer *) (renderer);
   cairo_t *cr = crenderer->cr;
 
+  pango_cairo_renderer_flush_glyphs (crenderer);
+
   if (!crenderer->do_path)
     {
       cairo_save (cr);
@@ -1009,6 +1138,8 @@ pango_cairo_renderer_draw_shape (PangoRenderer  *renderer,
   if (!shape_renderer)
     return;
 
+  pango_cairo_renderer_flush_glyphs (crenderer);
+
   base_x = crenderer->x_offset + (double)x / PANGO_SCALE;
   base_y = crenderer->y_offset + (double)y / PANGO_SCALE;
 
@@ -1023,24 +1154,48 @@ pango_cairo_renderer_draw_shape (PangoRenderer  *renderer,
   cairo_restore (cr);
 }
 
+static void
+pango_cairo_renderer_end (PangoRenderer *renderer)
+{
+  pango_cairo_renderer_flush_glyphs ((PangoCairoRenderer *) renderer);
+}
+
 static void
 pango_cairo_renderer_init (PangoCairoRenderer *renderer G_GNUC_UNUSED)
 {
 }
 
+static void
+pango_cairo_renderer_finalize (GObject *object)
+{
+  PangoCairoRenderer *crenderer = (PangoCairoRenderer *) object;
+
+  if (crenderer->glyphs_font)
+    cairo_scaled_font_destroy (crenderer->glyphs_font);
+  g_free (crenderer->glyphs);
+
+  G_OBJECT_CLASS (pango_cairo_renderer_parent_class)->finalize (object);
+}
+
 static void
 pango_cairo_renderer_class_init (PangoCairoRendererClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   PangoRendererClass *renderer_class = PANGO_RENDERER_CLASS (klass);
 
+  object_class->finalize = pango_cairo_renderer_finalize;
+
   renderer_class->draw_glyphs = pango_cairo_renderer_draw_glyphs;
   renderer_class->draw_glyph_item = pango_cairo_renderer_draw_glyph_item;
   renderer_class->draw_rectangle = pango_cairo_renderer_draw_rectangle;
   renderer_class->draw_trapezoid = pango_cairo_renderer_draw_trapezoid;
   renderer_class->draw_error_underline = pango_cairo_renderer_draw_error_underline;
   renderer_class->draw_shape = pango_cairo_renderer_draw_shape;
+  renderer_class->end = pango_cairo_renderer_end;
 }
 
+#define MAX_CACHED_GLYPHS 4096
+
 static PangoCairoRenderer *cached_renderer = NULL; /* MT-safe */
 G_LOCK_DEFINE_STATIC (cached_renderer);
 
@@ -1072,8 +1227,17 @@ acquire_renderer (void)
 static void
 release_renderer (PangoCairoRenderer *renderer)
 {
+  pango_cairo_renderer_flush_glyphs (renderer);
+
   if (G_LIKELY (renderer->is_cached_renderer))
     {
+      /* Don't keep a big glyph buffer around forever */
+      if (renderer->glyphs_size > MAX_CACHED_GLYPHS)
+        {
+          g_clear_pointer (&renderer->glyphs, g_free);
+          renderer->glyphs_size = 0;
+        }
+
       renderer->cr = NULL;
       renderer->do_path = FALSE;
       renderer->has_show_text_glyphs = FALSE;
@@ -1209,6 +1373,61 @@ _pango_cairo_do_layout_line (cairo_t          *cr,
   release_renderer (crenderer);
 }
 
+/* Gets the clip extents of the cairo context, relative to
+ * the current point, so that only the visible part of a layout
+ * needs to be drawn. Returns FALSE if the clip is too big to
+ * be worth culling to, or to be represented in Pango units.
+ */
+static gboolean
+get_visible_rect (PangoCairoRenderer *crenderer,
+                  PangoRectangle     *visible_rect)
+{
+  double x1, y1, x2, y2;
+
+  cairo_clip_extents (crenderer->cr, &x1, &y1, &x2, &y2);
+
+  x1 -= crenderer->x_offset;
+  x2 -= crenderer->x_offset;
+  y1 -= crenderer->y_offset;
+  y2 -= crenderer->y_offset;
+
+  if (x1 < -G_MAXINT / (4 * PANGO_SCALE) || x2 > G_MAXINT / (4 * PANGO_SCALE) ||
+      y1 < -G_MAXINT / (4 * PANGO_SCALE) || y2 > G_MAXINT / (4 * PANGO_SCALE))
+    return FALSE;
+
+  visible_rect->x = floor (x1 * PANGO_SCALE);
+  visible_rect->y = floor (y1 * PANGO_SCALE);
+  visible_rect->width = ceil (x2 * PANGO_SCALE) - visible_rect->x;
+  visible_rect->height = ceil (y2 * PANGO_SCALE) - visible_rect->y;
+
+  return TRUE;
+}
+
+/* Whether all of @layout is inside @visible_rect, so that
+ * there is nothing to cull. The extents of the layout are
+ * cached, so this is cheap compared to culling line by line.
+ */
+static gboolean
+layout_is_inside (PangoLayout          *layout,
+                  const PangoRectangle *visible_rect)
+{
+  PangoRectangle ink_rect, logical_rect;
+  int x1, y1, x2, y2;
+
+  pango_layout_get_extents (layout, &ink_rect, &logical_rect);
+
+  /* Backgrounds fill the logical rectangle */
+  x1 = MIN (ink_rect.x, logical_rect.x);
+  y1 = MIN (ink_rect.y, logical_rect.y);
+  x2 = MAX (ink_rect.x + ink_rect.width, logical_rect.x + logical_rect.width);
+  y2 = MAX (ink_rect.y + ink_rect.height, logical_rect.y + logical_rect.height);
+
+  return x1 >= visible_rect->x &&
+         y1 >= visible_rect->y &&
+         x2 <= visible_rect->x + visible_rect->width &&
+         y2 <= visible_rect->y + visible_rect->height;
+}
+
 static void
 _pango_cairo_do_layout (cairo_t              *cr,
                         PangoLayout          *layout,
@@ -1217,6 +1436,7 @@ _pango_cairo_do_layout (cairo_t              *cr,
 {
   PangoCairoRenderer *crenderer = acquire_renderer ();
   PangoRenderer *renderer = (PangoRenderer *) crenderer;
+  PangoRectangle visible_rect;
 
   pango_renderer_set_components (renderer, components);
 
@@ -1224,7 +1444,12 @@ _pango_cairo_do_layout (cairo_t              *cr,
   crenderer->do_path = do_path;
   save_current_point (crenderer);
 
-  pango_renderer_draw_layout (renderer, layout, 0, 0);
+  if (!do_path &&
+      get_visible_rect (crenderer, &visible_rect) &&
+      !layout_is_inside (layout, &visible_rect))
+    pango_renderer_draw_layout_region (renderer, layout, 0, 0, &visible_rect);
+  else
+    pango_renderer_draw_layout (renderer, layout, 0, 0);
 
   restore_current_point (crenderer);
 
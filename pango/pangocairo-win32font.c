@@ -180,6 +180,20 @@ pango_cairo_win32_font_get_glyph_extents (PangoFont        *font,
 					       logical_rect);
 }
 
+static void
+pango_cairo_win32_font_get_glyph_extents_batch (PangoFont        *font,
+                                                const PangoGlyph *glyphs,
+                                                guint             n_glyphs,
+                                                PangoRectangle   *ink_rects,
+                                                PangoRectangle   *logical_rects)
+{
+  PangoCairoWin32Font *cfont = (PangoCairoWin32Font *) font;
+
+  _pango_cairo_font_private_get_glyph_extents_batch (&cfont->cf_priv,
+                                                     glyphs, n_glyphs,
+                                                     ink_rects, logical_rects);
+}
+
 static gboolean
 pango_cairo_win32_font_select_font (PangoFont *font,
 				    HDC        hdc)
@@ -212,6 +226,7 @@ pango_cairo_win32_font_class_init (PangoCairoWin32FontClass *class)
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   PangoFontClass *font_class = PANGO_FONT_CLASS (class);
   PangoWin32FontClass *win32_font_class = PANGO_WIN32_FONT_CLASS (class);
+  PangoFontClassPrivate *pclass;
 
   object_class->finalize = pango_cairo_win32_font_finalize;
 
@@ -221,6 +236,9 @@ pango_cairo_win32_font_class_init (PangoCairoWin32FontClass *class)
   win32_font_class->select_font = pango_cairo_win32_font_select_font;
   win32_font_class->done_font = pango_cairo_win32_font_done_font;
   win32_font_class->get_metrics_factor = pango_cairo_win32_font_get_metrics_factor;
+
+  pclass = g_type_class_get_private ((GTypeClass *) class, PANGO_TYPE_FONT);
+  pclass->get_glyph_extents_batch = pango_cairo_win32_font_get_glyph_extents_batch;
 }
 
 static void
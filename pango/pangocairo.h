@@ -132,6 +132,12 @@ GType         pango_cairo_font_get_type               (void) G_GNUC_CONST;
 PANGO_AVAILABLE_IN_1_18
 cairo_scaled_font_t *pango_cairo_font_get_scaled_font (PangoCairoFont *font);
 
+PANGO_AVAILABLE_IN_1_60
+void          pango_cairo_font_get_glyph_extents_cache_stats (PangoCairoFont *font,
+                                                              guint64        *hits,
+                                                              guint64        *misses,
+                                                              guint          *n_entries);
+
 /* Update a Pango context for the current state of a cairo context
  */
 PANGO_AVAILABLE_IN_1_10
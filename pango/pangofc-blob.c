@@ -0,0 +1,276 @@
+/* Pango
+ * pangofc-blob.c: Font file data shared between fontmaps
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pangofc-blob-private.h"
+
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Font files are mapped read-only and shared, so that all
+ * fontmaps in a process use a single mapping of each file,
+ * and all processes that use the same fonts share the pages
+ * of the file in the page cache, instead of each keeping a
+ * private copy. This matters for big CJK fonts.
+ *
+ * The registry maps file names to mappings. A mapping is only
+ * reused if the file still has the same inode and mtime, so
+ * that fonts that were replaced on disk are mapped again. The
+ * mappings are refcounted by the blobs that we hand out, and
+ * unmapped when the last one goes away.
+ */
+
+#ifdef HAVE_MMAP
+
+typedef struct {
+  int ref_count;        /* protected by registry_lock */
+  gboolean registered;  /* protected by registry_lock */
+
+  char *filename;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+
+  char *data;
+  gsize length;
+} MappedFile;
+
+static GMutex registry_lock;
+static GHashTable *registry; /* Maps filename -> MappedFile */
+
+#ifdef HAVE_MADVISE
+
+/* The tables that are read when shaping, as opposed to
+ * the glyph outlines, which are only read for the glyphs
+ * that get rendered
+ */
+static const hb_tag_t shaping_tables[] = {
+  HB_TAG ('h','e','a','d'),
+  HB_TAG ('m','a','x','p'),
+  HB_TAG ('c','m','a','p'),
+  HB_TAG ('h','h','e','a'),
+  HB_TAG ('h','m','t','x'),
+  HB_TAG ('O','S','/','2'),
+  HB_TAG ('G','D','E','F'),
+  HB_TAG ('G','S','U','B'),
+  HB_TAG ('G','P','O','S'),
+  HB_TAG ('k','e','r','n'),
+  HB_TAG ('m','o','r','x'),
+  HB_TAG ('f','v','a','r'),
+  HB_TAG ('a','v','a','r'),
+  HB_TAG ('H','V','A','R'),
+};
+
+static void
+mapped_file_advise (MappedFile *file)
+{
+  gsize page_size = sysconf (_SC_PAGESIZE);
+  hb_blob_t *blob;
+  unsigned int n_faces, i, j;
+
+  /* Don't read ahead, most of a big font is outlines */
+  madvise (file->data, file->length, MADV_RANDOM);
+
+  blob = hb_blob_create (file->data, file->length, HB_MEMORY_MODE_READONLY, NULL, NULL);
+
+  n_faces = hb_face_count (blob);
+  for (i = 0; i < n_faces; i++)
+    {
+      hb_face_t *face = hb_face_create (blob, i);
+
+      for (j = 0; j < G_N_ELEMENTS (shaping_tables); j++)
+        {
+          hb_blob_t *table = hb_face_reference_table (face, shaping_tables[j]);
+          const char *data;
+          unsigned int length;
+          gsize start, end;
+
+          data = hb_blob_get_data (table, &length);
+          if (length > 0 &&
+              data >= file->data && data + length <= file->data + file->length)
+            {
+              start = (data - file->data) & ~(page_size - 1);
+              end = (data - file->data) + length;
+              madvise (file->data + start, end - start, MADV_WILLNEED);
+            }
+
+          hb_blob_destroy (table);
+        }
+
+      hb_face_destroy (face);
+    }
+
+  hb_blob_destroy (blob);
+}
+
+#else
+
+static void
+mapped_file_advise (MappedFile *file)
+{
+}
+
+#endif
+
+static MappedFile *
+mapped_file_new (const char *filename)
+{
+  MappedFile *file;
+  struct stat st;
+  void *data;
+  int fd;
+
+#ifdef O_CLOEXEC
+  fd = open (filename, O_RDONLY | O_CLOEXEC);
+#else
+  fd = open (filename, O_RDONLY);
+#endif
+  if (fd < 0)
+    return NULL;
+
+  if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode) || st.st_size <= 0)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (data == MAP_FAILED)
+    return NULL;
+
+  file = g_new0 (MappedFile, 1);
+  file->ref_count = 1;
+  file->filename = g_strdup (filename);
+  file->dev = st.st_dev;
+  file->ino = st.st_ino;
+  file->mtime = st.st_mtime;
+  file->data = data;
+  file->length = st.st_size;
+
+  return file;
+}
+
+static void
+mapped_file_unref (gpointer data)
+{
+  MappedFile *file = data;
+  gboolean last;
+
+  g_mutex_lock (&registry_lock);
+
+  last = --file->ref_count == 0;
+  if (last && file->registered)
+    g_hash_table_remove (registry, file->filename);
+
+  g_mutex_unlock (&registry_lock);
+
+  if (!last)
+    return;
+
+  munmap (file->data, file->length);
+  g_free (file->filename);
+  g_free (file);
+}
+
+static gboolean
+mapped_file_is_current (MappedFile        *file,
+                        const struct stat *st)
+{
+  return file->dev == st->st_dev &&
+         file->ino == st->st_ino &&
+         file->mtime == st->st_mtime &&
+         file->length == (gsize) st->st_size;
+}
+
+#endif
+
+/*
+ * pango_fc_blob_from_file:
+ * @filename: the font file
+ *
+ * Returns a blob with the contents of @filename, like
+ * hb_blob_create_from_file(), but all blobs for the same
+ * file share a single read-only mapping of it.
+ *
+ * Returns: (transfer full): a new blob, which is empty
+ *   if the file can't be read
+ */
+hb_blob_t *
+pango_fc_blob_from_file (const char *filename)
+{
+#ifdef HAVE_MMAP
+  MappedFile *file;
+  gboolean mapped = FALSE;
+  struct stat st;
+
+  if (stat (filename, &st) < 0)
+    return hb_blob_create_from_file (filename);
+
+  g_mutex_lock (&registry_lock);
+
+  if (G_UNLIKELY (!registry))
+    registry = g_hash_table_new (g_str_hash, g_str_equal);
+
+  file = g_hash_table_lookup (registry, filename);
+  if (file && !mapped_file_is_current (file, &st))
+    {
+      /* The file was replaced. Its users keep the old mapping */
+      file->registered = FALSE;
+      g_hash_table_remove (registry, filename);
+      file = NULL;
+    }
+
+  if (file)
+    file->ref_count++;
+  else
+    {
+      file = mapped_file_new (filename);
+      if (file)
+        {
+          file->registered = TRUE;
+          g_hash_table_replace (registry, file->filename, file);
+          mapped = TRUE;
+        }
+    }
+
+  g_mutex_unlock (&registry_lock);
+
+  if (!file)
+    return hb_blob_create_from_file (filename);
+
+  /* This walks the tables of the font and touches the page
+   * tables, so don't make other lookups wait for it. Our
+   * reference keeps the mapping alive.
+   */
+  if (mapped)
+    mapped_file_advise (file);
+
+  return hb_blob_create (file->data, file->length,
+                         HB_MEMORY_MODE_READONLY,
+                         file, mapped_file_unref);
+#else
+  return hb_blob_create_from_file (filename);
+#endif
+}
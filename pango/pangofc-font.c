@@ -44,6 +44,8 @@ struct _PangoFcFontPrivate
   PangoFcDecoder *decoder;
   PangoFcFontKey *key;
   PangoFontFace *face;
+
+  GMutex mutex; /* protects metrics_by_lang */
 };
 
 static gboolean pango_fc_font_real_has_char  (PangoFcFont *font,
@@ -151,6 +153,7 @@ static void
 pango_fc_font_init (PangoFcFont *fcfont)
 {
   fcfont->priv = pango_fc_font_get_instance_private (fcfont);
+  g_mutex_init (&fcfont->priv->mutex);
 }
 
 static void
@@ -185,6 +188,8 @@ pango_fc_font_finalize (GObject *object)
 
   g_clear_object (&priv->face);
 
+  g_mutex_clear (&priv->mutex);
+
   G_OBJECT_CLASS (pango_fc_font_parent_class)->finalize (object);
 }
 
@@ -452,85 +457,120 @@ max_glyph_width (PangoLayout *layout)
   return max_width;
 }
 
+/* Must be called with the font mutex held */
+static PangoFcMetricsInfo *
+find_metrics_info (PangoFcFont *fcfont,
+                   const char  *sample_str)
+{
+  GSList *tmp_list;
+
+  for (tmp_list = fcfont->metrics_by_lang; tmp_list; tmp_list = tmp_list->next)
+    {
+      PangoFcMetricsInfo *info = tmp_list->data;
+
+      if (info->sample_str == sample_str)    /* We _don't_ need strcmp */
+        return info;
+    }
+
+  return NULL;
+}
+
 static PangoFontMetrics *
 pango_fc_font_get_metrics (PangoFont     *font,
 			   PangoLanguage *language)
 {
   PangoFcFont *fcfont = PANGO_FC_FONT (font);
-  PangoFcMetricsInfo *info = NULL; /* Quiet gcc */
-  GSList *tmp_list;
-  static int in_get_metrics;
+  PangoFcMetricsInfo *info, *other;
+  PangoFontMetrics *metrics;
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  gboolean recursing;
+  /* Per thread, since fonts can be shared between threads */
+  static GPrivate in_get_metrics;
 
   const char *sample_str = pango_language_get_sample_string (language);
 
-  tmp_list = fcfont->metrics_by_lang;
-  while (tmp_list)
-    {
-      info = tmp_list->data;
+  g_mutex_lock (&fcfont->priv->mutex);
+  info = find_metrics_info (fcfont, sample_str);
+  metrics = info ? pango_font_metrics_ref (info->metrics) : NULL;
+  g_mutex_unlock (&fcfont->priv->mutex);
 
-      if (info->sample_str == sample_str)    /* We _don't_ need strcmp */
-	break;
-
-      tmp_list = tmp_list->next;
-    }
+  if (metrics)
+    return metrics;
 
-  if (!tmp_list)
-    {
-      PangoFontMap *fontmap;
-      PangoContext *context;
+  fontmap = fcfont->fontmap;
+  if (!fontmap)
+    return pango_font_metrics_new ();
 
-      fontmap = fcfont->fontmap;
-      if (!fontmap)
-	return pango_font_metrics_new ();
+  /* We compute the metrics without holding the lock, since we
+   * call into PangoLayout below, and add them afterwards, unless
+   * another thread was faster.
+   */
+  info = g_slice_new0 (PangoFcMetricsInfo);
 
-      info = g_slice_new0 (PangoFcMetricsInfo);
+  info->sample_str = sample_str;
 
-      /* Note: we need to add info to the list before calling
-       * into PangoLayout below, to prevent recursion
-       */
-      fcfont->metrics_by_lang = g_slist_prepend (fcfont->metrics_by_lang,
-						 info);
+  context = pango_font_map_create_context (fontmap);
+  pango_context_set_language (context, language);
 
-      info->sample_str = sample_str;
+  info->metrics = pango_fc_font_create_base_metrics_for_context (fcfont, context);
 
-      context = pango_font_map_create_context (fontmap);
-      pango_context_set_language (context, language);
+  /* We need to prevent recursion when we call into PangoLayout */
+  recursing = g_private_get (&in_get_metrics) != NULL;
+  if (!recursing)
+    {
+      /* Compute derived metrics */
+      PangoLayout *layout;
+      PangoRectangle extents;
+      PangoFontDescription *desc = pango_font_describe_with_absolute_size (font);
+      gulong sample_str_width;
 
-      info->metrics = pango_fc_font_create_base_metrics_for_context (fcfont, context);
+      g_private_set (&in_get_metrics, GINT_TO_POINTER (1));
 
-      if (!in_get_metrics)
-        {
-          /* Compute derived metrics */
-          PangoLayout *layout;
-          PangoRectangle extents;
-          PangoFontDescription *desc = pango_font_describe_with_absolute_size (font);
-          gulong sample_str_width;
+      layout = pango_layout_new (context);
+      pango_layout_set_font_description (layout, desc);
+      pango_font_description_free (desc);
 
-          in_get_metrics = 1;
+      pango_layout_set_text (layout, sample_str, -1);
+      pango_layout_get_extents (layout, NULL, &extents);
 
-          layout = pango_layout_new (context);
-          pango_layout_set_font_description (layout, desc);
-          pango_font_description_free (desc);
+      sample_str_width = pango_utf8_strwidth (sample_str);
+      g_assert (sample_str_width > 0);
+      info->metrics->approximate_char_width = extents.width / sample_str_width;
 
-          pango_layout_set_text (layout, sample_str, -1);
-          pango_layout_get_extents (layout, NULL, &extents);
+      pango_layout_set_text (layout, "0123456789", -1);
+      info->metrics->approximate_digit_width = max_glyph_width (layout);
 
-          sample_str_width = pango_utf8_strwidth (sample_str);
-          g_assert (sample_str_width > 0);
-          info->metrics->approximate_char_width = extents.width / sample_str_width;
+      g_object_unref (layout);
 
-          pango_layout_set_text (layout, "0123456789", -1);
-          info->metrics->approximate_digit_width = max_glyph_width (layout);
+      g_private_set (&in_get_metrics, NULL);
+    }
 
-          g_object_unref (layout);
+  g_object_unref (context);
 
-          in_get_metrics = 0;
-        }
+  /* Metrics computed while recursing lack the approximate
+   * widths, so we don't keep them
+   */
+  if (recursing)
+    {
+      metrics = pango_font_metrics_ref (info->metrics);
+      free_metrics_info (info);
+      return metrics;
+    }
 
-      g_object_unref (context);
+  g_mutex_lock (&fcfont->priv->mutex);
+  other = find_metrics_info (fcfont, sample_str);
+  if (other)
+    {
+      free_metrics_info (info);
+      info = other;
     }
+  else
+    fcfont->metrics_by_lang = g_slist_prepend (fcfont->metrics_by_lang, info);
+  metrics = pango_font_metrics_ref (info->metrics);
+  g_mutex_unlock (&fcfont->priv->mutex);
 
-  return pango_font_metrics_ref (info->metrics);
+  return metrics;
 }
 
 static PangoFontMap *
@@ -867,6 +907,79 @@ pango_fc_font_get_raw_extents (PangoFcFont    *fcfont,
     }
 }
 
+/*< private >
+ * pango_fc_font_get_raw_extents_batch:
+ * @fcfont: a `PangoFcFont`
+ * @glyphs: (array length=n_glyphs): the glyphs
+ * @n_glyphs: the number of glyphs
+ * @ink_rects: (out caller-allocates) (optional) (array length=n_glyphs):
+ *   array to store the ink extents in
+ * @logical_rects: (out caller-allocates) (optional) (array length=n_glyphs):
+ *   array to store the logical extents in
+ *
+ * Like [method@PangoFc.Font.get_raw_extents], for several glyphs.
+ *
+ * The font extents are only looked up once, and the advances
+ * are fetched with a single call to HarfBuzz.
+ */
+void
+pango_fc_font_get_raw_extents_batch (PangoFcFont      *fcfont,
+                                     const PangoGlyph *glyphs,
+                                     guint             n_glyphs,
+                                     PangoRectangle   *ink_rects,
+                                     PangoRectangle   *logical_rects)
+{
+  hb_font_t *hb_font;
+  hb_font_extents_t font_extents;
+  guint i;
+
+  g_return_if_fail (PANGO_IS_FC_FONT (fcfont));
+
+  if (n_glyphs == 0)
+    return;
+
+  hb_font = pango_font_get_hb_font (PANGO_FONT (fcfont));
+
+  if (logical_rects)
+    {
+      hb_font_get_extents_for_direction (hb_font, HB_DIRECTION_LTR, &font_extents);
+      hb_font_get_glyph_h_advances (hb_font, n_glyphs,
+                                    glyphs, sizeof (PangoGlyph),
+                                    (hb_position_t *) &logical_rects[0].width, sizeof (PangoRectangle));
+    }
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      if (glyphs[i] == PANGO_GLYPH_EMPTY)
+        {
+          if (ink_rects)
+            ink_rects[i] = (PangoRectangle) { 0, 0, 0, 0 };
+          if (logical_rects)
+            logical_rects[i] = (PangoRectangle) { 0, 0, 0, 0 };
+          continue;
+        }
+
+      if (ink_rects)
+        {
+          hb_glyph_extents_t extents;
+
+          hb_font_get_glyph_extents (hb_font, glyphs[i], &extents);
+
+          ink_rects[i].x = extents.x_bearing;
+          ink_rects[i].width = extents.width;
+          ink_rects[i].y = -extents.y_bearing;
+          ink_rects[i].height = -extents.height;
+        }
+
+      if (logical_rects)
+        {
+          logical_rects[i].x = 0;
+          logical_rects[i].y = - font_extents.ascender;
+          logical_rects[i].height = font_extents.ascender - font_extents.descender;
+        }
+    }
+}
+
 static void
 pango_fc_font_get_features (PangoFont    *font,
                             hb_feature_t *features,
@@ -46,6 +46,8 @@
 #include "pango-enum-types.h"
 #include "pango-coverage-private.h"
 #include "pango-trace-private.h"
+#include "pangofc-sortcache-private.h"
+#include "pangofc-blob-private.h"
 #include <hb-ft.h>
 #include <fontconfig/fcfreetype.h>
 
@@ -62,7 +64,8 @@
  * - All FcPattern's referenced by any object in the fontmap are uniquified
  *   and cached in the fontmap.  This both speeds lookups based on patterns
  *   faster, and saves memory.  This is handled by fontmap->priv->pattern_hash.
- *   The patterns are cached indefinitely.
+ *   The most recently used patterns are kept in pattern_cache; by default
+ *   there is no limit on their number.
  *
  * - The results of a FcFontSort() are used to populate fontsets.  However,
  *   FcFontSort() relies on the search pattern only, which includes the font
@@ -77,22 +80,73 @@
  *   without trimming, and do the trimming lazily as we go.  Only pattern sets
  *   already referenced by a fontset are cached.
  *
+ * - If the PANGO_FC_SORT_CACHE environment variable names a file, the
+ *   FcFontMatch() and FcFontSort() results are also stored there, as
+ *   indices into our font set, and reused by later processes without
+ *   calling into Fontconfig.  The file is keyed on a fingerprint of the
+ *   font set and the configuration files, so installing or removing fonts
+ *   or changing the configuration invalidates it.  This is handled by
+ *   fontmap->priv->sort_cache.  It is written by the fontconfig thread
+ *   when it runs out of work, or when pango_fc_font_map_save_sort_cache()
+ *   asks for it.
+ *
  * - A number of most-recently-used fontsets are cached and reused when
- *   needed.  This is achieved using fontmap->priv->fontset_hash and
- *   fontmap->priv->fontset_cache.
+ *   needed.  This is achieved using the fontset_hash and fontset_cache
+ *   of the shards in fontmap->priv->shards.
  *
  * - All fonts created by any of our fontsets are also cached and reused.
- *   This is what fontmap->priv->font_hash does.
+ *   This is what the font_hash of the shards does.  It only holds weak
+ *   references to the fonts.
  *
  * - Data that only depends on the font file and face index is cached and
  *   reused by multiple fonts.  This includes coverage and cmap cache info.
- *   This is done using fontmap->priv->font_face_data_hash.
+ *   This is done using fontmap->priv->font_face_data_hash.  Fonts keep a
+ *   reference to their data, so it can be evicted while they are alive.
+ *   The font files behind the hb_face_t are mapped once per process, and
+ *   shared by all fontmaps, see pangofc-blob.c.
+ *
+ * - The pattern, fontset and face data caches have limits on the number
+ *   and estimated size of their entries, and evict the least recently used
+ *   entries, see pango_fc_font_map_set_cache_limits().  Each cache keeps
+ *   statistics in a PangoFcCacheBudget, protected by the lock of the cache.
  *
  * Upon a cache_clear() request, all caches are emptied.  All objects (fonts,
  * fontsets, faces, families) having a reference from outside will still live
  * and may reference the fontmap still, but will not be reused by the fontmap.
  *
  *
+ * Threads:
+ *
+ * A fontmap can be used from several threads at the same time, except for
+ * add_font_file() and shutdown(), which must not race with anything else.
+ *
+ * - The fontset and font caches are split into shards by key hash, each
+ *   with its own mutex.  A cache hit only takes the lock of one shard, so
+ *   threads that load different fonts rarely contend.  Shard locks are
+ *   never held while calling out of the shard, and lookups never hold more
+ *   than one at a time.
+ *
+ * - cache_clear(), config_changed() and set_config() take the fontmap lock
+ *   and then all shard locks, in order, while they swap the config and the
+ *   caches.  The old fontsets and fonts are dropped after the locks are
+ *   released, since dropping them takes the shard locks again.
+ *
+ * - The sharding does not change which fontsets are kept: the limits of
+ *   the fontset cache apply to all shards together, and the least recently
+ *   used fontset of any shard is evicted first.  The limits and total size
+ *   are protected by fontmap->priv->fontsets_lock, which is always taken
+ *   last.
+ *
+ * - Everything else (pattern_hash, patterns_hash, font_face_data_hash,
+ *   the families and the lazily created data in them) is only needed when
+ *   a cache misses, and is protected by fontmap->priv->lock.  It is a
+ *   recursive lock, since these paths call into each other.
+ *
+ * - Each fontset has a mutex for the fonts and coverages that it loads
+ *   lazily.  It may be held while taking a shard lock or the fontmap lock,
+ *   but not the other way around.
+ *
+ *
  * Todo:
  *
  * - Make PangoCoverage a GObject and subclass it as PangoFcCoverage which
@@ -141,21 +195,91 @@ typedef struct _PangoFcFontset      PangoFcFontset;
 #define PANGO_FC_FONTSET(object)        (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_FC_TYPE_FONTSET, PangoFcFontset))
 #define PANGO_FC_IS_FONTSET(object)     (G_TYPE_CHECK_INSTANCE_TYPE ((object), PANGO_FC_TYPE_FONTSET))
 
-struct _PangoFcFontMapPrivate
+#define N_CACHE_SHARDS 16 /* should be power of two */
+
+typedef struct _PangoFcCacheBudget PangoFcCacheBudget;
+typedef struct _PangoFcCacheShard  PangoFcCacheShard;
+typedef struct _PangoFcShardCaches PangoFcShardCaches;
+typedef struct _PangoFcFontEntry   PangoFcFontEntry;
+
+/* Limits and statistics of one cache, protected by
+ * the same lock as the cache itself. Sizes are estimates
+ */
+struct _PangoFcCacheBudget
+{
+  guint max_entries;		/* 0 == unlimited */
+  gsize max_bytes;		/* 0 == unlimited */
+
+  guint n_entries;
+  gsize n_bytes;
+
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+};
+
+struct _PangoFcCacheShard
 {
+  GMutex mutex;
+
   GHashTable *fontset_hash;	/* Maps PangoFcFontsetKey -> PangoFcFontset  */
   GQueue *fontset_cache;	/* Recently used fontsets */
+  PangoFcCacheBudget fontsets;	/* Statistics of our part of the fontset cache */
+
+  GHashTable *font_hash;	/* Maps PangoFcFontKey -> PangoFcFontEntry */
+  PangoFcCacheBudget fonts;	/* Only statistics */
+};
+
+/* The tables of a shard, taken out of it by
+ * pango_fc_font_map_fini() so that they can be
+ * freed after the shard locks are dropped
+ */
+struct _PangoFcShardCaches
+{
+  GHashTable *fontset_hash;
+  GQueue *fontset_cache;
+  GHashTable *font_hash;
+};
+
+/* The font cache does not keep fonts alive, and a font
+ * may be on its way to finalization when we find it, so
+ * we go through a weak ref to get a strong one.
+ */
+struct _PangoFcFontEntry
+{
+  GWeakRef ref;
+  PangoFcFont *font;
+};
+
+struct _PangoFcFontMapPrivate
+{
+  PangoFcCacheShard shards[N_CACHE_SHARDS];
+
+  /* Limits and size of the fontset cache as a whole. This lock may
+   * be taken while holding a shard lock, but nothing else is taken
+   * while holding it
+   */
+  GMutex fontsets_lock;
+  PangoFcCacheBudget fontsets;
+  int fontsets_clock;		/* atomic, see pango_fc_fontset_cache() */
 
-  GHashTable *font_hash;	/* Maps PangoFcFontKey -> PangoFcFont */
+  /* Protects the tables below and the data that is
+   * created lazily in them, see the overview above
+   */
+  GRecMutex lock;
 
   GHashTable *patterns_hash;	/* Maps FcPattern -> PangoFcPatterns */
 
   /* pattern_hash is used to make sure we only store one copy of
    * each identical pattern. (Speeds up lookup).
    */
-  GHashTable *pattern_hash;
+  GHashTable *pattern_hash;	/* Maps FcPattern -> link in pattern_cache */
+  GQueue *pattern_cache;	/* Recently used patterns */
+  PangoFcCacheBudget patterns;
 
   GHashTable *font_face_data_hash; /* Maps font file name/id -> data */
+  GQueue *font_face_data_cache;	/* Recently used data */
+  PangoFcCacheBudget font_face_data;
 
   /* List of all families available */
   PangoFcFamily **families;
@@ -172,6 +296,10 @@ struct _PangoFcFontMapPrivate
   FcFontSet *fonts;
 
   GAsyncQueue *queue;
+
+  PangoFcSortCache *sort_cache;
+  guint64 fonts_fingerprint;
+  int fingerprint_nfont; /* nfont of fonts when fingerprinted, or -1 */
 };
 
 struct _PangoFcFontFaceData
@@ -186,6 +314,12 @@ struct _PangoFcFontFaceData
   PangoLanguage **languages;
 
   hb_face_t *hb_face;
+
+  /* The fonts using the data hold references to it, so that
+   * it stays alive when it is evicted from the cache
+   */
+  GList *cache_link;
+  gsize cache_size;
 };
 
 struct _PangoFcFace
@@ -275,6 +409,7 @@ static void               pango_fc_fontset_key_init  (PangoFcFontsetKey
 						      PangoLanguage              *language);
 static PangoFcFontsetKey *pango_fc_fontset_key_copy  (const PangoFcFontsetKey *key);
 static void               pango_fc_fontset_key_free  (PangoFcFontsetKey       *key);
+static guint              pango_fc_fontset_key_compute_hash (const PangoFcFontsetKey *key);
 static guint              pango_fc_fontset_key_hash  (const PangoFcFontsetKey *key);
 static gboolean           pango_fc_fontset_key_equal (const PangoFcFontsetKey *key_a,
 						      const PangoFcFontsetKey *key_b);
@@ -336,7 +471,7 @@ pango_fc_font_face_data_equal (PangoFcFontFaceData *key1,
 }
 
 static void
-pango_fc_font_face_data_free (PangoFcFontFaceData *data)
+pango_fc_font_face_data_clear (PangoFcFontFaceData *data)
 {
   FcPatternDestroy (data->pattern);
 
@@ -346,8 +481,48 @@ pango_fc_font_face_data_free (PangoFcFontFaceData *data)
   g_free (data->languages);
 
   hb_face_destroy (data->hb_face);
+}
+
+static void
+pango_fc_font_face_data_unref (PangoFcFontFaceData *data)
+{
+  g_atomic_rc_box_release_full (data, (GDestroyNotify) pango_fc_font_face_data_clear);
+}
+
+static GQuark
+pango_fc_font_face_data_quark (void)
+{
+  static GQuark quark = 0;
 
-  g_slice_free (PangoFcFontFaceData, data);
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("pango-fc-font-face-data");
+
+  return quark;
+}
+
+/* Returns whether a cache needs to evict entries. We always
+ * keep the most recently used entry, even if it is too big
+ */
+static gboolean
+pango_fc_cache_budget_exceeded (PangoFcCacheBudget *budget)
+{
+  if (budget->n_entries <= 1)
+    return FALSE;
+
+  return (budget->max_entries && budget->n_entries > budget->max_entries) ||
+         (budget->max_bytes && budget->n_bytes > budget->max_bytes);
+}
+
+/* Moves link to the head of an LRU queue */
+static void
+pango_fc_cache_touch (GQueue *cache,
+                      GList  *link)
+{
+  if (link == cache->head)
+    return;
+
+  g_queue_unlink (cache, link);
+  g_queue_push_head_link (cache, link);
 }
 
 /* Fowler / Noll / Vo (FNV) Hash (http://www.isthe.com/chongo/tech/comp/fnv/)
@@ -414,6 +589,7 @@ struct _PangoFcFontsetKey {
   gpointer context_key;
   char *variations;
   char *features;
+  guint hash;
 };
 
 struct _PangoFcFontKey {
@@ -440,8 +616,11 @@ pango_fc_fontset_key_init (PangoFcFontsetKey          *key,
   key->pixelsize = get_scaled_size (fcfontmap, context, desc);
   key->resolution = pango_fc_font_map_get_resolution (fcfontmap, context);
   key->language = language;
-  key->variations = g_strdup (pango_font_description_get_variations (desc));
-  key->features = g_strdup (pango_font_description_get_features (desc));
+  /* The strings are borrowed from @desc. Only the copies of
+   * the key that are stored in fontsets own theirs.
+   */
+  key->variations = (char *) pango_font_description_get_variations (desc);
+  key->features = (char *) pango_font_description_get_features (desc);
   key->desc = pango_font_description_copy_static (desc);
   pango_font_description_unset_fields (key->desc, PANGO_FONT_MASK_SIZE | PANGO_FONT_MASK_VARIATIONS | PANGO_FONT_MASK_FEATURES);
 
@@ -449,13 +628,16 @@ pango_fc_fontset_key_init (PangoFcFontsetKey          *key,
     key->context_key = (gpointer)PANGO_FC_FONT_MAP_GET_CLASS (fcfontmap)->context_key_get (fcfontmap, context);
   else
     key->context_key = NULL;
+
+  key->hash = pango_fc_fontset_key_compute_hash (key);
 }
 
 static gboolean
 pango_fc_fontset_key_equal (const PangoFcFontsetKey *key_a,
 			    const PangoFcFontsetKey *key_b)
 {
-  if (key_a->language == key_b->language &&
+  if (key_a->hash == key_b->hash &&
+      key_a->language == key_b->language &&
       key_a->pixelsize == key_b->pixelsize &&
       key_a->resolution == key_b->resolution &&
       ((key_a->variations == NULL && key_b->variations == NULL) ||
@@ -477,7 +659,7 @@ pango_fc_fontset_key_equal (const PangoFcFontsetKey *key_a,
 }
 
 static guint
-pango_fc_fontset_key_hash (const PangoFcFontsetKey *key)
+pango_fc_fontset_key_compute_hash (const PangoFcFontsetKey *key)
 {
     guint32 hash = FNV1_32_INIT;
 
@@ -502,6 +684,12 @@ pango_fc_fontset_key_hash (const PangoFcFontsetKey *key)
 	    pango_font_description_hash (key->desc));
 }
 
+static guint
+pango_fc_fontset_key_hash (const PangoFcFontsetKey *key)
+{
+  return key->hash;
+}
+
 static void
 pango_fc_fontset_key_free (PangoFcFontsetKey *key)
 {
@@ -523,12 +711,16 @@ pango_fc_fontset_key_copy (const PangoFcFontsetKey *old)
 
   key->fontmap = old->fontmap;
   key->language = old->language;
-  key->desc = pango_font_description_copy (old->desc);
+  /* Fontsets for different sizes and languages of the
+   * same font share a single copy of the description
+   */
+  key->desc = pango_font_description_intern (old->desc);
   key->matrix = old->matrix;
   key->pixelsize = old->pixelsize;
   key->resolution = old->resolution;
   key->variations = g_strdup (old->variations);
   key->features = g_strdup (old->features);
+  key->hash = old->hash;
 
   if (old->context_key)
     key->context_key = PANGO_FC_FONT_MAP_GET_CLASS (key->fontmap)->context_key_copy (key->fontmap,
@@ -825,6 +1017,7 @@ struct _PangoFcPatterns {
   FcPattern *pattern;
   FcPattern *match;
   FcFontSet *fontset;
+  gboolean sort_requested; /* protected by mutex */
 };
 
 static FcFontSet *
@@ -850,18 +1043,33 @@ typedef enum {
   FC_INIT,
   FC_MATCH,
   FC_SORT,
+  FC_SAVE,
   FC_END,
 } FcOp;
 
+/* Lets pango_fc_font_map_save_sort_cache() wait for the thread */
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  gboolean done;
+  gboolean result;
+  GError *error;
+} SaveData;
+
 typedef struct {
   FcOp op;
   FcConfig *config;
   FcFontSet *fonts;
   FcPattern *pattern;
   PangoFcPatterns *patterns;
+  GAsyncQueue *queue;
+  PangoFcSortCache *sort_cache;
+  guint64 fingerprint;
+  SaveData *save;
 } ThreadData;
 
 static FcFontSet *pango_fc_font_map_get_config_fonts (PangoFcFontMap *fcfontmap);
+static guint64    pango_fc_font_map_get_fonts_fingerprint (PangoFcFontMap *fcfontmap);
 
 static ThreadData *
 thread_data_new (FcOp             op,
@@ -882,8 +1090,22 @@ thread_data_new (FcOp             op,
   td->patterns = pango_fc_patterns_ref (patterns);
   td->pattern = FcPatternDuplicate (patterns->pattern);
 
+  /* set_config() swaps these under the fontmap lock */
+  g_rec_mutex_lock (&patterns->fontmap->priv->lock);
   td->config = FcConfigReference (pango_fc_font_map_get_config (patterns->fontmap));
   td->fonts = font_set_copy (pango_fc_font_map_get_config_fonts (patterns->fontmap));
+  g_rec_mutex_unlock (&patterns->fontmap->priv->lock);
+
+  /* The fontmap may drop these while we are in the
+   * queue, e.g. when it is cleared or finalized, so
+   * the thread must not get them from the fontmap
+   */
+  td->queue = g_async_queue_ref (patterns->fontmap->priv->queue);
+  if (patterns->fontmap->priv->sort_cache)
+    {
+      td->sort_cache = pango_fc_sort_cache_ref (patterns->fontmap->priv->sort_cache);
+      td->fingerprint = pango_fc_font_map_get_fonts_fingerprint (patterns->fontmap);
+    }
 
   return td;
 }
@@ -901,6 +1123,8 @@ thread_data_free (gpointer data)
     FcConfigDestroy (td->config);
   if (td->patterns)
     pango_fc_patterns_unref (td->patterns);
+  g_clear_pointer (&td->queue, g_async_queue_unref);
+  g_clear_pointer (&td->sort_cache, pango_fc_sort_cache_unref);
   g_free (td);
 
   g_clear_object (&fontmap);
@@ -928,6 +1152,16 @@ init_in_thread (gpointer task_data)
   return NULL;
 }
 
+/* Write out the sort cache once we are done with
+ * the work that is queued up, not after every result
+ */
+static void
+save_sort_cache_if_idle (ThreadData *td)
+{
+  if (td->sort_cache && g_async_queue_length (td->queue) <= 0)
+    pango_fc_sort_cache_save (td->sort_cache, NULL);
+}
+
 static gpointer
 sort_in_thread (gpointer task_data)
 {
@@ -952,6 +1186,14 @@ sort_in_thread (gpointer task_data)
   g_cond_signal (&td->patterns->cond);
   g_mutex_unlock (&td->patterns->mutex);
 
+  if (td->sort_cache && fontset)
+    {
+      pango_fc_sort_cache_add_sort (td->sort_cache,
+                                    td->fingerprint, td->pattern, td->fonts,
+                                    fontset);
+      save_sort_cache_if_idle (td);
+    }
+
   thread_data_free (td);
 
   return NULL;
@@ -979,10 +1221,40 @@ match_in_thread (gpointer task_data)
   g_cond_signal (&td->patterns->cond);
   g_mutex_unlock (&td->patterns->mutex);
 
+  if (td->sort_cache && match)
+    pango_fc_sort_cache_add_match (td->sort_cache,
+                                   td->fingerprint, td->pattern, td->fonts,
+                                   match);
+
   if (result == FcResultNoMatch)
     sort_in_thread (td);
   else
-    thread_data_free (td);
+    {
+      save_sort_cache_if_idle (td);
+      thread_data_free (td);
+    }
+
+  return NULL;
+}
+
+static gpointer
+save_in_thread (gpointer task_data)
+{
+  ThreadData *td = task_data;
+  SaveData *save = td->save;
+  GError *error = NULL;
+  gboolean result;
+
+  result = pango_fc_sort_cache_save (td->sort_cache, &error);
+
+  thread_data_free (td);
+
+  g_mutex_lock (&save->mutex);
+  save->result = result;
+  save->error = error;
+  save->done = TRUE;
+  g_cond_signal (&save->cond);
+  g_mutex_unlock (&save->mutex);
 
   return NULL;
 }
@@ -1011,6 +1283,10 @@ fc_thread_func (gpointer data)
           sort_in_thread (td);
           break;
 
+        case FC_SAVE:
+          save_in_thread (td);
+          break;
+
         case FC_END:
           thread_data_free (td);
           done = TRUE;
@@ -1028,30 +1304,69 @@ fc_thread_func (gpointer data)
   return NULL;
 }
 
+/* Fill in match and fontset from the sort cache,
+ * if it has results for our pattern
+ */
+static gboolean
+pango_fc_patterns_load_cached (PangoFcPatterns *pats)
+{
+  PangoFcFontMap *fontmap = pats->fontmap;
+  FcFontSet *fonts;
+  FcPattern *best;
+  FcFontSet *sorted;
+
+  if (!fontmap->priv->sort_cache)
+    return FALSE;
+
+  fonts = pango_fc_font_map_get_config_fonts (fontmap);
+
+  if (!pango_fc_sort_cache_lookup (fontmap->priv->sort_cache,
+                                   pango_fc_font_map_get_fonts_fingerprint (fontmap),
+                                   pats->pattern, fonts,
+                                   &best, &sorted))
+    return FALSE;
+
+  if (best)
+    pats->match = FcFontRenderPrepare (fontmap->priv->config, pats->pattern, best);
+  pats->fontset = sorted;
+
+  return pats->match || pats->fontset;
+}
+
 static PangoFcPatterns *
 pango_fc_patterns_new (FcPattern *pat, PangoFcFontMap *fontmap)
 {
   PangoFcPatterns *pats;
 
+  /* The lock keeps the last unref from racing with our lookup */
+  g_rec_mutex_lock (&fontmap->priv->lock);
+
   pat = uniquify_pattern (fontmap, pat);
   pats = g_hash_table_lookup (fontmap->priv->patterns_hash, pat);
   if (pats)
-    return pango_fc_patterns_ref (pats);
+    {
+      pango_fc_patterns_ref (pats);
+      g_rec_mutex_unlock (&fontmap->priv->lock);
+      FcPatternDestroy (pat);
+      return pats;
+    }
 
   pats = g_atomic_rc_box_new0 (PangoFcPatterns);
 
   pats->fontmap = fontmap;
 
-  FcPatternReference (pat);
   pats->pattern = pat;
 
   g_mutex_init (&pats->mutex);
   g_cond_init (&pats->cond);
 
-  g_async_queue_push (fontmap->priv->queue, thread_data_new (FC_MATCH, pats));
+  if (!pango_fc_patterns_load_cached (pats))
+    g_async_queue_push (fontmap->priv->queue, thread_data_new (FC_MATCH, pats));
 
   g_hash_table_insert (fontmap->priv->patterns_hash, pats->pattern, pats);
 
+  g_rec_mutex_unlock (&fontmap->priv->lock);
+
   return pats;
 }
 
@@ -1088,7 +1403,11 @@ free_patterns (gpointer data)
 static void
 pango_fc_patterns_unref (PangoFcPatterns *pats)
 {
+  GRecMutex *lock = &pats->fontmap->priv->lock;
+
+  g_rec_mutex_lock (lock);
   g_atomic_rc_box_release_full (pats, free_patterns);
+  g_rec_mutex_unlock (lock);
 }
 
 static FcPattern *
@@ -1181,6 +1500,27 @@ filter_by_format (FcFontSet **sets, int nsets)
   return result;
 }
 
+/* Queues the FcFontSort for pats, unless that already happened.
+ * Must be called with pats->mutex held.
+ */
+static void
+pango_fc_patterns_request_sort_locked (PangoFcPatterns *pats)
+{
+  if (pats->fontset || pats->sort_requested)
+    return;
+
+  pats->sort_requested = TRUE;
+  g_async_queue_push (pats->fontmap->priv->queue, thread_data_new (FC_SORT, pats));
+}
+
+static void
+pango_fc_patterns_request_sort (PangoFcPatterns *pats)
+{
+  g_mutex_lock (&pats->mutex);
+  pango_fc_patterns_request_sort_locked (pats);
+  g_mutex_unlock (&pats->mutex);
+}
+
 static FcPattern *
 pango_fc_patterns_get_font_pattern (PangoFcPatterns *pats, int i, gboolean *prepare)
 {
@@ -1223,11 +1563,10 @@ pango_fc_patterns_get_font_pattern (PangoFcPatterns *pats, int i, gboolean *prep
 
       before = PANGO_TRACE_CURRENT_TIME;
 
-      if (!pats->fontset)
-        g_async_queue_push (pats->fontmap->priv->queue, thread_data_new (FC_SORT, pats));
-
       g_mutex_lock (&pats->mutex);
 
+      pango_fc_patterns_request_sort_locked (pats);
+
       while (!pats->fontset)
         {
           waited = TRUE;
@@ -1273,13 +1612,18 @@ struct _PangoFcFontset
 
   PangoFcFontsetKey *key;
 
+  /* Protects patterns_i, fonts and coverages */
+  GMutex mutex;
+
   PangoFcPatterns *patterns;
   int patterns_i;
 
   GPtrArray *fonts;
   GPtrArray *coverages;
 
-  GList *cache_link;
+  GList *cache_link; /* protected by the lock of our shard */
+  guint last_used;   /* protected by the lock of our shard */
+  gsize cache_size;
 };
 
 typedef PangoFontsetClass PangoFcFontsetClass;
@@ -1297,6 +1641,15 @@ pango_fc_fontset_new (PangoFcFontsetKey *key,
   fontset->key = pango_fc_fontset_key_copy (key);
   fontset->patterns = pango_fc_patterns_ref (patterns);
 
+  /* The fonts are shared with other fontsets, so we only
+   * account for what belongs to the fontset itself
+   */
+  fontset->cache_size = sizeof (PangoFcFontset) + sizeof (PangoFcFontsetKey);
+  if (key->variations)
+    fontset->cache_size += strlen (key->variations) + 1;
+  if (key->features)
+    fontset->cache_size += strlen (key->features) + 1;
+
   return fontset;
 }
 
@@ -1322,7 +1675,16 @@ pango_fc_fontset_load_next_font (PangoFcFontset *fontset)
 
   if (prepare)
     {
-      font_pattern = FcFontRenderPrepare (fontset->key->fontmap->priv->config, pattern, font_pattern);
+      PangoFcFontMapPrivate *priv = fontset->key->fontmap->priv;
+      FcConfig *config;
+
+      /* set_config() may drop the config while we use it */
+      g_rec_mutex_lock (&priv->lock);
+      config = FcConfigReference (priv->config);
+      g_rec_mutex_unlock (&priv->lock);
+
+      font_pattern = FcFontRenderPrepare (config, pattern, font_pattern);
+      FcConfigDestroy (config);
 
       if (G_UNLIKELY (!font_pattern))
 	return NULL;
@@ -1338,6 +1700,7 @@ pango_fc_fontset_load_next_font (PangoFcFontset *fontset)
   return font;
 }
 
+/* Must be called with the fontset mutex held */
 static PangoFont *
 pango_fc_fontset_get_font_at (PangoFcFontset *fontset,
 			      unsigned int    i)
@@ -1370,6 +1733,7 @@ pango_fc_fontset_class_init (PangoFcFontsetClass *class)
 static void
 pango_fc_fontset_init (PangoFcFontset *fontset)
 {
+  g_mutex_init (&fontset->mutex);
   fontset->fonts = g_ptr_array_new ();
   fontset->coverages = g_ptr_array_new ();
 }
@@ -1402,6 +1766,8 @@ pango_fc_fontset_finalize (GObject *object)
   if (fontset->patterns)
     pango_fc_patterns_unref (fontset->patterns);
 
+  g_mutex_clear (&fontset->mutex);
+
   G_OBJECT_CLASS (pango_fc_fontset_parent_class)->finalize (object);
 }
 
@@ -1425,6 +1791,8 @@ pango_fc_fontset_get_font (PangoFontset  *fontset,
   int result = -1;
   unsigned int i;
 
+  g_mutex_lock (&fcfontset->mutex);
+
   for (i = 0;
        pango_fc_fontset_get_font_at (fcfontset, i);
        i++)
@@ -1451,10 +1819,13 @@ pango_fc_fontset_get_font (PangoFontset  *fontset,
     }
 
   if (G_UNLIKELY (result == -1))
-    return NULL;
+    font = NULL;
+  else
+    font = g_object_ref (g_ptr_array_index (fcfontset->fonts, result));
+
+  g_mutex_unlock (&fcfontset->mutex);
 
-  font = g_ptr_array_index (fcfontset->fonts, result);
-  return g_object_ref (font);
+  return font;
 }
 
 static void
@@ -1466,10 +1837,19 @@ pango_fc_fontset_foreach (PangoFontset           *fontset,
   PangoFont *font;
   unsigned int i;
 
-  for (i = 0;
-       (font = pango_fc_fontset_get_font_at (fcfontset, i));
-       i++)
+  /* Fonts are never removed from the fontset before it
+   * is finalized, so we don't need to hold the lock while
+   * calling func
+   */
+  for (i = 0; ; i++)
     {
+      g_mutex_lock (&fcfontset->mutex);
+      font = pango_fc_fontset_get_font_at (fcfontset, i);
+      g_mutex_unlock (&fcfontset->mutex);
+
+      if (!font)
+        return;
+
       if ((*func) (fontset, font, data))
 	return;
     }
@@ -1563,22 +1943,91 @@ wait_for_fc_init (void)
 }
 
 static void
-pango_fc_font_map_init (PangoFcFontMap *fcfontmap)
+pango_fc_font_entry_free (PangoFcFontEntry *entry)
 {
-  PangoFcFontMapPrivate *priv;
+  g_weak_ref_clear (&entry->ref);
+  g_free (entry);
+}
 
-  priv = fcfontmap->priv = pango_fc_font_map_get_instance_private (fcfontmap);
+static inline PangoFcCacheShard *
+get_fontset_shard (PangoFcFontMapPrivate *priv,
+                   PangoFcFontsetKey     *key)
+{
+  return &priv->shards[pango_fc_fontset_key_hash (key) & (N_CACHE_SHARDS - 1)];
+}
 
-  priv->n_families = -1;
+static inline PangoFcCacheShard *
+get_font_shard (PangoFcFontMapPrivate *priv,
+                PangoFcFontKey        *key)
+{
+  return &priv->shards[pango_fc_font_key_hash (key) & (N_CACHE_SHARDS - 1)];
+}
+
+/* Must be called with the shard mutex held.
+ * Returns a new reference, or NULL if the font is
+ * not cached or is being finalized.
+ */
+static PangoFcFont *
+lookup_font_locked (PangoFcCacheShard *shard,
+                    PangoFcFontKey    *key)
+{
+  PangoFcFontEntry *entry;
+
+  if (G_UNLIKELY (!shard->font_hash))
+    return NULL;
+
+  entry = g_hash_table_lookup (shard->font_hash, key);
+  if (!entry)
+    return NULL;
+
+  return g_weak_ref_get (&entry->ref);
+}
+
+static PangoFcFont *
+lookup_font (PangoFcFontMap *fcfontmap,
+             PangoFcFontKey *key)
+{
+  PangoFcCacheShard *shard = get_font_shard (fcfontmap->priv, key);
+  PangoFcFont *fcfont;
+
+  g_mutex_lock (&shard->mutex);
+  fcfont = lookup_font_locked (shard, key);
+  if (fcfont)
+    shard->fonts.hits++;
+  else
+    shard->fonts.misses++;
+  g_mutex_unlock (&shard->mutex);
+
+  return fcfont;
+}
+
+/* Sets up the caches; this is also used to
+ * reset them in pango_fc_font_map_cache_clear()
+ */
+static void
+pango_fc_font_map_setup (PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  const char *cache_file;
+  int i;
 
-  priv->font_hash = g_hash_table_new ((GHashFunc)pango_fc_font_key_hash,
-				      (GEqualFunc)pango_fc_font_key_equal);
+  priv->n_families = -1;
 
-  priv->fontset_hash = g_hash_table_new_full ((GHashFunc)pango_fc_fontset_key_hash,
-					      (GEqualFunc)pango_fc_fontset_key_equal,
-					      NULL,
-					      (GDestroyNotify)g_object_unref);
-  priv->fontset_cache = g_queue_new ();
+  for (i = 0; i < N_CACHE_SHARDS; i++)
+    {
+      PangoFcCacheShard *shard = &priv->shards[i];
+
+      shard->font_hash = g_hash_table_new_full ((GHashFunc)pango_fc_font_key_hash,
+                                                (GEqualFunc)pango_fc_font_key_equal,
+                                                NULL,
+                                                (GDestroyNotify)pango_fc_font_entry_free);
+
+      shard->fontset_hash = g_hash_table_new_full ((GHashFunc)pango_fc_fontset_key_hash,
+                                                   (GEqualFunc)pango_fc_fontset_key_equal,
+                                                   NULL,
+                                                   (GDestroyNotify)g_object_unref);
+      shard->fontset_cache = g_queue_new ();
+    }
 
   priv->patterns_hash = g_hash_table_new (NULL, NULL);
 
@@ -1586,44 +2035,125 @@ pango_fc_font_map_init (PangoFcFontMap *fcfontmap)
 					      (GEqualFunc) FcPatternEqual,
 					      (GDestroyNotify) FcPatternDestroy,
 					      NULL);
+  priv->pattern_cache = g_queue_new ();
 
   priv->font_face_data_hash = g_hash_table_new_full ((GHashFunc)pango_fc_font_face_data_hash,
 						     (GEqualFunc)pango_fc_font_face_data_equal,
-						     (GDestroyNotify)pango_fc_font_face_data_free,
-						     NULL);
+						     NULL,
+						     (GDestroyNotify)pango_fc_font_face_data_unref);
+  priv->font_face_data_cache = g_queue_new ();
   priv->dpi = -1;
 
   priv->queue = g_async_queue_new ();
 
   start_fontconfig_thread (fcfontmap);
+
+  cache_file = g_getenv ("PANGO_FC_SORT_CACHE");
+  if (cache_file && *cache_file)
+    priv->sort_cache = pango_fc_sort_cache_new (cache_file);
+  priv->fingerprint_nfont = -1;
 }
 
 static void
-pango_fc_font_map_fini (PangoFcFontMap *fcfontmap)
+pango_fc_font_map_init (PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv;
+  int i;
+
+  priv = fcfontmap->priv = pango_fc_font_map_get_instance_private (fcfontmap);
+
+  g_rec_mutex_init (&priv->lock);
+  for (i = 0; i < N_CACHE_SHARDS; i++)
+    g_mutex_init (&priv->shards[i].mutex);
+
+  g_mutex_init (&priv->fontsets_lock);
+  priv->fontsets.max_entries = FONTSET_CACHE_SIZE;
+  priv->fontsets.max_bytes = 0;
+
+  pango_fc_font_map_setup (fcfontmap);
+}
+
+/* Takes the fontmap lock and then all shard locks, in order.
+ * This is what keeps cache_clear() and set_config() from racing
+ * with lookups; lookups only ever hold one shard lock at a time.
+ */
+static void
+pango_fc_font_map_lock_all (PangoFcFontMapPrivate *priv)
+{
+  int i;
+
+  g_rec_mutex_lock (&priv->lock);
+  for (i = 0; i < N_CACHE_SHARDS; i++)
+    g_mutex_lock (&priv->shards[i].mutex);
+}
+
+static void
+pango_fc_font_map_unlock_all (PangoFcFontMapPrivate *priv)
+{
+  int i;
+
+  for (i = N_CACHE_SHARDS - 1; i >= 0; i--)
+    g_mutex_unlock (&priv->shards[i].mutex);
+  g_rec_mutex_unlock (&priv->lock);
+}
+
+/* Must be called with all locks held. The fontset and font
+ * tables of the shards are moved to @caches instead of being
+ * freed, since dropping the fontsets unrefs fonts, which take
+ * the shard locks to remove themselves from the font caches.
+ * Free them with pango_fc_shard_caches_free() after unlocking.
+ */
+static void
+pango_fc_font_map_fini (PangoFcFontMap     *fcfontmap,
+                        PangoFcShardCaches *caches)
 {
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
   int i;
 
   g_clear_pointer (&priv->fonts, FcFontSetDestroy);
 
-  g_queue_free (priv->fontset_cache);
-  priv->fontset_cache = NULL;
+  for (i = 0; i < N_CACHE_SHARDS; i++)
+    {
+      PangoFcCacheShard *shard = &priv->shards[i];
+
+      caches[i].fontset_hash = g_steal_pointer (&shard->fontset_hash);
+      caches[i].fontset_cache = g_steal_pointer (&shard->fontset_cache);
+      caches[i].font_hash = g_steal_pointer (&shard->font_hash);
 
-  g_hash_table_destroy (priv->fontset_hash);
-  priv->fontset_hash = NULL;
+      shard->fontsets.n_entries = 0;
+      shard->fontsets.n_bytes = 0;
+    }
+
+  g_mutex_lock (&priv->fontsets_lock);
+  priv->fontsets.n_entries = 0;
+  priv->fontsets.n_bytes = 0;
+  g_mutex_unlock (&priv->fontsets_lock);
 
   g_hash_table_destroy (priv->patterns_hash);
   priv->patterns_hash = NULL;
 
-  g_hash_table_destroy (priv->font_hash);
-  priv->font_hash = NULL;
+  /* Fonts may keep face data alive after this */
+  while (!g_queue_is_empty (priv->font_face_data_cache))
+    {
+      PangoFcFontFaceData *data = g_queue_pop_head (priv->font_face_data_cache);
+      data->cache_link = NULL;
+    }
+  g_clear_pointer (&priv->font_face_data_cache, g_queue_free);
 
   g_hash_table_destroy (priv->font_face_data_hash);
   priv->font_face_data_hash = NULL;
 
+  priv->font_face_data.n_entries = 0;
+  priv->font_face_data.n_bytes = 0;
+
   g_hash_table_destroy (priv->pattern_hash);
   priv->pattern_hash = NULL;
 
+  g_clear_pointer (&priv->pattern_cache, g_queue_free);
+
+  priv->patterns.n_entries = 0;
+  priv->patterns.n_bytes = 0;
+
   for (i = 0; i < priv->n_families; i++)
     g_object_unref (priv->families[i]);
   g_free (priv->families);
@@ -1634,6 +2164,41 @@ pango_fc_font_map_fini (PangoFcFontMap *fcfontmap)
 
   g_async_queue_unref (priv->queue);
   priv->queue = NULL;
+
+  /* Jobs that are still queued hold their own reference,
+   * and add their results to this cache, not the next one
+   */
+  if (priv->sort_cache)
+    {
+      pango_fc_sort_cache_save (priv->sort_cache, NULL);
+      g_clear_pointer (&priv->sort_cache, pango_fc_sort_cache_unref);
+    }
+}
+
+/* Must be called without any shard locks held */
+static void
+pango_fc_shard_caches_free (PangoFcShardCaches *caches)
+{
+  int i;
+
+  for (i = 0; i < N_CACHE_SHARDS; i++)
+    {
+      g_clear_pointer (&caches[i].fontset_cache, g_queue_free);
+      g_clear_pointer (&caches[i].fontset_hash, g_hash_table_destroy);
+      g_clear_pointer (&caches[i].font_hash, g_hash_table_destroy);
+    }
+}
+
+static void
+pango_fc_font_map_prefetch_fontset (PangoFontMap *fontmap G_GNUC_UNUSED,
+                                    PangoFontset *fontset)
+{
+  /* Loading the fontset has already queued the FcFontMatch.
+   * Queue the FcFontSort as well, so that the fallback fonts
+   * are ready by the time that layout needs them.
+   */
+  if (PANGO_FC_IS_FONTSET (fontset))
+    pango_fc_patterns_request_sort (PANGO_FC_FONTSET (fontset)->patterns);
 }
 
 static void
@@ -1656,6 +2221,8 @@ pango_fc_font_map_class_init (PangoFcFontMapClass *class)
 
   pclass->reload_font = pango_fc_font_map_reload_font;
   pclass->add_font_file = pango_fc_font_map_add_font_file;
+  pclass->prefetch_fontset = pango_fc_font_map_prefetch_fontset;
+  pclass->threadsafe = TRUE;
 }
 
 
@@ -1740,6 +2307,7 @@ static void
 pango_fc_font_map_finalize (GObject *object)
 {
   PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (object);
+  int i;
 
   pango_fc_font_map_shutdown (fcfontmap);
 
@@ -1749,29 +2317,68 @@ pango_fc_font_map_finalize (GObject *object)
   if (fcfontmap->priv->config)
     FcConfigDestroy (fcfontmap->priv->config);
 
+  for (i = 0; i < N_CACHE_SHARDS; i++)
+    g_mutex_clear (&fcfontmap->priv->shards[i].mutex);
+  g_mutex_clear (&fcfontmap->priv->fontsets_lock);
+  g_rec_mutex_clear (&fcfontmap->priv->lock);
+
   G_OBJECT_CLASS (pango_fc_font_map_parent_class)->finalize (object);
 }
 
-/* Add a mapping from key to fcfont */
-static void
+/* Add a mapping from key to fcfont, unless another thread
+ * has added a font for the same key in the meantime. In that
+ * case, fcfont is dropped and the other font is returned.
+ */
+static PangoFcFont *
 pango_fc_font_map_add (PangoFcFontMap *fcfontmap,
 		       PangoFcFontKey *key,
 		       PangoFcFont    *fcfont)
 {
-  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  PangoFcCacheShard *shard = get_font_shard (fcfontmap->priv, key);
   PangoFcFontKey *key_copy;
+  PangoFcFontEntry *entry;
+  PangoFcFont *existing;
 
   key_copy = pango_fc_font_key_copy (key);
-  _pango_fc_font_set_font_key (fcfont, key_copy);
-  g_hash_table_insert (priv->font_hash, key_copy, fcfont);
-}
 
-static PangoFont *
-pango_fc_font_map_reload_font (PangoFontMap *fontmap,
-                               PangoFont    *font,
-                               double        scale,
-                               PangoContext *context,
-                               const char   *variations)
+  g_mutex_lock (&shard->mutex);
+
+  existing = lookup_font_locked (shard, key);
+  if (!existing)
+    {
+      _pango_fc_font_set_font_key (fcfont, key_copy);
+
+      if (shard->font_hash)
+        {
+          entry = g_new (PangoFcFontEntry, 1);
+          g_weak_ref_init (&entry->ref, fcfont);
+          entry->font = fcfont;
+
+          /* This replaces a stale entry for a font that
+           * is being finalized, if there is one
+           */
+          g_hash_table_replace (shard->font_hash, key_copy, entry);
+        }
+    }
+
+  g_mutex_unlock (&shard->mutex);
+
+  if (existing)
+    {
+      pango_fc_font_key_free (key_copy);
+      g_object_unref (fcfont);
+      return existing;
+    }
+
+  return fcfont;
+}
+
+static PangoFont *
+pango_fc_font_map_reload_font (PangoFontMap *fontmap,
+                               PangoFont    *font,
+                               double        scale,
+                               PangoContext *context,
+                               const char   *variations)
 {
   PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (fontmap);
   PangoFcFont *fcfont = PANGO_FC_FONT (font);
@@ -1828,7 +2435,10 @@ pango_fc_font_map_reload_font (PangoFontMap *fontmap,
   scaled = pango_fc_font_map_new_font_from_key (fcfontmap, &key);
 
   if (pattern)
-    FcPatternDestroy (pattern);
+    {
+      FcPatternDestroy (key.pattern);
+      FcPatternDestroy (pattern);
+    }
 
   return scaled;
 }
@@ -1839,19 +2449,27 @@ void
 _pango_fc_font_map_remove (PangoFcFontMap *fcfontmap,
 			   PangoFcFont    *fcfont)
 {
-  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  PangoFcCacheShard *shard;
+  PangoFcFontEntry *entry;
   PangoFcFontKey *key;
 
   key = _pango_fc_font_get_font_key (fcfont);
   if (key)
     {
+      shard = get_font_shard (fcfontmap->priv, key);
+
       /* Only remove from fontmap hash if we are in it.  This is not necessarily
-       * the case after a cache_clear() call. */
-      if (priv->font_hash &&
-	  fcfont == g_hash_table_lookup (priv->font_hash, key))
+       * the case after a cache_clear() call, or if another thread has already
+       * replaced our entry. */
+      g_mutex_lock (&shard->mutex);
+      if (shard->font_hash &&
+          (entry = g_hash_table_lookup (shard->font_hash, key)) != NULL &&
+	  entry->font == fcfont)
         {
-	  g_hash_table_remove (priv->font_hash, key);
+	  g_hash_table_remove (shard->font_hash, key);
 	}
+      g_mutex_unlock (&shard->mutex);
+
       _pango_fc_font_set_font_key (fcfont, NULL);
       pango_fc_font_key_free (key);
     }
@@ -1918,6 +2536,11 @@ ensure_families (PangoFcFontMap *fcfontmap)
 
   wait_for_fc_init ();
 
+  if (g_atomic_int_get (&priv->n_families) >= 0)
+    return;
+
+  g_rec_mutex_lock (&priv->lock);
+
   if (priv->n_families < 0)
     {
       FcObjectSet *os = FcObjectSetBuild (FC_FAMILY, FC_SPACING, FC_STYLE, FC_WEIGHT, FC_WIDTH, FC_SLANT,
@@ -1984,8 +2607,10 @@ ensure_families (PangoFcFontMap *fcfontmap)
 
       qsort (priv->families, count, sizeof (PangoFcFamily *), compare_font_family_names);
 
-      priv->n_families = count;
+      g_atomic_int_set (&priv->n_families, count);
     }
+
+  g_rec_mutex_unlock (&priv->lock);
 }
 
 
@@ -2207,24 +2832,72 @@ pango_fc_make_pattern (const  PangoFontDescription *description,
   return pattern;
 }
 
+/* Fontconfig does not tell us how big a pattern is. This
+ * is roughly what it allocates for a pattern whose objects
+ * have one value each.
+ */
+static gsize
+pattern_size (FcPattern *pattern)
+{
+  return 32 + FcPatternObjectCount (pattern) * 48;
+}
+
+/* Must be called with the fontmap lock held */
+static void
+pango_fc_font_map_trim_patterns (PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+
+  while (pango_fc_cache_budget_exceeded (&priv->patterns))
+    {
+      FcPattern *pattern = g_queue_pop_tail (priv->pattern_cache);
+
+      priv->patterns.n_entries--;
+      priv->patterns.n_bytes -= pattern_size (pattern);
+      priv->patterns.evictions++;
+
+      /* Drops our reference */
+      g_hash_table_remove (priv->pattern_hash, pattern);
+    }
+}
+
+/* Returns a new reference to the single copy of pattern
+ * that we keep, so that it stays alive when it is evicted
+ */
 static FcPattern *
 uniquify_pattern (PangoFcFontMap *fcfontmap,
 		  FcPattern      *pattern)
 {
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
-  FcPattern *old_pattern;
+  GList *link;
 
-  old_pattern = g_hash_table_lookup (priv->pattern_hash, pattern);
-  if (old_pattern)
+  g_rec_mutex_lock (&priv->lock);
+
+  link = g_hash_table_lookup (priv->pattern_hash, pattern);
+  if (link)
     {
-      return old_pattern;
+      pattern = link->data;
+      pango_fc_cache_touch (priv->pattern_cache, link);
+      priv->patterns.hits++;
     }
   else
     {
       FcPatternReference (pattern);
-      g_hash_table_insert (priv->pattern_hash, pattern, pattern);
-      return pattern;
+      g_queue_push_head (priv->pattern_cache, pattern);
+      g_hash_table_insert (priv->pattern_hash, pattern, priv->pattern_cache->head);
+
+      priv->patterns.n_entries++;
+      priv->patterns.n_bytes += pattern_size (pattern);
+      priv->patterns.misses++;
+
+      pango_fc_font_map_trim_patterns (fcfontmap);
     }
+
+  FcPatternReference (pattern);
+
+  g_rec_mutex_unlock (&priv->lock);
+
+  return pattern;
 }
 
 static PangoFont *
@@ -2238,9 +2911,9 @@ pango_fc_font_map_new_font_from_key (PangoFcFontMap *fcfontmap,
   if (priv->closed)
     return NULL;
 
-  fcfont = g_hash_table_lookup (priv->font_hash, key);
+  fcfont = lookup_font (fcfontmap, key);
   if (fcfont)
-    return g_object_ref (PANGO_FONT (fcfont));
+    return PANGO_FONT (fcfont);
 
   class = PANGO_FC_FONT_MAP_GET_CLASS (fcfontmap);
 
@@ -2255,9 +2928,8 @@ pango_fc_font_map_new_font_from_key (PangoFcFontMap *fcfontmap,
   pango_fc_font_set_face (fcfont,
                           pango_fc_font_map_get_face (PANGO_FONT_MAP (fcfontmap),
                                                       PANGO_FONT (fcfont)));
-  pango_fc_font_map_add (fcfontmap, key, fcfont);
 
-  return (PangoFont *)fcfont;
+  return (PangoFont *) pango_fc_font_map_add (fcfontmap, key, fcfont);
 }
 
 static PangoFont *
@@ -2267,7 +2939,7 @@ pango_fc_font_map_new_font (PangoFcFontMap    *fcfontmap,
 {
   PangoFcFontMapClass *class;
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
-  FcPattern *pattern;
+  FcPattern *pattern, *unique;
   PangoFcFont *fcfont;
   PangoFcFontKey key;
 
@@ -2278,9 +2950,9 @@ pango_fc_font_map_new_font (PangoFcFontMap    *fcfontmap,
 
   pango_fc_font_key_init (&key, fcfontmap, fontset_key, match);
 
-  fcfont = g_hash_table_lookup (priv->font_hash, &key);
+  fcfont = lookup_font (fcfontmap, &key);
   if (fcfont)
-    return g_object_ref (PANGO_FONT (fcfont));
+    goto out;
 
   class = PANGO_FC_FONT_MAP_GET_CLASS (fcfontmap);
 
@@ -2309,13 +2981,15 @@ pango_fc_font_map_new_font (PangoFcFontMap    *fcfontmap,
       FcPatternDel (pattern, FC_MATRIX);
       FcPatternAddMatrix (pattern, FC_MATRIX, &fc_matrix);
 
-      fcfont = class->new_font (fcfontmap, uniquify_pattern (fcfontmap, pattern));
+      unique = uniquify_pattern (fcfontmap, pattern);
+      fcfont = class->new_font (fcfontmap, unique);
 
+      FcPatternDestroy (unique);
       FcPatternDestroy (pattern);
     }
 
   if (!fcfont)
-    return NULL;
+    goto out;
 
   pango_fc_font_set_face (fcfont,
                           pango_fc_font_map_get_face (PANGO_FONT_MAP (fcfontmap),
@@ -2328,9 +3002,12 @@ pango_fc_font_map_new_font (PangoFcFontMap    *fcfontmap,
 		  NULL);
 
   /* cache it on fontmap */
-  pango_fc_font_map_add (fcfontmap, &key, fcfont);
+  fcfont = pango_fc_font_map_add (fcfontmap, &key, fcfont);
 
-  return (PangoFont *)fcfont;
+out:
+  FcPatternDestroy (match);
+
+  return (PangoFont *) fcfont;
 }
 
 static PangoFontFace *
@@ -2341,6 +3018,7 @@ pango_fc_font_map_get_face (PangoFontMap *fontmap,
   FcResult res;
   const char *s;
   PangoFcFamily *family;
+  PangoFontFace *face = NULL;
 
   res = FcPatternGetString (fcfont->font_pattern, FC_FAMILY, 0, (FcChar8 **) &s);
   g_assert (res == FcResultMatch);
@@ -2348,16 +3026,24 @@ pango_fc_font_map_get_face (PangoFontMap *fontmap,
   family = (PangoFcFamily *) pango_fc_font_map_get_family (fontmap, s);
   if (family)
     {
+      /* The faces are created lazily */
+      g_rec_mutex_lock (&PANGO_FC_FONT_MAP (fontmap)->priv->lock);
+
       ensure_faces (family);
 
       for (int i = 0; i < family->n_faces; i++)
         {
           if (compare_face_pattern (family->faces[i]->pattern, fcfont->font_pattern) == 0)
-            return PANGO_FONT_FACE (family->faces[i]);
+            {
+              face = PANGO_FONT_FACE (family->faces[i]);
+              break;
+            }
         }
+
+      g_rec_mutex_unlock (&PANGO_FC_FONT_MAP (fontmap)->priv->lock);
     }
 
-  return NULL;
+  return face;
 }
 
 static void
@@ -2494,41 +3180,118 @@ pango_fc_font_map_load_font (PangoFontMap               *fontmap,
   return font;
 }
 
-static void
-pango_fc_fontset_cache (PangoFcFontset *fontset,
-			PangoFcFontMap *fcfontmap)
+/* The fontset cache is split into shards, but its limits
+ * apply to all of them together. When the cache is over its
+ * limits, we evict the least recently used fontset of all
+ * shards, so a shard can hold all of the fontsets if they
+ * happen to end up in it. Fontsets are stamped with a clock
+ * when they are used, to find the oldest one.
+ *
+ * Returns the fontsets that were evicted from the cache, for
+ * the caller to unref. Must be called without holding any
+ * shard lock.
+ */
+static GSList *
+pango_fc_font_map_trim_fontsets (PangoFcFontMapPrivate *priv)
 {
-  PangoFcFontMapPrivate *priv = fcfontmap->priv;
-  GQueue *cache = priv->fontset_cache;
+  GSList *evicted = NULL;
 
-  if (fontset->cache_link)
+  while (TRUE)
     {
-      if (fontset->cache_link == cache->head)
-        return;
+      PangoFcCacheShard *victim = NULL;
+      PangoFcFontset *fontset;
+      guint oldest = 0;
+      gboolean exceeded;
+      int i;
 
-      /* Already in cache, move to head
+      g_mutex_lock (&priv->fontsets_lock);
+      exceeded = pango_fc_cache_budget_exceeded (&priv->fontsets);
+      g_mutex_unlock (&priv->fontsets_lock);
+
+      if (!exceeded)
+        break;
+
+      for (i = 0; i < N_CACHE_SHARDS; i++)
+        {
+          PangoFcCacheShard *shard = &priv->shards[i];
+
+          g_mutex_lock (&shard->mutex);
+          fontset = shard->fontset_cache ? g_queue_peek_tail (shard->fontset_cache) : NULL;
+          if (fontset && (!victim || (int) (fontset->last_used - oldest) < 0))
+            {
+              victim = shard;
+              oldest = fontset->last_used;
+            }
+          g_mutex_unlock (&shard->mutex);
+        }
+
+      if (!victim)
+        break;
+
+      /* Another thread may have used or evicted the fontset
+       * meanwhile, then we just evict the next oldest one
        */
-      if (fontset->cache_link == cache->tail)
-	cache->tail = fontset->cache_link->prev;
+      g_mutex_lock (&victim->mutex);
+      fontset = victim->fontset_cache ? g_queue_pop_tail (victim->fontset_cache) : NULL;
+      if (fontset)
+        {
+          fontset->cache_link = NULL;
+          g_hash_table_steal (victim->fontset_hash, fontset->key);
+
+          victim->fontsets.n_entries--;
+          victim->fontsets.n_bytes -= fontset->cache_size;
+          victim->fontsets.evictions++;
 
-      cache->head = g_list_remove_link (cache->head, fontset->cache_link);
-      cache->length--;
+          g_mutex_lock (&priv->fontsets_lock);
+          priv->fontsets.n_entries--;
+          priv->fontsets.n_bytes -= fontset->cache_size;
+          g_mutex_unlock (&priv->fontsets_lock);
+
+          evicted = g_slist_prepend (evicted, fontset);
+        }
+      g_mutex_unlock (&victim->mutex);
     }
-  else
+
+  return evicted;
+}
+
+/* Must be called with the shard mutex held. Returns whether
+ * the cache is over its limits now, in which case the caller
+ * must call pango_fc_font_map_trim_fontsets() after dropping
+ * the lock.
+ */
+static gboolean
+pango_fc_fontset_cache (PangoFcFontMapPrivate *priv,
+                        PangoFcFontset        *fontset,
+                        PangoFcCacheShard     *shard)
+{
+  gboolean exceeded;
+
+  fontset->last_used = (guint) g_atomic_int_add (&priv->fontsets_clock, 1);
+
+  if (fontset->cache_link)
     {
-      /* Add to cache initially
+      /* Already in cache, move to head
        */
-      if (cache->length == FONTSET_CACHE_SIZE)
-	{
-	  PangoFcFontset *tmp_fontset = g_queue_pop_tail (cache);
-	  tmp_fontset->cache_link = NULL;
-	  g_hash_table_remove (priv->fontset_hash, tmp_fontset->key);
-	}
-
-      fontset->cache_link = g_list_prepend (NULL, fontset);
+      pango_fc_cache_touch (shard->fontset_cache, fontset->cache_link);
+      return FALSE;
     }
 
-  g_queue_push_head_link (cache, fontset->cache_link);
+  /* Add to cache initially
+   */
+  fontset->cache_link = g_list_prepend (NULL, fontset);
+  g_queue_push_head_link (shard->fontset_cache, fontset->cache_link);
+
+  shard->fontsets.n_entries++;
+  shard->fontsets.n_bytes += fontset->cache_size;
+
+  g_mutex_lock (&priv->fontsets_lock);
+  priv->fontsets.n_entries++;
+  priv->fontsets.n_bytes += fontset->cache_size;
+  exceeded = pango_fc_cache_budget_exceeded (&priv->fontsets);
+  g_mutex_unlock (&priv->fontsets_lock);
+
+  return exceeded;
 }
 
 static PangoFontset *
@@ -2539,33 +3302,61 @@ pango_fc_font_map_load_fontset (PangoFontMap                 *fontmap,
 {
   PangoFcFontMap *fcfontmap = (PangoFcFontMap *)fontmap;
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  PangoFcCacheShard *shard;
   PangoFcFontset *fontset;
+  gboolean trim = FALSE;
   PangoFcFontsetKey key;
 
   pango_fc_fontset_key_init (&key, fcfontmap, context, desc, language);
 
-  fontset = g_hash_table_lookup (priv->fontset_hash, &key);
+  shard = get_fontset_shard (priv, &key);
+
+  g_mutex_lock (&shard->mutex);
+  fontset = g_hash_table_lookup (shard->fontset_hash, &key);
+  if (G_LIKELY (fontset))
+    {
+      shard->fontsets.hits++;
+      trim = pango_fc_fontset_cache (priv, fontset, shard);
+      g_object_ref (fontset);
+    }
+  else
+    shard->fontsets.misses++;
+  g_mutex_unlock (&shard->mutex);
 
   if (G_UNLIKELY (!fontset))
     {
       PangoFcPatterns *patterns = pango_fc_font_map_get_patterns (fontmap, &key);
+      PangoFcFontset *new_fontset;
 
       if (!patterns)
-	return NULL;
-
-      fontset = pango_fc_fontset_new (&key, patterns);
-      g_hash_table_insert (priv->fontset_hash, pango_fc_fontset_get_key (fontset), fontset);
+	goto out;
 
+      new_fontset = pango_fc_fontset_new (&key, patterns);
       pango_fc_patterns_unref (patterns);
+
+      /* Another thread may have created the same fontset meanwhile */
+      g_mutex_lock (&shard->mutex);
+      fontset = g_hash_table_lookup (shard->fontset_hash, &key);
+      if (!fontset)
+        {
+          fontset = new_fontset;
+          new_fontset = NULL;
+          g_hash_table_insert (shard->fontset_hash, pango_fc_fontset_get_key (fontset), fontset);
+        }
+      trim = pango_fc_fontset_cache (priv, fontset, shard);
+      g_object_ref (fontset);
+      g_mutex_unlock (&shard->mutex);
+
+      g_clear_object (&new_fontset);
     }
 
-  pango_fc_fontset_cache (fontset, fcfontmap);
+  if (trim)
+    g_slist_free_full (pango_fc_font_map_trim_fontsets (priv), g_object_unref);
 
+out:
   pango_font_description_free (key.desc);
-  g_free (key.variations);
-  g_free (key.features);
 
-  return g_object_ref (PANGO_FONTSET (fontset));
+  return (PangoFontset *) fontset;
 }
 
 /**
@@ -2584,15 +3375,22 @@ pango_fc_font_map_load_fontset (PangoFontMap                 *fontmap,
 void
 pango_fc_font_map_cache_clear (PangoFcFontMap *fcfontmap)
 {
+  PangoFcShardCaches caches[N_CACHE_SHARDS];
   guint removed, added;
 
   if (G_UNLIKELY (fcfontmap->priv->closed))
     return;
 
+  pango_fc_font_map_lock_all (fcfontmap->priv);
+
   removed = fcfontmap->priv->n_families;
 
-  pango_fc_font_map_fini (fcfontmap);
-  pango_fc_font_map_init (fcfontmap);
+  pango_fc_font_map_fini (fcfontmap, caches);
+  pango_fc_font_map_setup (fcfontmap);
+
+  pango_fc_font_map_unlock_all (fcfontmap->priv);
+
+  pango_fc_shard_caches_free (caches);
 
   ensure_families (fcfontmap);
 
@@ -2605,6 +3403,307 @@ pango_fc_font_map_cache_clear (PangoFcFontMap *fcfontmap)
   pango_font_map_changed (PANGO_FONT_MAP (fcfontmap));
 }
 
+/**
+ * pango_fc_font_map_set_cache_limits:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @cache: the cache to limit
+ * @max_entries: the maximum number of entries, or 0 for no limit
+ * @max_bytes: the maximum size of the entries in bytes, or 0 for no limit
+ *
+ * Limits how much one of the caches of @fcfontmap may hold.
+ *
+ * When a cache grows beyond either limit, the entries that
+ * were used least recently are evicted. Objects that are in
+ * use stay alive when they are evicted; the font map just
+ * stops reusing them.
+ *
+ * Sizes are estimates. For face data, they include the
+ * font file data that the `hb_face_t` maps. The cache
+ * of fonts can not be limited.
+ *
+ * By default, 256 fontsets are cached, and the other caches
+ * are unlimited. The limits are kept across
+ * [method@PangoFc.FontMap.cache_clear].
+ *
+ * Since: 1.60
+ */
+void
+pango_fc_font_map_set_cache_limits (PangoFcFontMap *fcfontmap,
+                                    PangoFcCache    cache,
+                                    guint           max_entries,
+                                    gsize           max_bytes)
+{
+  PangoFcFontMapPrivate *priv;
+
+  g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
+  g_return_if_fail (cache != PANGO_FC_CACHE_FONTS);
+
+  priv = fcfontmap->priv;
+
+  switch (cache)
+    {
+    case PANGO_FC_CACHE_FONTSETS:
+      g_mutex_lock (&priv->fontsets_lock);
+      priv->fontsets.max_entries = max_entries;
+      priv->fontsets.max_bytes = max_bytes;
+      g_mutex_unlock (&priv->fontsets_lock);
+
+      g_slist_free_full (pango_fc_font_map_trim_fontsets (priv), g_object_unref);
+      break;
+
+    case PANGO_FC_CACHE_PATTERNS:
+      g_rec_mutex_lock (&priv->lock);
+      priv->patterns.max_entries = max_entries;
+      priv->patterns.max_bytes = max_bytes;
+      pango_fc_font_map_trim_patterns (fcfontmap);
+      g_rec_mutex_unlock (&priv->lock);
+      break;
+
+    case PANGO_FC_CACHE_FACE_DATA:
+      g_rec_mutex_lock (&priv->lock);
+      priv->font_face_data.max_entries = max_entries;
+      priv->font_face_data.max_bytes = max_bytes;
+      pango_fc_font_map_trim_font_face_data (fcfontmap);
+      g_rec_mutex_unlock (&priv->lock);
+      break;
+
+    case PANGO_FC_CACHE_FONTS:
+    default:
+      g_return_if_reached ();
+    }
+}
+
+/**
+ * pango_fc_font_map_get_cache_limits:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @cache: the cache to query
+ * @max_entries: (out) (optional): return location for the
+ *   maximum number of entries
+ * @max_bytes: (out) (optional): return location for the
+ *   maximum size of the entries in bytes
+ *
+ * Gets the limits of one of the caches of @fcfontmap.
+ *
+ * See [method@PangoFc.FontMap.set_cache_limits]. A limit
+ * of 0 means that the cache is not limited.
+ *
+ * Since: 1.60
+ */
+void
+pango_fc_font_map_get_cache_limits (PangoFcFontMap *fcfontmap,
+                                    PangoFcCache    cache,
+                                    guint          *max_entries,
+                                    gsize          *max_bytes)
+{
+  PangoFcFontMapPrivate *priv;
+  guint entries = 0;
+  gsize bytes = 0;
+
+  g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
+
+  priv = fcfontmap->priv;
+
+  switch (cache)
+    {
+    case PANGO_FC_CACHE_FONTSETS:
+      g_mutex_lock (&priv->fontsets_lock);
+      entries = priv->fontsets.max_entries;
+      bytes = priv->fontsets.max_bytes;
+      g_mutex_unlock (&priv->fontsets_lock);
+      break;
+
+    case PANGO_FC_CACHE_FONTS:
+      break;
+
+    case PANGO_FC_CACHE_PATTERNS:
+      g_rec_mutex_lock (&priv->lock);
+      entries = priv->patterns.max_entries;
+      bytes = priv->patterns.max_bytes;
+      g_rec_mutex_unlock (&priv->lock);
+      break;
+
+    case PANGO_FC_CACHE_FACE_DATA:
+      g_rec_mutex_lock (&priv->lock);
+      entries = priv->font_face_data.max_entries;
+      bytes = priv->font_face_data.max_bytes;
+      g_rec_mutex_unlock (&priv->lock);
+      break;
+
+    default:
+      g_return_if_reached ();
+    }
+
+  if (max_entries)
+    *max_entries = entries;
+  if (max_bytes)
+    *max_bytes = bytes;
+}
+
+/**
+ * pango_fc_font_map_get_cache_stats:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @cache: the cache to query
+ * @hits: (out) (optional): return location for the number
+ *   of lookups that found an entry
+ * @misses: (out) (optional): return location for the number
+ *   of lookups that had to create an entry
+ * @evictions: (out) (optional): return location for the number
+ *   of entries that were evicted
+ * @n_entries: (out) (optional): return location for the number
+ *   of entries in the cache
+ * @n_bytes: (out) (optional): return location for the estimated
+ *   size of the entries in the cache
+ *
+ * Gets statistics about one of the caches of @fcfontmap.
+ *
+ * The counters are kept across [method@PangoFc.FontMap.cache_clear],
+ * which only empties the caches. The cache of fonts does not account
+ * for the size of its entries, since fonts are owned by the fontsets
+ * and the application.
+ *
+ * Since: 1.60
+ */
+void
+pango_fc_font_map_get_cache_stats (PangoFcFontMap *fcfontmap,
+                                   PangoFcCache    cache,
+                                   guint64        *hits,
+                                   guint64        *misses,
+                                   guint64        *evictions,
+                                   guint          *n_entries,
+                                   gsize          *n_bytes)
+{
+  PangoFcFontMapPrivate *priv;
+  PangoFcCacheBudget stats = { 0, };
+  int i;
+
+  g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
+
+  priv = fcfontmap->priv;
+
+  switch (cache)
+    {
+    case PANGO_FC_CACHE_FONTSETS:
+    case PANGO_FC_CACHE_FONTS:
+      for (i = 0; i < N_CACHE_SHARDS; i++)
+        {
+          PangoFcCacheShard *shard = &priv->shards[i];
+          PangoFcCacheBudget *budget;
+
+          g_mutex_lock (&shard->mutex);
+
+          if (cache == PANGO_FC_CACHE_FONTSETS)
+            budget = &shard->fontsets;
+          else
+            {
+              budget = &shard->fonts;
+              if (shard->font_hash)
+                stats.n_entries += g_hash_table_size (shard->font_hash);
+            }
+
+          stats.hits += budget->hits;
+          stats.misses += budget->misses;
+          stats.evictions += budget->evictions;
+          stats.n_entries += budget->n_entries;
+          stats.n_bytes += budget->n_bytes;
+
+          g_mutex_unlock (&shard->mutex);
+        }
+      break;
+
+    case PANGO_FC_CACHE_PATTERNS:
+      g_rec_mutex_lock (&priv->lock);
+      stats = priv->patterns;
+      g_rec_mutex_unlock (&priv->lock);
+      break;
+
+    case PANGO_FC_CACHE_FACE_DATA:
+      g_rec_mutex_lock (&priv->lock);
+      stats = priv->font_face_data;
+      g_rec_mutex_unlock (&priv->lock);
+      break;
+
+    default:
+      g_return_if_reached ();
+    }
+
+  if (hits)
+    *hits = stats.hits;
+  if (misses)
+    *misses = stats.misses;
+  if (evictions)
+    *evictions = stats.evictions;
+  if (n_entries)
+    *n_entries = stats.n_entries;
+  if (n_bytes)
+    *n_bytes = stats.n_bytes;
+}
+
+/**
+ * pango_fc_font_map_save_sort_cache:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @error: return location for an error
+ *
+ * Writes the Fontconfig results of @fcfontmap to the file that is
+ * named by the `PANGO_FC_SORT_CACHE` environment variable.
+ *
+ * The results are normally written in the background, whenever the
+ * font map runs out of Fontconfig work. This function waits for the
+ * work that is already queued and writes the file before it returns,
+ * for example before the application exits.
+ *
+ * Returns: %TRUE if the file was written, or there was nothing to
+ *   write, %FALSE if an error occurred
+ *
+ * Since: 1.60
+ */
+gboolean
+pango_fc_font_map_save_sort_cache (PangoFcFontMap  *fcfontmap,
+                                   GError         **error)
+{
+  PangoFcFontMapPrivate *priv;
+  SaveData save = { 0, };
+  ThreadData *td;
+
+  g_return_val_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  priv = fcfontmap->priv;
+
+  g_rec_mutex_lock (&priv->lock);
+
+  if (!priv->sort_cache)
+    {
+      g_rec_mutex_unlock (&priv->lock);
+      return TRUE;
+    }
+
+  g_mutex_init (&save.mutex);
+  g_cond_init (&save.cond);
+
+  /* The thread works through the queue in order, so
+   * it gets to us after everything that is queued now
+   */
+  td = thread_data_new (FC_SAVE, NULL);
+  td->sort_cache = pango_fc_sort_cache_ref (priv->sort_cache);
+  td->save = &save;
+  g_async_queue_push (priv->queue, td);
+
+  g_rec_mutex_unlock (&priv->lock);
+
+  g_mutex_lock (&save.mutex);
+  while (!save.done)
+    g_cond_wait (&save.cond, &save.mutex);
+  g_mutex_unlock (&save.mutex);
+
+  g_mutex_clear (&save.mutex);
+  g_cond_clear (&save.cond);
+
+  if (save.error)
+    g_propagate_error (error, save.error);
+
+  return save.result;
+}
+
 static void
 pango_fc_font_map_changed (PangoFontMap *fontmap)
 {
@@ -2664,15 +3763,19 @@ pango_fc_font_map_set_config (PangoFcFontMap *fcfontmap,
 
   g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
 
-  oldconfig = fcfontmap->priv->config;
-
   if (fcconfig)
     FcConfigReference (fcconfig);
 
+  pango_fc_font_map_lock_all (fcfontmap->priv);
+
+  oldconfig = fcfontmap->priv->config;
   fcfontmap->priv->config = fcconfig;
 
   g_clear_pointer (&fcfontmap->priv->fonts, FcFontSetDestroy);
 
+  pango_fc_font_map_unlock_all (fcfontmap->priv);
+
+  /* Threads that are still using the old config hold their own reference */
   if (oldconfig != fcconfig)
     pango_fc_font_map_config_changed (fcfontmap);
 
@@ -2707,6 +3810,10 @@ pango_fc_font_map_get_config (PangoFcFontMap *fcfontmap)
 static FcFontSet *
 pango_fc_font_map_get_config_fonts (PangoFcFontMap *fcfontmap)
 {
+  FcFontSet *fonts;
+
+  g_rec_mutex_lock (&fcfontmap->priv->lock);
+
   if (fcfontmap->priv->fonts == NULL)
     {
       FcFontSet *sets[2];
@@ -2717,19 +3824,101 @@ pango_fc_font_map_get_config_fonts (PangoFcFontMap *fcfontmap)
       sets[FcSetApplication] = FcConfigGetFonts (fcfontmap->priv->config, FcSetApplication);
 
       fcfontmap->priv->fonts = filter_by_format (sets, 2);
+      fcfontmap->priv->fingerprint_nfont = -1;
     }
 
-  return fcfontmap->priv->fonts;
+  fonts = fcfontmap->priv->fonts;
+
+  g_rec_mutex_unlock (&fcfontmap->priv->lock);
+
+  return fonts;
+}
+
+/* Fonts only get added to our font set after it has been
+ * created, so checking the count is enough to notice changes.
+ * The configuration can't change without the font set being
+ * created again.
+ */
+static guint64
+pango_fc_font_map_get_fonts_fingerprint (PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  FcFontSet *fonts;
+  guint64 fingerprint;
+
+  g_rec_mutex_lock (&priv->lock);
+
+  fonts = pango_fc_font_map_get_config_fonts (fcfontmap);
+  if (priv->fingerprint_nfont != fonts->nfont)
+    {
+      priv->fonts_fingerprint = pango_fc_sort_cache_fingerprint (priv->config, fonts);
+      priv->fingerprint_nfont = fonts->nfont;
+    }
+  fingerprint = priv->fonts_fingerprint;
+
+  g_rec_mutex_unlock (&priv->lock);
+
+  return fingerprint;
 }
 
+/* Must be called with the fontmap lock held */
+static void
+pango_fc_font_map_trim_font_face_data (PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+
+  while (pango_fc_cache_budget_exceeded (&priv->font_face_data))
+    {
+      PangoFcFontFaceData *data = g_queue_pop_tail (priv->font_face_data_cache);
+
+      data->cache_link = NULL;
+
+      priv->font_face_data.n_entries--;
+      priv->font_face_data.n_bytes -= data->cache_size;
+      priv->font_face_data.evictions++;
+
+      /* Drops our reference */
+      g_hash_table_remove (priv->font_face_data_hash, data);
+    }
+}
+
+/* Must be called with the fontmap lock held */
+static void
+pango_fc_font_face_data_grow (PangoFcFontMap      *fcfontmap,
+                              PangoFcFontFaceData *data,
+                              gsize                size)
+{
+  data->cache_size += size;
+
+  if (data->cache_link)
+    {
+      fcfontmap->priv->font_face_data.n_bytes += size;
+      pango_fc_font_map_trim_font_face_data (fcfontmap);
+    }
+}
+
+/* Must be called with the fontmap lock held. The font
+ * holds a reference to the data, so it stays valid for
+ * as long as the font, even if it is evicted
+ */
 static PangoFcFontFaceData *
 pango_fc_font_map_get_font_face_data (PangoFcFontMap *fcfontmap,
-				      FcPattern      *font_pattern)
+				      PangoFcFont    *fcfont)
 {
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  FcPattern *font_pattern = fcfont->font_pattern;
   PangoFcFontFaceData key;
   PangoFcFontFaceData *data;
 
+  data = g_object_get_qdata (G_OBJECT (fcfont), pango_fc_font_face_data_quark ());
+  if (G_LIKELY (data))
+    {
+      if (data->cache_link)
+        pango_fc_cache_touch (priv->font_face_data_cache, data->cache_link);
+      priv->font_face_data.hits++;
+      return data;
+    }
+
   if (FcPatternGetString (font_pattern, FC_FILE, 0, (FcChar8 **)(void*)&key.filename) != FcResultMatch)
     return NULL;
 
@@ -2738,25 +3927,70 @@ pango_fc_font_map_get_font_face_data (PangoFcFontMap *fcfontmap,
 
   data = g_hash_table_lookup (priv->font_face_data_hash, &key);
   if (G_LIKELY (data))
-    return data;
+    {
+      pango_fc_cache_touch (priv->font_face_data_cache, data->cache_link);
+      priv->font_face_data.hits++;
+    }
+  else
+    {
+      data = g_atomic_rc_box_new0 (PangoFcFontFaceData);
+      data->filename = key.filename;
+      data->id = key.id;
+
+      data->pattern = font_pattern;
+      FcPatternReference (data->pattern);
 
-  data = g_slice_new0 (PangoFcFontFaceData);
-  data->filename = key.filename;
-  data->id = key.id;
+      data->cache_size = sizeof (PangoFcFontFaceData);
 
-  data->pattern = font_pattern;
-  FcPatternReference (data->pattern);
+      g_queue_push_head (priv->font_face_data_cache, data);
+      data->cache_link = priv->font_face_data_cache->head;
+      g_hash_table_insert (priv->font_face_data_hash, data, data);
 
-  g_hash_table_insert (priv->font_face_data_hash, data, data);
+      priv->font_face_data.n_entries++;
+      priv->font_face_data.n_bytes += data->cache_size;
+      priv->font_face_data.misses++;
+    }
+
+  g_object_set_qdata_full (G_OBJECT (fcfont), pango_fc_font_face_data_quark (),
+                           g_atomic_rc_box_acquire (data),
+                           (GDestroyNotify) pango_fc_font_face_data_unref);
+
+  pango_fc_font_map_trim_font_face_data (fcfontmap);
 
   return data;
 }
 
+/* PangoFcCoverage is an immutable bitmap of the characters
+ * that a font covers. It is built once from the FcCharSet of
+ * the font, and includes the characters whose canonical
+ * decompositions are covered, so looking up a character is
+ * a few loads, without writes, and the coverage can be shared
+ * between threads without locking.
+ *
+ * There is a page of 256 bits for each block of 256 characters
+ * that has any covered characters. The summary bitmap has a bit
+ * for each block that has a page. The pages are stored in order,
+ * so the page of a block is found by counting the bits before
+ * it in the summary, for which rank has the counts up to each
+ * summary word.
+ */
+
+#define N_COVERAGE_BLOCKS (0x110000 >> 8)
+#define N_SUMMARY_WORDS (N_COVERAGE_BLOCKS / 64)
+#define PAGE_WORDS (256 / 32)
+
+typedef struct {
+  guint32 bits[PAGE_WORDS];
+} PangoFcCoveragePage;
+
 typedef struct {
   PangoCoverage parent_instance;
 
-  FcCharSet *covered;
-  FcCharSet *not_covered;
+  guint64 summary[N_SUMMARY_WORDS];
+  guint16 rank[N_SUMMARY_WORDS];
+
+  PangoFcCoveragePage *pages;
+  guint n_pages;
 } PangoFcCoverage;
 
 typedef struct {
@@ -2767,55 +4001,241 @@ GType pango_fc_coverage_get_type (void) G_GNUC_CONST;
 
 G_DEFINE_TYPE (PangoFcCoverage, pango_fc_coverage, PANGO_TYPE_COVERAGE)
 
-static void
-pango_fc_coverage_init (PangoFcCoverage *coverage)
+static inline guint
+popcount64 (guint64 x)
 {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll (x);
+#else
+  x = x - ((x >> 1) & G_GUINT64_CONSTANT (0x5555555555555555));
+  x = (x & G_GUINT64_CONSTANT (0x3333333333333333)) + ((x >> 2) & G_GUINT64_CONSTANT (0x3333333333333333));
+  x = (x + (x >> 4)) & G_GUINT64_CONSTANT (0x0f0f0f0f0f0f0f0f);
+  return (x * G_GUINT64_CONSTANT (0x0101010101010101)) >> 56;
+#endif
 }
 
-static PangoCoverageLevel
-pango_fc_coverage_real_get (PangoCoverage *coverage,
-                            int            index)
+static inline const PangoFcCoveragePage *
+pango_fc_coverage_find_page (PangoFcCoverage *coverage,
+                             guint            block)
+{
+  guint word = block / 64;
+  guint64 bit = G_GUINT64_CONSTANT (1) << (block % 64);
+
+  if (!(coverage->summary[word] & bit))
+    return NULL;
+
+  return &coverage->pages[coverage->rank[word] + popcount64 (coverage->summary[word] & (bit - 1))];
+}
+
+/* While we build a coverage, the pages are kept in an array
+ * with an entry for every block, NULL for the empty ones.
+ */
+typedef struct {
+  guint32 *blocks[N_COVERAGE_BLOCKS];
+} PangoFcCoverageBuilder;
+
+static inline gboolean
+builder_has (PangoFcCoverageBuilder *builder,
+             gunichar                ch)
+{
+  guint32 *page = builder->blocks[ch >> 8];
+
+  return page && (page[(ch >> 5) % PAGE_WORDS] & (1u << (ch % 32)));
+}
+
+static inline void
+builder_add (PangoFcCoverageBuilder *builder,
+             gunichar                ch)
+{
+  guint32 *page = builder->blocks[ch >> 8];
+
+  if (!page)
+    page = builder->blocks[ch >> 8] = g_new0 (guint32, PAGE_WORDS);
+
+  page[(ch >> 5) % PAGE_WORDS] |= 1u << (ch % 32);
+}
+
+static gboolean
+builder_covers (PangoFcCoverageBuilder *builder,
+                gunichar                ch,
+                int                     depth)
 {
-  PangoFcCoverage *fc_coverage = (PangoFcCoverage*)coverage;
   gunichar ch1, ch2;
 
-  if (FcCharSetHasChar (fc_coverage->covered, index))
-    return PANGO_COVERAGE_EXACT;
+  if (builder_has (builder, ch))
+    return TRUE;
 
-  if (FcCharSetHasChar (fc_coverage->not_covered, index))
-    return PANGO_COVERAGE_NONE;
+  if (depth == 0 || !g_unichar_decompose (ch, &ch1, &ch2))
+    return FALSE;
+
+  return builder_covers (builder, ch1, depth - 1) &&
+         (ch2 == 0 || builder_covers (builder, ch2, depth - 1));
+}
+
+/* All characters that have canonical decompositions.
+ * There are none past the CJK compatibility ideographs
+ */
+static const gunichar *
+get_decomposable_chars (guint *n_chars)
+{
+  static gsize initialized = 0;
+  static GArray *chars;
 
-  if (g_unichar_decompose ((gunichar) index, &ch1, &ch2))
+  if (g_once_init_enter (&initialized))
     {
-      if ((pango_coverage_get (coverage, ch1) == PANGO_COVERAGE_EXACT) &&
-          (ch2 == 0 || pango_coverage_get (coverage, ch2) == PANGO_COVERAGE_EXACT))
+      GArray *array = g_array_new (FALSE, FALSE, sizeof (gunichar));
+      gunichar ch, ch1, ch2;
+
+      for (ch = 0; ch < 0x30000; ch++)
         {
-          FcCharSetAddChar (fc_coverage->covered, index);
-          return PANGO_COVERAGE_EXACT;
+          if (g_unichar_decompose (ch, &ch1, &ch2))
+            g_array_append_val (array, ch);
         }
+
+      chars = array;
+      g_once_init_leave (&initialized, 1);
+    }
+
+  *n_chars = chars->len;
+  return (const gunichar *) chars->data;
+}
+
+/* Adds the characters whose decompositions are covered */
+static void
+builder_add_decomposables (PangoFcCoverageBuilder *builder)
+{
+  const gunichar *chars;
+  guint n_chars, i;
+  gboolean jamo = FALSE;
+  gunichar ch;
+
+  /* Hangul syllables are most of the decomposable characters,
+   * and can only be covered if a leading jamo is
+   */
+  for (ch = 0x1100; ch <= 0x1112 && !jamo; ch++)
+    jamo = builder_has (builder, ch);
+
+  chars = get_decomposable_chars (&n_chars);
+  for (i = 0; i < n_chars; i++)
+    {
+      ch = chars[i];
+
+      if (!jamo && ch >= 0xac00 && ch <= 0xd7a3)
+        continue;
+
+      if (!builder_has (builder, ch) && builder_covers (builder, ch, 4))
+        builder_add (builder, ch);
     }
+}
+
+static void
+builder_init_from_coverage (PangoFcCoverageBuilder *builder,
+                            PangoFcCoverage        *coverage)
+{
+  guint block;
+
+  for (block = 0; block < N_COVERAGE_BLOCKS; block++)
+    {
+      const PangoFcCoveragePage *page = pango_fc_coverage_find_page (coverage, block);
+
+      if (page)
+        builder->blocks[block] = g_memdup2 (page->bits, sizeof (page->bits));
+    }
+}
+
+/* Replaces the bitmap of coverage and frees the builder pages */
+static void
+builder_finish (PangoFcCoverageBuilder *builder,
+                PangoFcCoverage        *coverage)
+{
+  guint block, n_pages = 0;
+
+  for (block = 0; block < N_COVERAGE_BLOCKS; block++)
+    if (builder->blocks[block])
+      n_pages++;
+
+  g_free (coverage->pages);
+  coverage->pages = g_new (PangoFcCoveragePage, n_pages);
+  coverage->n_pages = n_pages;
+  memset (coverage->summary, 0, sizeof (coverage->summary));
+
+  n_pages = 0;
+  for (block = 0; block < N_COVERAGE_BLOCKS; block++)
+    {
+      if (block % 64 == 0)
+        coverage->rank[block / 64] = n_pages;
+
+      if (!builder->blocks[block])
+        continue;
+
+      memcpy (coverage->pages[n_pages].bits, builder->blocks[block], sizeof (coverage->pages[n_pages].bits));
+      coverage->summary[block / 64] |= G_GUINT64_CONSTANT (1) << (block % 64);
+      n_pages++;
+
+      g_clear_pointer (&builder->blocks[block], g_free);
+    }
+}
+
+static void
+pango_fc_coverage_init (PangoFcCoverage *coverage)
+{
+}
+
+static PangoCoverageLevel
+pango_fc_coverage_real_get (PangoCoverage *coverage,
+                            int            index)
+{
+  const PangoFcCoveragePage *page;
+
+  if ((guint) index >= 0x110000)
+    return PANGO_COVERAGE_NONE;
+
+  page = pango_fc_coverage_find_page ((PangoFcCoverage *) coverage, index >> 8);
+  if (page && (page->bits[(index >> 5) % PAGE_WORDS] & (1u << (index % 32))))
+    return PANGO_COVERAGE_EXACT;
 
-  FcCharSetAddChar (fc_coverage->not_covered, index);
   return PANGO_COVERAGE_NONE;
 }
 
+/* This rebuilds the bitmap, and must not be called
+ * while other threads may use the coverage
+ */
 static void
 pango_fc_coverage_real_set (PangoCoverage *coverage,
                             int            index,
                             PangoCoverageLevel level)
 {
   PangoFcCoverage *fc_coverage = (PangoFcCoverage*)coverage;
+  PangoFcCoverageBuilder *builder;
+  guint32 *page;
 
-  if (level == PANGO_COVERAGE_NONE)
-    {
-      FcCharSetDelChar (fc_coverage->covered, index);
-      FcCharSetAddChar (fc_coverage->not_covered, index);
-    }
+  if ((guint) index >= 0x110000)
+    return;
+
+  if ((pango_fc_coverage_real_get (coverage, index) != PANGO_COVERAGE_NONE) ==
+      (level != PANGO_COVERAGE_NONE))
+    return;
+
+  builder = g_new0 (PangoFcCoverageBuilder, 1);
+  builder_init_from_coverage (builder, fc_coverage);
+
+  if (level != PANGO_COVERAGE_NONE)
+    builder_add (builder, index);
   else
     {
-      FcCharSetAddChar (fc_coverage->covered, index);
-      FcCharSetDelChar (fc_coverage->not_covered, index);
+      int i;
+
+      page = builder->blocks[index >> 8];
+      page[(index >> 5) % PAGE_WORDS] &= ~(1u << (index % 32));
+
+      for (i = 0; i < PAGE_WORDS && page[i] == 0; i++)
+        ;
+      if (i == PAGE_WORDS)
+        g_clear_pointer (&builder->blocks[index >> 8], g_free);
     }
+
+  builder_finish (builder, fc_coverage);
+  g_free (builder);
 }
 
 static PangoCoverage *
@@ -2825,8 +4245,10 @@ pango_fc_coverage_real_copy (PangoCoverage *coverage)
   PangoFcCoverage *copy;
 
   copy = g_object_new (pango_fc_coverage_get_type (), NULL);
-  copy->covered = FcCharSetCopy (fc_coverage->covered);
-  copy->not_covered = FcCharSetCopy (fc_coverage->not_covered);
+  memcpy (copy->summary, fc_coverage->summary, sizeof (copy->summary));
+  memcpy (copy->rank, fc_coverage->rank, sizeof (copy->rank));
+  copy->pages = g_memdup2 (fc_coverage->pages, fc_coverage->n_pages * sizeof (PangoFcCoveragePage));
+  copy->n_pages = fc_coverage->n_pages;
 
   return (PangoCoverage *)copy;
 }
@@ -2836,8 +4258,7 @@ pango_fc_coverage_finalize (GObject *object)
 {
   PangoFcCoverage *fc_coverage = (PangoFcCoverage*)object;
 
-  FcCharSetDestroy (fc_coverage->covered);
-  FcCharSetDestroy (fc_coverage->not_covered);
+  g_free (fc_coverage->pages);
 
   G_OBJECT_CLASS (pango_fc_coverage_parent_class)->finalize (object);
 }
@@ -2855,16 +4276,28 @@ pango_fc_coverage_class_init (PangoFcCoverageClass *class)
   coverage_class->copy = pango_fc_coverage_real_copy;
 }
 
+static gsize
+pango_fc_coverage_get_size (PangoCoverage *coverage)
+{
+  return sizeof (PangoFcCoverage) + ((PangoFcCoverage *) coverage)->n_pages * sizeof (PangoFcCoveragePage);
+}
+
 PangoCoverage *
 _pango_fc_font_map_get_coverage (PangoFcFontMap *fcfontmap,
 				 PangoFcFont    *fcfont)
 {
   PangoFcFontFaceData *data;
+  PangoCoverage *coverage;
   FcCharSet *charset;
 
-  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
+  g_rec_mutex_lock (&fcfontmap->priv->lock);
+
+  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont);
   if (G_UNLIKELY (!data))
-    return NULL;
+    {
+      g_rec_mutex_unlock (&fcfontmap->priv->lock);
+      return NULL;
+    }
 
   if (G_UNLIKELY (data->coverage == NULL))
     {
@@ -2873,12 +4306,20 @@ _pango_fc_font_map_get_coverage (PangoFcFontMap *fcfontmap,
        * doesn't require loading the font
        */
       if (FcPatternGetCharSet (fcfont->font_pattern, FC_CHARSET, 0, &charset) != FcResultMatch)
-        return pango_coverage_new ();
+        {
+          g_rec_mutex_unlock (&fcfontmap->priv->lock);
+          return pango_coverage_new ();
+        }
 
       data->coverage = _pango_fc_font_map_fc_to_coverage (charset);
+      pango_fc_font_face_data_grow (fcfontmap, data, pango_fc_coverage_get_size (data->coverage));
     }
 
-  return g_object_ref (data->coverage);
+  coverage = g_object_ref (data->coverage);
+
+  g_rec_mutex_unlock (&fcfontmap->priv->lock);
+
+  return coverage;
 }
 
 /**
@@ -2895,10 +4336,35 @@ PangoCoverage  *
 _pango_fc_font_map_fc_to_coverage (FcCharSet *charset)
 {
   PangoFcCoverage *coverage;
+  PangoFcCoverageBuilder *builder;
+  FcChar32 map[FC_CHARSET_MAP_SIZE];
+  FcChar32 base, next;
+  int i;
+
+  G_STATIC_ASSERT (FC_CHARSET_MAP_SIZE == PAGE_WORDS);
+
+  builder = g_new0 (PangoFcCoverageBuilder, 1);
+
+  for (base = FcCharSetFirstPage (charset, map, &next);
+       base != FC_CHARSET_DONE;
+       base = FcCharSetNextPage (charset, map, &next))
+    {
+      if (base >= 0x110000)
+        break;
+
+      for (i = 0; i < FC_CHARSET_MAP_SIZE && map[i] == 0; i++)
+        ;
+      if (i == FC_CHARSET_MAP_SIZE)
+        continue;
+
+      builder->blocks[base >> 8] = g_memdup2 (map, sizeof (map));
+    }
+
+  builder_add_decomposables (builder);
 
   coverage = g_object_new (pango_fc_coverage_get_type (), NULL);
-  coverage->covered = FcCharSetCopy (charset);
-  coverage->not_covered = FcCharSetCreate ();
+  builder_finish (builder, coverage);
+  g_free (builder);
 
   return (PangoCoverage *)coverage;
 }
@@ -2936,11 +4402,17 @@ _pango_fc_font_map_get_languages (PangoFcFontMap *fcfontmap,
                                   PangoFcFont    *fcfont)
 {
   PangoFcFontFaceData *data;
+  PangoLanguage **languages;
   FcLangSet *langset;
 
-  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
+  g_rec_mutex_lock (&fcfontmap->priv->lock);
+
+  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont);
   if (G_UNLIKELY (!data))
-    return NULL;
+    {
+      g_rec_mutex_unlock (&fcfontmap->priv->lock);
+      return NULL;
+    }
 
   if (G_UNLIKELY (data->languages == NULL))
     {
@@ -2948,13 +4420,19 @@ _pango_fc_font_map_get_languages (PangoFcFontMap *fcfontmap,
        * Pull the languages out of the pattern, this
        * doesn't require loading the font
        */
-      if (FcPatternGetLangSet (fcfont->font_pattern, FC_LANG, 0, &langset) != FcResultMatch)
-        return NULL;
-
-      data->languages = _pango_fc_font_map_fc_to_languages (langset);
+      if (FcPatternGetLangSet (fcfont->font_pattern, FC_LANG, 0, &langset) == FcResultMatch)
+        {
+          data->languages = _pango_fc_font_map_fc_to_languages (langset);
+          pango_fc_font_face_data_grow (fcfontmap, data,
+                                        (g_strv_length ((char **) data->languages) + 1) * sizeof (PangoLanguage *));
+        }
     }
 
-  return data->languages;
+  languages = data->languages;
+
+  g_rec_mutex_unlock (&fcfontmap->priv->lock);
+
+  return languages;
 }
 
 /**
@@ -2983,14 +4461,22 @@ pango_fc_font_map_create_context (PangoFcFontMap *fcfontmap)
 }
 
 static void
-shutdown_font (gpointer        key,
-	       PangoFcFont    *fcfont,
-	       PangoFcFontMap *fcfontmap)
+shutdown_font (gpointer          key,
+	       PangoFcFontEntry *entry,
+	       PangoFcFontMap   *fcfontmap)
 {
+  PangoFcFont *fcfont = g_weak_ref_get (&entry->ref);
+
+  /* If the font is being finalized, it removes itself */
+  if (!fcfont)
+    return;
+
   _pango_fc_font_shutdown (fcfont);
 
   _pango_fc_font_set_font_key (fcfont, NULL);
   pango_fc_font_key_free (key);
+
+  g_object_unref (fcfont);
 }
 
 /**
@@ -3013,16 +4499,28 @@ void
 pango_fc_font_map_shutdown (PangoFcFontMap *fcfontmap)
 {
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  PangoFcShardCaches caches[N_CACHE_SHARDS];
   int i;
 
   if (priv->closed)
     return;
 
-  g_hash_table_foreach (priv->font_hash, (GHFunc) shutdown_font, fcfontmap);
+  pango_fc_font_map_lock_all (priv);
+
   for (i = 0; i < priv->n_families; i++)
     priv->families[i]->fontmap = NULL;
 
-  pango_fc_font_map_fini (fcfontmap);
+  pango_fc_font_map_fini (fcfontmap, caches);
+
+  pango_fc_font_map_unlock_all (priv);
+
+  /* The fonts are out of the cache now, so the
+   * last unref of a font will not try to remove it
+   */
+  for (i = 0; i < N_CACHE_SHARDS; i++)
+    g_hash_table_foreach (caches[i].font_hash, (GHFunc) shutdown_font, fcfontmap);
+
+  pango_fc_shard_caches_free (caches);
 
   while (priv->findfuncs)
     {
@@ -3374,8 +4872,10 @@ pango_fc_face_list_sizes (PangoFontFace  *face,
   objectset = FcObjectSetCreate ();
   FcObjectSetAdd (objectset, FC_PIXEL_SIZE);
 
+  g_rec_mutex_lock (&fcface->family->fontmap->priv->lock);
   fonts = pango_fc_font_map_get_config_fonts (fcface->family->fontmap);
   fontset = FcFontSetList (fcface->family->fontmap->priv->config, &fonts, 1, pattern, objectset);
+  g_rec_mutex_unlock (&fcface->family->fontmap->priv->lock);
 
   if (fontset)
     {
@@ -3496,10 +4996,17 @@ static guint
 pango_fc_family_get_n_items (GListModel *list)
 {
   PangoFcFamily *fcfamily = PANGO_FC_FAMILY (list);
+  PangoFcFontMapPrivate *priv = fcfamily->fontmap->priv;
+  guint n_items;
+
+  g_rec_mutex_lock (&priv->lock);
 
   ensure_faces (fcfamily);
+  n_items = (guint)fcfamily->n_faces;
 
-  return (guint)fcfamily->n_faces;
+  g_rec_mutex_unlock (&priv->lock);
+
+  return n_items;
 }
 
 static gpointer
@@ -3507,13 +5014,18 @@ pango_fc_family_get_item (GListModel *list,
                           guint       position)
 {
   PangoFcFamily *fcfamily = PANGO_FC_FAMILY (list);
+  PangoFcFontMapPrivate *priv = fcfamily->fontmap->priv;
+  gpointer item = NULL;
 
-  ensure_faces (fcfamily);
+  g_rec_mutex_lock (&priv->lock);
 
+  ensure_faces (fcfamily);
   if (position < fcfamily->n_faces)
-    return g_object_ref (fcfamily->faces[position]);
+    item = g_object_ref (fcfamily->faces[position]);
 
-  return NULL;
+  g_rec_mutex_unlock (&priv->lock);
+
+  return item;
 }
 
 static void
@@ -3578,6 +5090,9 @@ compare_face (const void *p1, const void *p2)
   return compare_face_pattern (f1->pattern, f2->pattern);
 }
 
+/* Must be called with the fontmap lock held, since fonts
+ * that are loaded on other threads look up their face
+ */
 static void
 ensure_faces (PangoFcFamily *fcfamily)
 {
@@ -3729,6 +5244,8 @@ pango_fc_family_list_faces (PangoFontFamily  *family,
   if (G_UNLIKELY (!fcfamily->fontmap))
     return;
 
+  g_rec_mutex_lock (&fcfamily->fontmap->priv->lock);
+
   ensure_faces (fcfamily);
 
   if (n_faces)
@@ -3736,6 +5253,8 @@ pango_fc_family_list_faces (PangoFontFamily  *family,
 
   if (faces)
     *faces = g_memdup2 (fcfamily->faces, fcfamily->n_faces * sizeof (PangoFontFace *));
+
+  g_rec_mutex_unlock (&fcfamily->fontmap->priv->lock);
 }
 
 static PangoFontFace *
@@ -3743,8 +5262,11 @@ pango_fc_family_get_face (PangoFontFamily *family,
                           const char      *name)
 {
   PangoFcFamily *fcfamily = PANGO_FC_FAMILY (family);
+  PangoFontFace *result = NULL;
   int i;
 
+  g_rec_mutex_lock (&fcfamily->fontmap->priv->lock);
+
   ensure_faces (fcfamily);
 
   for (i = 0; i < fcfamily->n_faces; i++)
@@ -3753,10 +5275,15 @@ pango_fc_family_get_face (PangoFontFamily *family,
 
       if ((name != NULL && strcmp (name, pango_font_face_get_face_name (face)) == 0) ||
           (name == NULL && PANGO_FC_FACE (face)->regular))
-        return face;
+        {
+          result = face;
+          break;
+        }
     }
 
-  return NULL;
+  g_rec_mutex_unlock (&fcfamily->fontmap->priv->lock);
+
+  return result;
 }
 
 static const char *
@@ -3840,19 +5367,27 @@ pango_fc_font_map_get_hb_face (PangoFcFontMap *fcfontmap,
                                PangoFcFont    *fcfont)
 {
   PangoFcFontFaceData *data;
+  hb_face_t *hb_face;
 
-  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
+  g_rec_mutex_lock (&fcfontmap->priv->lock);
+
+  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont);
 
   if (!data->hb_face)
     {
       hb_blob_t *blob;
 
-      blob = hb_blob_create_from_file (data->filename);
+      blob = pango_fc_blob_from_file (data->filename);
       data->hb_face = hb_face_create (blob, data->id);
+      pango_fc_font_face_data_grow (fcfontmap, data, hb_blob_get_length (blob));
       hb_blob_destroy (blob);
     }
 
-  return data->hb_face;
+  hb_face = data->hb_face;
+
+  g_rec_mutex_unlock (&fcfontmap->priv->lock);
+
+  return hb_face;
 }
 
 static gboolean
@@ -106,6 +106,53 @@ PANGO_AVAILABLE_IN_1_44
 hb_face_t * pango_fc_font_map_get_hb_face (PangoFcFontMap *fcfontmap,
                                            PangoFcFont    *fcfont);
 
+/**
+ * PangoFcCache:
+ * @PANGO_FC_CACHE_FONTSETS: The most recently used fontsets, and the
+ *   fonts they keep alive
+ * @PANGO_FC_CACHE_FONTS: The fonts that are in use. This cache does not
+ *   keep fonts alive, so it only has statistics and can not be limited
+ * @PANGO_FC_CACHE_PATTERNS: The Fontconfig patterns that the font map
+ *   stores a single copy of
+ * @PANGO_FC_CACHE_FACE_DATA: Data that is shared by all fonts for the
+ *   same font file, such as its coverage, languages and `hb_face_t`
+ *
+ * The caches of a `PangoFcFontMap`.
+ *
+ * See [method@PangoFc.FontMap.set_cache_limits] and
+ * [method@PangoFc.FontMap.get_cache_stats].
+ *
+ * Since: 1.60
+ */
+typedef enum {
+  PANGO_FC_CACHE_FONTSETS,
+  PANGO_FC_CACHE_FONTS,
+  PANGO_FC_CACHE_PATTERNS,
+  PANGO_FC_CACHE_FACE_DATA
+} PangoFcCache;
+
+PANGO_AVAILABLE_IN_1_60
+void        pango_fc_font_map_set_cache_limits (PangoFcFontMap *fcfontmap,
+                                                PangoFcCache    cache,
+                                                guint           max_entries,
+                                                gsize           max_bytes);
+PANGO_AVAILABLE_IN_1_60
+void        pango_fc_font_map_get_cache_limits (PangoFcFontMap *fcfontmap,
+                                                PangoFcCache    cache,
+                                                guint          *max_entries,
+                                                gsize          *max_bytes);
+PANGO_AVAILABLE_IN_1_60
+void        pango_fc_font_map_get_cache_stats  (PangoFcFontMap *fcfontmap,
+                                                PangoFcCache    cache,
+                                                guint64        *hits,
+                                                guint64        *misses,
+                                                guint64        *evictions,
+                                                guint          *n_entries,
+                                                gsize          *n_bytes);
+PANGO_AVAILABLE_IN_1_60
+gboolean    pango_fc_font_map_save_sort_cache  (PangoFcFontMap  *fcfontmap,
+                                                GError         **error);
+
 /**
  * PangoFcSubstituteFunc:
  * @pattern: the FcPattern to tweak.
@@ -73,6 +73,11 @@ void            pango_fc_font_get_raw_extents    (PangoFcFont    *font,
 						  PangoGlyph      glyph,
 						  PangoRectangle *ink_rect,
 						  PangoRectangle *logical_rect);
+void            pango_fc_font_get_raw_extents_batch (PangoFcFont      *font,
+						     const PangoGlyph *glyphs,
+						     guint             n_glyphs,
+						     PangoRectangle   *ink_rects,
+						     PangoRectangle   *logical_rects);
 
 _PANGO_EXTERN
 PangoFontMetrics *pango_fc_font_create_base_metrics_for_context (PangoFcFont   *font,
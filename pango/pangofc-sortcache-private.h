@@ -0,0 +1,55 @@
+/* Pango
+ * pangofc-sortcache-private.h: Persistent cache of Fontconfig results
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <fontconfig/fontconfig.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PangoFcSortCache PangoFcSortCache;
+
+PangoFcSortCache *      pango_fc_sort_cache_new         (const char        *filename);
+PangoFcSortCache *      pango_fc_sort_cache_ref         (PangoFcSortCache  *cache);
+void                    pango_fc_sort_cache_unref       (PangoFcSortCache  *cache);
+
+guint64                 pango_fc_sort_cache_fingerprint (FcConfig          *config,
+                                                         FcFontSet         *fonts);
+
+gboolean                pango_fc_sort_cache_lookup      (PangoFcSortCache  *cache,
+                                                         guint64            fingerprint,
+                                                         FcPattern         *pattern,
+                                                         FcFontSet         *fonts,
+                                                         FcPattern        **best,
+                                                         FcFontSet        **sorted);
+
+void                    pango_fc_sort_cache_add_match   (PangoFcSortCache  *cache,
+                                                         guint64            fingerprint,
+                                                         FcPattern         *pattern,
+                                                         FcFontSet         *fonts,
+                                                         FcPattern         *match);
+void                    pango_fc_sort_cache_add_sort    (PangoFcSortCache  *cache,
+                                                         guint64            fingerprint,
+                                                         FcPattern         *pattern,
+                                                         FcFontSet         *fonts,
+                                                         FcFontSet         *sorted);
+
+gboolean                pango_fc_sort_cache_save        (PangoFcSortCache  *cache,
+                                                         GError           **error);
+
+G_END_DECLS
@@ -0,0 +1,752 @@
+/* Pango
+ * pangofc-sortcache.c: Persistent cache of Fontconfig results
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "pangofc-sortcache-private.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+/* The sort cache remembers the results of FcFontSetMatch() and
+ * FcFontSetSort() across processes. Results are stored as indices
+ * into the font set of the fontmap, so they can be turned back
+ * into patterns without asking Fontconfig. The font set and the
+ * configuration are identified by a fingerprint. When it changes,
+ * e.g. because fonts were installed or the configuration was
+ * edited, all stored results are dropped.
+ *
+ * The cache is refcounted, since the fontconfig thread adds
+ * results to it after the fontmap may have dropped it.
+ *
+ * The file starts with a CacheHeader, followed by n_entries
+ * records. Each record is a CacheRecord, followed by the key of
+ * the search pattern (see pattern_key(), nul-terminated and padded
+ * to a multiple of 4 bytes), followed by n_sorted guint32 indices.
+ * Everything is in native byte order, the file is mapped and
+ * read in place.
+ */
+
+#define CACHE_MAGIC 0x53434650 /* "PFCS" */
+#define CACHE_VERSION 2
+
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint64 fingerprint;
+  guint32 n_entries;
+  guint32 reserved;
+} CacheHeader;
+
+typedef struct {
+  guint32 key_size;
+  gint32 match;     /* -1 if there was no match */
+  gint32 n_sorted;  /* -1 if we have no sort result */
+} CacheRecord;
+
+typedef struct {
+  int match;
+  int n_sorted;
+  const guint32 *sorted; /* Points into the mapped file or to owned */
+  guint32 *owned;
+} CacheEntry;
+
+struct _PangoFcSortCache
+{
+  int ref_count;
+  GMutex mutex;
+
+  char *filename;
+  GMappedFile *file;
+
+  guint64 fingerprint;
+  GHashTable *entries; /* Maps pattern key -> CacheEntry */
+  gboolean dirty;
+
+  /* Used to turn results back into indices. They map to index + 1 */
+  guint64 index_fingerprint;
+  GHashTable *font_index; /* Maps FcPattern -> index */
+  GHashTable *file_index; /* Maps "index:file" -> index */
+};
+
+static void
+cache_entry_free (gpointer data)
+{
+  CacheEntry *entry = data;
+
+  g_free (entry->owned);
+  g_free (entry);
+}
+
+static void
+pango_fc_sort_cache_load (PangoFcSortCache *cache)
+{
+  GMappedFile *file;
+  const char *data, *end;
+  const CacheHeader *header;
+  guint i;
+
+  file = g_mapped_file_new (cache->filename, FALSE, NULL);
+  if (!file)
+    return;
+
+  data = g_mapped_file_get_contents (file);
+  end = data + g_mapped_file_get_length (file);
+
+  if ((gsize) (end - data) < sizeof (CacheHeader))
+    goto invalid;
+
+  header = (const CacheHeader *) data;
+  if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION)
+    goto invalid;
+
+  data += sizeof (CacheHeader);
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      const CacheRecord *record;
+      const char *key;
+      CacheEntry *entry;
+
+      if ((gsize) (end - data) < sizeof (CacheRecord))
+        goto invalid;
+
+      record = (const CacheRecord *) data;
+      data += sizeof (CacheRecord);
+
+      if (record->key_size == 0 || record->key_size % 4 != 0 ||
+          (gsize) (end - data) < record->key_size)
+        goto invalid;
+
+      key = data;
+      if (key[record->key_size - 1] != '\0')
+        goto invalid;
+
+      data += record->key_size;
+
+      if (record->n_sorted > 0 &&
+          (gsize) (end - data) / sizeof (guint32) < (gsize) record->n_sorted)
+        goto invalid;
+
+      entry = g_new0 (CacheEntry, 1);
+      entry->match = record->match;
+      entry->n_sorted = record->n_sorted;
+      entry->sorted = (const guint32 *) data;
+
+      if (record->n_sorted > 0)
+        data += record->n_sorted * sizeof (guint32);
+
+      g_hash_table_replace (cache->entries, g_strdup (key), entry);
+    }
+
+  cache->fingerprint = header->fingerprint;
+  cache->file = file;
+
+  return;
+
+invalid:
+  g_hash_table_remove_all (cache->entries);
+  g_mapped_file_unref (file);
+}
+
+/*
+ * Creates a sort cache that is backed by @filename.
+ * Results stored there by earlier runs are available
+ * right away.
+ */
+PangoFcSortCache *
+pango_fc_sort_cache_new (const char *filename)
+{
+  PangoFcSortCache *cache;
+
+  cache = g_new0 (PangoFcSortCache, 1);
+
+  cache->ref_count = 1;
+  g_mutex_init (&cache->mutex);
+  cache->filename = g_strdup (filename);
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, cache_entry_free);
+
+  pango_fc_sort_cache_load (cache);
+
+  return cache;
+}
+
+PangoFcSortCache *
+pango_fc_sort_cache_ref (PangoFcSortCache *cache)
+{
+  g_atomic_int_inc (&cache->ref_count);
+
+  return cache;
+}
+
+void
+pango_fc_sort_cache_unref (PangoFcSortCache *cache)
+{
+  if (!g_atomic_int_dec_and_test (&cache->ref_count))
+    return;
+
+  g_hash_table_unref (cache->entries);
+  g_clear_pointer (&cache->font_index, g_hash_table_unref);
+  g_clear_pointer (&cache->file_index, g_hash_table_unref);
+  g_clear_pointer (&cache->file, g_mapped_file_unref);
+  g_free (cache->filename);
+  g_mutex_clear (&cache->mutex);
+  g_free (cache);
+}
+
+/*
+ * Computes a fingerprint for @config and @fonts that changes
+ * when fonts are added, removed or updated, or when the files
+ * that make up the configuration change.
+ */
+guint64
+pango_fc_sort_cache_fingerprint (FcConfig  *config,
+                                 FcFontSet *fonts)
+{
+  const guint64 prime = G_GUINT64_CONSTANT (1099511628211);
+  guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+  FcStrList *files;
+  const FcChar8 *file;
+  int i;
+
+  hash = (hash ^ FcGetVersion ()) * prime;
+  hash = (hash ^ fonts->nfont) * prime;
+
+  for (i = 0; i < fonts->nfont; i++)
+    hash = (hash ^ FcPatternHash (fonts->fonts[i])) * prime;
+
+  /* The rules live in the config files, so an edit that
+   * keeps the same fonts can still change the results
+   */
+  files = FcConfigGetConfigFiles (config);
+  while ((file = FcStrListNext (files)))
+    {
+      GStatBuf st;
+
+      hash = (hash ^ g_str_hash (file)) * prime;
+
+      if (g_stat ((const char *) file, &st) == 0)
+        {
+          hash = (hash ^ (guint64) st.st_mtime) * prime;
+          hash = (hash ^ (guint64) st.st_size) * prime;
+        }
+    }
+  FcStrListDone (files);
+
+  return hash;
+}
+
+static void
+ensure_fingerprint (PangoFcSortCache *cache,
+                    guint64           fingerprint)
+{
+  if (cache->fingerprint == fingerprint)
+    return;
+
+  /* The fonts changed, nothing we have is valid anymore */
+  g_hash_table_remove_all (cache->entries);
+  g_clear_pointer (&cache->file, g_mapped_file_unref);
+
+  cache->fingerprint = fingerprint;
+  cache->dirty = TRUE;
+}
+
+static char *
+font_file_key (FcPattern *pattern)
+{
+  const char *file;
+  int index;
+
+  if (FcPatternGetString (pattern, FC_FILE, 0, (FcChar8 **)(void*)&file) != FcResultMatch)
+    return NULL;
+
+  if (FcPatternGetInteger (pattern, FC_INDEX, 0, &index) != FcResultMatch)
+    index = 0;
+
+  return g_strdup_printf ("%d:%s", index, file);
+}
+
+static void
+ensure_index (PangoFcSortCache *cache,
+              guint64           fingerprint,
+              FcFontSet        *fonts,
+              gboolean          force)
+{
+  int i;
+
+  if (!force && cache->font_index && cache->index_fingerprint == fingerprint)
+    return;
+
+  g_clear_pointer (&cache->font_index, g_hash_table_unref);
+  g_clear_pointer (&cache->file_index, g_hash_table_unref);
+
+  cache->font_index = g_hash_table_new (NULL, NULL);
+  cache->file_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* Walk backwards, so the first of any duplicates wins */
+  for (i = fonts->nfont - 1; i >= 0; i--)
+    {
+      char *key;
+
+      g_hash_table_insert (cache->font_index, fonts->fonts[i], GINT_TO_POINTER (i + 1));
+
+      key = font_file_key (fonts->fonts[i]);
+      if (key)
+        g_hash_table_insert (cache->file_index, key, GINT_TO_POINTER (i + 1));
+    }
+
+  cache->index_fingerprint = fingerprint;
+}
+
+static int
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+  return strcmp (*(const char **) a, *(const char **) b);
+}
+
+static void
+append_double (GString *key,
+               double   d)
+{
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append (key, g_ascii_dtostr (buf, sizeof (buf), d));
+  g_string_append_c (key, ' ');
+}
+
+static gboolean
+append_value (GString       *key,
+              const FcValue *value)
+{
+  switch ((int) value->type)
+    {
+    case FcTypeVoid:
+      g_string_append (key, "v ");
+      return TRUE;
+
+    case FcTypeInteger:
+      g_string_append_printf (key, "i%d ", value->u.i);
+      return TRUE;
+
+    case FcTypeDouble:
+      g_string_append_c (key, 'd');
+      append_double (key, value->u.d);
+      return TRUE;
+
+    case FcTypeString:
+      g_string_append_printf (key, "s%" G_GSIZE_FORMAT ":%s ",
+                              strlen ((const char *) value->u.s),
+                              (const char *) value->u.s);
+      return TRUE;
+
+    case FcTypeBool:
+      g_string_append_printf (key, "b%d ", value->u.b);
+      return TRUE;
+
+    case FcTypeMatrix:
+      g_string_append_c (key, 'm');
+      append_double (key, value->u.m->xx);
+      append_double (key, value->u.m->xy);
+      append_double (key, value->u.m->yx);
+      append_double (key, value->u.m->yy);
+      return TRUE;
+
+    case FcTypeCharSet:
+      {
+        FcChar32 map[FC_CHARSET_MAP_SIZE];
+        FcChar32 next, page;
+        int i;
+
+        g_string_append_c (key, 'c');
+        for (page = FcCharSetFirstPage (value->u.c, map, &next);
+             page != FC_CHARSET_DONE;
+             page = FcCharSetNextPage (value->u.c, map, &next))
+          {
+            g_string_append_printf (key, "%x:", page);
+            for (i = 0; i < FC_CHARSET_MAP_SIZE; i++)
+              g_string_append_printf (key, "%x,", map[i]);
+          }
+        g_string_append_c (key, ' ');
+        return TRUE;
+      }
+
+    case FcTypeLangSet:
+      {
+        FcStrSet *langs = FcLangSetGetLangs (value->u.l);
+        FcStrList *list = FcStrListCreate (langs);
+        GPtrArray *sorted = g_ptr_array_new ();
+        FcChar8 *lang;
+        guint i;
+
+        while ((lang = FcStrListNext (list)))
+          g_ptr_array_add (sorted, lang);
+        g_ptr_array_sort (sorted, compare_strings);
+
+        g_string_append_c (key, 'l');
+        for (i = 0; i < sorted->len; i++)
+          g_string_append_printf (key, "%s,", (const char *) g_ptr_array_index (sorted, i));
+        g_string_append_c (key, ' ');
+
+        g_ptr_array_unref (sorted);
+        FcStrListDone (list);
+        FcStrSetDestroy (langs);
+        return TRUE;
+      }
+
+    case FcTypeRange:
+      {
+        double begin, end;
+
+        FcRangeGetDouble (value->u.r, &begin, &end);
+        g_string_append_c (key, 'r');
+        append_double (key, begin);
+        append_double (key, end);
+        return TRUE;
+      }
+
+    default:
+      /* Things like FT_Face don't survive the process */
+      return FALSE;
+    }
+}
+
+/* Builds the key that results for @pattern are stored under.
+ *
+ * FcNameUnparse() drops objects that it doesn't know about, such as
+ * the gravity that Pango adds, so patterns that only differ in those
+ * would share results. Instead, we write down all objects. They are
+ * sorted by name, since the order of objects in a pattern depends on
+ * the order in which the process registered them.
+ *
+ * Returns %NULL if @pattern has values that can't be written down.
+ */
+static char *
+pattern_key (FcPattern *pattern)
+{
+  GPtrArray *objects;
+  FcPatternIter iter;
+  GString *key;
+  guint i;
+
+  objects = g_ptr_array_new ();
+
+  FcPatternIterStart (pattern, &iter);
+  if (FcPatternIterIsValid (pattern, &iter))
+    do
+      g_ptr_array_add (objects, (gpointer) FcPatternIterGetObject (pattern, &iter));
+    while (FcPatternIterNext (pattern, &iter));
+
+  g_ptr_array_sort (objects, compare_strings);
+
+  key = g_string_new ("");
+
+  for (i = 0; i < objects->len; i++)
+    {
+      const char *object = g_ptr_array_index (objects, i);
+      FcValue value;
+      int j;
+
+      g_string_append_printf (key, "%s=", object);
+
+      for (j = 0; FcPatternGet (pattern, object, j, &value) == FcResultMatch; j++)
+        {
+          if (!append_value (key, &value))
+            {
+              g_ptr_array_unref (objects);
+              g_string_free (key, TRUE);
+              return NULL;
+            }
+        }
+
+      g_string_append_c (key, '\n');
+    }
+
+  g_ptr_array_unref (objects);
+
+  return g_string_free (key, FALSE);
+}
+
+static CacheEntry *
+ensure_entry (PangoFcSortCache *cache,
+              const char       *key)
+{
+  CacheEntry *entry;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (!entry)
+    {
+      entry = g_new0 (CacheEntry, 1);
+      entry->match = -1;
+      entry->n_sorted = -1;
+      g_hash_table_insert (cache->entries, g_strdup (key), entry);
+    }
+
+  return entry;
+}
+
+/*
+ * Looks up stored results for @pattern. @fingerprint must
+ * be the fingerprint of @fonts.
+ *
+ * @best is set to the best match from @fonts, or %NULL, and
+ * needs to be passed through FcFontRenderPrepare(). @sorted is
+ * set to a new font set with the sorted fonts, or %NULL.
+ *
+ * Returns %TRUE if either of them was found.
+ */
+gboolean
+pango_fc_sort_cache_lookup (PangoFcSortCache  *cache,
+                            guint64            fingerprint,
+                            FcPattern         *pattern,
+                            FcFontSet         *fonts,
+                            FcPattern        **best,
+                            FcFontSet        **sorted)
+{
+  char *key;
+  CacheEntry *entry;
+
+  *best = NULL;
+  *sorted = NULL;
+
+  key = pattern_key (pattern);
+  if (!key)
+    return FALSE;
+
+  g_mutex_lock (&cache->mutex);
+
+  ensure_fingerprint (cache, fingerprint);
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (entry)
+    {
+      int i;
+
+      if (entry->match >= 0 && entry->match < fonts->nfont)
+        *best = fonts->fonts[entry->match];
+
+      if (entry->n_sorted >= 0)
+        {
+          *sorted = FcFontSetCreate ();
+
+          for (i = 0; i < entry->n_sorted; i++)
+            {
+              guint32 index = entry->sorted[i];
+
+              if (index >= (guint32) fonts->nfont)
+                {
+                  g_clear_pointer (sorted, FcFontSetDestroy);
+                  break;
+                }
+
+              FcPatternReference (fonts->fonts[index]);
+              FcFontSetAdd (*sorted, fonts->fonts[index]);
+            }
+        }
+    }
+
+  g_mutex_unlock (&cache->mutex);
+
+  g_free (key);
+
+  return *best != NULL || *sorted != NULL;
+}
+
+/*
+ * Stores the result of FcFontSetMatch() on @fonts for @pattern.
+ */
+void
+pango_fc_sort_cache_add_match (PangoFcSortCache  *cache,
+                               guint64            fingerprint,
+                               FcPattern         *pattern,
+                               FcFontSet         *fonts,
+                               FcPattern         *match)
+{
+  char *key;
+  char *file_key;
+  int index;
+
+  key = pattern_key (pattern);
+  file_key = font_file_key (match);
+
+  if (!key || !file_key)
+    goto out;
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Results for fonts we no longer have are useless */
+  if (fingerprint == cache->fingerprint)
+    {
+      ensure_index (cache, fingerprint, fonts, FALSE);
+
+      index = GPOINTER_TO_INT (g_hash_table_lookup (cache->file_index, file_key)) - 1;
+      if (index >= 0)
+        {
+          CacheEntry *entry = ensure_entry (cache, key);
+
+          if (entry->match != index)
+            {
+              entry->match = index;
+              cache->dirty = TRUE;
+            }
+        }
+    }
+
+  g_mutex_unlock (&cache->mutex);
+
+out:
+  g_free (key);
+  g_free (file_key);
+}
+
+/*
+ * Stores the result of FcFontSetSort() on @fonts for @pattern.
+ */
+void
+pango_fc_sort_cache_add_sort (PangoFcSortCache  *cache,
+                              guint64            fingerprint,
+                              FcPattern         *pattern,
+                              FcFontSet         *fonts,
+                              FcFontSet         *sorted)
+{
+  char *key;
+  CacheEntry *entry;
+  guint32 *indices;
+  int i;
+
+  key = pattern_key (pattern);
+  if (!key)
+    return;
+
+  g_mutex_lock (&cache->mutex);
+
+  if (fingerprint != cache->fingerprint)
+    goto out;
+
+  ensure_index (cache, fingerprint, fonts, FALSE);
+
+  indices = g_new (guint32, MAX (sorted->nfont, 1));
+  for (i = 0; i < sorted->nfont; i++)
+    {
+      int index = GPOINTER_TO_INT (g_hash_table_lookup (cache->font_index, sorted->fonts[i])) - 1;
+
+      if (index < 0 || index >= fonts->nfont || fonts->fonts[index] != sorted->fonts[i])
+        {
+          /* The font set has the same contents as the one we
+           * indexed, but may be made of different patterns
+           */
+          if (i > 0)
+            {
+              g_free (indices);
+              goto out;
+            }
+
+          ensure_index (cache, fingerprint, fonts, TRUE);
+          index = GPOINTER_TO_INT (g_hash_table_lookup (cache->font_index, sorted->fonts[i])) - 1;
+          if (index < 0)
+            {
+              g_free (indices);
+              goto out;
+            }
+        }
+
+      indices[i] = index;
+    }
+
+  entry = ensure_entry (cache, key);
+
+  g_free (entry->owned);
+  entry->owned = indices;
+  entry->sorted = indices;
+  entry->n_sorted = sorted->nfont;
+  cache->dirty = TRUE;
+
+out:
+  g_mutex_unlock (&cache->mutex);
+
+  g_free (key);
+}
+
+/*
+ * Writes the cache to its file, if anything changed
+ * since it was loaded or last saved.
+ */
+gboolean
+pango_fc_sort_cache_save (PangoFcSortCache  *cache,
+                          GError           **error)
+{
+  GByteArray *data;
+  CacheHeader header = { 0, };
+  GHashTableIter iter;
+  gpointer key, value;
+  char *dir;
+  gboolean ret;
+
+  g_mutex_lock (&cache->mutex);
+
+  if (!cache->dirty)
+    {
+      g_mutex_unlock (&cache->mutex);
+      return TRUE;
+    }
+
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.fingerprint = cache->fingerprint;
+  header.n_entries = g_hash_table_size (cache->entries);
+
+  data = g_byte_array_new ();
+  g_byte_array_append (data, (const guint8 *) &header, sizeof (header));
+
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const CacheEntry *entry = value;
+      static const guint8 padding[4] = { 0, };
+      CacheRecord record;
+      gsize key_len = strlen (key) + 1;
+
+      record.key_size = (key_len + 3) & ~3;
+      record.match = entry->match;
+      record.n_sorted = entry->n_sorted;
+
+      g_byte_array_append (data, (const guint8 *) &record, sizeof (record));
+      g_byte_array_append (data, key, key_len);
+      g_byte_array_append (data, padding, record.key_size - key_len);
+      if (entry->n_sorted > 0)
+        g_byte_array_append (data, (const guint8 *) entry->sorted,
+                             entry->n_sorted * sizeof (guint32));
+    }
+
+  cache->dirty = FALSE;
+
+  g_mutex_unlock (&cache->mutex);
+
+  /* g_file_set_contents() replaces the file atomically, so it
+   * is safe to keep using the old contents while they are mapped
+   */
+  dir = g_path_get_dirname (cache->filename);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  ret = g_file_set_contents (cache->filename, (const char *) data->data, data->len, error);
+
+  g_byte_array_unref (data);
+
+  return ret;
+}
@@ -0,0 +1,549 @@
+/* Pango
+ * pangoft2-glyph-cache.c: Cache for rendered glyph bitmaps
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "pangoft2-private.h"
+
+/* The bitmaps that the FT2 renderer produces are kept in a cache
+ * that is shared by all PangoFT2Font instances and limited in the
+ * number of bytes it uses. When it goes over the limit, the least
+ * recently used glyphs are dropped.
+ *
+ * The cache does not have its own lookup table. Each font keeps
+ * the pointer to its cached bitmap in the glyph info of the glyph,
+ * and the cache only knows the location of that pointer, so that
+ * it can clear it when the glyph is evicted.
+ *
+ * Rendered glyphs are refcounted, so that a glyph that is being
+ * drawn stays alive if another thread evicts it.
+ *
+ * Small bitmaps are packed into slabs instead of each having their
+ * own allocation. A slab is freed when the last bitmap in it is
+ * gone, except for one empty slab that is kept for reuse. Slabs are
+ * filled from start to end and never reuse the space of bitmaps
+ * that went away, so they are evicted as a whole: a slab is as old
+ * as its most recently used glyph, and when it is the least recently
+ * used thing in the cache, all its glyphs are dropped together. Glyphs
+ * that are too big for a slab are evicted on their own.
+ *
+ * The limit applies to the memory that is actually held, so a slab
+ * counts in full as long as any of its bitmaps is in the cache, and
+ * slabs that are allocated but not used by cached glyphs count too.
+ */
+
+#define SLAB_SIZE (64 * 1024)
+#define MAX_SLAB_ALLOCATION (SLAB_SIZE / 8)
+#define DEFAULT_MAX_BYTES (16 * 1024 * 1024)
+
+struct _PangoFT2GlyphSlab
+{
+  gsize used;
+  guint n_live;    /* bitmaps that are allocated in the slab */
+  GQueue glyphs;   /* cached glyphs in the slab */
+  guint64 last_used;
+  GList link;      /* in slab_lru, while it has cached glyphs */
+  guchar data[];
+};
+
+G_LOCK_DEFINE_STATIC (glyph_cache);
+
+/* All protected by the glyph_cache lock */
+static PangoFT2GlyphSlab *current_slab;
+static PangoFT2GlyphSlab *spare_slab;
+static GQueue slab_lru = G_QUEUE_INIT;   /* slabs with cached glyphs */
+static GQueue glyph_lru = G_QUEUE_INIT;  /* cached glyphs outside of slabs */
+static guint64 lru_clock;
+static guint n_cached_glyphs;
+static gsize cache_limit = DEFAULT_MAX_BYTES;
+static gsize cache_bytes;   /* glyphs, and slabs with cached glyphs */
+static guint n_slabs;       /* all allocated slabs */
+static guint64 n_hits;
+static guint64 n_misses;
+static guint64 n_evictions;
+
+static guchar *
+slab_alloc_locked (gsize               size,
+                   PangoFT2GlyphSlab **slab)
+{
+  guchar *data;
+
+  size = (size + 7) & ~(gsize) 7;
+
+  if (size > MAX_SLAB_ALLOCATION)
+    {
+      *slab = NULL;
+      return g_malloc0 (size);
+    }
+
+  if (!current_slab || current_slab->used + size > SLAB_SIZE)
+    {
+      /* The old slab is freed when its last bitmap goes away */
+      if (spare_slab)
+        {
+          current_slab = spare_slab;
+          spare_slab = NULL;
+        }
+      else
+        {
+          current_slab = g_malloc (sizeof (PangoFT2GlyphSlab) + SLAB_SIZE);
+          n_slabs++;
+        }
+
+      current_slab->used = 0;
+      current_slab->n_live = 0;
+      g_queue_init (&current_slab->glyphs);
+      current_slab->last_used = 0;
+      current_slab->link.data = current_slab;
+      current_slab->link.prev = current_slab->link.next = NULL;
+    }
+
+  data = current_slab->data + current_slab->used;
+  current_slab->used += size;
+  current_slab->n_live++;
+
+  memset (data, 0, size);
+
+  *slab = current_slab;
+  return data;
+}
+
+static void
+slab_free_locked (PangoFT2GlyphSlab *slab,
+                  guchar            *data)
+{
+  if (!slab)
+    {
+      g_free (data);
+      return;
+    }
+
+  if (--slab->n_live > 0)
+    return;
+
+  if (slab == current_slab)
+    slab->used = 0;
+  else if (!spare_slab)
+    spare_slab = slab;
+  else
+    {
+      g_free (slab);
+      n_slabs--;
+    }
+}
+
+/* The memory that the cache holds, including slabs that have
+ * no cached glyphs, but are kept alive by glyphs that are being
+ * drawn, or for reuse
+ */
+static gsize
+get_footprint_locked (void)
+{
+  return cache_bytes + (gsize) (n_slabs - slab_lru.length) * SLAB_SIZE;
+}
+
+/* Marks @rendered, and the slab it is in, as the most recently used */
+static void
+touch_locked (PangoFT2RenderedGlyph *rendered)
+{
+  PangoFT2GlyphSlab *slab = rendered->slab;
+
+  rendered->last_used = ++lru_clock;
+
+  if (slab)
+    {
+      slab->last_used = rendered->last_used;
+      g_queue_unlink (&slab_lru, &slab->link);
+      g_queue_push_head_link (&slab_lru, &slab->link);
+    }
+  else
+    {
+      g_queue_unlink (&glyph_lru, &rendered->link);
+      g_queue_push_head_link (&glyph_lru, &rendered->link);
+    }
+}
+
+static void
+link_locked (PangoFT2RenderedGlyph *rendered)
+{
+  PangoFT2GlyphSlab *slab = rendered->slab;
+
+  cache_bytes += rendered->size;
+  n_cached_glyphs++;
+
+  rendered->last_used = ++lru_clock;
+
+  if (slab)
+    {
+      if (slab->glyphs.length == 0)
+        cache_bytes += SLAB_SIZE;
+      else
+        g_queue_unlink (&slab_lru, &slab->link);
+
+      g_queue_push_head_link (&slab->glyphs, &rendered->link);
+
+      slab->last_used = rendered->last_used;
+      g_queue_push_head_link (&slab_lru, &slab->link);
+    }
+  else
+    g_queue_push_head_link (&glyph_lru, &rendered->link);
+}
+
+static void
+unlink_locked (PangoFT2RenderedGlyph *rendered)
+{
+  PangoFT2GlyphSlab *slab = rendered->slab;
+
+  cache_bytes -= rendered->size;
+  n_cached_glyphs--;
+
+  if (slab)
+    {
+      g_queue_unlink (&slab->glyphs, &rendered->link);
+
+      if (slab->glyphs.length == 0)
+        {
+          cache_bytes -= SLAB_SIZE;
+          g_queue_unlink (&slab_lru, &slab->link);
+        }
+    }
+  else
+    g_queue_unlink (&glyph_lru, &rendered->link);
+
+  *rendered->slot = NULL;
+  rendered->slot = NULL;
+}
+
+/*
+ * _pango_ft2_rendered_glyph_new:
+ * @bitmap: the bitmap to copy
+ * @bitmap_left: the left bearing of the bitmap
+ * @bitmap_top: the top bearing of the bitmap
+ *
+ * Creates a rendered glyph with a copy of @bitmap. If the
+ * buffer of @bitmap is %NULL, the new bitmap is cleared.
+ *
+ * Returns: (transfer full): a new rendered glyph
+ */
+PangoFT2RenderedGlyph *
+_pango_ft2_rendered_glyph_new (const FT_Bitmap *bitmap,
+                               int              bitmap_left,
+                               int              bitmap_top)
+{
+  PangoFT2RenderedGlyph *rendered;
+  gsize length;
+
+  length = (gsize) bitmap->rows * ABS (bitmap->pitch);
+
+  rendered = g_new0 (PangoFT2RenderedGlyph, 1);
+  rendered->ref_count = 1;
+  rendered->bitmap = *bitmap;
+  rendered->bitmap_left = bitmap_left;
+  rendered->bitmap_top = bitmap_top;
+  rendered->size = sizeof (PangoFT2RenderedGlyph);
+
+  if (length > 0)
+    {
+      G_LOCK (glyph_cache);
+      rendered->bitmap.buffer = slab_alloc_locked (length, &rendered->slab);
+      G_UNLOCK (glyph_cache);
+
+      /* Bitmaps in slabs are accounted for with their slab */
+      if (!rendered->slab)
+        rendered->size += length;
+
+      if (bitmap->buffer)
+        memcpy (rendered->bitmap.buffer, bitmap->buffer, length);
+    }
+  else
+    rendered->bitmap.buffer = NULL;
+
+  return rendered;
+}
+
+PangoFT2RenderedGlyph *
+_pango_ft2_rendered_glyph_ref (PangoFT2RenderedGlyph *rendered)
+{
+  g_atomic_int_inc (&rendered->ref_count);
+
+  return rendered;
+}
+
+void
+_pango_ft2_rendered_glyph_unref (PangoFT2RenderedGlyph *rendered)
+{
+  if (!g_atomic_int_dec_and_test (&rendered->ref_count))
+    return;
+
+  if (rendered->bitmap.buffer)
+    {
+      G_LOCK (glyph_cache);
+      slab_free_locked (rendered->slab, rendered->bitmap.buffer);
+      G_UNLOCK (glyph_cache);
+    }
+
+  g_free (rendered);
+}
+
+/* Drops the least recently used glyphs, or slabs of glyphs, until
+ * the cache is within its limit. The dropped glyphs are returned,
+ * so that they can be unreffed after releasing the lock.
+ */
+static GSList *
+evict_locked (void)
+{
+  GSList *evicted = NULL;
+
+  if (spare_slab && get_footprint_locked () > cache_limit)
+    {
+      g_free (spare_slab);
+      spare_slab = NULL;
+      n_slabs--;
+    }
+
+  /* Always keep the most recent glyph, or its slab, even if
+   * that is too big
+   */
+  while (get_footprint_locked () > cache_limit &&
+         slab_lru.length + glyph_lru.length > 1)
+    {
+      PangoFT2GlyphSlab *slab = slab_lru.tail ? slab_lru.tail->data : NULL;
+      PangoFT2RenderedGlyph *glyph = glyph_lru.tail ? glyph_lru.tail->data : NULL;
+
+      if (slab && (!glyph || slab->last_used < glyph->last_used))
+        {
+          /* New bitmaps go into a fresh slab, and this
+           * one is freed when the last of them is gone
+           */
+          if (slab == current_slab)
+            current_slab = NULL;
+
+          while (slab->glyphs.length > 0)
+            {
+              PangoFT2RenderedGlyph *rendered = slab->glyphs.head->data;
+
+              unlink_locked (rendered);
+              n_evictions++;
+
+              evicted = g_slist_prepend (evicted, rendered);
+            }
+        }
+      else
+        {
+          unlink_locked (glyph);
+          n_evictions++;
+
+          evicted = g_slist_prepend (evicted, glyph);
+        }
+    }
+
+  return evicted;
+}
+
+/*
+ * _pango_ft2_glyph_cache_lookup:
+ * @slot: the location of the cached glyph
+ *
+ * Looks up the glyph that is cached in @slot, and marks
+ * it as recently used.
+ *
+ * Returns: (transfer full) (nullable): the cached glyph
+ */
+PangoFT2RenderedGlyph *
+_pango_ft2_glyph_cache_lookup (PangoFT2RenderedGlyph **slot)
+{
+  PangoFT2RenderedGlyph *rendered;
+
+  G_LOCK (glyph_cache);
+
+  rendered = *slot;
+  if (rendered)
+    {
+      n_hits++;
+
+      touch_locked (rendered);
+
+      _pango_ft2_rendered_glyph_ref (rendered);
+    }
+  else
+    n_misses++;
+
+  G_UNLOCK (glyph_cache);
+
+  return rendered;
+}
+
+/*
+ * _pango_ft2_glyph_cache_insert:
+ * @slot: the location to cache the glyph in
+ * @rendered: the glyph
+ *
+ * Adds @rendered to the cache, and stores it in @slot
+ * until it is evicted.
+ */
+void
+_pango_ft2_glyph_cache_insert (PangoFT2RenderedGlyph **slot,
+                               PangoFT2RenderedGlyph  *rendered)
+{
+  GSList *evicted = NULL;
+
+  g_return_if_fail (rendered->slot == NULL);
+
+  G_LOCK (glyph_cache);
+
+  if (*slot)
+    {
+      evicted = g_slist_prepend (evicted, *slot);
+      unlink_locked (*slot);
+    }
+
+  _pango_ft2_rendered_glyph_ref (rendered);
+  rendered->link.data = rendered;
+  rendered->slot = slot;
+  *slot = rendered;
+
+  link_locked (rendered);
+
+  evicted = g_slist_concat (evict_locked (), evicted);
+
+  G_UNLOCK (glyph_cache);
+
+  g_slist_free_full (evicted, (GDestroyNotify) _pango_ft2_rendered_glyph_unref);
+}
+
+/*
+ * _pango_ft2_glyph_cache_remove:
+ * @slot: the location of the cached glyph
+ *
+ * Removes the glyph that is cached in @slot from the cache.
+ * This must be called before the memory of @slot goes away.
+ */
+void
+_pango_ft2_glyph_cache_remove (PangoFT2RenderedGlyph **slot)
+{
+  PangoFT2RenderedGlyph *rendered;
+
+  G_LOCK (glyph_cache);
+
+  rendered = *slot;
+  if (rendered)
+    unlink_locked (rendered);
+
+  G_UNLOCK (glyph_cache);
+
+  if (rendered)
+    _pango_ft2_rendered_glyph_unref (rendered);
+}
+
+/**
+ * pango_ft2_set_glyph_cache_limit:
+ * @max_bytes: the maximum number of bytes to use
+ *
+ * Sets the maximum amount of memory that is used for caching
+ * rendered glyphs.
+ *
+ * The cache is shared by all fonts from all `PangoFT2FontMap`s.
+ * If the cache is above the new limit, the least recently used
+ * glyphs are dropped immediately.
+ *
+ * The default limit is 16 megabytes.
+ *
+ * Since: 1.60
+ */
+void
+pango_ft2_set_glyph_cache_limit (gsize max_bytes)
+{
+  GSList *evicted;
+
+  G_LOCK (glyph_cache);
+
+  cache_limit = max_bytes;
+  evicted = evict_locked ();
+
+  G_UNLOCK (glyph_cache);
+
+  g_slist_free_full (evicted, (GDestroyNotify) _pango_ft2_rendered_glyph_unref);
+}
+
+/**
+ * pango_ft2_get_glyph_cache_limit:
+ *
+ * Gets the maximum amount of memory that is used for caching
+ * rendered glyphs.
+ *
+ * See [func@PangoFT2.set_glyph_cache_limit].
+ *
+ * Returns: the maximum number of bytes
+ *
+ * Since: 1.60
+ */
+gsize
+pango_ft2_get_glyph_cache_limit (void)
+{
+  gsize limit;
+
+  G_LOCK (glyph_cache);
+  limit = cache_limit;
+  G_UNLOCK (glyph_cache);
+
+  return limit;
+}
+
+/**
+ * pango_ft2_get_glyph_cache_stats:
+ * @hits: (out) (optional): return location for the number of glyphs
+ *   that were found in the cache
+ * @misses: (out) (optional): return location for the number of glyphs
+ *   that had to be rendered
+ * @evictions: (out) (optional): return location for the number of glyphs
+ *   that were dropped to stay within the limit
+ * @n_glyphs: (out) (optional): return location for the number of glyphs
+ *   in the cache
+ * @n_bytes: (out) (optional): return location for the number of bytes
+ *   of memory that the cache holds
+ *
+ * Gets statistics about the cache of rendered glyphs.
+ *
+ * The memory includes whole slabs of bitmaps, even if only
+ * some of the bitmaps in them are still cached.
+ *
+ * Since: 1.60
+ */
+void
+pango_ft2_get_glyph_cache_stats (guint64 *hits,
+                                 guint64 *misses,
+                                 guint64 *evictions,
+                                 guint   *n_glyphs,
+                                 gsize   *n_bytes)
+{
+  G_LOCK (glyph_cache);
+
+  if (hits)
+    *hits = n_hits;
+  if (misses)
+    *misses = n_misses;
+  if (evictions)
+    *evictions = n_evictions;
+  if (n_glyphs)
+    *n_glyphs = n_cached_glyphs;
+  if (n_bytes)
+    *n_bytes = get_footprint_locked ();
+
+  G_UNLOCK (glyph_cache);
+}
@@ -87,20 +87,6 @@ pango_ft2_renderer_set_bitmap (PangoFT2Renderer *renderer,
   renderer->bitmap = bitmap;
 }
 
-typedef struct
-{
-  FT_Bitmap bitmap;
-  int bitmap_left;
-  int bitmap_top;
-} PangoFT2RenderedGlyph;
-
-static void
-pango_ft2_free_rendered_glyph (PangoFT2RenderedGlyph *rendered)
-{
-  g_free (rendered->bitmap.buffer);
-  g_slice_free (PangoFT2RenderedGlyph, rendered);
-}
-
 static PangoFT2RenderedGlyph *
 pango_ft2_font_render_box_glyph (int      width,
 				 int      height,
@@ -108,29 +94,20 @@ pango_ft2_font_render_box_glyph (int      width,
 				 gboolean invalid)
 {
   PangoFT2RenderedGlyph *box;
+  FT_Bitmap bitmap = { 0, };
   int i, j, offset1, offset2, line_width;
 
   line_width = MAX ((height + 43) / 44, 1);
   if (width < 1 || height < 1)
     line_width = 0;
 
-  box = g_slice_new (PangoFT2RenderedGlyph);
-
-  box->bitmap_left = 0;
-  box->bitmap_top = top;
-
-  box->bitmap.pixel_mode = ft_pixel_mode_grays;
+  bitmap.pixel_mode = ft_pixel_mode_grays;
+  bitmap.width = MAX (width, 0);
+  bitmap.rows = MAX (height, 0);
+  bitmap.pitch = MAX (width, 0);
 
-  box->bitmap.width = width;
-  box->bitmap.rows = height;
-  box->bitmap.pitch = width;
-
-  box->bitmap.buffer = g_malloc0_n (box->bitmap.rows, box->bitmap.pitch);
-
-  if (G_UNLIKELY (!box->bitmap.buffer)) {
-    g_slice_free (PangoFT2RenderedGlyph, box);
-    return NULL;
-  }
+  /* The buffer of the new glyph is cleared */
+  box = _pango_ft2_rendered_glyph_new (&bitmap, 0, top);
 
   /* draw the box */
   for (j = 0; j < line_width; j++)
@@ -219,24 +196,15 @@ pango_ft2_font_render_glyph (PangoFont *font,
       PangoFT2RenderedGlyph *rendered;
       PangoFT2Font *ft2font = (PangoFT2Font *) font;
 
-      rendered = g_slice_new (PangoFT2RenderedGlyph);
-
       /* Draw glyph */
       FT_Load_Glyph (face, glyph_index, ft2font->load_flags);
       FT_Render_Glyph (face->glyph,
 		       (ft2font->load_flags & FT_LOAD_TARGET_MONO ?
 			ft_render_mode_mono : ft_render_mode_normal));
 
-      rendered->bitmap = face->glyph->bitmap;
-      rendered->bitmap.buffer = g_memdup2 (face->glyph->bitmap.buffer,
-                                           face->glyph->bitmap.rows * face->glyph->bitmap.pitch);
-      rendered->bitmap_left = face->glyph->bitmap_left;
-      rendered->bitmap_top = face->glyph->bitmap_top;
-
-      if (G_UNLIKELY (!rendered->bitmap.buffer)) {
-        g_slice_free (PangoFT2RenderedGlyph, rendered);
-	return NULL;
-      }
+      rendered = _pango_ft2_rendered_glyph_new (&face->glyph->bitmap,
+                                                face->glyph->bitmap_left,
+                                                face->glyph->bitmap_top);
 
       return rendered;
     }
@@ -259,7 +227,6 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
 {
   FT_Bitmap *bitmap = PANGO_FT2_RENDERER (renderer)->bitmap;
   PangoFT2RenderedGlyph *rendered_glyph;
-  gboolean add_glyph_to_cache;
   guchar *src, *dest;
 
   int x_start, x_limit;
@@ -283,16 +250,21 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
 	glyph = PANGO_GLYPH_UNKNOWN_FLAG;
     }
 
+  /* We hold a reference while drawing, since the glyph
+   * can be evicted from the cache at any time
+   */
   rendered_glyph = _pango_ft2_font_get_cache_glyph_data (font, glyph);
-  add_glyph_to_cache = FALSE;
   if (rendered_glyph == NULL)
     {
       rendered_glyph = pango_ft2_font_render_glyph (font, glyph);
       if (rendered_glyph == NULL)
         return;
-      add_glyph_to_cache = TRUE;
+      _pango_ft2_font_set_cache_glyph_data (font, glyph, rendered_glyph);
     }
 
+  if (rendered_glyph->bitmap.buffer == NULL)
+    goto out;
+
   x_start = MAX (0, - (ixoff + rendered_glyph->bitmap_left));
   x_limit = MIN ((int) rendered_glyph->bitmap.width,
 		 (int) (bitmap->width - (ixoff + rendered_glyph->bitmap_left)));
@@ -369,13 +341,8 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
       break;
     }
 
-  if (add_glyph_to_cache)
-    {
-      _pango_ft2_font_set_glyph_cache_destroy (font,
-					       (GDestroyNotify) pango_ft2_free_rendered_glyph);
-      _pango_ft2_font_set_cache_glyph_data (font,
-					    glyph, rendered_glyph);
-    }
+out:
+  _pango_ft2_rendered_glyph_unref (rendered_glyph);
 }
 
 typedef struct {
@@ -32,6 +32,7 @@
 #include "pangoft2-private.h"
 #include "pangofc-fontmap-private.h"
 #include "pangofc-private.h"
+#include "pango-font-private.h"
 
 /* for compatibility with older freetype versions */
 #ifndef FT_LOAD_TARGET_MONO
@@ -56,6 +57,12 @@ static void     pango_ft2_font_get_glyph_extents (PangoFont      *font,
                                                   PangoRectangle *ink_rect,
                                                   PangoRectangle *logical_rect);
 
+static void     pango_ft2_font_get_glyph_extents_batch (PangoFont        *font,
+                                                        const PangoGlyph *glyphs,
+                                                        guint             n_glyphs,
+                                                        PangoRectangle   *ink_rects,
+                                                        PangoRectangle   *logical_rects);
+
 static FT_Face  pango_ft2_font_real_lock_face    (PangoFcFont    *font);
 static void     pango_ft2_font_real_unlock_face  (PangoFcFont    *font);
 
@@ -274,6 +281,7 @@ pango_ft2_font_class_init (PangoFT2FontClass *class)
   GObjectClass *object_class = G_OBJECT_CLASS (class);
   PangoFontClass *font_class = PANGO_FONT_CLASS (class);
   PangoFcFontClass *fc_font_class = PANGO_FC_FONT_CLASS (class);
+  PangoFontClassPrivate *pclass;
 
   object_class->finalize = pango_ft2_font_finalize;
 
@@ -281,6 +289,9 @@ pango_ft2_font_class_init (PangoFT2FontClass *class)
 
   fc_font_class->lock_face = pango_ft2_font_real_lock_face;
   fc_font_class->unlock_face = pango_ft2_font_real_unlock_face;
+
+  pclass = g_type_class_get_private ((GTypeClass *) class, PANGO_TYPE_FONT);
+  pclass->get_glyph_extents_batch = pango_ft2_font_get_glyph_extents_batch;
 }
 
 static PangoFT2GlyphInfo *
@@ -374,6 +385,81 @@ pango_ft2_font_get_glyph_extents (PangoFont      *font,
     }
 }
 
+#define GLYPH_INFO_BATCH_SIZE 64
+
+static void
+pango_ft2_font_add_glyph_infos (PangoFont        *font,
+                                const PangoGlyph *glyphs,
+                                guint             n_glyphs)
+{
+  PangoFT2Font *ft2font = (PangoFT2Font *)font;
+  PangoRectangle ink_rects[GLYPH_INFO_BATCH_SIZE];
+  PangoRectangle logical_rects[GLYPH_INFO_BATCH_SIZE];
+  guint i;
+
+  pango_fc_font_get_raw_extents_batch ((PangoFcFont *) font,
+                                       glyphs, n_glyphs,
+                                       ink_rects, logical_rects);
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      PangoFT2GlyphInfo *info;
+
+      /* The same glyph may be in the batch more than once */
+      if (g_hash_table_contains (ft2font->glyph_info, GUINT_TO_POINTER (glyphs[i])))
+        continue;
+
+      info = g_slice_new0 (PangoFT2GlyphInfo);
+      info->ink_rect = ink_rects[i];
+      info->logical_rect = logical_rects[i];
+
+      g_hash_table_insert (ft2font->glyph_info, GUINT_TO_POINTER (glyphs[i]), info);
+    }
+}
+
+/* Fills the glyph info cache for all the glyphs that are
+ * not in it yet with batched lookups, and then takes the
+ * same path as for single glyphs.
+ */
+static void
+pango_ft2_font_get_glyph_extents_batch (PangoFont        *font,
+                                        const PangoGlyph *glyphs,
+                                        guint             n_glyphs,
+                                        PangoRectangle   *ink_rects,
+                                        PangoRectangle   *logical_rects)
+{
+  PangoFT2Font *ft2font = (PangoFT2Font *)font;
+  PangoGlyph missing[GLYPH_INFO_BATCH_SIZE];
+  guint n_missing = 0;
+  guint i;
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      PangoGlyph glyph = glyphs[i];
+
+      if (glyph == PANGO_GLYPH_EMPTY || (glyph & PANGO_GLYPH_UNKNOWN_FLAG))
+        continue;
+
+      if (g_hash_table_contains (ft2font->glyph_info, GUINT_TO_POINTER (glyph)))
+        continue;
+
+      missing[n_missing++] = glyph;
+      if (n_missing == GLYPH_INFO_BATCH_SIZE)
+        {
+          pango_ft2_font_add_glyph_infos (font, missing, n_missing);
+          n_missing = 0;
+        }
+    }
+
+  if (n_missing > 0)
+    pango_ft2_font_add_glyph_infos (font, missing, n_missing);
+
+  for (i = 0; i < n_glyphs; i++)
+    pango_ft2_font_get_glyph_extents (font, glyphs[i],
+                                      ink_rects ? &ink_rects[i] : NULL,
+                                      logical_rects ? &logical_rects[i] : NULL);
+}
+
 /**
  * pango_ft2_font_get_kerning:
  * @font: a `PangoFont`
@@ -433,13 +519,11 @@ pango_ft2_font_real_unlock_face (PangoFcFont *font G_GNUC_UNUSED)
 static gboolean
 pango_ft2_free_glyph_info_callback (gpointer key G_GNUC_UNUSED,
 				    gpointer value,
-				    gpointer data)
+				    gpointer data G_GNUC_UNUSED)
 {
-  PangoFT2Font *font = PANGO_FT2_FONT (data);
   PangoFT2GlyphInfo *info = value;
 
-  if (font->glyph_cache_destroy && info->cached_glyph)
-    (*font->glyph_cache_destroy) (info->cached_glyph);
+  _pango_ft2_glyph_cache_remove (&info->cached_glyph);
 
   g_slice_free (PangoFT2GlyphInfo, info);
   return TRUE;
@@ -508,7 +592,10 @@ pango_ft2_get_unknown_glyph (PangoFont *font)
     return PANGO_GLYPH_EMPTY;
 }
 
-void *
+/* Returns a reference to the rendered glyph, if it is
+ * still in the glyph cache
+ */
+PangoFT2RenderedGlyph *
 _pango_ft2_font_get_cache_glyph_data (PangoFont *font,
 				     int        glyph_index)
 {
@@ -517,18 +604,15 @@ _pango_ft2_font_get_cache_glyph_data (PangoFont *font,
   if (!PANGO_FT2_IS_FONT (font))
     return NULL;
 
-  info = pango_ft2_font_get_glyph_info (font, glyph_index, FALSE);
-
-  if (info == NULL)
-    return NULL;
+  info = pango_ft2_font_get_glyph_info (font, glyph_index, TRUE);
 
-  return info->cached_glyph;
+  return _pango_ft2_glyph_cache_lookup (&info->cached_glyph);
 }
 
 void
-_pango_ft2_font_set_cache_glyph_data (PangoFont     *font,
-				     int            glyph_index,
-				     void          *cached_glyph)
+_pango_ft2_font_set_cache_glyph_data (PangoFont             *font,
+				     int                    glyph_index,
+				     PangoFT2RenderedGlyph *cached_glyph)
 {
   PangoFT2GlyphInfo *info;
 
@@ -537,17 +621,5 @@ _pango_ft2_font_set_cache_glyph_data (PangoFont     *font,
 
   info = pango_ft2_font_get_glyph_info (font, glyph_index, TRUE);
 
-  info->cached_glyph = cached_glyph;
-
-  /* TODO: Implement limiting of the number of cached glyphs */
-}
-
-void
-_pango_ft2_font_set_glyph_cache_destroy (PangoFont      *font,
-					 GDestroyNotify  destroy_notify)
-{
-  if (!PANGO_FT2_IS_FONT (font))
-    return;
-
-  PANGO_FT2_FONT (font)->glyph_cache_destroy = destroy_notify;
+  _pango_ft2_glyph_cache_insert (&info->cached_glyph, cached_glyph);
 }
@@ -107,6 +107,17 @@ void pango_ft2_render_layout_subpixel      (FT_Bitmap        *bitmap,
 					    int               x,
 					    int               y);
 
+PANGO_AVAILABLE_IN_1_60
+void  pango_ft2_set_glyph_cache_limit (gsize     max_bytes);
+PANGO_AVAILABLE_IN_1_60
+gsize pango_ft2_get_glyph_cache_limit (void);
+PANGO_AVAILABLE_IN_1_60
+void  pango_ft2_get_glyph_cache_stats (guint64  *hits,
+                                       guint64  *misses,
+                                       guint64  *evictions,
+                                       guint    *n_glyphs,
+                                       gsize    *n_bytes);
+
 PANGO_AVAILABLE_IN_ALL
 GType pango_ft2_font_map_get_type (void) G_GNUC_CONST;
 
@@ -30,46 +30,43 @@
 
 #include "pango-item-private.h"
 #include "pango-font-private.h"
+#include "pango-shape-private.h"
 
 #include <hb-ot.h>
+#include <hb-aat.h>
 
 /* {{{ Harfbuzz shaping */
 /* {{{ Buffer handling */
 
-static hb_buffer_t *cached_buffer = NULL; /* MT-safe */
-G_LOCK_DEFINE_STATIC (cached_buffer);
+/* Each thread keeps a buffer around, so that shaping does not
+ * need to allocate, and threads don't compete for a buffer.
+ * The buffer is taken out of the slot while it is in use, in
+ * case shaping is reentered from one of the font callbacks.
+ */
+static GPrivate cached_buffer = G_PRIVATE_INIT ((GDestroyNotify) hb_buffer_destroy);
 
 static hb_buffer_t *
-acquire_buffer (gboolean *free_buffer)
+acquire_buffer (void)
 {
   hb_buffer_t *buffer;
 
-  if (G_LIKELY (G_TRYLOCK (cached_buffer)))
-    {
-      if (G_UNLIKELY (!cached_buffer))
-        cached_buffer = hb_buffer_create ();
-
-      buffer = cached_buffer;
-      *free_buffer = FALSE;
-    }
+  buffer = g_private_get (&cached_buffer);
+  if (G_LIKELY (buffer))
+    g_private_set (&cached_buffer, NULL);
   else
-    {
-      buffer = hb_buffer_create ();
-      *free_buffer = TRUE;
-    }
+    buffer = hb_buffer_create ();
 
   return buffer;
 }
 
 static void
-release_buffer (hb_buffer_t *buffer,
-                gboolean     free_buffer)
+release_buffer (hb_buffer_t *buffer)
 {
-  if (G_LIKELY (!free_buffer))
-    {
-      hb_buffer_reset (buffer);
-      G_UNLOCK (cached_buffer);
-    }
+  /* Resetting the buffer keeps its allocations */
+  hb_buffer_reset (buffer);
+
+  if (G_LIKELY (!g_private_get (&cached_buffer)))
+    g_private_set (&cached_buffer, buffer);
   else
     hb_buffer_destroy (buffer);
 }
@@ -186,6 +183,73 @@ pango_hb_font_get_glyph_h_advance (hb_font_t      *font,
   return hb_font_get_glyph_h_advance (context->parent, glyph);
 }
 
+#define ADVANCE_BATCH_SIZE 64
+
+static void
+set_unknown_advances (PangoFont        *font,
+                      const PangoGlyph *glyphs,
+                      unsigned int     *indices,
+                      guint             n_glyphs,
+                      hb_position_t    *first_advance,
+                      unsigned int      advance_stride)
+{
+  PangoRectangle logical[ADVANCE_BATCH_SIZE];
+  guint i;
+
+  pango_font_get_glyph_extents_batch (font, glyphs, n_glyphs, NULL, logical);
+
+  for (i = 0; i < n_glyphs; i++)
+    *(hb_position_t *) ((char *) first_advance + indices[i] * advance_stride) = logical[i].width;
+}
+
+/* Unknown glyphs are rare, so we let the parent font do all
+ * advances in one go, and then fix up the unknown ones with
+ * batched extents lookups.
+ */
+static void
+pango_hb_font_get_glyph_h_advances (hb_font_t            *font,
+                                    void                 *font_data,
+                                    unsigned int          count,
+                                    const hb_codepoint_t *first_glyph,
+                                    unsigned int          glyph_stride,
+                                    hb_position_t        *first_advance,
+                                    unsigned int          advance_stride,
+                                    void                 *user_data G_GNUC_UNUSED)
+{
+  PangoHbShapeContext *context = (PangoHbShapeContext *) font_data;
+  PangoGlyph unknown[ADVANCE_BATCH_SIZE];
+  unsigned int indices[ADVANCE_BATCH_SIZE];
+  guint n_unknown = 0;
+  unsigned int i;
+
+  hb_font_get_glyph_h_advances (context->parent, count,
+                                first_glyph, glyph_stride,
+                                first_advance, advance_stride);
+
+  for (i = 0; i < count; i++)
+    {
+      hb_codepoint_t glyph = *(const hb_codepoint_t *) ((const char *) first_glyph + i * glyph_stride);
+
+      if ((glyph & PANGO_GLYPH_UNKNOWN_FLAG) == 0)
+        continue;
+
+      unknown[n_unknown] = glyph;
+      indices[n_unknown] = i;
+      n_unknown++;
+
+      if (n_unknown == ADVANCE_BATCH_SIZE)
+        {
+          set_unknown_advances (context->font, unknown, indices, n_unknown,
+                                first_advance, advance_stride);
+          n_unknown = 0;
+        }
+    }
+
+  if (n_unknown > 0)
+    set_unknown_advances (context->font, unknown, indices, n_unknown,
+                          first_advance, advance_stride);
+}
+
 static hb_position_t
 pango_hb_font_get_glyph_v_advance (hb_font_t      *font,
                                    void           *font_data,
@@ -231,14 +295,45 @@ pango_hb_font_get_glyph_extents (hb_font_t          *font,
   return hb_font_get_glyph_extents (context->parent, glyph, extents);
 }
 
+#define ALL_SHOW_FLAGS (PANGO_SHOW_SPACES | PANGO_SHOW_LINE_BREAKS | PANGO_SHOW_IGNORABLES)
+
+/* The hb fonts that we use for shaping with a PangoFont, one
+ * for each combination of show flags. They are created as
+ * needed, and live as long as the PangoFont.
+ */
+typedef struct
+{
+  hb_font_t *fonts[ALL_SHOW_FLAGS + 1];
+} PangoHbShapeFonts;
+
+static void
+pango_hb_shape_fonts_free (gpointer data)
+{
+  PangoHbShapeFonts *shape_fonts = data;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (shape_fonts->fonts); i++)
+    {
+      if (shape_fonts->fonts[i])
+        hb_font_destroy (shape_fonts->fonts[i]);
+    }
+
+  g_free (shape_fonts);
+}
+
+/* Returns a hb font that wraps the hb font of @font, to handle
+ * @show_flags and our special glyphs. The returned font is
+ * owned by @font, and can be used from multiple threads.
+ */
 static hb_font_t *
-pango_font_get_hb_font_for_context (PangoFont           *font,
-                                    PangoHbShapeContext *context)
+pango_font_get_hb_font_for_context (PangoFont      *font,
+                                    PangoShowFlags  show_flags)
 {
-  hb_font_t *hb_font;
   static hb_font_funcs_t *funcs;
-
-  hb_font = pango_font_get_hb_font (font);
+  static GQuark shape_fonts_quark;
+  PangoHbShapeFonts *shape_fonts;
+  PangoHbShapeContext *context;
+  hb_font_t *hb_font;
 
   if (G_UNLIKELY (g_once_init_enter (&funcs)))
     {
@@ -246,18 +341,54 @@ pango_font_get_hb_font_for_context (PangoFont           *font,
 
       hb_font_funcs_set_nominal_glyph_func (f, pango_hb_font_get_nominal_glyph, NULL, NULL);
       hb_font_funcs_set_glyph_h_advance_func (f, pango_hb_font_get_glyph_h_advance, NULL, NULL);
+      hb_font_funcs_set_glyph_h_advances_func (f, pango_hb_font_get_glyph_h_advances, NULL, NULL);
       hb_font_funcs_set_glyph_v_advance_func (f, pango_hb_font_get_glyph_v_advance, NULL, NULL);
       hb_font_funcs_set_glyph_extents_func (f, pango_hb_font_get_glyph_extents, NULL, NULL);
 
       hb_font_funcs_make_immutable (f);
+
+      shape_fonts_quark = g_quark_from_static_string ("pango-hb-shape-fonts");
+
       g_once_init_leave (&funcs, f);
     }
 
+  show_flags &= ALL_SHOW_FLAGS;
+
+  shape_fonts = g_object_get_qdata (G_OBJECT (font), shape_fonts_quark);
+  if (G_UNLIKELY (!shape_fonts))
+    {
+      shape_fonts = g_new0 (PangoHbShapeFonts, 1);
+      if (!g_object_replace_qdata (G_OBJECT (font), shape_fonts_quark,
+                                   NULL, shape_fonts,
+                                   pango_hb_shape_fonts_free, NULL))
+        {
+          /* Another thread was faster */
+          g_free (shape_fonts);
+          shape_fonts = g_object_get_qdata (G_OBJECT (font), shape_fonts_quark);
+        }
+    }
+
+  hb_font = g_atomic_pointer_get (&shape_fonts->fonts[show_flags]);
+  if (G_LIKELY (hb_font))
+    return hb_font;
+
+  /* The font is not referenced by the context, since the
+   * context is owned by the font
+   */
+  context = g_new (PangoHbShapeContext, 1);
   context->font = font;
-  context->parent = hb_font;
+  context->parent = pango_font_get_hb_font (font);
+  context->show_flags = show_flags;
+
+  hb_font = hb_font_create_sub_font (context->parent);
+  hb_font_set_funcs (hb_font, funcs, context, g_free);
+  hb_font_make_immutable (hb_font);
 
-  hb_font = hb_font_create_sub_font (hb_font);
-  hb_font_set_funcs (hb_font, funcs, context, NULL);
+  if (!g_atomic_pointer_compare_and_exchange (&shape_fonts->fonts[show_flags], NULL, hb_font))
+    {
+      hb_font_destroy (hb_font);
+      hb_font = g_atomic_pointer_get (&shape_fonts->fonts[show_flags]);
+    }
 
   return hb_font;
 }
@@ -360,6 +491,628 @@ glyph_has_color (hb_font_t      *font,
   return FALSE;
 }
 
+/* }}} */
+/* {{{ Buffer setup and output */
+
+static void
+setup_buffer (hb_buffer_t         *hb_buffer,
+              const PangoAnalysis *analysis,
+              PangoShowFlags       show_flags)
+{
+  hb_buffer_flags_t hb_buffer_flags;
+  hb_direction_t hb_direction;
+
+  hb_direction = PANGO_GRAVITY_IS_VERTICAL (analysis->gravity) ? HB_DIRECTION_TTB : HB_DIRECTION_LTR;
+  if (analysis->level % 2)
+    hb_direction = HB_DIRECTION_REVERSE (hb_direction);
+  if (PANGO_GRAVITY_IS_IMPROPER (analysis->gravity))
+    hb_direction = HB_DIRECTION_REVERSE (hb_direction);
+
+  hb_buffer_flags = HB_BUFFER_FLAG_BOT | HB_BUFFER_FLAG_EOT;
+
+  if (show_flags & PANGO_SHOW_IGNORABLES)
+    hb_buffer_flags |= HB_BUFFER_FLAG_PRESERVE_DEFAULT_IGNORABLES;
+
+  hb_buffer_set_direction (hb_buffer, hb_direction);
+  hb_buffer_set_script (hb_buffer, (hb_script_t) g_unicode_script_to_iso15924 (analysis->script));
+  hb_buffer_set_language (hb_buffer, hb_language_from_string (pango_language_to_string (analysis->language), -1));
+  hb_buffer_set_cluster_level (hb_buffer, HB_BUFFER_CLUSTER_LEVEL_MONOTONE_CHARACTERS);
+  hb_buffer_set_flags (hb_buffer, hb_buffer_flags);
+  hb_buffer_set_invisible_glyph (hb_buffer, PANGO_GLYPH_EMPTY);
+}
+
+/* Appends the glyphs in @hb_buffer to @glyphs, with
+ * clusters relative to @item_offset.
+ */
+static void
+append_buffer_glyphs (hb_font_t           *hb_font,
+                      hb_buffer_t         *hb_buffer,
+                      const PangoAnalysis *analysis,
+                      unsigned int         item_offset,
+                      gboolean             font_is_color,
+                      PangoGlyphString    *glyphs)
+{
+  hb_glyph_info_t *hb_glyph;
+  hb_glyph_position_t *hb_position;
+  PangoGlyphInfo *infos;
+  int *log_clusters;
+  int last_cluster;
+  guint i, num_glyphs;
+
+  num_glyphs = hb_buffer_get_length (hb_buffer);
+  hb_glyph = hb_buffer_get_glyph_infos (hb_buffer, NULL);
+  pango_glyph_string_set_size (glyphs, glyphs->num_glyphs + num_glyphs);
+  infos = glyphs->glyphs + glyphs->num_glyphs - num_glyphs;
+  log_clusters = glyphs->log_clusters + glyphs->num_glyphs - num_glyphs;
+  last_cluster = -1;
+
+  for (i = 0; i < num_glyphs; i++)
+    {
+      infos[i].glyph = hb_glyph->codepoint;
+      log_clusters[i] = hb_glyph->cluster - item_offset;
+      infos[i].attr.is_cluster_start = log_clusters[i] != last_cluster;
+      infos[i].attr.is_color = font_is_color && glyph_has_color (hb_font, hb_glyph->codepoint);
+      hb_glyph++;
+      last_cluster = log_clusters[i];
+    }
+
+  hb_position = hb_buffer_get_glyph_positions (hb_buffer, NULL);
+  if (PANGO_GRAVITY_IS_VERTICAL (analysis->gravity))
+    for (i = 0; i < num_glyphs; i++)
+      {
+        /* 90 degrees rotation counter-clockwise. */
+        infos[i].geometry.width    = - hb_position->y_advance;
+        infos[i].geometry.x_offset = - hb_position->y_offset;
+        infos[i].geometry.y_offset = - hb_position->x_offset;
+        hb_position++;
+      }
+  else /* horizontal */
+    for (i = 0; i < num_glyphs; i++)
+      {
+        infos[i].geometry.width    =   hb_position->x_advance;
+        infos[i].geometry.x_offset =   hb_position->x_offset;
+        infos[i].geometry.y_offset = - hb_position->y_offset;
+        hb_position++;
+      }
+}
+
+/* }}} */
+/* {{{ Shape cache */
+
+/* The shape cache keeps the results of shaping short,
+ * word-bounded segments of items, so that text that
+ * repeats a lot does not need to go through HarfBuzz
+ * every time.
+ *
+ * HarfBuzz looks at up to HB_BUFFER_CONTEXT_LENGTH
+ * characters of context on either side of the text that
+ * it shapes, so we include that much context in the key.
+ * This keeps context-sensitive shaping (such as Arabic
+ * joining) correct at the segment boundaries.
+ *
+ * Items are only split into words at spaces if the font
+ * has no lookups that involve the space glyph, so that we
+ * don't lose kerning or ligatures across word boundaries.
+ * Otherwise, the entire item is used as a single segment.
+ */
+
+#define CONTEXT_LENGTH 5
+#define MAX_SEGMENT_LENGTH 128
+#define MAX_FEATURES 32
+
+typedef struct
+{
+  hb_tag_t tag;
+  guint32 value;
+} SegmentFeature;
+
+typedef struct
+{
+  /* key */
+  PangoFont *font;              /* Not owned, see font_ref */
+  PangoLanguage *language;
+  GUnicodeScript script;
+  guint level;
+  PangoShowFlags show_flags;
+  char *text;                   /* Pre-context, segment and post-context */
+  int before;                   /* Length of the pre-context, in bytes */
+  int length;                   /* Length of the segment, in bytes */
+  int after;                    /* Length of the post-context, in bytes */
+  SegmentFeature *features;     /* Features that apply to the segment */
+  guint n_features;
+  guint hash;
+
+  /* value */
+  int num_glyphs;
+  PangoGlyphInfo *glyphs;
+  int *log_clusters;            /* Relative to the start of the segment */
+
+  /* The cache does not keep fonts alive. If the font is gone,
+   * another one may have taken its address, so the entry must
+   * not be used anymore.
+   */
+  GWeakRef font_ref;
+
+  GList link;                   /* Link in PangoShapeCache.lru */
+} ShapeCacheEntry;
+
+struct _PangoShapeCache
+{
+  GHashTable *entries;
+  GQueue lru;                   /* Most recently used entries first */
+  guint size;
+  guint hits;
+  guint misses;
+};
+
+static void
+shape_cache_entry_free (gpointer data)
+{
+  ShapeCacheEntry *entry = data;
+
+  g_weak_ref_clear (&entry->font_ref);
+  g_free (entry->text);
+  g_free (entry->features);
+  g_free (entry->glyphs);
+  g_free (entry->log_clusters);
+  g_free (entry);
+}
+
+static void
+shape_cache_entry_compute_hash (ShapeCacheEntry *entry)
+{
+  guint hash = 5381;
+  int i;
+
+  for (i = 0; i < entry->before + entry->length + entry->after; i++)
+    hash = (hash << 5) + hash + (guchar) entry->text[i];
+
+  hash = hash * 31 + g_direct_hash (entry->font);
+  hash = hash * 31 + g_direct_hash (entry->language);
+  hash = hash * 31 + entry->script;
+  hash = hash * 31 + entry->level;
+  hash = hash * 31 + entry->show_flags;
+  hash = hash * 31 + entry->before;
+  hash = hash * 31 + entry->length;
+
+  for (i = 0; i < (int) entry->n_features; i++)
+    {
+      hash = hash * 31 + entry->features[i].tag;
+      hash = hash * 31 + entry->features[i].value;
+    }
+
+  entry->hash = hash;
+}
+
+static guint
+shape_cache_entry_hash (gconstpointer data)
+{
+  const ShapeCacheEntry *entry = data;
+
+  return entry->hash;
+}
+
+static gboolean
+shape_cache_entry_equal (gconstpointer a,
+                         gconstpointer b)
+{
+  const ShapeCacheEntry *entry1 = a;
+  const ShapeCacheEntry *entry2 = b;
+
+  return entry1->hash == entry2->hash &&
+         entry1->font == entry2->font &&
+         entry1->language == entry2->language &&
+         entry1->script == entry2->script &&
+         entry1->level == entry2->level &&
+         entry1->show_flags == entry2->show_flags &&
+         entry1->before == entry2->before &&
+         entry1->length == entry2->length &&
+         entry1->after == entry2->after &&
+         entry1->n_features == entry2->n_features &&
+         memcmp (entry1->text, entry2->text, entry1->before + entry1->length + entry1->after) == 0 &&
+         memcmp (entry1->features, entry2->features, sizeof (SegmentFeature) * entry1->n_features) == 0;
+}
+
+static void
+shape_cache_trim (PangoShapeCache *cache)
+{
+  while (cache->lru.length > cache->size)
+    {
+      GList *link = g_queue_pop_tail_link (&cache->lru);
+
+      g_hash_table_remove (cache->entries, link->data);
+    }
+}
+
+PangoShapeCache *
+pango_shape_cache_new (guint size)
+{
+  PangoShapeCache *cache;
+
+  cache = g_new0 (PangoShapeCache, 1);
+  cache->entries = g_hash_table_new_full (shape_cache_entry_hash,
+                                          shape_cache_entry_equal,
+                                          shape_cache_entry_free,
+                                          NULL);
+  g_queue_init (&cache->lru);
+  cache->size = size;
+
+  return cache;
+}
+
+void
+pango_shape_cache_free (PangoShapeCache *cache)
+{
+  g_hash_table_unref (cache->entries);
+  g_free (cache);
+}
+
+void
+pango_shape_cache_set_size (PangoShapeCache *cache,
+                            guint            size)
+{
+  cache->size = size;
+  shape_cache_trim (cache);
+}
+
+guint
+pango_shape_cache_get_size (PangoShapeCache *cache)
+{
+  return cache->size;
+}
+
+void
+pango_shape_cache_get_stats (PangoShapeCache *cache,
+                             guint           *hits,
+                             guint           *misses)
+{
+  if (hits)
+    *hits = cache->hits;
+  if (misses)
+    *misses = cache->misses;
+}
+
+static gboolean
+face_has_table (hb_face_t *face,
+                hb_tag_t   tag)
+{
+  hb_blob_t *blob;
+  gboolean result;
+
+  blob = hb_face_reference_table (face, tag);
+  result = hb_blob_get_length (blob) > 0;
+  hb_blob_destroy (blob);
+
+  return result;
+}
+
+static hb_user_data_key_t space_lookups_key;
+
+/* Returns whether the font has lookups that involve the
+ * space glyph, in which case we can't shape the words
+ * between spaces separately. The result is stored on
+ * the face, since it is expensive to compute.
+ */
+static gboolean
+font_has_space_lookups (hb_font_t *hb_font)
+{
+  hb_face_t *face;
+  gpointer data;
+  gboolean result;
+  hb_codepoint_t space;
+
+  face = hb_font_get_face (hb_font);
+
+  data = hb_face_get_user_data (face, &space_lookups_key);
+  if (data)
+    return GPOINTER_TO_INT (data) - 1;
+
+  /* We don't look into AAT tables or legacy kerning,
+   * and just assume that they involve the space glyph
+   */
+  if (hb_aat_layout_has_substitution (face) ||
+      hb_aat_layout_has_positioning (face) ||
+      (!hb_ot_layout_has_positioning (face) &&
+       face_has_table (face, HB_TAG ('k','e','r','n'))))
+    {
+      result = TRUE;
+    }
+  else if (hb_font_get_nominal_glyph (hb_font, ' ', &space))
+    {
+      const hb_tag_t tables[] = { HB_OT_TAG_GSUB, HB_OT_TAG_GPOS };
+      hb_set_t *before, *input, *after;
+      guint i, j;
+
+      before = hb_set_create ();
+      input = hb_set_create ();
+      after = hb_set_create ();
+
+      result = FALSE;
+      for (i = 0; i < G_N_ELEMENTS (tables) && !result; i++)
+        {
+          guint n_lookups = hb_ot_layout_table_get_lookup_count (face, tables[i]);
+
+          for (j = 0; j < n_lookups && !result; j++)
+            {
+              hb_set_clear (before);
+              hb_set_clear (input);
+              hb_set_clear (after);
+
+              hb_ot_layout_lookup_collect_glyphs (face, tables[i], j, before, input, after, NULL);
+
+              result = hb_set_has (before, space) ||
+                       hb_set_has (input, space) ||
+                       hb_set_has (after, space);
+            }
+        }
+
+      hb_set_destroy (before);
+      hb_set_destroy (input);
+      hb_set_destroy (after);
+    }
+  else
+    result = FALSE;
+
+  hb_face_set_user_data (face, &space_lookups_key, GINT_TO_POINTER (result + 1), NULL, FALSE);
+
+  return result;
+}
+
+/* Returns the end of the segment starting at @start. Segments
+ * are words together with the spaces that follow them, unless
+ * the next word starts with a mark that would attach to the
+ * last space.
+ */
+static int
+find_segment_end (const char *text,
+                  int         start,
+                  int         end,
+                  gboolean    split_words)
+{
+  const char *p = text + start;
+  const char *q = text + end;
+
+  if (!split_words)
+    return end;
+
+  while (p < q)
+    {
+      while (p < q && *p != ' ')
+        p++;
+
+      while (p < q && *p == ' ')
+        p++;
+
+      if (p < q && !g_unichar_ismark (g_utf8_get_char (p)))
+        return p - text;
+    }
+
+  return end;
+}
+
+/* Collects the features that apply to the segment from @start
+ * to @end. Returns %FALSE if some feature only applies to part
+ * of the segment, in which case we don't cache it.
+ */
+static gboolean
+collect_segment_features (const hb_feature_t *features,
+                          guint               num_features,
+                          unsigned int        start,
+                          unsigned int        end,
+                          SegmentFeature     *segment_features,
+                          guint              *n_segment_features)
+{
+  guint i;
+
+  *n_segment_features = 0;
+
+  for (i = 0; i < num_features; i++)
+    {
+      if (features[i].end <= start || features[i].start >= end)
+        continue;
+
+      if (features[i].start > start || features[i].end < end)
+        return FALSE;
+
+      segment_features[*n_segment_features].tag = features[i].tag;
+      segment_features[*n_segment_features].value = features[i].value;
+      (*n_segment_features)++;
+    }
+
+  return TRUE;
+}
+
+static void
+shape_segment_cached (PangoShapeCache     *cache,
+                      hb_font_t           *hb_font,
+                      hb_buffer_t         *hb_buffer,
+                      const PangoAnalysis *analysis,
+                      PangoShowFlags       show_flags,
+                      const char          *paragraph_text,
+                      int                  paragraph_length,
+                      int                  item_offset,
+                      int                  start,
+                      int                  end,
+                      const hb_feature_t  *features,
+                      guint                num_features,
+                      gboolean             font_is_color,
+                      PangoGlyphString    *glyphs)
+{
+  SegmentFeature segment_features[MAX_FEATURES];
+  ShapeCacheEntry key;
+  ShapeCacheEntry *entry;
+  const char *p;
+  int i;
+  int first_glyph;
+  gboolean cacheable;
+
+  cacheable = end - start <= MAX_SEGMENT_LENGTH &&
+              collect_segment_features (features, num_features,
+                                        start, end,
+                                        segment_features, &key.n_features);
+
+  if (cacheable)
+    {
+      key.font = analysis->font;
+      key.language = analysis->language;
+      key.script = analysis->script;
+      key.level = analysis->level % 2;
+      key.show_flags = show_flags;
+
+      p = paragraph_text + start;
+      for (i = 0; i < CONTEXT_LENGTH && p > paragraph_text; i++)
+        p = g_utf8_prev_char (p);
+      key.before = paragraph_text + start - p;
+      key.text = (char *) p;
+      key.length = end - start;
+
+      p = paragraph_text + end;
+      for (i = 0; i < CONTEXT_LENGTH && p < paragraph_text + paragraph_length; i++)
+        p = g_utf8_next_char (p);
+      key.after = p - (paragraph_text + end);
+
+      key.features = segment_features;
+      shape_cache_entry_compute_hash (&key);
+
+      entry = g_hash_table_lookup (cache->entries, &key);
+      if (entry)
+        {
+          PangoFont *font;
+
+          /* We hold analysis->font, so this is either
+           * that font, or the entry is for a dead one
+           */
+          font = g_weak_ref_get (&entry->font_ref);
+          if (font)
+            g_object_unref (font);
+          else
+            {
+              g_queue_unlink (&cache->lru, &entry->link);
+              g_hash_table_remove (cache->entries, entry);
+              entry = NULL;
+            }
+        }
+
+      if (entry)
+        {
+          cache->hits++;
+
+          g_queue_unlink (&cache->lru, &entry->link);
+          g_queue_push_head_link (&cache->lru, &entry->link);
+
+          first_glyph = glyphs->num_glyphs;
+          pango_glyph_string_set_size (glyphs, first_glyph + entry->num_glyphs);
+          memcpy (glyphs->glyphs + first_glyph, entry->glyphs, sizeof (PangoGlyphInfo) * entry->num_glyphs);
+          for (i = 0; i < entry->num_glyphs; i++)
+            glyphs->log_clusters[first_glyph + i] = entry->log_clusters[i] + start - item_offset;
+
+          return;
+        }
+
+      cache->misses++;
+    }
+
+  hb_buffer_clear_contents (hb_buffer);
+  setup_buffer (hb_buffer, analysis, show_flags);
+
+  /* Add the segment with pre-context, then the post-context */
+  hb_buffer_add_utf8 (hb_buffer, paragraph_text, end, start, end - start);
+  hb_buffer_add_utf8 (hb_buffer, paragraph_text, paragraph_length, end, 0);
+
+  hb_shape (hb_font, hb_buffer, features, num_features);
+
+  first_glyph = glyphs->num_glyphs;
+  append_buffer_glyphs (hb_font, hb_buffer, analysis, item_offset, font_is_color, glyphs);
+
+  if (!cacheable)
+    return;
+
+  entry = g_new (ShapeCacheEntry, 1);
+  *entry = key;
+  g_weak_ref_init (&entry->font_ref, entry->font);
+  entry->text = g_memdup2 (key.text, key.before + key.length + key.after);
+  entry->features = g_memdup2 (segment_features, sizeof (SegmentFeature) * key.n_features);
+  entry->num_glyphs = glyphs->num_glyphs - first_glyph;
+  entry->glyphs = g_memdup2 (glyphs->glyphs + first_glyph, sizeof (PangoGlyphInfo) * entry->num_glyphs);
+  entry->log_clusters = g_new (int, entry->num_glyphs);
+  for (i = 0; i < entry->num_glyphs; i++)
+    entry->log_clusters[i] = glyphs->log_clusters[first_glyph + i] - (start - item_offset);
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+
+  g_hash_table_add (cache->entries, entry);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+
+  shape_cache_trim (cache);
+}
+
+static void
+shape_item_cached (PangoShapeCache     *cache,
+                   hb_font_t           *hb_font,
+                   hb_buffer_t         *hb_buffer,
+                   const PangoAnalysis *analysis,
+                   PangoShowFlags       show_flags,
+                   const char          *paragraph_text,
+                   int                  paragraph_length,
+                   int                  item_offset,
+                   int                  item_length,
+                   const hb_feature_t  *features,
+                   guint                num_features,
+                   gboolean             font_is_color,
+                   PangoGlyphString    *glyphs)
+{
+  gboolean split_words;
+  int segment_ends_[64];
+  int *segment_ends;
+  int n_segments;
+  int start, end;
+  int i;
+
+  split_words = !font_has_space_lookups (pango_font_get_hb_font (analysis->font));
+
+  n_segments = 0;
+  for (start = item_offset; start < item_offset + item_length; start = end)
+    {
+      end = find_segment_end (paragraph_text, start, item_offset + item_length, split_words);
+      n_segments++;
+    }
+
+  if (n_segments <= (int) G_N_ELEMENTS (segment_ends_))
+    segment_ends = segment_ends_;
+  else
+    segment_ends = g_new (int, n_segments);
+
+  i = 0;
+  for (start = item_offset; start < item_offset + item_length; start = end)
+    {
+      end = find_segment_end (paragraph_text, start, item_offset + item_length, split_words);
+      segment_ends[i++] = end;
+    }
+
+  /* Glyphs are in visual order, so for right-to-left
+   * text, we need to add the last segment first
+   */
+  for (i = 0; i < n_segments; i++)
+    {
+      int n = analysis->level % 2 ? n_segments - 1 - i : i;
+
+      start = n > 0 ? segment_ends[n - 1] : item_offset;
+      end = segment_ends[n];
+
+      shape_segment_cached (cache,
+                            hb_font, hb_buffer,
+                            analysis, show_flags,
+                            paragraph_text, paragraph_length,
+                            item_offset, start, end,
+                            features, num_features,
+                            font_is_color,
+                            glyphs);
+    }
+
+  if (segment_ends != segment_ends_)
+    g_free (segment_ends);
+}
+
 /* }}} */
 
 static void
@@ -371,54 +1124,55 @@ pango_hb_shape (const char          *item_text,
                 PangoLogAttr        *log_attrs,
                 int                  num_chars,
                 PangoGlyphString    *glyphs,
-                PangoShapeFlags      flags)
+                PangoShapeFlags      flags,
+                PangoShapeCache     *cache)
 {
-  PangoHbShapeContext context = { 0, };
-  hb_buffer_flags_t hb_buffer_flags;
+  PangoShowFlags show_flags;
   hb_font_t *hb_font;
   hb_buffer_t *hb_buffer;
-  hb_direction_t hb_direction;
-  gboolean free_buffer;
-  hb_glyph_info_t *hb_glyph;
-  hb_glyph_position_t *hb_position;
-  int last_cluster;
-  guint i, num_glyphs;
   unsigned int item_offset = item_text - paragraph_text;
-  hb_feature_t features[32];
+  hb_feature_t features[MAX_FEATURES];
   unsigned int num_features = 0;
-  PangoGlyphInfo *infos;
   PangoTextTransform transform;
   int hyphen_index;
-  gboolean font_is_color;
 
   g_return_if_fail (analysis != NULL);
   g_return_if_fail (analysis->font != NULL);
 
-  context.show_flags = find_show_flags (analysis);
-  hb_font = pango_font_get_hb_font_for_context (analysis->font, &context);
-  hb_buffer = acquire_buffer (&free_buffer);
+  show_flags = find_show_flags (analysis);
+  hb_font = pango_font_get_hb_font_for_context (analysis->font, show_flags);
+  hb_buffer = acquire_buffer ();
 
   transform = find_text_transform (analysis);
 
-  hb_direction = PANGO_GRAVITY_IS_VERTICAL (analysis->gravity) ? HB_DIRECTION_TTB : HB_DIRECTION_LTR;
-  if (analysis->level % 2)
-    hb_direction = HB_DIRECTION_REVERSE (hb_direction);
-  if (PANGO_GRAVITY_IS_IMPROPER (analysis->gravity))
-    hb_direction = HB_DIRECTION_REVERSE (hb_direction);
-
-  hb_buffer_flags = HB_BUFFER_FLAG_BOT | HB_BUFFER_FLAG_EOT;
+  pango_analysis_collect_features (analysis, features, G_N_ELEMENTS (features), &num_features);
 
-  if (context.show_flags & PANGO_SHOW_IGNORABLES)
-    hb_buffer_flags |= HB_BUFFER_FLAG_PRESERVE_DEFAULT_IGNORABLES;
+  /* Items that need a hyphen or a text transform are rare
+   * enough that we don't bother to cache them. The same goes
+   * for vertical and upside-down text.
+   */
+  if (cache &&
+      transform == PANGO_TEXT_TRANSFORM_NONE &&
+      (analysis->flags & PANGO_ANALYSIS_FLAG_NEED_HYPHEN) == 0 &&
+      !PANGO_GRAVITY_IS_VERTICAL (analysis->gravity) &&
+      !PANGO_GRAVITY_IS_IMPROPER (analysis->gravity))
+    {
+      shape_item_cached (cache,
+                         hb_font, hb_buffer,
+                         analysis, show_flags,
+                         paragraph_text, paragraph_length,
+                         item_offset, item_length,
+                         features, num_features,
+                         font_has_color (hb_font),
+                         glyphs);
+
+      release_buffer (hb_buffer);
+      return;
+    }
 
   /* setup buffer */
 
-  hb_buffer_set_direction (hb_buffer, hb_direction);
-  hb_buffer_set_script (hb_buffer, (hb_script_t) g_unicode_script_to_iso15924 (analysis->script));
-  hb_buffer_set_language (hb_buffer, hb_language_from_string (pango_language_to_string (analysis->language), -1));
-  hb_buffer_set_cluster_level (hb_buffer, HB_BUFFER_CLUSTER_LEVEL_MONOTONE_CHARACTERS);
-  hb_buffer_set_flags (hb_buffer, hb_buffer_flags);
-  hb_buffer_set_invisible_glyph (hb_buffer, PANGO_GLYPH_EMPTY);
+  setup_buffer (hb_buffer, analysis, show_flags);
 
   if (analysis->flags & PANGO_ANALYSIS_FLAG_NEED_HYPHEN)
     {
@@ -507,52 +1261,15 @@ pango_hb_shape (const char          *item_text,
         hb_buffer_add (hb_buffer, '-', hyphen_index);
     }
 
-  pango_analysis_collect_features (analysis, features, G_N_ELEMENTS (features), &num_features);
-
   hb_shape (hb_font, hb_buffer, features, num_features);
 
   if (PANGO_GRAVITY_IS_IMPROPER (analysis->gravity))
     hb_buffer_reverse (hb_buffer);
 
   /* buffer output */
-  num_glyphs = hb_buffer_get_length (hb_buffer);
-  hb_glyph = hb_buffer_get_glyph_infos (hb_buffer, NULL);
-  pango_glyph_string_set_size (glyphs, num_glyphs);
-  infos = glyphs->glyphs;
-  last_cluster = -1;
-  font_is_color = font_has_color (hb_font);
-
-  for (i = 0; i < num_glyphs; i++)
-    {
-      infos[i].glyph = hb_glyph->codepoint;
-      glyphs->log_clusters[i] = hb_glyph->cluster - item_offset;
-      infos[i].attr.is_cluster_start = glyphs->log_clusters[i] != last_cluster;
-      infos[i].attr.is_color = font_is_color && glyph_has_color (hb_font, hb_glyph->codepoint);
-      hb_glyph++;
-      last_cluster = glyphs->log_clusters[i];
-    }
+  append_buffer_glyphs (hb_font, hb_buffer, analysis, item_offset, font_has_color (hb_font), glyphs);
 
-  hb_position = hb_buffer_get_glyph_positions (hb_buffer, NULL);
-  if (PANGO_GRAVITY_IS_VERTICAL (analysis->gravity))
-    for (i = 0; i < num_glyphs; i++)
-      {
-        /* 90 degrees rotation counter-clockwise. */
-        infos[i].geometry.width    = - hb_position->y_advance;
-        infos[i].geometry.x_offset = - hb_position->y_offset;
-        infos[i].geometry.y_offset = - hb_position->x_offset;
-        hb_position++;
-      }
-  else /* horizontal */
-    for (i = 0; i < num_glyphs; i++)
-      {
-        infos[i].geometry.width    =   hb_position->x_advance;
-        infos[i].geometry.x_offset =   hb_position->x_offset;
-        infos[i].geometry.y_offset = - hb_position->y_offset;
-        hb_position++;
-      }
-
-  release_buffer (hb_buffer, free_buffer);
-  hb_font_destroy (hb_font);
+  release_buffer (hb_buffer);
 }
 
 /* }}} */
@@ -621,7 +1338,8 @@ pango_shape_internal (const char          *item_text,
                       PangoLogAttr        *log_attrs,
                       int                  num_chars,
                       PangoGlyphString    *glyphs,
-                      PangoShapeFlags      flags)
+                      PangoShapeFlags      flags,
+                      PangoShapeCache     *cache)
 {
   int i;
   int last_cluster;
@@ -648,7 +1366,8 @@ pango_shape_internal (const char          *item_text,
                       paragraph_text, paragraph_length,
                       analysis,
                       log_attrs, num_chars,
-                      glyphs, flags);
+                      glyphs, flags,
+                      cache);
 
       if (G_UNLIKELY (glyphs->num_glyphs == 0))
         {
@@ -920,7 +1639,8 @@ pango_shape_with_flags (const char          *item_text,
   pango_shape_internal (item_text, item_length,
                         paragraph_text, paragraph_length,
                         analysis, NULL, 0,
-                        glyphs, flags);
+                        glyphs, flags,
+                        NULL);
 }
 
 /**
@@ -961,7 +1681,41 @@ pango_shape_item (PangoItem        *item,
                         paragraph_text, paragraph_length,
                         &item->analysis,
                         log_attrs, item->num_chars,
-                        glyphs, flags);
+                        glyphs, flags,
+                        NULL);
+}
+
+/* }}} */
+/* {{{ Private API */
+
+/*< private >
+ * pango_shape_item_with_cache:
+ * @cache: (nullable): a `PangoShapeCache`
+ * @item: `PangoItem` to shape
+ * @paragraph_text: (nullable): text of the paragraph
+ * @paragraph_length: the length (in bytes) of @paragraph_text
+ * @log_attrs: (nullable): array of `PangoLogAttr` for @item
+ * @glyphs: glyph string in which to store results
+ * @flags: flags influencing the shaping process
+ *
+ * Like [func@Pango.shape_item], but looks up the results
+ * of shaping the words of @item in @cache first.
+ */
+void
+pango_shape_item_with_cache (PangoShapeCache  *cache,
+                             PangoItem        *item,
+                             const char       *paragraph_text,
+                             int               paragraph_length,
+                             PangoLogAttr     *log_attrs,
+                             PangoGlyphString *glyphs,
+                             PangoShapeFlags   flags)
+{
+  pango_shape_internal (paragraph_text + item->offset, item->length,
+                        paragraph_text, paragraph_length,
+                        &item->analysis,
+                        log_attrs, item->num_chars,
+                        glyphs, flags,
+                        cache);
 }
 
 /* }}} */
@@ -0,0 +1,197 @@
+/* Pango
+ * bench-attributes.c: Benchmark attribute lists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+
+#include <pango/pango.h>
+
+#define N_TOKENS 20000
+#define TOKEN_LENGTH 6
+
+static int n_iterations = 20;
+
+/* Builds a list the way a syntax highlighter would: a font
+ * for the whole text, and a foreground color per token, added
+ * in order with pango_attr_list_change(). Every other token
+ * has the same color as the previous one, so half of the
+ * changes merge with an existing attribute.
+ */
+static PangoAttrList *
+build_highlighted_list (void)
+{
+  PangoAttrList *list;
+  PangoAttribute *attr;
+  int i;
+
+  list = pango_attr_list_new ();
+
+  attr = pango_attr_family_new ("Monospace");
+  pango_attr_list_insert (list, attr);
+
+  for (i = 0; i < N_TOKENS; i++)
+    {
+      guint16 c = ((i / 2) % 4) * 0x4000;
+
+      attr = pango_attr_foreground_new (c, 0, 0);
+      attr->start_index = i * TOKEN_LENGTH;
+      attr->end_index = (i + 1) * TOKEN_LENGTH;
+      pango_attr_list_change (list, attr);
+
+      if (i % 16 == 0)
+        {
+          attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
+          attr->start_index = i * TOKEN_LENGTH;
+          attr->end_index = i * TOKEN_LENGTH + 2;
+          pango_attr_list_change (list, attr);
+        }
+    }
+
+  return list;
+}
+
+static void
+bench_change_in_order (void)
+{
+  double elapsed;
+  int i;
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    pango_attr_list_unref (build_highlighted_list ());
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%.3f ms per list of %d changes",
+                           1000 * elapsed / n_iterations, N_TOKENS);
+}
+
+/* Recolors tokens of an existing list, as done when
+ * rehighlighting after an edit.
+ */
+static void
+bench_change_existing (void)
+{
+  PangoAttrList *list;
+  double elapsed;
+  int i, j;
+
+  list = build_highlighted_list ();
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    for (j = 0; j < 1000; j++)
+      {
+        PangoAttribute *attr;
+        int token = g_test_rand_int_range (0, N_TOKENS);
+
+        attr = pango_attr_foreground_new (0, (j % 2) * 0xffff, 0);
+        attr->start_index = token * TOKEN_LENGTH;
+        attr->end_index = (token + 1) * TOKEN_LENGTH;
+        pango_attr_list_change (list, attr);
+      }
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%.3f ms per 1000 changes",
+                           1000 * elapsed / n_iterations);
+
+  pango_attr_list_unref (list);
+}
+
+/* Inserts and removes text at the front, which shifts
+ * every attribute in the list.
+ */
+static void
+bench_update (void)
+{
+  PangoAttrList *list;
+  double elapsed;
+  int i, j;
+
+  list = build_highlighted_list ();
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    for (j = 0; j < 100; j++)
+      {
+        pango_attr_list_update (list, 10, 0, 1);
+        pango_attr_list_update (list, 10, 1, 0);
+      }
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%.3f ms per 200 updates",
+                           1000 * elapsed / n_iterations);
+
+  pango_attr_list_unref (list);
+}
+
+static void
+bench_iterate (void)
+{
+  PangoAttrList *list;
+  double elapsed;
+  int i, n_runs = 0;
+
+  list = build_highlighted_list ();
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      PangoAttrIterator *iter;
+
+      iter = pango_attr_list_get_iterator (list);
+      do
+        {
+          if (pango_attr_iterator_get (iter, PANGO_ATTR_FOREGROUND))
+            n_runs++;
+        }
+      while (pango_attr_iterator_next (iter));
+      pango_attr_iterator_destroy (iter);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_assert_cmpint (n_runs, >, 0);
+
+  g_test_minimized_result (elapsed / n_iterations, "%.3f ms per iteration",
+                           1000 * elapsed / n_iterations);
+
+  pango_attr_list_unref (list);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (!g_test_perf ())
+    n_iterations = 1;
+
+  g_test_add_func ("/attributes/change-in-order", bench_change_in_order);
+  g_test_add_func ("/attributes/change-existing", bench_change_existing);
+  g_test_add_func ("/attributes/update", bench_update);
+  g_test_add_func ("/attributes/iterate", bench_iterate);
+
+  return g_test_run ();
+}
@@ -0,0 +1,137 @@
+/* Pango
+ * bench-font-description.c: Benchmark parsing font descriptions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+
+#include <pango/pango.h>
+
+#define N_PARSES 100000
+
+static int n_iterations = 20;
+
+/* Font strings as they are found in markup, settings and CSS */
+static const char *corpus[] = {
+  "Sans 10",
+  "Cantarell 11",
+  "Cantarell Bold 11",
+  "Monospace 10",
+  "Source Code Pro 10",
+  "DejaVu Sans Mono Book 9",
+  "Noto Sans CJK JP 12",
+  "Noto Color Emoji 14",
+  "Ubuntu Medium 11",
+  "Serif Italic 12",
+  "Inter Semi-Bold 13px",
+  "Roboto Light Condensed 14",
+  "Cantarell, Noto Sans, Sans 11",
+  "Helvetica Neue, Arial, sans-serif Bold 16px",
+  "Fira Code Retina 10 #calt=1,liga=1",
+  "Inter Variable 12 @wght=450,opsz=14",
+  "Bitstream Vera Sans Oblique Small-Caps 8",
+  "Liberation Serif Ultra-Bold Expanded 24",
+  "Monospace Rotated-Left 10",
+  "Noto Sans Arabic UI Semi-Light 11",
+};
+
+static void
+parse_corpus (gboolean unique)
+{
+  double elapsed;
+  int i, j;
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    for (j = 0; j < N_PARSES; j++)
+      {
+        PangoFontDescription *desc;
+        const char *str = corpus[j % G_N_ELEMENTS (corpus)];
+        char buf[128];
+
+        /* Strings that have not been seen before
+         * take the full parser
+         */
+        if (unique)
+          {
+            g_snprintf (buf, sizeof (buf), "%s %d", str, i * N_PARSES + j);
+            str = buf;
+          }
+
+        desc = pango_font_description_from_string (str);
+        pango_font_description_free (desc);
+      }
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%.3f ms per %d parses",
+                           1000 * elapsed / n_iterations, N_PARSES);
+}
+
+static void
+bench_parse_repeated (void)
+{
+  parse_corpus (FALSE);
+}
+
+static void
+bench_parse_unique (void)
+{
+  parse_corpus (TRUE);
+}
+
+static void
+bench_roundtrip (void)
+{
+  double elapsed;
+  int i, j;
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    for (j = 0; j < N_PARSES / 10; j++)
+      {
+        PangoFontDescription *desc;
+        char *str;
+
+        desc = pango_font_description_from_string (corpus[j % G_N_ELEMENTS (corpus)]);
+        str = pango_font_description_to_string (desc);
+        pango_font_description_free (desc);
+        g_free (str);
+      }
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%.3f ms per %d roundtrips",
+                           1000 * elapsed / n_iterations, N_PARSES / 10);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (!g_test_perf ())
+    n_iterations = 1;
+
+  g_test_add_func ("/font-description/parse-repeated", bench_parse_repeated);
+  g_test_add_func ("/font-description/parse-unique", bench_parse_unique);
+  g_test_add_func ("/font-description/roundtrip", bench_roundtrip);
+
+  return g_test_run ();
+}
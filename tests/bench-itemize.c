@@ -0,0 +1,107 @@
+/* Pango
+ * bench-itemize.c: Benchmark itemization
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include <pango/pangocairo.h>
+
+static int n_iterations = 100;
+
+/* Itemizes the text of one of the sample files in utils/
+ * repeatedly, which mostly measures how fast we find fonts
+ * for the characters, once the font cache is warmed up.
+ */
+static void
+bench_itemize_file (gconstpointer data)
+{
+  const char *filename = data;
+  PangoContext *context;
+  char *text;
+  gsize length;
+  GError *error = NULL;
+  guint n_chars;
+  double elapsed;
+  int i;
+
+  if (!g_file_get_contents (filename, &text, &length, &error))
+    {
+      g_test_skip (error->message);
+      g_error_free (error);
+      return;
+    }
+
+  n_chars = g_utf8_strlen (text, length);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  /* Warm up the caches */
+  g_list_free_full (pango_itemize (context, text, 0, length, NULL, NULL),
+                    (GDestroyNotify) pango_item_free);
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    g_list_free_full (pango_itemize (context, text, 0, length, NULL, NULL),
+                      (GDestroyNotify) pango_item_free);
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%s: %.3f ms per itemization",
+                           filename, 1000 * elapsed / n_iterations);
+  g_test_message ("%s: %.1f Mchars/s", filename,
+                  n_chars * (double) n_iterations / MAX (elapsed, 1e-9) / 1e6);
+
+  g_object_unref (context);
+  g_free (text);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GDir *dir;
+  GError *error = NULL;
+  const char *name;
+  char *path;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (!g_test_perf ())
+    n_iterations = 1;
+
+  path = g_test_build_filename (G_TEST_DIST, "..", "utils", NULL);
+  dir = g_dir_open (path, 0, &error);
+  g_assert_no_error (error);
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      char *test_path;
+
+      if (!g_str_has_prefix (name, "test-") || !g_str_has_suffix (name, ".txt"))
+        continue;
+
+      test_path = g_strconcat ("/itemize/", name, NULL);
+      g_test_add_data_func_full (test_path, g_build_filename (path, name, NULL),
+                                 bench_itemize_file, g_free);
+      g_free (test_path);
+    }
+  g_dir_close (dir);
+  g_free (path);
+
+  return g_test_run ();
+}
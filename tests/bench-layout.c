@@ -0,0 +1,163 @@
+/* Pango
+ * bench-layout.c: Benchmark paragraph layout
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include <pango/pangocairo.h>
+
+static int n_iterations = 100;
+
+/* Reports how well the glyph extents caches of
+ * the fonts used for @text are doing
+ */
+static void
+report_glyph_extents_cache (PangoContext *context,
+                            const char   *text,
+                            gsize         length)
+{
+  PangoLayout *layout;
+  PangoLayoutIter *iter;
+  GHashTable *fonts;
+  GHashTableIter font_iter;
+  gpointer font;
+
+  layout = pango_layout_new (context);
+  pango_layout_set_width (layout, 600 * PANGO_SCALE);
+  pango_layout_set_text (layout, text, length);
+
+  fonts = g_hash_table_new (NULL, NULL);
+  iter = pango_layout_get_iter (layout);
+  do
+    {
+      PangoLayoutRun *run = pango_layout_iter_get_run_readonly (iter);
+
+      if (run)
+        g_hash_table_add (fonts, run->item->analysis.font);
+    }
+  while (pango_layout_iter_next_run (iter));
+  pango_layout_iter_free (iter);
+
+  g_hash_table_iter_init (&font_iter, fonts);
+  while (g_hash_table_iter_next (&font_iter, &font, NULL))
+    {
+      PangoFontDescription *desc;
+      guint64 hits, misses;
+      guint n_entries;
+      char *str;
+
+      pango_cairo_font_get_glyph_extents_cache_stats (font, &hits, &misses, &n_entries);
+
+      desc = pango_font_describe (font);
+      str = pango_font_description_to_string (desc);
+      g_test_message ("%s: %" G_GUINT64_FORMAT " glyph extents cache hits, %"
+                      G_GUINT64_FORMAT " misses, %u entries",
+                      str, hits, misses, n_entries);
+      g_free (str);
+      pango_font_description_free (desc);
+    }
+
+  g_hash_table_unref (fonts);
+  g_object_unref (layout);
+}
+
+/* Lays out the text of one of the sample files in utils/ from
+ * scratch repeatedly, which measures the whole pipeline from
+ * itemization and break analysis to shaping and line breaking.
+ */
+static void
+bench_layout_file (gconstpointer data)
+{
+  const char *filename = data;
+  PangoContext *context;
+  char *text;
+  gsize length;
+  GError *error = NULL;
+  guint n_chars;
+  double elapsed;
+  int i;
+
+  if (!g_file_get_contents (filename, &text, &length, &error))
+    {
+      g_test_skip (error->message);
+      g_error_free (error);
+      return;
+    }
+
+  n_chars = g_utf8_strlen (text, length);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      PangoLayout *layout;
+
+      layout = pango_layout_new (context);
+      pango_layout_set_width (layout, 600 * PANGO_SCALE);
+      pango_layout_set_text (layout, text, length);
+      pango_layout_get_line_count (layout);
+      g_object_unref (layout);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%s: %.3f ms per layout",
+                           filename, 1000 * elapsed / n_iterations);
+  g_test_message ("%s: %.1f Mchars/s", filename,
+                  n_chars * (double) n_iterations / MAX (elapsed, 1e-9) / 1e6);
+
+  report_glyph_extents_cache (context, text, length);
+
+  g_object_unref (context);
+  g_free (text);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *files[] = {
+    "test-latin.txt",
+    "test-long-paragraph.txt",
+    "test-chinese.txt",
+    "test-devanagari.txt",
+  };
+  char *path;
+  int i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (!g_test_perf ())
+    n_iterations = 1;
+
+  path = g_test_build_filename (G_TEST_DIST, "..", "utils", NULL);
+  for (i = 0; i < G_N_ELEMENTS (files); i++)
+    {
+      char *test_path;
+
+      test_path = g_strconcat ("/layout/", files[i], NULL);
+      g_test_add_data_func_full (test_path, g_build_filename (path, files[i], NULL),
+                                 bench_layout_file, g_free);
+      g_free (test_path);
+    }
+  g_free (path);
+
+  return g_test_run ();
+}
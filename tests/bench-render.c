@@ -0,0 +1,150 @@
+/* Pango
+ * bench-render.c: Benchmark rendering layouts with cairo
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include <pango/pangocairo.h>
+
+static int n_iterations = 100;
+
+/* Draws @layout repeatedly, which measures the renderer
+ * and the glyph submission to cairo, since the layout and
+ * the glyph caches are warm after the first iteration.
+ */
+static void
+bench_render_layout (const char  *name,
+                     PangoLayout *layout)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  double elapsed;
+  int i;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 800, 800);
+  cr = cairo_create (surface);
+
+  pango_cairo_show_layout (cr, layout);
+
+  g_test_timer_start ();
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      cairo_move_to (cr, 0, 0);
+      pango_cairo_show_layout (cr, layout);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / n_iterations, "%s: %.3f ms per render",
+                           name, 1000 * elapsed / n_iterations);
+
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+}
+
+static void
+bench_render_markup_file (gconstpointer data)
+{
+  const char *filename = data;
+  PangoContext *context;
+  PangoLayout *layout;
+  char *markup;
+  gsize length;
+  GError *error = NULL;
+
+  if (!g_file_get_contents (filename, &markup, &length, &error))
+    {
+      g_test_skip (error->message);
+      g_error_free (error);
+      return;
+    }
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_width (layout, 780 * PANGO_SCALE);
+  pango_layout_set_markup (layout, markup, length);
+
+  bench_render_layout (filename, layout);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_free (markup);
+}
+
+/* Every word is its own run, but all runs use the
+ * same font and color, so they can be drawn together
+ */
+static void
+bench_render_many_runs (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  GString *markup;
+  int i;
+
+  markup = g_string_new ("");
+  for (i = 0; i < 2000; i++)
+    g_string_append_printf (markup,
+                            "<span underline_color=\"%s\">word%d</span> ",
+                            i % 2 ? "red" : "blue", i);
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+  pango_layout_set_width (layout, 780 * PANGO_SCALE);
+  pango_layout_set_markup (layout, markup->str, markup->len);
+
+  bench_render_layout ("many-runs", layout);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_string_free (markup, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *files[] = {
+    "test-mixed.markup",
+    "test-color-run.markup",
+  };
+  char *path;
+  int i;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (!g_test_perf ())
+    n_iterations = 1;
+
+  path = g_test_build_filename (G_TEST_DIST, "..", "utils", NULL);
+  for (i = 0; i < G_N_ELEMENTS (files); i++)
+    {
+      char *test_path;
+
+      test_path = g_strconcat ("/render/", files[i], NULL);
+      g_test_add_data_func_full (test_path, g_build_filename (path, files[i], NULL),
+                                 bench_render_markup_file, g_free);
+      g_free (test_path);
+    }
+  g_free (path);
+
+  g_test_add_func ("/render/many-runs", bench_render_many_runs);
+
+  return g_test_run ();
+}
@@ -282,3 +282,19 @@ get_font_map_with_cantarell (void)
   return fontmap;
 }
 
+
+/* Compare the serialized output of two layouts */
+void
+assert_layouts_equal (PangoLayout *layout,
+                      PangoLayout *layout2)
+{
+  GBytes *bytes, *bytes2;
+
+  bytes = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  bytes2 = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+
+  g_assert_cmpstr (g_bytes_get_data (bytes, NULL), ==, g_bytes_get_data (bytes2, NULL));
+
+  g_bytes_unref (bytes);
+  g_bytes_unref (bytes2);
+}
@@ -27,4 +27,7 @@ const char *get_script_name (GUnicodeScript s);
 
 PangoFontMap *get_font_map_with_cantarell (void);
 
+void assert_layouts_equal (PangoLayout *layout,
+                           PangoLayout *layout2);
+
 #endif
@@ -21,6 +21,10 @@
 
 #include <pango/pango.h>
 
+#ifdef HAVE_FREETYPE
+#include <pango/pangoft2.h>
+#endif
+
 static void
 test_coverage_basic (void)
 {
@@ -89,6 +93,62 @@ test_coverage_decomposition (void)
   g_object_unref (coverage);
 }
 
+#ifdef HAVE_FREETYPE
+/* The coverage of fontconfig fonts matches their charset */
+static void
+test_fc_coverage (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFont *font;
+  PangoCoverage *coverage, *copy;
+  FcCharSet *charset;
+  gunichar ch, ch1, ch2;
+
+  fontmap = pango_ft2_font_map_new ();
+
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Sans 12");
+  font = pango_font_map_load_font (fontmap, context, desc);
+  coverage = pango_font_get_coverage (font, pango_language_get_default ());
+
+  g_assert_true (FcPatternGetCharSet (pango_fc_font_get_pattern (PANGO_FC_FONT (font)),
+                                      FC_CHARSET, 0, &charset) == FcResultMatch);
+
+  for (ch = 0; ch < 0x3000; ch++)
+    {
+      gboolean covered = FcCharSetHasChar (charset, ch);
+
+      if (!covered && g_unichar_decompose (ch, &ch1, &ch2))
+        covered = pango_coverage_get (coverage, ch1) == PANGO_COVERAGE_EXACT &&
+                  (ch2 == 0 || pango_coverage_get (coverage, ch2) == PANGO_COVERAGE_EXACT);
+
+      g_assert_cmpint (pango_coverage_get (coverage, ch), ==,
+                       covered ? PANGO_COVERAGE_EXACT : PANGO_COVERAGE_NONE);
+    }
+
+  g_assert_cmpint (pango_coverage_get (coverage, -1), ==, PANGO_COVERAGE_NONE);
+  g_assert_cmpint (pango_coverage_get (coverage, 0x110000), ==, PANGO_COVERAGE_NONE);
+
+  copy = pango_coverage_copy (coverage);
+  pango_coverage_set (copy, 0x10fffd, PANGO_COVERAGE_EXACT);
+  pango_coverage_set (copy, 'a', PANGO_COVERAGE_NONE);
+  g_assert_cmpint (pango_coverage_get (copy, 0x10fffd), ==, PANGO_COVERAGE_EXACT);
+  g_assert_cmpint (pango_coverage_get (copy, 'a'), ==, PANGO_COVERAGE_NONE);
+  g_assert_cmpint (pango_coverage_get (copy, 'b'), ==, pango_coverage_get (coverage, 'b'));
+  g_assert_cmpint (pango_coverage_get (coverage, 0x10fffd), ==, PANGO_COVERAGE_NONE);
+  g_object_unref (copy);
+
+  g_object_unref (coverage);
+  g_object_unref (font);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+#endif
+
 int
 main (int argc, char *argv[])
 {
@@ -97,6 +157,9 @@ main (int argc, char *argv[])
   g_test_add_func ("/coverage/basic", test_coverage_basic);
   g_test_add_func ("/coverage/copy", test_coverage_copy);
   g_test_add_func ("/coverage/decomposition", test_coverage_decomposition);
+#ifdef HAVE_FREETYPE
+  g_test_add_func ("/coverage/fc", test_fc_coverage);
+#endif
 
   return g_test_run ();
 }
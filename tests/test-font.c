@@ -28,6 +28,7 @@
 #include <gio/gio.h>
 #include <pango/pangocairo.h>
 
+#include "pango/pango-font-private.h"
 #include "test-common.h"
 
 #ifdef HAVE_FREETYPE
@@ -881,6 +882,71 @@ test_glyph_extents (void)
   g_assert_cmpint (logical.width, ==, PANGO_UNKNOWN_GLYPH_WIDTH * PANGO_SCALE);
 }
 
+static void
+test_glyph_extents_batch (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFont *font;
+  hb_font_t *hb_font;
+  PangoGlyph glyphs[100];
+  PangoRectangle ink[G_N_ELEMENTS (glyphs)], logical[G_N_ELEMENTS (glyphs)];
+  guint i, n_glyphs;
+  const char *text = "Hello, batched world! 0123456789";
+
+#ifdef HAVE_CARBON
+  desc = pango_font_description_from_string ("Helvetica 11");
+#else
+  desc = pango_font_description_from_string ("Cantarell 11");
+#endif
+
+  fontmap = get_font_map_with_cantarell ();
+  context = pango_font_map_create_context (fontmap);
+  font = pango_context_load_font (context, desc);
+  hb_font = pango_font_get_hb_font (font);
+
+  n_glyphs = 0;
+  for (i = 0; text[i]; i++)
+    {
+      hb_codepoint_t glyph;
+
+      if (!hb_font_get_nominal_glyph (hb_font, text[i], &glyph))
+        glyph = PANGO_GET_UNKNOWN_GLYPH (text[i]);
+      glyphs[n_glyphs++] = glyph;
+    }
+  glyphs[n_glyphs++] = PANGO_GLYPH_EMPTY;
+  glyphs[n_glyphs++] = PANGO_GET_UNKNOWN_GLYPH (0x1234);
+  glyphs[n_glyphs++] = glyphs[0];
+
+  pango_font_get_glyph_extents_batch (font, glyphs, n_glyphs, ink, logical);
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      PangoRectangle ink1, logical1;
+
+      pango_font_get_glyph_extents (font, glyphs[i], &ink1, &logical1);
+
+      g_assert_true (memcmp (&ink[i], &ink1, sizeof (PangoRectangle)) == 0);
+      g_assert_true (memcmp (&logical[i], &logical1, sizeof (PangoRectangle)) == 0);
+    }
+
+  /* Only logical extents */
+  pango_font_get_glyph_extents_batch (font, glyphs, n_glyphs, NULL, logical);
+  for (i = 0; i < n_glyphs; i++)
+    {
+      PangoRectangle logical1;
+
+      pango_font_get_glyph_extents (font, glyphs[i], NULL, &logical1);
+      g_assert_true (memcmp (&logical[i], &logical1, sizeof (PangoRectangle)) == 0);
+    }
+
+  g_object_unref (font);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 static void
 test_font_metrics (void)
 {
@@ -968,6 +1034,75 @@ test_stretch_vs_width (void)
   pango_font_description_free (desc2);
 }
 
+static void
+test_parse_cache (void)
+{
+  PangoFontDescription *desc, *desc2;
+  char *str;
+
+  desc = pango_font_description_from_string (" Cantarell ,  Noto Sans , Bold 11 #tnum=1");
+  g_assert_cmpstr (pango_font_description_get_family (desc), ==, "Cantarell,Noto Sans");
+
+  /* Parsing the same string again gives an independent copy */
+  pango_font_description_set_family (desc, "Sans");
+  pango_font_description_set_size (desc, 20 * PANGO_SCALE);
+
+  desc2 = pango_font_description_from_string (" Cantarell ,  Noto Sans , Bold 11 #tnum=1");
+  str = pango_font_description_to_string (desc2);
+  g_assert_cmpstr (str, ==, "Cantarell,Noto Sans Bold 11 #tnum=1");
+  g_free (str);
+
+  g_assert_false (pango_font_description_equal (desc, desc2));
+
+  pango_font_description_free (desc);
+  pango_font_description_free (desc2);
+}
+
+static void
+test_intern (void)
+{
+  PangoFontDescription *desc, *desc2;
+  PangoFontDescription *interned, *interned2, *interned3;
+
+  desc = pango_font_description_from_string ("Cantarell Bold 11 @wght=600");
+  desc2 = pango_font_description_from_string ("CANTARELL Bold 11 @wght=600");
+
+  interned = pango_font_description_intern (desc);
+  interned2 = pango_font_description_intern (desc2);
+  interned3 = pango_font_description_intern (interned);
+
+  g_assert_true (interned == interned3);
+  g_assert_true (pango_font_description_equal (interned, desc));
+  g_assert_cmpuint (pango_font_description_hash (interned), ==, pango_font_description_hash (desc));
+
+  /* The family is kept as it was given */
+  g_assert_true (interned != interned2);
+  g_assert_true (pango_font_description_equal (interned, interned2));
+  g_assert_cmpuint (pango_font_description_hash (interned), ==, pango_font_description_hash (interned2));
+  g_assert_cmpstr (pango_font_description_get_family (interned), ==, "Cantarell");
+  g_assert_cmpstr (pango_font_description_get_family (interned2), ==, "CANTARELL");
+  g_assert_cmpstr (pango_font_description_get_variations (interned), ==, "wght=600");
+
+  /* The mask is part of the identity of interned descriptions */
+  pango_font_description_unset_fields (desc2, PANGO_FONT_MASK_STYLE);
+  pango_font_description_free (interned3);
+  interned3 = pango_font_description_intern (desc2);
+  g_assert_true (interned3 != interned);
+  g_assert_true (pango_font_description_equal (interned3, interned));
+
+  /* Copies are not interned */
+  pango_font_description_free (desc2);
+  desc2 = pango_font_description_copy (interned);
+  pango_font_description_set_size (desc2, 20 * PANGO_SCALE);
+  g_assert_false (pango_font_description_equal (desc2, interned));
+
+  pango_font_description_free (interned3);
+  pango_font_description_free (interned2);
+  pango_font_description_free (interned);
+  pango_font_description_free (desc2);
+  pango_font_description_free (desc);
+}
+
 static void
 test_font_scale (void)
 {
@@ -1243,6 +1378,315 @@ test_font_lifecycle (void)
   g_object_unref (font);
 }
 
+static void
+prefetch_done (GObject      *source,
+               GAsyncResult *result,
+               gpointer      data)
+{
+  gboolean *done = data;
+  GError *error = NULL;
+
+  g_assert_true (pango_font_map_prefetch_finish (PANGO_FONT_MAP (source), result, &error));
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+prefetch_cancelled (GObject      *source,
+                    GAsyncResult *result,
+                    gpointer      data)
+{
+  gboolean *done = data;
+  GError *error = NULL;
+
+  g_assert_false (pango_font_map_prefetch_finish (PANGO_FONT_MAP (source), result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_error_free (error);
+
+  *done = TRUE;
+}
+
+static void
+test_font_map_prefetch (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *descs[3];
+  PangoLanguage *languages[3];
+  GCancellable *cancellable;
+  PangoLayout *layout;
+  gboolean done;
+
+  fontmap = get_font_map_with_cantarell ();
+  context = pango_font_map_create_context (fontmap);
+
+  descs[0] = pango_font_description_from_string ("Cantarell 11");
+  descs[1] = pango_font_description_from_string ("Monospace Bold 9");
+  descs[2] = NULL;
+  languages[0] = pango_language_from_string ("en");
+  languages[1] = pango_language_from_string ("ja");
+  languages[2] = NULL;
+
+  pango_font_map_prefetch (fontmap, context, (const PangoFontDescription * const *) descs, languages);
+  pango_font_map_prefetch (fontmap, context, (const PangoFontDescription * const *) descs, NULL);
+
+  done = FALSE;
+  pango_font_map_prefetch_async (fontmap, context,
+                                 (const PangoFontDescription * const *) descs, languages,
+                                 NULL, prefetch_done, &done);
+  g_assert_false (done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  done = FALSE;
+  pango_font_map_prefetch_async (fontmap, context,
+                                 (const PangoFontDescription * const *) descs, NULL,
+                                 cancellable, prefetch_cancelled, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+  g_object_unref (cancellable);
+
+#ifdef HAVE_FREETYPE
+  /* The prefetched fontsets are cached and their fonts are ready */
+  if (PANGO_IS_FC_FONT_MAP (fontmap))
+    {
+      PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (fontmap);
+      guint64 hits, misses, hits2, misses2;
+      guint n_face_data;
+      PangoFontset *fontset;
+
+      pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                         &hits, &misses, NULL, NULL, NULL);
+      pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FACE_DATA,
+                                         NULL, NULL, NULL, &n_face_data, NULL);
+      g_assert_cmpuint (n_face_data, >, 0);
+
+      fontset = pango_font_map_load_fontset (fontmap, context, descs[1], languages[1]);
+      g_object_unref (fontset);
+
+      pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                         &hits2, &misses2, NULL, NULL, NULL);
+      g_assert_cmpuint (hits2, ==, hits + 1);
+      g_assert_cmpuint (misses2, ==, misses);
+    }
+#endif
+
+  /* The prefetched fonts are used like any other */
+  layout = pango_layout_new (context);
+  pango_layout_set_font_description (layout, descs[1]);
+  pango_layout_set_text (layout, "Hello 日本語", -1);
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, 1);
+  g_object_unref (layout);
+
+  pango_font_description_free (descs[0]);
+  pango_font_description_free (descs[1]);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+static gboolean
+count_ticks (gpointer data)
+{
+  guint *ticks = data;
+
+  (*ticks)++;
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* The main loop keeps running while fonts are prefetched */
+static void
+test_font_map_prefetch_main_loop (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *descs[41];
+  PangoLanguage *languages[4];
+  guint ticks, ticks_when_done;
+  gboolean done;
+  guint id;
+  int i;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+
+  for (i = 0; i < 40; i++)
+    {
+      descs[i] = pango_font_description_from_string (i % 2 ? "Serif" : "Sans");
+      pango_font_description_set_size (descs[i], (6 + i) * PANGO_SCALE);
+    }
+  descs[40] = NULL;
+  languages[0] = pango_language_from_string ("en");
+  languages[1] = pango_language_from_string ("ja");
+  languages[2] = pango_language_from_string ("ar");
+  languages[3] = NULL;
+
+  ticks = 0;
+  id = g_idle_add_full (G_PRIORITY_HIGH, count_ticks, &ticks, NULL);
+
+  done = FALSE;
+  pango_font_map_prefetch_async (fontmap, context,
+                                 (const PangoFontDescription * const *) descs, languages,
+                                 NULL, prefetch_done, &done);
+  g_assert_false (done);
+  g_assert_cmpuint (ticks, ==, 0);
+
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+  ticks_when_done = ticks;
+
+  g_source_remove (id);
+
+  g_assert_cmpuint (ticks_when_done, >, 0);
+
+  for (i = 0; i < 40; i++)
+    pango_font_description_free (descs[i]);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+#ifdef HAVE_FREETYPE
+static void
+render_ft2_layout (PangoLayout *layout)
+{
+  FT_Bitmap bitmap = { 0, };
+
+  bitmap.width = 800;
+  bitmap.rows = 100;
+  bitmap.pitch = 800;
+  bitmap.num_grays = 256;
+  bitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+  bitmap.buffer = g_malloc0 (bitmap.rows * bitmap.pitch);
+
+  pango_ft2_render_layout (&bitmap, layout, 0, 0);
+
+  g_free (bitmap.buffer);
+}
+
+static void
+test_ft2_glyph_cache (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoFontDescription *desc;
+  guint64 hits, misses, evictions;
+  guint64 hits2, misses2, evictions2;
+  guint n_glyphs;
+  gsize n_bytes, limit;
+
+  limit = pango_ft2_get_glyph_cache_limit ();
+
+  fontmap = pango_ft2_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  desc = pango_font_description_from_string ("Sans 48px");
+  pango_layout_set_font_description (layout, desc);
+  pango_layout_set_text (layout, "The quick brown fox jumps over the lazy dog", -1);
+
+  render_ft2_layout (layout);
+  pango_ft2_get_glyph_cache_stats (&hits, &misses, &evictions, &n_glyphs, &n_bytes);
+  g_assert_cmpuint (misses, >, 0);
+  g_assert_cmpuint (n_glyphs, >, 1);
+  g_assert_cmpuint (n_bytes, <=, limit);
+  /* Small bitmaps share a slab, which counts in full */
+  g_assert_cmpuint (n_bytes, >=, 64 * 1024);
+
+  /* Everything is cached now */
+  render_ft2_layout (layout);
+  pango_ft2_get_glyph_cache_stats (&hits2, &misses2, NULL, NULL, NULL);
+  g_assert_cmpuint (hits2, >, hits);
+  g_assert_cmpuint (misses2, ==, misses);
+
+  /* Lowering the limit drops glyphs immediately */
+  pango_ft2_set_glyph_cache_limit (1024);
+  g_assert_cmpuint (pango_ft2_get_glyph_cache_limit (), ==, 1024);
+  pango_ft2_get_glyph_cache_stats (NULL, NULL, &evictions2, &n_glyphs, &n_bytes);
+  g_assert_cmpuint (evictions2, >, evictions);
+  g_assert_true (n_bytes <= 1024 || n_glyphs == 1);
+
+  /* Glyphs that were evicted are drawn correctly */
+  render_ft2_layout (layout);
+  pango_ft2_get_glyph_cache_stats (NULL, &misses, NULL, &n_glyphs, &n_bytes);
+  g_assert_cmpuint (misses, >, misses2);
+  g_assert_true (n_bytes <= 1024 || n_glyphs == 1);
+
+  pango_font_description_free (desc);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+
+  pango_ft2_set_glyph_cache_limit (limit);
+}
+
+/* Renders many glyphs that are only used once, together with a few
+ * that are used all the time, and checks that the cache stays within
+ * its limit without dropping the glyphs that are used all the time.
+ */
+static void
+test_ft2_glyph_cache_churn (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *hot, *cold;
+  PangoFontDescription *desc;
+  guint64 misses, misses2;
+  guint n_glyphs, n_hot_misses;
+  gsize n_bytes, limit;
+  int i;
+
+  limit = pango_ft2_get_glyph_cache_limit ();
+  pango_ft2_set_glyph_cache_limit (8 * 64 * 1024);
+
+  fontmap = pango_ft2_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+
+  hot = pango_layout_new (context);
+  desc = pango_font_description_from_string ("Sans 12px");
+  pango_layout_set_font_description (hot, desc);
+  pango_layout_set_text (hot, "Hot", -1);
+
+  cold = pango_layout_new (context);
+  pango_layout_set_text (cold, "The quick brown fox jumps over the lazy dog", -1);
+
+  render_ft2_layout (hot);
+
+  n_hot_misses = 0;
+  for (i = 0; i < 60; i++)
+    {
+      /* Every size gives new glyphs */
+      pango_font_description_set_absolute_size (desc, (13 + i) * PANGO_SCALE);
+      pango_layout_set_font_description (cold, desc);
+      render_ft2_layout (cold);
+
+      pango_ft2_get_glyph_cache_stats (NULL, &misses, NULL, &n_glyphs, &n_bytes);
+      g_assert_true (n_bytes <= 8 * 64 * 1024 || n_glyphs == 1);
+
+      render_ft2_layout (hot);
+
+      pango_ft2_get_glyph_cache_stats (NULL, &misses2, NULL, &n_glyphs, &n_bytes);
+      g_assert_true (n_bytes <= 8 * 64 * 1024 || n_glyphs == 1);
+
+      if (misses2 > misses)
+        n_hot_misses++;
+    }
+
+  /* Glyphs that are used all the time stay cached */
+  g_assert_cmpuint (n_hot_misses, <=, 2);
+
+  pango_font_description_free (desc);
+  g_object_unref (cold);
+  g_object_unref (hot);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+
+  pango_ft2_set_glyph_cache_limit (limit);
+}
+#endif
+
 int
 main (int argc, char *argv[])
 {
@@ -1264,6 +1708,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/pango/fontdescription/set-gravity", test_set_gravity);
   g_test_add_func ("/pango/fontdescription/match", test_match);
   g_test_add_func ("/pango/fontdescription/stretch-vs-width", test_stretch_vs_width);
+  g_test_add_func ("/pango/fontdescription/parse-cache", test_parse_cache);
+  g_test_add_func ("/pango/fontdescription/intern", test_intern);
   g_test_add_func ("/pango/font/extents", test_extents);
   g_test_add_func ("/pango/font/enumerate", test_enumerate);
   g_test_add_func ("/pango/font/roundtrip/plain", test_roundtrip_plain);
@@ -1275,6 +1721,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/pango/font/roundtrip/emoji", test_roundtrip_emoji);
   g_test_add_func ("/pango/font/models", test_font_models);
   g_test_add_func ("/pango/font/glyph-extents", test_glyph_extents);
+  g_test_add_func ("/pango/font/glyph-extents-batch", test_glyph_extents_batch);
   g_test_add_func ("/pango/font/font-metrics", test_font_metrics);
   g_test_add_func ("/pango/font/scale-font/plain", test_font_scale);
   g_test_add_func ("/pango/font/scale-font/variations", test_font_scale_variations);
@@ -1282,6 +1729,12 @@ main (int argc, char *argv[])
   g_test_add_func ("/pango/font/features-and-variants", test_features_and_variants);
   g_test_add_func ("/pango/font/features-and-variants2", test_features_and_variants2);
   g_test_add_func ("/pango/font/lifecycle", test_font_lifecycle);
+  g_test_add_func ("/pango/fontmap/prefetch", test_font_map_prefetch);
+  g_test_add_func ("/pango/fontmap/prefetch-main-loop", test_font_map_prefetch_main_loop);
+#ifdef HAVE_FREETYPE
+  g_test_add_func ("/pango/ft2/glyph-cache", test_ft2_glyph_cache);
+  g_test_add_func ("/pango/ft2/glyph-cache-churn", test_ft2_glyph_cache_churn);
+#endif
 
   return g_test_run ();
 }
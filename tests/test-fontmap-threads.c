@@ -0,0 +1,280 @@
+/* Pango
+ * test-fontmap-threads.c: Test sharing a fontmap between threads
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pango/pango.h>
+#include <pango/pangocairo.h>
+#include <pango/pangofc-fontmap.h>
+
+/* Shares a single fontmap between many threads which load
+ * fontsets and fonts and lay out text at the same time, and
+ * checks that they get the same results as a single thread
+ * using a fontmap of its own.
+ *
+ * There are more descriptions than the fontmap caches fontsets,
+ * so the threads race on cache misses and evictions, not just
+ * on cache hits. Listing the faces of a family races with
+ * other threads looking up the faces of the fonts they load.
+ *
+ * Clearing the caches of the fontmap races with all of that.
+ */
+
+static const char *text = "Hamburgerfonts วิวิวิ بهداد";
+
+static const char *families[] = { "Sans", "Serif", "Monospace", "Cantarell", "DejaVu Sans" };
+static const char *languages[] = { "en", "th", "ar" };
+#define N_SIZES 24
+#define N_DESCRIPTIONS (G_N_ELEMENTS (families) * G_N_ELEMENTS (languages) * N_SIZES * 2)
+
+static int num_iters = 200;
+static int num_threads = 32;
+
+static GMutex mutex;
+
+typedef struct {
+  PangoFontMap *fontmap;
+  int widths[N_DESCRIPTIONS];
+  int n_running;
+} SharedData;
+
+typedef struct {
+  SharedData *shared;
+  guint32 seed;
+} ThreadData;
+
+static PangoFontDescription *
+get_description (guint n)
+{
+  PangoFontDescription *desc;
+
+  desc = pango_font_description_new ();
+  pango_font_description_set_family (desc, families[n % G_N_ELEMENTS (families)]);
+  n /= G_N_ELEMENTS (families);
+  n /= G_N_ELEMENTS (languages);
+  pango_font_description_set_size (desc, (6 + n % N_SIZES) * PANGO_SCALE);
+  n /= N_SIZES;
+  pango_font_description_set_weight (desc, n ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL);
+
+  return desc;
+}
+
+static PangoLanguage *
+get_language (guint n)
+{
+  n /= G_N_ELEMENTS (families);
+
+  return pango_language_from_string (languages[n % G_N_ELEMENTS (languages)]);
+}
+
+static int
+measure (PangoContext *context,
+         guint         n)
+{
+  PangoFontDescription *desc;
+  PangoLayout *layout;
+  int width;
+
+  pango_context_set_language (context, get_language (n));
+
+  desc = get_description (n);
+  layout = pango_layout_new (context);
+  pango_layout_set_font_description (layout, desc);
+  pango_layout_set_text (layout, text, -1);
+  pango_layout_get_size (layout, &width, NULL);
+
+  g_object_unref (layout);
+  pango_font_description_free (desc);
+
+  return width;
+}
+
+static gpointer
+thread_func (gpointer data)
+{
+  ThreadData *td = data;
+  PangoFontMap *fontmap = td->shared->fontmap;
+  PangoContext *context;
+  GRand *rand;
+  int i;
+
+  rand = g_rand_new_with_seed (td->seed);
+  context = pango_font_map_create_context (fontmap);
+
+  g_mutex_lock (&mutex);
+  g_mutex_unlock (&mutex);
+
+  for (i = 0; i < num_iters; i++)
+    {
+      guint n = g_rand_int_range (rand, 0, N_DESCRIPTIONS);
+      PangoFontDescription *desc = get_description (n);
+      PangoLanguage *language = get_language (n);
+      PangoFontset *fontset;
+      PangoFont *font, *font2;
+      PangoFontMetrics *metrics;
+
+      pango_context_set_language (context, language);
+
+      fontset = pango_font_map_load_fontset (fontmap, context, desc, language);
+      g_assert_nonnull (fontset);
+
+      font = pango_fontset_get_font (fontset, g_rand_boolean (rand) ? 'a' : 0x0e27);
+      g_assert_nonnull (font);
+      g_assert_true (pango_font_get_font_map (font) == fontmap);
+
+      metrics = pango_font_get_metrics (font, language);
+      g_assert_cmpint (pango_font_metrics_get_height (metrics), >, 0);
+      pango_font_metrics_unref (metrics);
+
+      g_object_unref (font);
+      g_object_unref (fontset);
+
+      font = pango_font_map_load_font (fontmap, context, desc);
+      g_assert_nonnull (font);
+      font2 = pango_font_map_load_font (fontmap, context, desc);
+      g_assert_nonnull (font2);
+
+      if (i % 4 == 0)
+        {
+          PangoFontFace *face = pango_font_get_face (font);
+          PangoFontFamily *family = pango_font_face_get_family (face);
+          guint n_faces, j;
+
+          n_faces = g_list_model_get_n_items (G_LIST_MODEL (family));
+          g_assert_cmpuint (n_faces, >, 0);
+          for (j = 0; j < n_faces; j++)
+            {
+              PangoFontFace *item = g_list_model_get_item (G_LIST_MODEL (family), j);
+
+              g_assert_nonnull (item);
+              g_object_unref (item);
+            }
+        }
+
+      g_object_unref (font2);
+      g_object_unref (font);
+
+      g_assert_cmpint (measure (context, n), ==, td->shared->widths[n]);
+
+      pango_font_description_free (desc);
+    }
+
+  g_object_unref (context);
+  g_rand_free (rand);
+
+  g_atomic_int_dec_and_test (&td->shared->n_running);
+
+  return NULL;
+}
+
+static void
+run_threads (gboolean clear)
+{
+  SharedData *shared;
+  ThreadData *td;
+  GPtrArray *threads;
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  guint n;
+  int i;
+
+  fontmap = pango_cairo_font_map_new ();
+  if (pango_cairo_font_map_get_font_type (PANGO_CAIRO_FONT_MAP (fontmap)) != CAIRO_FONT_TYPE_FT)
+    {
+      g_test_skip ("Only fontconfig fontmaps can be shared between threads");
+      g_object_unref (fontmap);
+      return;
+    }
+
+  shared = g_new0 (SharedData, 1);
+
+  /* Get the reference results from a fontmap of our own,
+   * and leave the caches of the shared one cold.
+   */
+  context = pango_font_map_create_context (fontmap);
+  for (n = 0; n < N_DESCRIPTIONS; n++)
+    shared->widths[n] = measure (context, n);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+
+  shared->fontmap = pango_cairo_font_map_new ();
+  shared->n_running = num_threads;
+
+  threads = g_ptr_array_new ();
+  td = g_new0 (ThreadData, num_threads);
+
+  g_mutex_lock (&mutex);
+
+  for (i = 0; i < num_threads; i++)
+    {
+      char buf[10];
+
+      td[i].shared = shared;
+      td[i].seed = g_test_rand_int ();
+
+      g_snprintf (buf, sizeof (buf), "%d", i);
+      g_ptr_array_add (threads, g_thread_new (buf, thread_func, &td[i]));
+    }
+
+  /* Let them loose! */
+  g_mutex_unlock (&mutex);
+
+  while (clear && g_atomic_int_get (&shared->n_running) > 0)
+    {
+      pango_fc_font_map_cache_clear (PANGO_FC_FONT_MAP (shared->fontmap));
+      g_usleep (1000);
+    }
+
+  for (i = 0; i < num_threads; i++)
+    g_thread_join (g_ptr_array_index (threads, i));
+
+  g_ptr_array_unref (threads);
+  g_free (td);
+
+  g_object_unref (shared->fontmap);
+  g_free (shared);
+}
+
+static void
+test_shared_fontmap (void)
+{
+  run_threads (FALSE);
+}
+
+static void
+test_cache_clear (void)
+{
+  run_threads (TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  if (argc > 1)
+    num_threads = atoi (argv[1]);
+  if (argc > 2)
+    num_iters = atoi (argv[2]);
+
+  g_test_add_func ("/fontmap/threads/shared", test_shared_fontmap);
+  g_test_add_func ("/fontmap/threads/cache-clear", test_cache_clear);
+
+  return g_test_run ();
+}
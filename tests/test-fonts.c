@@ -1,6 +1,7 @@
 #include <string.h>
 #include <locale.h>
 
+#include <glib/gstdio.h>
 #include <pango/pango.h>
 #include <pango/pangocairo-fc.h>
 #include <pango/pangofc-fontmap.h>
@@ -161,6 +162,373 @@ test_fontset (gconstpointer d)
   g_object_unref (fontmap);
 }
 
+typedef struct {
+  gunichar wc;
+  PangoFont *font;
+  int position;
+} FirstFontInfo;
+
+static gboolean
+find_first_font (PangoFontset *fontset,
+                 PangoFont    *font,
+                 gpointer      data)
+{
+  FirstFontInfo *info = data;
+
+  if (pango_font_has_char (font, info->wc))
+    {
+      info->font = font;
+      return TRUE;
+    }
+
+  info->position++;
+
+  return FALSE;
+}
+
+static void
+test_fontset_get_fonts (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFontset *fontset;
+  const char *text = "Hello, Ελληνικά, Русский, 日本語, 한국어, עברית, العربية, 😀🎉 \xf4\x8f\xbf\xbd";
+  gunichar *chars;
+  glong n_chars;
+  PangoFont **fonts;
+  int *positions;
+  glong i;
+
+  fontmap = generate_font_map ();
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Cantarell 11");
+  fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_from_string ("en"));
+
+  chars = g_utf8_to_ucs4_fast (text, -1, &n_chars);
+  positions = g_new (int, n_chars);
+  fonts = pango_fontset_get_fonts (fontset, chars, n_chars, positions);
+
+  for (i = 0; i < n_chars; i++)
+    {
+      FirstFontInfo info = { chars[i], NULL, 0 };
+
+      pango_fontset_foreach (fontset, find_first_font, &info);
+
+      g_assert_true (fonts[i] == info.font);
+      g_assert_cmpint (positions[i], ==, info.position);
+    }
+
+  g_free (positions);
+  g_free (fonts);
+  g_free (chars);
+  g_object_unref (fontset);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+static char *
+describe_font_for_char (PangoFontMap *fontmap,
+                        gunichar      wc)
+{
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFontset *fontset;
+  PangoFont *font;
+  PangoFontDescription *font_desc;
+  char *s;
+
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Sans 12");
+  fontset = pango_font_map_load_fontset (fontmap, context, desc,
+                                         pango_language_from_string ("en-us"));
+  font = pango_fontset_get_font (fontset, wc);
+  font_desc = pango_font_describe (font);
+  s = pango_font_description_to_string (font_desc);
+
+  pango_font_description_free (font_desc);
+  g_object_unref (font);
+  g_object_unref (fontset);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+
+  return s;
+}
+
+/* Check that fontconfig results stored in the sort cache
+ * by one fontmap give the same fonts in another one
+ */
+static void
+test_fc_sort_cache (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  char *dir, *filename;
+  char *s1, *s2;
+  int i;
+
+  dir = g_dir_make_tmp ("pango-sort-cache-XXXXXX", NULL);
+  g_assert_nonnull (dir);
+  filename = g_build_filename (dir, "sort-cache", NULL);
+
+  g_setenv ("PANGO_FC_SORT_CACHE", filename, TRUE);
+
+  fontmap = generate_font_map ();
+  s1 = describe_font_for_char (fontmap, 'a');
+
+  /* This waits for the fontconfig thread to add its results */
+  g_assert_true (pango_fc_font_map_save_sort_cache (PANGO_FC_FONT_MAP (fontmap), NULL));
+  g_assert_true (g_file_test (filename, G_FILE_TEST_EXISTS));
+  g_object_unref (fontmap);
+
+  fontmap = generate_font_map ();
+  s2 = describe_font_for_char (fontmap, 'a');
+
+  g_assert_cmpstr (s1, ==, s2);
+
+  g_free (s2);
+  g_free (s1);
+
+  /* Drop the cache while the fontconfig thread still
+   * has work queued that adds results to it
+   */
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Serif");
+  for (i = 0; i < 20; i++)
+    {
+      PangoFontset *fontset;
+
+      pango_font_description_set_size (desc, (6 + i) * PANGO_SCALE);
+      fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+      g_object_unref (fontset);
+    }
+  pango_fc_font_map_cache_clear (PANGO_FC_FONT_MAP (fontmap));
+  pango_font_description_free (desc);
+  g_object_unref (context);
+
+  g_object_unref (fontmap);
+  g_unsetenv ("PANGO_FC_SORT_CACHE");
+  g_remove (filename);
+  g_rmdir (dir);
+  g_free (filename);
+  g_free (dir);
+}
+
+static void
+test_fc_cache_limits (void)
+{
+  PangoFontMap *fontmap;
+  PangoFcFontMap *fcfontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFontset *fontset;
+  PangoFont *font;
+  PangoCoverage *coverage;
+  guint64 hits, misses, evictions;
+  guint max_entries, n_entries;
+  gsize n_bytes;
+  const guint limits[] = { 1, 20, 32 };
+  guint i, j;
+
+  fontmap = generate_font_map ();
+  fcfontmap = PANGO_FC_FONT_MAP (fontmap);
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Sans");
+
+  pango_fc_font_map_get_cache_limits (fcfontmap, PANGO_FC_CACHE_FONTSETS, &max_entries, NULL);
+  g_assert_cmpuint (max_entries, ==, 256);
+
+  /* The limit holds exactly, also for limits that
+   * don't divide evenly between the parts of the cache
+   */
+  for (j = 0; j < G_N_ELEMENTS (limits); j++)
+    {
+      guint64 misses_before, evictions_before;
+
+      pango_fc_font_map_cache_clear (fcfontmap);
+      pango_fc_font_map_set_cache_limits (fcfontmap, PANGO_FC_CACHE_FONTSETS, limits[j], 0);
+      pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                         NULL, &misses_before, &evictions_before, NULL, NULL);
+
+      for (i = 0; i < 100; i++)
+        {
+          pango_font_description_set_size (desc, (4 + i) * PANGO_SCALE);
+          fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+          g_object_unref (fontset);
+
+          pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                             NULL, NULL, NULL, &n_entries, NULL);
+          g_assert_cmpuint (n_entries, ==, MIN (i + 1, limits[j]));
+        }
+
+      pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                         &hits, &misses, &evictions, &n_entries, &n_bytes);
+      g_assert_cmpuint (misses - misses_before, ==, 100);
+      g_assert_cmpuint (evictions - evictions_before, ==, 100 - limits[j]);
+      g_assert_cmpuint (n_bytes, >, 0);
+    }
+
+  pango_fc_font_map_set_cache_limits (fcfontmap, PANGO_FC_CACHE_FACE_DATA, 1, 0);
+
+  fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+  g_object_unref (fontset);
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                     &hits, NULL, NULL, NULL, NULL);
+  g_assert_cmpuint (hits, ==, 1);
+
+  /* Fonts keep their face data alive when it is evicted */
+  pango_font_description_set_family (desc, "Cantarell");
+  font = pango_font_map_load_font (fontmap, context, desc);
+  coverage = pango_font_get_coverage (font, pango_language_get_default ());
+  g_object_unref (coverage);
+
+  for (i = 0; i < 2; i++)
+    {
+      PangoFont *other;
+
+      pango_font_description_set_family (desc, i ? "DejaVu Sans Mono" : "DejaVu Sans");
+      other = pango_font_map_load_font (fontmap, context, desc);
+      coverage = pango_font_get_coverage (other, pango_language_get_default ());
+      g_object_unref (coverage);
+      g_object_unref (other);
+    }
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FACE_DATA,
+                                     NULL, NULL, NULL, &n_entries, NULL);
+  g_assert_cmpuint (n_entries, ==, 1);
+
+  g_assert_nonnull (pango_font_get_languages (font));
+  g_assert_nonnull (pango_font_get_hb_font (font));
+
+  g_object_unref (font);
+
+  pango_fc_font_map_cache_clear (fcfontmap);
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                     &hits, NULL, NULL, &n_entries, NULL);
+  g_assert_cmpuint (n_entries, ==, 0);
+  g_assert_cmpuint (hits, ==, 1);
+  pango_fc_font_map_get_cache_limits (fcfontmap, PANGO_FC_CACHE_FONTSETS, &max_entries, NULL);
+  g_assert_cmpuint (max_entries, ==, 32);
+
+  pango_font_description_free (desc);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+/* The fontset cache is split into shards, but the limit
+ * applies to all of them together, and the least recently
+ * used fontset goes first, whichever shard it is in
+ */
+static void
+test_fc_cache_lru (void)
+{
+  PangoFontMap *fontmap;
+  PangoFcFontMap *fcfontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFontset *fontset;
+  guint64 hits, misses, evictions;
+  guint64 hits_before, misses_before;
+  guint i;
+
+  fontmap = generate_font_map ();
+  fcfontmap = PANGO_FC_FONT_MAP (fontmap);
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Sans");
+
+  pango_fc_font_map_set_cache_limits (fcfontmap, PANGO_FC_CACHE_FONTSETS, 20, 0);
+
+  for (i = 0; i < 20; i++)
+    {
+      pango_font_description_set_size (desc, (4 + i) * PANGO_SCALE);
+      fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+      g_object_unref (fontset);
+    }
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                     NULL, NULL, &evictions, NULL, NULL);
+  g_assert_cmpuint (evictions, ==, 0);
+
+  /* Touch the oldest one, then make room for one more */
+  pango_font_description_set_size (desc, 4 * PANGO_SCALE);
+  fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+  g_object_unref (fontset);
+
+  pango_font_description_set_size (desc, 100 * PANGO_SCALE);
+  fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+  g_object_unref (fontset);
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                     &hits_before, &misses_before, &evictions, NULL, NULL);
+  g_assert_cmpuint (evictions, ==, 1);
+
+  /* The one we touched is still there, the next oldest is gone */
+  pango_font_description_set_size (desc, 4 * PANGO_SCALE);
+  fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+  g_object_unref (fontset);
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                     &hits, &misses, NULL, NULL, NULL);
+  g_assert_cmpuint (hits - hits_before, ==, 1);
+  g_assert_cmpuint (misses - misses_before, ==, 0);
+
+  pango_font_description_set_size (desc, 5 * PANGO_SCALE);
+  fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_get_default ());
+  g_object_unref (fontset);
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_CACHE_FONTSETS,
+                                     &hits, &misses, NULL, NULL, NULL);
+  g_assert_cmpuint (hits - hits_before, ==, 1);
+  g_assert_cmpuint (misses - misses_before, ==, 1);
+
+  pango_font_description_free (desc);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+static const char *
+get_font_data (PangoFontMap *fontmap)
+{
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoFont *font;
+  hb_blob_t *blob;
+  const char *data;
+
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Sans 12");
+  font = pango_font_map_load_font (fontmap, context, desc);
+
+  blob = hb_face_reference_blob (hb_font_get_face (pango_font_get_hb_font (font)));
+  data = hb_blob_get_data (blob, NULL);
+  hb_blob_destroy (blob);
+
+  g_object_unref (font);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+
+  return data;
+}
+
+static void
+test_fc_shared_blobs (void)
+{
+  PangoFontMap *fontmap1, *fontmap2;
+  const char *data;
+
+  fontmap1 = generate_font_map ();
+  fontmap2 = generate_font_map ();
+
+  data = get_font_data (fontmap1);
+  g_assert_nonnull (data);
+  g_assert_true (data == get_font_data (fontmap2));
+
+  g_object_unref (fontmap2);
+  g_object_unref (fontmap1);
+}
+
 static void
 generate_expected_output (const char *path)
 {
@@ -221,6 +589,12 @@ main (int argc, char *argv[])
   if (!opt_fonts)
     opt_fonts = g_test_build_filename (G_TEST_DIST, "fonts", NULL);
 
+  g_test_add_func ("/fontset/get-fonts", test_fontset_get_fonts);
+  g_test_add_func ("/fc/sort-cache", test_fc_sort_cache);
+  g_test_add_func ("/fc/cache-limits", test_fc_cache_limits);
+  g_test_add_func ("/fc/cache-lru", test_fc_cache_lru);
+  g_test_add_func ("/fc/shared-blobs", test_fc_shared_blobs);
+
   path = g_test_build_filename (G_TEST_DIST, "fontsets", NULL);
   dir = g_dir_open (path, 0, &error);
   g_free (path);
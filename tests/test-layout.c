@@ -139,6 +139,204 @@ test_layout (gconstpointer d)
   g_free (diff);
 }
 
+/* Test that editing a layout with many paragraphs
+ * gives the same result as laying out the text from scratch
+ */
+static void
+test_replace_text (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout, *layout2;
+  PangoAttrList *attrs;
+  PangoAttribute *attr;
+  const char *text;
+
+  fontmap = generate_font_map ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+
+  pango_layout_set_text (layout,
+                         "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n"
+                         "Sed do eiusmod\ttempor incididunt ut labore et dolore.\n"
+                         "\n"
+                         "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n"
+                         "Ut enim ad minim veniam, quis nostrud exercitation", -1);
+
+  attrs = pango_attr_list_new ();
+  attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
+  attr->start_index = 62;
+  attr->end_index = 70;
+  pango_attr_list_insert (attrs, attr);
+  attr = pango_attr_foreground_new (0xffff, 0, 0);
+  attr->start_index = 120;
+  attr->end_index = 140;
+  pango_attr_list_insert (attrs, attr);
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  pango_layout_set_width (layout, 200 * PANGO_SCALE);
+  pango_layout_get_line_count (layout);
+
+  pango_layout_replace_text (layout, 64, 6, "modifications", -1);
+  pango_layout_replace_text (layout, 0, 0, "Ipsum\n", -1);
+
+  text = pango_layout_get_text (layout);
+  g_assert_true (g_str_has_prefix (text, "Ipsum\nLorem"));
+  g_assert_cmpint (pango_layout_get_character_count (layout), ==, g_utf8_strlen (text, -1));
+
+  layout2 = pango_layout_new (context);
+  pango_layout_set_text (layout2, text, -1);
+  pango_layout_set_attributes (layout2, pango_layout_get_attributes (layout));
+  pango_layout_set_width (layout2, 200 * PANGO_SCALE);
+
+  assert_layouts_equal (layout, layout2);
+
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+  pango_layout_set_width (layout2, 100 * PANGO_SCALE);
+
+  assert_layouts_equal (layout, layout2);
+
+  pango_layout_replace_text (layout, 6, strlen (text) - 6, "", 0);
+  g_assert_cmpstr (pango_layout_get_text (layout), ==, "Ipsum\n");
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, 2);
+
+  g_object_unref (layout2);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+/* Test that reflowing a layout at different widths,
+ * which reuses the shaped paragraphs, gives the same
+ * result as laying out the text from scratch.
+ */
+static void
+test_width_reflow (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoAttrList *attrs;
+  PangoAttribute *attr;
+  int width;
+
+  fontmap = generate_font_map ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+
+  pango_layout_set_text (layout,
+                         "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+                         "sed do eiusmod\ttempor incididunt ut labore et dolore magna "
+                         "aliqua. Ut enim ad minim veniam, quis nostrud exercitation.", -1);
+
+  attrs = pango_attr_list_new ();
+  attr = pango_attr_letter_spacing_new (2 * PANGO_SCALE);
+  attr->start_index = 12;
+  attr->end_index = 40;
+  pango_attr_list_insert (attrs, attr);
+  attr = pango_attr_size_new (16 * PANGO_SCALE);
+  attr->start_index = 80;
+  attr->end_index = 120;
+  pango_attr_list_insert (attrs, attr);
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  pango_layout_set_justify (layout, TRUE);
+
+  for (width = 300; width >= 20; width -= 20)
+    {
+      PangoLayout *layout2;
+
+      pango_layout_set_width (layout, width * PANGO_SCALE);
+
+      layout2 = pango_layout_new (context);
+      pango_layout_set_text (layout2, pango_layout_get_text (layout), -1);
+      pango_layout_set_attributes (layout2, pango_layout_get_attributes (layout));
+      pango_layout_set_justify (layout2, TRUE);
+      pango_layout_set_width (layout2, width * PANGO_SCALE);
+
+      assert_layouts_equal (layout, layout2);
+
+      g_object_unref (layout2);
+    }
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+static void
+assert_log_attrs_for_text (const PangoLogAttr *attrs,
+                           const char         *text,
+                           int                 n_attrs,
+                           PangoLanguage      *language)
+{
+  PangoLogAttr *expected;
+  int n_chars = g_utf8_strlen (text, -1);
+
+  expected = g_new0 (PangoLogAttr, n_chars + 1);
+  pango_get_log_attrs (text, -1, 0, language, expected, n_chars + 1);
+
+  g_assert_true (memcmp (attrs, expected, n_attrs * sizeof (PangoLogAttr)) == 0);
+
+  g_free (expected);
+}
+
+/* Test that the word and sentence information that is filled in
+ * on demand matches what we get when breaking the text directly,
+ * both for freshly broken paragraphs and for cached ones.
+ */
+static void
+test_lazy_log_attrs (void)
+{
+  const char *para1 = "Hello world. This is it!\n";
+  const char *para2 = "Another one, isn't it? Yes.";
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLanguage *language;
+  PangoLayout *layout;
+  const PangoLogAttr *attrs;
+  char *text;
+  int n_attrs;
+  int n_chars1;
+
+  fontmap = generate_font_map ();
+  context = pango_font_map_create_context (fontmap);
+  language = pango_context_get_language (context);
+  layout = pango_layout_new (context);
+
+  text = g_strconcat (para1, para2, NULL);
+  n_chars1 = g_utf8_strlen (para1, -1);
+
+  pango_layout_set_text (layout, text, -1);
+  pango_layout_set_width (layout, 50 * PANGO_SCALE);
+  g_assert_cmpint (pango_layout_get_line_count (layout), >, 2);
+
+  attrs = pango_layout_get_log_attrs_readonly (layout, &n_attrs);
+  g_assert_cmpint (n_attrs, ==, g_utf8_strlen (text, -1) + 1);
+  assert_log_attrs_for_text (attrs, para1, n_chars1, language);
+  assert_log_attrs_for_text (attrs + n_chars1, para2, n_attrs - n_chars1, language);
+
+  /* Change only the first paragraph, so the second one comes from the cache */
+  pango_layout_replace_text (layout, 0, 5, "Goodbye", -1);
+  pango_layout_get_line_count (layout);
+
+  g_free (text);
+  text = g_strdup (pango_layout_get_text (layout));
+  text[strlen (text) - strlen (para2)] = '\0';
+  n_chars1 = g_utf8_strlen (text, -1);
+
+  attrs = pango_layout_get_log_attrs_readonly (layout, &n_attrs);
+  assert_log_attrs_for_text (attrs, text, n_chars1, language);
+  assert_log_attrs_for_text (attrs + n_chars1, para2, n_attrs - n_chars1, language);
+
+  g_free (text);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 static void
 generate_expected_output (const char *path)
 {
@@ -209,6 +407,10 @@ main (int argc, char *argv[])
   if (!opt_fonts)
     opt_fonts = g_test_build_filename (G_TEST_DIST, "fonts", NULL);
 
+  g_test_add_func ("/layout/replace-text", test_replace_text);
+  g_test_add_func ("/layout/width-reflow", test_width_reflow);
+  g_test_add_func ("/layout/lazy-log-attrs", test_lazy_log_attrs);
+
   path = g_test_build_filename (G_TEST_DIST, "layouts", NULL);
   dir = g_dir_open (path, 0, &error);
   g_free (path);
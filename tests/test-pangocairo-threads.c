@@ -136,6 +136,104 @@ pangocairo_threads (void)
 
 }
 
+static gpointer
+shape_thread_func (gpointer data)
+{
+  guint *n_shaped = data;
+  PangoContext *context;
+  GList *items, *l;
+  PangoGlyphString *glyphs;
+  int ref_width;
+  int i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  items = pango_itemize (context, text, 0, strlen (text), NULL, NULL);
+  glyphs = pango_glyph_string_new ();
+
+  ref_width = 0;
+  for (l = items; l; l = l->next)
+    {
+      pango_shape_item (l->data, text, -1, NULL, glyphs, PANGO_SHAPE_NONE);
+      ref_width += pango_glyph_string_get_width (glyphs);
+    }
+
+  g_mutex_lock (&mutex);
+  g_mutex_unlock (&mutex);
+
+  for (i = 0; i < num_iters * 20; i++)
+    {
+      int width = 0;
+
+      for (l = items; l; l = l->next)
+        {
+          pango_shape_item (l->data, text, -1, NULL, glyphs, PANGO_SHAPE_NONE);
+          width += pango_glyph_string_get_width (glyphs);
+          (*n_shaped)++;
+        }
+
+      g_assert_cmpint (width, ==, ref_width);
+    }
+
+  pango_glyph_string_free (glyphs);
+  g_list_free_full (items, (GDestroyNotify) pango_item_free);
+  g_object_unref (context);
+
+  return 0;
+}
+
+/* Shape concurrently with an increasing number of threads,
+ * and report the throughput, to see how shaping scales.
+ */
+static void
+pangocairo_threads_shape (void)
+{
+  int n_threads;
+
+  for (n_threads = 1; n_threads <= num_threads; n_threads *= 2)
+    {
+      GPtrArray *threads = g_ptr_array_new ();
+      guint *n_shaped = g_new0 (guint, n_threads);
+      guint total;
+      gint64 start, elapsed;
+      int i;
+
+      g_mutex_lock (&mutex);
+
+      for (i = 0; i < n_threads; i++)
+        {
+          char buf[10];
+          g_snprintf (buf, sizeof (buf), "%d", i);
+          g_ptr_array_add (threads,
+                           g_thread_new (buf,
+                                         shape_thread_func,
+                                         &n_shaped[i]));
+        }
+
+      start = g_get_monotonic_time ();
+
+      /* Let them loose! */
+      g_mutex_unlock (&mutex);
+
+      total = 0;
+      for (i = 0; i < n_threads; i++)
+        {
+          g_thread_join (g_ptr_array_index (threads, i));
+          total += n_shaped[i];
+        }
+
+      elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+      g_test_message ("%d threads: %u items shaped in %.3f ms, %.0f items/s",
+                      n_threads, total, elapsed / 1000.,
+                      total * (double) G_USEC_PER_SEC / elapsed);
+
+      g_ptr_array_unref (threads);
+      g_free (n_shaped);
+    }
+
+  pango_cairo_font_map_set_default (NULL);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -147,6 +245,7 @@ main (int argc, char **argv)
     num_iters = atoi (argv[2]);
 
   g_test_add_func ("/pangocairo/threads", pangocairo_threads);
+  g_test_add_func ("/pangocairo/threads/shape", pangocairo_threads_shape);
 
   return g_test_run ();
 }
@@ -31,6 +31,9 @@
 
 #include "config.h"
 #include <pango/pangocairo.h>
+#ifdef HAVE_CAIRO_FREETYPE
+#include <pango/pangofc-fontmap.h>
+#endif
 #include "test-common.h"
 
 
@@ -388,6 +391,80 @@ test_shape (gconstpointer d)
   g_free (expected_file);
 }
 
+/* Test that the shape cache gives the same results
+ * as shaping without it, including for right-to-left
+ * text, and that it actually gets used.
+ */
+static void
+test_shape_cache (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context, *context2;
+  PangoLayout *layout, *layout2;
+  const char *text;
+  guint hits, misses;
+
+  text = "one two three one two three\n"
+         "ffi fi ffl AV To Ta\n"
+         "\xd9\x85\xd8\xb1\xd8\xad\xd8\xa8\xd8\xa7 \xd8\xa8\xd9\x83\xd9\x85 "
+         "\xd9\x85\xd8\xb1\xd8\xad\xd8\xa8\xd8\xa7 \xd8\xa8\xd9\x83\xd9\x85\n"
+         "one two three";
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  context2 = pango_font_map_create_context (fontmap);
+
+  g_assert_cmpuint (pango_context_get_shape_cache_size (context), ==, 0);
+  pango_context_set_shape_cache_size (context, 100);
+  g_assert_cmpuint (pango_context_get_shape_cache_size (context), ==, 100);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text, -1);
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+
+  layout2 = pango_layout_new (context2);
+  pango_layout_set_text (layout2, text, -1);
+  pango_layout_set_width (layout2, 100 * PANGO_SCALE);
+
+  assert_layouts_equal (layout, layout2);
+
+  pango_context_get_shape_cache_stats (context, &hits, &misses);
+  g_assert_cmpuint (hits, >, 0);
+  g_assert_cmpuint (misses, >, 0);
+
+  pango_context_get_shape_cache_stats (context2, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 0);
+  g_assert_cmpuint (misses, ==, 0);
+
+#ifdef HAVE_CAIRO_FREETYPE
+  /* The cache does not keep fonts alive */
+  if (PANGO_IS_FC_FONT_MAP (fontmap))
+    {
+      PangoLayoutRun *run;
+      PangoFont *font;
+
+      run = pango_layout_get_line_readonly (layout, 0)->runs->data;
+      font = run->item->analysis.font;
+      g_object_add_weak_pointer (G_OBJECT (font), (gpointer *) &font);
+
+      g_clear_object (&layout);
+      g_clear_object (&layout2);
+      pango_fc_font_map_cache_clear (PANGO_FC_FONT_MAP (fontmap));
+
+      g_assert_null (font);
+    }
+#endif
+
+  pango_context_set_shape_cache_size (context, 0);
+  g_assert_cmpuint (pango_context_get_shape_cache_size (context), ==, 0);
+
+  g_clear_object (&layout2);
+  g_clear_object (&layout);
+  g_object_unref (context2);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -427,6 +504,8 @@ main (int argc, char *argv[])
       return 0;
     }
 
+  g_test_add_func ("/shape/cache", test_shape_cache);
+
   path = g_test_build_filename (G_TEST_DIST, "shape", NULL);
   dir = g_dir_open (path, 0, &error);
   g_free (path);
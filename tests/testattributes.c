@@ -660,6 +660,45 @@ test_list_change12 (void)
   pango_attr_list_unref (list);
 }
 
+/* Lists this long use a tree to find overlapping attributes */
+static void
+test_list_change13 (void)
+{
+  PangoAttrList *list;
+  PangoAttribute *attr;
+  GString *expected;
+  int i;
+
+  list = pango_attr_list_new ();
+  pango_attr_list_insert (list, pango_attr_size_new (10));
+
+  /* Pairs of tokens with the same rise get merged */
+  for (i = 0; i < 100; i++)
+    {
+      attr = pango_attr_rise_new (((i / 2) % 2) * 100);
+      attr->start_index = 2 * i;
+      attr->end_index = 2 * i + 2;
+      pango_attr_list_change (list, attr);
+    }
+
+  attr = pango_attr_rise_new (100);
+  attr->start_index = 6;
+  attr->end_index = 10;
+  pango_attr_list_change (list, attr);
+
+  expected = g_string_new ("0 -1 size 10\n"
+                           "0 4 rise 0\n"
+                           "4 10 rise 100\n"
+                           "10 12 rise 0\n");
+  for (i = 3; i < 50; i++)
+    g_string_append_printf (expected, "%d %d rise %d\n", 4 * i, 4 * i + 4, (i % 2) * 100);
+
+  assert_attr_list (list, expected->str);
+
+  g_string_free (expected, TRUE);
+  pango_attr_list_unref (list);
+}
+
 static void
 test_list_splice (void)
 {
@@ -1442,6 +1481,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/attributes/list/change10", test_list_change10);
   g_test_add_func ("/attributes/list/change11", test_list_change11);
   g_test_add_func ("/attributes/list/change12", test_list_change12);
+  g_test_add_func ("/attributes/list/change13", test_list_change13);
   g_test_add_func ("/attributes/list/splice", test_list_splice);
   g_test_add_func ("/attributes/list/splice2", test_list_splice2);
   g_test_add_func ("/attributes/list/splice3", test_list_splice3);
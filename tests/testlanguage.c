@@ -32,6 +32,62 @@ test_language_to_string (void)
   g_assert_cmpstr ((pango_language_to_string) (lang), ==, "ja-jp");
 }
 
+#define N_THREADS 8
+#define N_LANGUAGES 500
+
+static gpointer
+intern_languages (gpointer data)
+{
+  PangoLanguage **languages = data;
+  int i;
+
+  for (i = 0; i < N_LANGUAGES; i++)
+    {
+      char *tag = g_strdup_printf ("x-Test_%d", i);
+      PangoLanguage *lang = pango_language_from_string (tag);
+
+      g_assert_nonnull (lang);
+      if (languages)
+        languages[i] = lang;
+
+      g_free (tag);
+    }
+
+  return NULL;
+}
+
+static void
+test_language_threads (void)
+{
+  PangoLanguage *languages[N_LANGUAGES];
+  GThread *threads[N_THREADS];
+  int i;
+
+  for (i = 0; i < N_THREADS; i++)
+    threads[i] = g_thread_new ("intern", intern_languages, NULL);
+
+  intern_languages (languages);
+
+  for (i = 0; i < N_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  for (i = 0; i < N_LANGUAGES; i++)
+    {
+      char *tag = g_strdup_printf ("x-test-%d", i);
+
+      g_assert_true (pango_language_from_string (tag) == languages[i]);
+      g_assert_cmpstr (pango_language_to_string (languages[i]), ==, tag);
+
+      g_free (tag);
+    }
+
+  /* Languages with records get them, whichever way they are spelled */
+  g_assert_true (pango_language_includes_script (pango_language_from_string ("JA_jp"), PANGO_SCRIPT_HAN));
+  g_assert_false (pango_language_includes_script (pango_language_from_string ("en-us"), PANGO_SCRIPT_HAN));
+  g_assert_true (pango_language_get_sample_string (pango_language_from_string ("de")) !=
+                 pango_language_get_sample_string (pango_language_from_string ("xx")));
+}
+
 static void
 test_language_env (void)
 {
@@ -62,6 +118,7 @@ main (int argc, char *argv[])
 
   g_test_add_func ("/language/to-string", test_language_to_string);
   g_test_add_func ("/language/language-env", test_language_env);
+  g_test_add_func ("/language/threads", test_language_threads);
 
   return g_test_run ();
 }
@@ -83,6 +83,57 @@ test_itemize_utf8 (void)
   g_object_unref (fontmap);
 }
 
+/* Test that pure ASCII text, which takes shortcuts through
+ * the bidi and script analysis, is itemized the same way as
+ * other text would be.
+ */
+static void
+test_itemize_ascii (void)
+{
+  struct {
+    const char *text;
+    PangoDirection base_dir;
+    guint8 level;
+    PangoScript script;
+  } tests[] = {
+    { "Hello, world!", PANGO_DIRECTION_LTR, 0, PANGO_SCRIPT_LATIN },
+    { "Hello (world)", PANGO_DIRECTION_WEAK_LTR, 0, PANGO_SCRIPT_LATIN },
+    { "Hello", PANGO_DIRECTION_WEAK_RTL, 0, PANGO_SCRIPT_LATIN },
+    { "Hello", PANGO_DIRECTION_RTL, 2, PANGO_SCRIPT_LATIN },
+    { "123 + 456", PANGO_DIRECTION_LTR, 0, PANGO_SCRIPT_COMMON },
+    { "123", PANGO_DIRECTION_WEAK_RTL, 2, PANGO_SCRIPT_COMMON },
+  };
+  PangoFontMap *fontmap;
+  PangoContext *context;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+
+  for (int i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      GList *items;
+      PangoItem *item;
+      int length = strlen (tests[i].text);
+
+      items = pango_itemize_with_base_dir (context, tests[i].base_dir,
+                                           tests[i].text, 0, length,
+                                           NULL, NULL);
+
+      g_assert_cmpint (g_list_length (items), ==, 1);
+      item = items->data;
+      g_assert_cmpint (item->offset, ==, 0);
+      g_assert_cmpint (item->length, ==, length);
+      g_assert_cmpint (item->num_chars, ==, length);
+      g_assert_cmpint (item->analysis.level, ==, tests[i].level);
+      g_assert_cmpint (item->analysis.script, ==, tests[i].script);
+
+      g_list_free_full (items, (GDestroyNotify) pango_item_free);
+    }
+
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 /* Test that pango_layout_set_text (layout, "short", 200)
  * does not lead to a crash. (pidgin does this)
  */
@@ -879,6 +930,176 @@ test_small_caps_crash (void)
   g_object_unref (fontmap);
 }
 
+/* A renderer that only counts what it is asked to draw */
+typedef struct
+{
+  PangoRenderer parent_instance;
+
+  int n_glyphs;
+  int n_shapes;
+} CountingRenderer;
+
+typedef struct
+{
+  PangoRendererClass parent_class;
+} CountingRendererClass;
+
+static GType counting_renderer_get_type (void);
+
+G_DEFINE_TYPE (CountingRenderer, counting_renderer, PANGO_TYPE_RENDERER)
+
+static void
+counting_renderer_draw_glyphs (PangoRenderer    *renderer,
+                               PangoFont        *font,
+                               PangoGlyphString *glyphs,
+                               int               x,
+                               int               y)
+{
+  ((CountingRenderer *) renderer)->n_glyphs += glyphs->num_glyphs;
+}
+
+static void
+counting_renderer_draw_shape (PangoRenderer  *renderer,
+                              PangoAttrShape *attr,
+                              int             x,
+                              int             y)
+{
+  ((CountingRenderer *) renderer)->n_shapes++;
+}
+
+static void
+counting_renderer_draw_rectangle (PangoRenderer   *renderer,
+                                  PangoRenderPart  part,
+                                  int              x,
+                                  int              y,
+                                  int              width,
+                                  int              height)
+{
+}
+
+static void
+counting_renderer_init (CountingRenderer *renderer)
+{
+}
+
+static void
+counting_renderer_class_init (CountingRendererClass *class)
+{
+  PangoRendererClass *renderer_class = PANGO_RENDERER_CLASS (class);
+
+  renderer_class->draw_glyphs = counting_renderer_draw_glyphs;
+  renderer_class->draw_shape = counting_renderer_draw_shape;
+  renderer_class->draw_rectangle = counting_renderer_draw_rectangle;
+}
+
+static void
+test_draw_layout_region (void)
+{
+  PangoContext *context;
+  PangoLayout *layout;
+  CountingRenderer *renderer;
+  PangoAttrList *attrs;
+  PangoAttribute *attr;
+  PangoRectangle ink = { 0, -100 * PANGO_SCALE, 10 * PANGO_SCALE, 100 * PANGO_SCALE };
+  PangoRectangle logical = { 0, -10 * PANGO_SCALE, 10 * PANGO_SCALE, 10 * PANGO_SCALE };
+  PangoRectangle layout_rect, line_rect, visible;
+  GString *text;
+  int all_glyphs, i;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  layout = pango_layout_new (context);
+
+  text = g_string_new ("");
+  for (i = 0; i < 100; i++)
+    g_string_append (text, "Line of text\n");
+  g_string_append (text, "Shape: \xef\xbf\xbc");
+  pango_layout_set_text (layout, text->str, text->len);
+
+  /* The shape at the end overhangs far upwards */
+  attrs = pango_attr_list_new ();
+  attr = pango_attr_shape_new (&ink, &logical);
+  attr->start_index = text->len - 3;
+  attr->end_index = text->len;
+  pango_attr_list_insert (attrs, attr);
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  renderer = g_object_new (counting_renderer_get_type (), NULL);
+
+  pango_renderer_draw_layout (PANGO_RENDERER (renderer), layout, 0, 0);
+  all_glyphs = renderer->n_glyphs;
+  g_assert_cmpint (renderer->n_shapes, ==, 1);
+
+  /* NULL draws everything */
+  renderer->n_glyphs = renderer->n_shapes = 0;
+  pango_renderer_draw_layout_region (PANGO_RENDERER (renderer), layout, 0, 0, NULL);
+  g_assert_cmpint (renderer->n_glyphs, ==, all_glyphs);
+  g_assert_cmpint (renderer->n_shapes, ==, 1);
+
+  /* A few lines in the middle */
+  pango_layout_get_extents (layout, NULL, &layout_rect);
+  pango_layout_line_get_extents (pango_layout_get_line_readonly (layout, 0), NULL, &line_rect);
+
+  visible.x = 0;
+  visible.y = 50 * line_rect.height;
+  visible.width = layout_rect.width;
+  visible.height = 2 * line_rect.height;
+
+  renderer->n_glyphs = renderer->n_shapes = 0;
+  pango_renderer_draw_layout_region (PANGO_RENDERER (renderer), layout, 0, 0, &visible);
+  g_assert_cmpint (renderer->n_glyphs, >, 0);
+  g_assert_cmpint (renderer->n_glyphs, <, all_glyphs / 10);
+  g_assert_cmpint (renderer->n_shapes, ==, 0);
+
+  /* Only the ink of the shape reaches into the visible area */
+  visible.y = layout_rect.height - line_rect.height - 50 * PANGO_SCALE;
+  visible.height = PANGO_SCALE;
+  visible.x = layout_rect.width + 100 * PANGO_SCALE;
+  renderer->n_glyphs = renderer->n_shapes = 0;
+  pango_renderer_draw_layout_region (PANGO_RENDERER (renderer), layout, 0, 0, &visible);
+  g_assert_cmpint (renderer->n_glyphs, ==, 0);
+  g_assert_cmpint (renderer->n_shapes, ==, 0);
+
+  visible.x = 0;
+  visible.width = layout_rect.width;
+  renderer->n_glyphs = renderer->n_shapes = 0;
+  pango_renderer_draw_layout_region (PANGO_RENDERER (renderer), layout, 0, 0, &visible);
+  g_assert_cmpint (renderer->n_shapes, ==, 1);
+
+  /* Runs of a long line are culled by their logical extents */
+  g_string_truncate (text, 0);
+  attrs = pango_attr_list_new ();
+  for (i = 0; i < 50; i++)
+    {
+      attr = pango_attr_weight_new (i % 2 ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL);
+      attr->start_index = text->len;
+      g_string_append (text, "Run of text ");
+      attr->end_index = text->len;
+      pango_attr_list_insert (attrs, attr);
+    }
+  pango_layout_set_text (layout, text->str, text->len);
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  renderer->n_glyphs = renderer->n_shapes = 0;
+  pango_renderer_draw_layout (PANGO_RENDERER (renderer), layout, 0, 0);
+  all_glyphs = renderer->n_glyphs;
+
+  pango_layout_get_extents (layout, NULL, &layout_rect);
+  visible = layout_rect;
+  visible.width = layout_rect.width / 10;
+
+  renderer->n_glyphs = renderer->n_shapes = 0;
+  pango_renderer_draw_layout_region (PANGO_RENDERER (renderer), layout, 0, 0, &visible);
+  g_assert_cmpint (renderer->n_glyphs, >, 0);
+  g_assert_cmpint (renderer->n_glyphs, <, all_glyphs / 2);
+
+  g_object_unref (renderer);
+  g_string_free (text, TRUE);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -887,6 +1108,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/layout/shape-tab-crash", test_shape_tab_crash);
   g_test_add_func ("/layout/itemize-empty-crash", test_itemize_empty_crash);
   g_test_add_func ("/layout/itemize-utf8", test_itemize_utf8);
+  g_test_add_func ("/layout/itemize-ascii", test_itemize_ascii);
   g_test_add_func ("/layout/short-string-crash", test_short_string_crash);
   g_test_add_func ("/language/emoji-crash", test_language_emoji_crash);
   g_test_add_func ("/layout/line-height", test_line_height);
@@ -914,6 +1136,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/layout/wrap-char", test_wrap_char);
   g_test_add_func ("/matrix/transform-rectangle", test_transform_rectangle);
   g_test_add_func ("/itemize/small-caps-crash", test_small_caps_crash);
+  g_test_add_func ("/renderer/draw-layout-region", test_draw_layout_region);
 
   return g_test_run ();
 }